@@ -43,7 +43,9 @@ class Image {
      *  @param zero_mem Flag to control zero-ing of memory once allocated.
      */
     Image(const ImageFormat& image_format, const bool zero_mem = false) :
-        Format_(image_format)
+        Format_(image_format),
+        BytesPerLine_(image_format.getWidth() * image_format.getBytesPerPixel()),
+        OwnsData_(true)
     {
         Data_ = (uint8_t*)av_malloc(Format_.getBytesPerImage());
         if (!Data_)
@@ -58,13 +60,32 @@ class Image {
         }
     };
     
+    /*! Constructor for an image that views memory owned by something else, e.g. a region of another image.
+     *  The memory is not freed by the image and has to outlive it.
+     *  @param image_format The image format of the viewed region.
+     *  @param data Pointer to the first pixel of the region.
+     *  @param bytes_per_line Distance in bytes between the starts of consecutive rows of the region.
+     */
+    Image(const ImageFormat& image_format, uint8_t* data, const size_t bytes_per_line) :
+        Format_(image_format),
+        Data_(data),
+        BytesPerLine_(bytes_per_line),
+        OwnsData_(false)
+    {
+    }
+    
     ~Image()
     {
-        av_free(Data_);
+        if (OwnsData_)
+        {
+            av_free(Data_);
+        }
     }
     
-    //! Copy constructor
-    Image(const Image& rh)
+    //! Copy constructor. The copy owns contiguous data, also when rh is a view.
+    Image(const Image& rh) :
+        BytesPerLine_(rh.Format_.getWidth() * rh.Format_.getBytesPerPixel()),
+        OwnsData_(true)
     {
         Data_ = (uint8_t*)av_malloc(rh.Format_.getBytesPerImage());
         if (!Data_)
@@ -74,7 +95,7 @@ class Image {
         deepCopy(rh);
     }
     
-    //! Assignment operator
+    //! Assignment operator. The image owns contiguous data afterwards, also when rh or this image is a view.
     Image& operator=(const Image& rh)
     {
         if (this == &rh)
@@ -86,12 +107,17 @@ class Image {
         
         if (new_data != 0)
         {
-            av_free(Data_);
+            if (OwnsData_)
+            {
+                av_free(Data_);
+            }
             Data_ = new_data;
+            OwnsData_ = true;
         } else
         {
             outOfMem();
         }
+        BytesPerLine_ = rh.Format_.getWidth() * rh.Format_.getBytesPerPixel();
 
         deepCopy(rh);
         return *this;
@@ -114,6 +140,30 @@ class Image {
     
     //!Get a pointer to const image data for reading.
     uint8_t const * data() const { return &(Data_[0]); }
+    
+    //!Get the distance in bytes between the starts of consecutive rows. Images that own their data are always contiguous, also after their format was changed.
+    size_t getBytesPerLine() const { return OwnsData_ ? (Format_.getWidth() * Format_.getBytesPerPixel()) : BytesPerLine_; }
+    
+    //!True if the rows follow each other without padding, as most processors assume.
+    bool isContiguous() const { return getBytesPerLine() == (Format_.getWidth() * Format_.getBytesPerPixel()); }
+    
+    //!True if the image views memory that it does not own.
+    bool isView() const { return !OwnsData_; }
+    
+    /*! Point a view at another region without reallocating. Only valid for images constructed as views.
+     *  @sa Image(const ImageFormat&, uint8_t*, const size_t)*/
+    void setView(const ImageFormat& image_format, uint8_t* data, const size_t bytes_per_line)
+    {
+        if (OwnsData_)
+        {
+            logMessage(LOG_CRITICAL) << "Image::setView called on an image that owns its data.\n";
+            return;
+        }
+        
+        Format_ = image_format;
+        Data_ = data;
+        BytesPerLine_ = bytes_per_line;
+    }
 
   private:
     void deepCopy(const Image& rh)
@@ -131,7 +181,18 @@ class Image {
             Metadata_.swap(new_meta);
         }
         // assume allocation was done
-        memcpy(Data_, rh.Data_, Format_.getBytesPerImage());
+        if (rh.isContiguous())
+        {
+            memcpy(Data_, rh.Data_, Format_.getBytesPerImage());
+        } else
+        {
+            const size_t bytesPerRow = Format_.getWidth() * Format_.getBytesPerPixel();
+            
+            for (size_t y = 0; y < Format_.getHeight(); ++y)
+            {
+                memcpy(Data_ + y * bytesPerRow, rh.Data_ + y * rh.getBytesPerLine(), bytesPerRow);
+            }
+        }
     }
     
     void outOfMem()
@@ -143,6 +204,11 @@ class Image {
     ImageFormat Format_;
     std::shared_ptr<ImageMetadata> Metadata_;
     uint8_t* Data_;
+    
+    /// Distance in bytes between the starts of consecutive rows of a view.
+    size_t BytesPerLine_;
+    /// False for views of memory owned elsewhere.
+    bool OwnsData_;
 };
 
 }
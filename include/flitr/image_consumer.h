@@ -98,6 +98,16 @@ namespace flitr {
         
         virtual bool init() { return true; }
         
+        /**
+         * Whether this consumer reads images whose rows are not contiguous,
+         * i.e. honours Image::getBytesPerLine(). Producers that can emit
+         * row-strided views, such as FIPCrop, fall back to contiguous copies
+         * unless all their consumers accept strided images.
+         *
+         * \return True if strided images are read correctly. False by default.
+         */
+        virtual bool acceptsStridedImages() const { return false; }
+        
         
         //! Get the image format
         virtual ImageFormat getFormat(const uint32_t index = 0) const;
@@ -26,7 +26,12 @@
 #include <math.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <vector>
 
 #ifdef FLITR_USE_OPENCL
@@ -38,6 +43,67 @@
 #endif
 
 namespace flitr {
+    /*! Get the number of row bands that an image of the given height is split into for multi-threaded processing.
+     * Returns one if OpenMP is not available.*/
+    FLITR_EXPORT size_t getNumRowBands(const size_t height);
+    
+    /*! log2 of a positive normal float. Polynomial in t=(m-1)/(m+1) of the mantissa m in [sqrt(0.5),sqrt(2)).
+     * Absolute error below 1e-7. Branch free so that loops calling it vectorise.*/
+    inline float approxLog2(const float x)
+    {
+        int32_t bits;
+        memcpy(&bits, &x, sizeof(bits));
+        
+        int32_t exponent=((bits >> 23) & 255) - 127;
+        const int32_t mantissaBits=(bits & 0x007FFFFF) | 0x3F800000;
+        float mantissa;
+        memcpy(&mantissa, &mantissaBits, sizeof(mantissa));
+        
+        const int32_t mantissaHigh=(mantissa > 1.41421356f) ? 1 : 0;
+        mantissa=mantissaHigh ? (mantissa * 0.5f) : mantissa;
+        exponent+=mantissaHigh;
+        
+        const float t=(mantissa - 1.0f) / (mantissa + 1.0f);
+        const float tSq=t*t;
+        
+        return float(exponent) + t*(2.88539008f + tSq*(0.961796694f + tSq*(0.577078016f + tSq*0.412198583f)));
+    }
+    
+    /*! 2^y for y clamped to the normal float exponent range. Degree 6 polynomial on the fraction in [-0.5,0.5].
+     * Relative error below 2e-7. Branch free so that loops calling it vectorise.*/
+    inline float approxExp2(float y)
+    {
+        y=std::min(std::max(y, -126.0f), 127.0f);
+        
+        const float n=floorf(y + 0.5f);
+        const float f=y - n;
+        
+        const float p=1.0f + f*(0.693147181f + f*(0.240226507f + f*(0.0555041087f + f*(0.00961812911f + f*(0.00133335581f + f*0.000154035304f)))));
+        
+        const int32_t scaleBits=(int32_t(n) + 127) << 23;
+        float scale;
+        memcpy(&scale, &scaleBits, sizeof(scale));
+        
+        return p * scale;
+    }
+    
+    /*! atan2(y,x) in [-pi,pi]. Degree 7 odd polynomial on the ratio of the smaller to the larger absolute component.
+     * Absolute error below 2e-5 radians. Returns 0 for x==y==0. Branch free so that loops calling it vectorise.*/
+    inline float approxAtan2(const float y, const float x)
+    {
+        const float absX=fabsf(x);
+        const float absY=fabsf(y);
+        
+        const float ratio=std::min(absX, absY) / (std::max(absX, absY) + 1.0e-30f);
+        const float ratioSq=ratio*ratio;
+        
+        float angle=ratio*(0.999866f + ratioSq*(-0.330299f + ratioSq*(0.180141f + ratioSq*(-0.085133f + ratioSq*0.0208351f))));
+        angle=(absY > absX) ? (1.57079633f - angle) : angle;
+        angle=(x < 0.0f) ? (3.14159265f - angle) : angle;
+        
+        return (y < 0.0f) ? -angle : angle;
+    }
+    
     //! General purpose Integral image.
     class FLITR_EXPORT IntegralImage
     {
@@ -419,6 +485,10 @@ namespace flitr {
             return filterRadius_ * 0.5f;
         }
         
+        /*! Writes the normalised 1D kernel of the given radius and odd width to kernel1D.
+         *  The kernel is symmetric, so kernel1D[i]==kernel1D[kernelWidth-1-i].*/
+        static void computeKernel1D(float * const kernel1D, const float filterRadius, const size_t kernelWidth);
+        
         /*!Synchronous process method for float pixel format..*/
         bool filter(float * const dataWriteDS, float const * const dataReadUS,
                     const size_t width, const size_t height,
@@ -514,6 +584,147 @@ namespace flitr {
     };
     
     
+    //! General purpose median filter. Image borders are handled by replicating the edge pixels.
+    class FLITR_EXPORT MedianFilter
+    {
+    public:
+        
+        /*! Constructor
+         @param kernelWidth Width of the square filter kernel in pixels. Made odd if even and limited to 255.
+         */
+        MedianFilter(const size_t kernelWidth);
+        
+        /*! Destructor */
+        ~MedianFilter();
+        
+        //! Copy constructor
+        MedianFilter(const MedianFilter& rh) :
+        kernelWidth_(rh.kernelWidth_)
+        {}
+        
+        //! Assignment operator
+        MedianFilter& operator=(const MedianFilter& rh)
+        {
+            if (this == &rh)
+            {
+                return *this;
+            }
+            
+            kernelWidth_=rh.kernelWidth_;
+            
+            return *this;
+        }
+        
+        //!Set the width of the median kernel.
+        void setKernelWidth(const int kernelWidth);
+        
+        //!Get the width of the median kernel.
+        size_t getKernelWidth() const
+        {
+            return kernelWidth_;
+        }
+        
+        /*!Synchronous process method for uint8_t pixel format.
+         * Constant time per pixel histogram median (Perreault & Hebert) processed in multi-threaded row bands.*/
+        bool filter(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                    const size_t width, const size_t height);
+        
+        /*!Synchronous process method for uint8_t RGB pixel format. Each component is filtered independently.*/
+        bool filterRGB(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                       const size_t width, const size_t height);
+        
+        /*!Synchronous process method for uint16_t pixel format.
+         * Sliding two level histogram that visits each row band in serpentine order so that the update cost is O(kernelWidth) per pixel.*/
+        bool filter(uint16_t * const dataWriteDS, uint16_t const * const dataReadUS,
+                    const size_t width, const size_t height);
+        
+        /*!Synchronous process method for the fast approximation: the max of the four (kernelWidth/2+1)^2 quadrant minima around each pixel.
+         * The quadrant minima are read from a separable box minimum image. A border of kernelWidth/2 pixels is set to zero.
+         *@param numComponents The number of interleaved components per pixel.*/
+        template<typename T>
+        bool filterQuadrantMinMax(T * const dataWriteDS, T const * const dataReadUS,
+                                  const size_t width, const size_t height,
+                                  const size_t numComponents)
+        {
+            const int32_t border=int32_t(kernelWidth_>>1);
+            const int32_t h=int32_t(height);
+            const int32_t nc=int32_t(numComponents);
+            const int32_t lineLength=int32_t(width)*nc;
+            const int32_t boxLineLength=lineLength - border*nc;//Box minima only exist where the box fits in the image.
+            
+            memset(dataWriteDS, 0, width*height*numComponents*sizeof(T));//Clear the border.
+            
+            if ((int32_t(width)<=2*border) || (h<=2*border)) return true;
+            
+            const size_t scratchSize=2*width*height*numComponents*sizeof(T);
+            if (quadrantScratch_.size()<scratchSize) quadrantScratch_.resize(scratchSize);
+            T * const rowMin=(T *)quadrantScratch_.data();
+            T * const boxMin=rowMin + width*height*numComponents;
+            
+            int32_t y=0;
+            
+            //Minimum over [x, x+border] in each row.
+#pragma omp parallel for
+            for (y=0; y<h; ++y)
+            {
+                T const * const lineRead=dataReadUS + y*lineLength;
+                T * const lineMin=rowMin + y*lineLength;
+                
+                for (int32_t i=0; i<boxLineLength; ++i)
+                {
+                    T minValue=lineRead[i];
+                    for (int32_t j=1; j<=border; ++j) minValue=std::min(minValue, lineRead[i + j*nc]);
+                    lineMin[i]=minValue;
+                }
+            }
+            
+            //Minimum over [y, y+border] of the row minima.
+#pragma omp parallel for
+            for (y=0; y<(h-border); ++y)
+            {
+                T * const lineBoxMin=boxMin + y*lineLength;
+                
+                for (int32_t i=0; i<boxLineLength; ++i)
+                {
+                    T minValue=rowMin[y*lineLength + i];
+                    for (int32_t j=1; j<=border; ++j) minValue=std::min(minValue, rowMin[(y+j)*lineLength + i]);
+                    lineBoxMin[i]=minValue;
+                }
+            }
+            
+            //Max of the top-left, top-right, bottom-left and bottom-right quadrant minima.
+#pragma omp parallel for
+            for (y=border; y<(h-border); ++y)
+            {
+                T const * const top=boxMin + (y-border)*lineLength;
+                T const * const bottom=boxMin + y*lineLength;
+                T * const lineWrite=dataWriteDS + y*lineLength;
+                
+                for (int32_t i=border*nc; i<boxLineLength; ++i)
+                {
+                    lineWrite[i]=std::max(std::max(top[i - border*nc], top[i]),
+                                          std::max(bottom[i - border*nc], bottom[i]));
+                }
+            }
+            
+            return true;
+        }
+    
+    private:
+        template<size_t C>
+        bool filterHistogram8(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                              const size_t width, const size_t height);
+        
+        size_t kernelWidth_;
+        
+        //!Histogram scratch memory per row band, reused between frames.
+        std::vector<std::vector<uint16_t> > bandScratch_;
+        
+        //!Box minimum scratch memory of the quadrant approximation.
+        std::vector<uint8_t> quadrantScratch_;
+    };
+    
+    
     
     //! General purpose Morphological filter.
     class FLITR_EXPORT MorphologicalFilter
@@ -1391,6 +1602,966 @@ namespace flitr {
 #endif
     };
     
+    
+    
+    /*! General purpose point-wise tone curve engine. The curve is defined on normalised [0,1] values and is tabulated
+     * in exact 256 and 65536 entry lookup tables for 8-bit and 16-bit pixel data. The tables are only (re)built the
+     * first time they are used after the curve changed. Power law, gain and sigmoid curve factories are provided so that
+     * the gamma, sigmoid and gain style processors can share the same engine.*/
+    class FLITR_EXPORT ToneCurveLUT
+    {
+    public:
+        //! Function that maps a normalised input value in [0,1] to a normalised output value.
+        typedef std::function<float(float)> CurveFunction;
+        
+        /*! Constructor
+         @param curve The tone curve. Defaults to the identity curve.*/
+        ToneCurveLUT(CurveFunction curve=CurveFunction());
+        
+        /*!Set a new tone curve. The lookup tables are rebuilt lazily on the next call to filter.*/
+        void setCurve(CurveFunction curve);
+        
+        /*!Map numComponents 8-bit values through the curve using the 256 entry table.*/
+        void filter(uint8_t * const dataWrite, uint8_t const * const dataRead, const size_t numComponents);
+        
+        /*!Map numComponents 16-bit values through the curve using the 65536 entry table.*/
+        void filter(uint16_t * const dataWrite, uint16_t const * const dataRead, const size_t numComponents);
+        
+        /*!Map numComponents float values through the curve. The curve is evaluated per component.*/
+        void filter(float * const dataWrite, float const * const dataRead, const size_t numComponents) const;
+        
+        /*!Raise numComponents float values to the given power using a vectorisable exp2/log2 polynomial approximation.
+         * The relative error is below 1e-5 for results in the normal float range. Non-positive inputs map to zero.*/
+        static void power(float * const dataWrite, float const * const dataRead, const size_t numComponents, const float power);
+        
+        //!Power law curve x^power.
+        static CurveFunction powerCurve(const float power);
+        
+        //!Linear gain curve gain*x+offset, clamped to [0,1].
+        static CurveFunction gainCurve(const float gain, const float offset=0.0f);
+        
+        //!Logistic sigmoid curve 1/(1+exp(-slope*(x-centre))).
+        static CurveFunction sigmoidCurve(const float slope, const float centre=0.5f);
+    
+    private:
+        template<typename T>
+        void updateLUT(std::vector<T> &lut);
+        
+        CurveFunction curve_;
+        
+        std::vector<uint8_t> lut8_;
+        std::vector<uint16_t> lut16_;
+        
+        bool lut8Dirty_;
+        bool lut16Dirty_;
+    };
+    
+    
+    
+    /*! General purpose affine image resampling engine.
+     *
+     * Destination pixel (x,y) is sampled from source position (s,t) with s=a*x+b*y+tx and t=c*x+d*y+ty.
+     * Destination pixels whose nearest source pixel falls outside the source image are set to zero.
+     * Integer translations and flips (|a|=|d|=1, b=c=0) are done with row span copies. Rotations by 90 and 270 degrees
+     * (a=d=0, |b|=|c|=1) are done with cache blocked tile copies. Other transforms use
+     * incremental fixed point coordinate stepping. Rows are processed in parallel if OpenMP is available.*/
+    class FLITR_EXPORT AffineTransform
+    {
+    public:
+        enum class Interpolation
+        {
+            NEAREST,
+            BILINEAR
+        };
+        
+        /*! Constructor. Defaults to the identity transform and nearest neighbour sampling.*/
+        AffineTransform();
+        
+        /*!Set the mapping from destination pixel coordinates to source pixel coordinates.*/
+        void setMatrix(const float a, const float b, const float c, const float d, const float tx, const float ty);
+        
+        //!Set the sampling method used by transform.
+        void setInterpolation(const Interpolation interpolation)
+        {
+            interpolation_=interpolation;
+        }
+        
+        //!Get the sampling method used by transform.
+        Interpolation getInterpolation() const
+        {
+            return interpolation_;
+        }
+        
+        /*!Nearest neighbour transform of images of any pixel format.
+         *@param bytesPerPixel The size of the pixels that are copied.*/
+        bool transformNearest(uint8_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                              uint8_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                              const size_t bytesPerPixel) const;
+        
+        /*!Transform of images with components of type T. Uses the configured interpolation.
+         * Instantiated for uint8_t, uint16_t and float.*/
+        template<typename T>
+        bool transform(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                       T const * const dataRead, const size_t widthUS, const size_t heightUS,
+                       const size_t componentsPerPixel) const;
+    
+    private:
+        float a_, b_, c_, d_;
+        float tx_, ty_;
+        
+        Interpolation interpolation_;
+    };
+    
+    
+    
+    /*! Stack of Gaussian blurred versions of an image at a number of scales, as used by multi-scale retinex.
+     *
+     * The scales are specified as kernel widths. With the GAUSSIAN filter type the standard deviation of a scale is
+     * 0.375*kernelWidth. Scales are filtered on a shared 2x2 box downsampled pyramid level at which the standard deviation
+     * is between two and four pixels, and bilinearly upsampled, so the cost is nearly independent of the scale. The box
+     * filter types apply a box of kernelWidth three times, which costs O(1) per pixel at full resolution.
+     * The scales are built in parallel if OpenMP is available.*/
+    class FLITR_EXPORT GaussianScaleSpace
+    {
+    public:
+        enum class FilterType : uint8_t
+        {
+            GAUSSIAN = 1,
+            BOX_INTEGRAL_IMAGE = 2,
+            BOX_RUNNING_SUM = 3
+        };
+        
+        /*! Constructor
+         @param filterType The filter used to blur the scales.*/
+        GaussianScaleSpace(const FilterType filterType);
+        
+        //!Sets the kernel widths of the scales.
+        void setKernelWidths(const std::vector<size_t> &kernelWidths);
+        
+        //!Gets the kernel widths of the scales.
+        const std::vector<size_t> &getKernelWidths() const
+        {
+            return kernelWidths_;
+        }
+        
+        //!Gets the number of scales.
+        size_t getNumScales() const
+        {
+            return kernelWidths_.size();
+        }
+        
+        /*!Build all the scales of a float image. Scales of the box filter types keep the previous values at the image borders.*/
+        bool build(float const * const image, const size_t width, const size_t height);
+        
+        /*!Gets the blurred image of a scale. Valid after build.*/
+        float const * getScaleImage(const size_t scaleIndex) const
+        {
+            return scaleImageVec_[scaleIndex].data();
+        }
+    
+    private:
+        void buildPyramid(float const * const image, const size_t width, const size_t height, const size_t numLevels);
+        
+        void buildGaussianScale(const size_t scaleIndex, const size_t width, const size_t height);
+        
+        const FilterType filterType_;
+        std::vector<size_t> kernelWidths_;
+        
+        //!The blurred full resolution image per scale.
+        std::vector<std::vector<float> > scaleImageVec_;
+        
+        //!Scratch images per scale.
+        std::vector<std::vector<float> > scratchImageVec_;
+        std::vector<std::vector<float> > scratchImage2Vec_;
+        std::vector<std::vector<double> > integralImageScratchVec_;
+        
+        //!Box filters per scale so that the scales can be filtered concurrently.
+        std::vector<std::shared_ptr<BoxFilterII> > boxFilterIIVec_;
+        std::vector<std::shared_ptr<BoxFilterRS> > boxFilterRSVec_;
+        
+        //!The image being built. Only valid during build.
+        float const * inputImage_;
+        
+        //!Box downsampled pyramid levels 1, 2, ... of the input image and their sizes.
+        std::vector<std::vector<float> > pyramidLevelVec_;
+        std::vector<size_t> pyramidWidthVec_;
+        std::vector<size_t> pyramidHeightVec_;
+    };
+    
+    
+    
+    /*! General purpose photometric equalisation engine. Images are scaled so that their global or local average equals a
+     * target average, which is given as a fraction of the full scale value of the data type (255, 65535 or 1.0).
+     * Sums of 8 and 16-bit data are exact integer sums and integer results are rounded and saturated. Rows are processed
+     * in parallel bands if OpenMP is available and the inner loops are written so that the compiler vectorises them.*/
+    class FLITR_EXPORT PhotometricEqualisation
+    {
+    public:
+        //!Sum of all the components of an image.
+        static double sum(uint8_t const * const data, const size_t componentsPerLine, const size_t height);
+        static double sum(uint16_t const * const data, const size_t componentsPerLine, const size_t height);
+        static double sum(float const * const data, const size_t componentsPerLine, const size_t height);
+        
+        //!Multiply all the components of an image by scale. dataWrite may be equal to dataRead.
+        static void scale(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                          const size_t componentsPerLine, const size_t height, const float scale);
+        static void scale(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                          const size_t componentsPerLine, const size_t height, const float scale);
+        static void scale(float * const dataWrite, float const * const dataRead,
+                          const size_t componentsPerLine, const size_t height, const float scale);
+        
+        /*!Scale the image so that its average equals targetAverage. An image with a zero average is copied unchanged.
+         *@return The average of the input image as a fraction of the full scale value.*/
+        static float equalise(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                              const size_t componentsPerLine, const size_t height, const float targetAverage);
+        static float equalise(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                              const size_t componentsPerLine, const size_t height, const float targetAverage);
+        static float equalise(float * const dataWrite, float const * const dataRead,
+                              const size_t componentsPerLine, const size_t height, const float targetAverage);
+        
+        /*!Scale each component so that the average of that component in the windowSize x windowSize window around the
+         * pixel equals targetAverage. Even windows reach one pixel further to the right and down than to the left and up.
+         * Windows are clipped at the image borders. dataWrite must not be equal to dataRead. Components of which the
+         * window sum is zero, e.g. in a black border after stabilisation, are set to zero.
+         * The window sums are running column sums followed by a vectorised sliding sum along the line. They are exact for
+         * 8 and 16-bit data.
+         *@param scaleByFirstComponent If true, all the components of a pixel are scaled by the factor of the first
+         * component, which keeps the colour of RGB pixels.*/
+        void equaliseLocal(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                           const size_t width, const size_t height, const size_t componentsPerPixel,
+                           const size_t windowSize, const float targetAverage,
+                           const bool scaleByFirstComponent=false);
+        void equaliseLocal(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                           const size_t width, const size_t height, const size_t componentsPerPixel,
+                           const size_t windowSize, const float targetAverage,
+                           const bool scaleByFirstComponent=false);
+        void equaliseLocal(float * const dataWrite, float const * const dataRead,
+                           const size_t width, const size_t height, const size_t componentsPerPixel,
+                           const size_t windowSize, const float targetAverage,
+                           const bool scaleByFirstComponent=false);
+    
+    private:
+        template<typename T, typename SumT>
+        void equaliseLocal(T * const dataWrite, T const * const dataRead,
+                           const size_t width, const size_t height, const size_t componentsPerPixel,
+                           const size_t windowSize, const float targetAverage,
+                           const bool scaleByFirstComponent,
+                           std::vector<std::vector<SumT> > &bandScratch);
+        
+        //!Per row band running column sums and window sums of the current row. Exact integers for 8-bit data.
+        std::vector<std::vector<int32_t> > bandScratchInt32_;
+        std::vector<std::vector<double> > bandScratchF64_;
+        
+        //!Target average times the number of window columns, per component of a line.
+        std::vector<float> columnTargetScale_;
+    };
+    
+    
+    /*! Connected component labelling of binary images. Non-zero pixels are foreground.
+     *
+     * The rows are first split into runs of foreground pixels. Background and foreground stretches are skipped eight
+     * pixels at a time, and the row bands are processed in parallel if OpenMP is available. Runs that touch a run of the
+     * previous row are merged with a union-find, and a second pass over the runs collects the bounding box, area and
+     * centroid of every component. The cost is linear in the number of pixels and runs.*/
+    class FLITR_EXPORT ConnectedComponents
+    {
+    public:
+        enum class Connectivity
+        {
+            //! Pixels that share an edge are connected.
+            FOUR,
+            //! Pixels that share an edge or a corner are connected.
+            EIGHT
+        };
+        
+        //! A connected component. The bounding box is inclusive and the centroid is the mean of the pixel coordinates.
+        struct Blob
+        {
+            int32_t left;
+            int32_t top;
+            int32_t right;
+            int32_t bottom;
+            
+            size_t area;
+            
+            float centroidX;
+            float centroidY;
+        };
+        
+        /*! Constructor
+         @param connectivity The pixel neighbourhood that connects foreground pixels.*/
+        ConnectedComponents(const Connectivity connectivity=Connectivity::EIGHT);
+        
+        //!Set the pixel neighbourhood that connects foreground pixels.
+        void setConnectivity(const Connectivity connectivity)
+        {
+            connectivity_=connectivity;
+        }
+        
+        //!Get the pixel neighbourhood that connects foreground pixels.
+        Connectivity getConnectivity() const
+        {
+            return connectivity_;
+        }
+        
+        /*!Find the connected components of a Y_8 image. The blobs are numbered in raster order of their first pixel.
+         *@param bytesPerLine Distance in bytes between the starts of consecutive rows, e.g. Image::getBytesPerLine().
+         *@param labels Optional width x height label image. Background pixels are set to zero and foreground pixels to
+         *              their blob index plus one. May be nullptr.
+         *@return The number of blobs.*/
+        size_t label(uint8_t const * const data, const size_t width, const size_t height, const size_t bytesPerLine,
+                     uint32_t * const labels=nullptr);
+        
+        /*!Gets the blobs found by the last call to label.*/
+        const std::vector<Blob> &getBlobs() const
+        {
+            return blobs_;
+        }
+    
+    private:
+        //!Foreground pixels [start,end) of a row.
+        struct Run
+        {
+            int32_t start;
+            int32_t end;
+        };
+        
+        static void extractRuns(uint8_t const * const line, const int32_t width, std::vector<Run> &runs);
+        
+        uint32_t findRoot(uint32_t runIndex);
+        
+        Connectivity connectivity_;
+        
+        //!Runs per row band, and the number of runs of each row.
+        std::vector<std::vector<Run> > bandRuns_;
+        std::vector<uint32_t> rowNumRuns_;
+        
+        //!All runs in raster order and the index of the first run of each row. rowRunStart_ has height+1 entries.
+        std::vector<Run> runs_;
+        std::vector<uint32_t> rowRunStart_;
+        
+        //!Union-find parent of each run. Parents always have a smaller index, so roots are the first run of their blob.
+        std::vector<uint32_t> parent_;
+        std::vector<uint32_t> runBlob_;
+        
+        std::vector<Blob> blobs_;
+        //!Twice the sum of the x coordinates and the sum of the y coordinates of each blob.
+        std::vector<uint64_t> blobSumX2_;
+        std::vector<uint64_t> blobSumY_;
+    };
+    
+    
+    /*! Histogram engine for 8-bit, 16-bit and float images with any number of interleaved components. Each component gets
+     * its own histogram.
+     *
+     * Integer values v of an n-bit type are counted in bin (v*numBins)>>n, so 16-bit data uses at most 65536 bins. 8-bit data
+     * with 256 bins is counted directly. Float values are mapped linearly from the
+     * range [low,high) onto the bins, and values outside the range are counted in the first or last bin. Every row band
+     * counts into four interleaved sub-histograms per component, so that runs of equal pixels do not wait on the previous
+     * increment of the same counter. The bands run in parallel if OpenMP is available and are summed at the end.*/
+    class FLITR_EXPORT ImageHistogram
+    {
+    public:
+        /*! Constructor
+         @param numBins The number of bins of each histogram.*/
+        ImageHistogram(const size_t numBins=256);
+        
+        //!Set the number of bins of each histogram.
+        void setNumBins(const size_t numBins)
+        {
+            numBins_=std::max<size_t>(numBins, 1);
+        }
+        
+        //!Get the number of bins of each histogram.
+        size_t getNumBins() const
+        {
+            return numBins_;
+        }
+        
+        //!Set the range of float values that is mapped onto the bins. The default is [0,1).
+        void setRange(const float low, const float high)
+        {
+            low_=low;
+            high_=high;
+        }
+        
+        //!Get the range of float values that is mapped onto the bins.
+        void getRange(float &low, float &high) const
+        {
+            low=low_;
+            high=high_;
+        }
+        
+        /*!Calculate the histograms of the components of an image.
+         *@param pixelStride Only every pixelStride-th pixel, in raster order, is counted. It is counted pixelStride times,
+         *                   so that the histogram sums stay close to the number of pixels.*/
+        void calculate(uint8_t const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                       const size_t pixelStride=1);
+        void calculate(uint16_t const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                       const size_t pixelStride=1);
+        void calculate(float const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                       const size_t pixelStride=1);
+        
+        //!Gets the number of histograms calculated by the last call to calculate, i.e. the components per pixel.
+        size_t getNumComponents() const
+        {
+            return histograms_.size();
+        }
+        
+        //!Gets the histogram of a component calculated by the last call to calculate.
+        const std::vector<int32_t> &getHistogram(const size_t component=0) const
+        {
+            return histograms_[component];
+        }
+        
+        //!Map of each of numBins bins to itself. With more than 256 bins, e.g. for 16-bit data, each bin is mapped onto the 8-bit level that it covers.
+        static const std::vector<uint8_t> calcIdentityMap(const size_t numBins=256);
+        
+        //!Flat reference histogram with numBins bins that sum to histoSum.
+        static const std::vector<int32_t> calcRefHistogramForEqualisation(const uint32_t histoSum, const size_t numBins=256);
+        
+        /*!Map of each bin of inHisto to the bin of refHisto with the same cumulative count. Used for histogram equalisation
+         * with the reference from calcRefHistogramForEqualisation. refHisto must have at most 256 bins.*/
+        static const std::vector<uint8_t> calcMatchMap(const std::vector<int32_t> &inHisto, const std::vector<int32_t> &refHisto);
+        
+        /*!Map of each bin of inHisto onto [0,255] that stretches the bins between the ignoreBelow and ignoreAbove fractions
+         * of the cumulative count over the full range. If only one bin is left to stretch, it keeps its identity map level.*/
+        static const std::vector<uint8_t> calcStretchMap(const std::vector<int32_t> &inHisto, const uint32_t histoSum,
+                                                         const double ignoreBelow=0.0, const double ignoreAbove=1.0);
+        
+        /*!Contrast limited equalisation map of a histogram, as used by CLAHE. The bins are clipped at clipLimit counts and the
+         * clipped counts are spread evenly over all the bins. The cumulative histogram is then scaled onto [0,255].
+         *@param map Output map with numBins entries.*/
+        static void calcClipLimitedEqualisationMap(uint8_t * const map, uint32_t const * const histogram, const size_t numBins,
+                                                   const uint32_t clipLimit);
+    
+    private:
+        template<typename T, typename BinFunction>
+        void calculate(T const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                       const size_t pixelStride, const BinFunction &binOf);
+        
+        size_t numBins_;
+        float low_;
+        float high_;
+        
+        //!Interleaved sub-histograms of each component, per row band.
+        std::vector<std::vector<uint32_t> > bandScratch_;
+        
+        std::vector<std::vector<int32_t> > histograms_;
+    };
+    
+    
+    /*! Edge preserving guided filter (He, Sun and Tang) with each component of the image as its own guide.
+     *
+     * The output is the local linear model q=a*I+b of each (2*radius+1)^2 window, where a=var/(var+epsilon), averaged over
+     * the windows that cover the pixel. Flat areas (var << epsilon) are smoothed and edges (var >> epsilon) are kept.
+     * The window means are taken from IntegralImage integral images, so the cost does not depend on the radius. Windows are
+     * clipped at the image borders. epsilon is given for data in [0,1]: it is scaled by 255^2 for 8-bit data.
+     *
+     * With a subsample factor above one the linear model is fitted on a box downsampled image with radius/subsample and
+     * the coefficients are bilinearly upsampled ("fast guided filter"), which reduces the cost by about subsample^2.
+     * The window passes are run in parallel row bands if OpenMP is available.*/
+    class FLITR_EXPORT GuidedFilter
+    {
+    public:
+        /*! Constructor
+         @param radius Radius of the square window in pixels.
+         @param epsilon Regularisation that sets the edge strength that is kept, for data in [0,1].
+         @param subsample Downsampling factor of the fast guided filter. 1 for the full resolution filter.*/
+        GuidedFilter(const size_t radius=4, const float epsilon=0.01f, const size_t subsample=1);
+        
+        void setRadius(const size_t radius)
+        {
+            radius_=std::max<size_t>(radius, 1);
+        }
+        
+        size_t getRadius() const
+        {
+            return radius_;
+        }
+        
+        void setEpsilon(const float epsilon)
+        {
+            epsilon_=std::max<float>(epsilon, 1.0e-8f);
+        }
+        
+        float getEpsilon() const
+        {
+            return epsilon_;
+        }
+        
+        void setSubsample(const size_t subsample)
+        {
+            subsample_=std::max<size_t>(subsample, 1);
+        }
+        
+        size_t getSubsample() const
+        {
+            return subsample_;
+        }
+        
+        /*!Filter each of the componentsPerPixel interleaved components of the image. dataWrite may be equal to dataRead.*/
+        bool filter(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                    const size_t width, const size_t height, const size_t componentsPerPixel);
+        bool filter(float * const dataWrite, float const * const dataRead,
+                    const size_t width, const size_t height, const size_t componentsPerPixel);
+    
+    private:
+        template<typename T>
+        bool filter(T * const dataWrite, T const * const dataRead,
+                    const size_t width, const size_t height, const size_t componentsPerPixel,
+                    const float epsilon);
+        
+        size_t radius_;
+        float epsilon_;
+        size_t subsample_;
+        
+        IntegralImage integralImage_;
+        
+        //!Guide component at full resolution, and the (subsampled) image the linear model is fitted on with its square.
+        std::vector<float> guide_;
+        std::vector<float> fitImage_;
+        std::vector<float> fitImageSquared_;
+        
+        //!Integral images of the fit image and its square, and then of the coefficients a and b.
+        std::vector<double> integralImageI_;
+        std::vector<double> integralImageII_;
+        
+        //!Coefficients a and b, and then their window means.
+        std::vector<float> coefficientA_;
+        std::vector<float> coefficientB_;
+        
+        //!Per row band window means of the current line of the fit image and its square.
+        std::vector<std::vector<float> > bandLines_;
+        
+        //!Zero line that stands in for the integral image line above the first line.
+        std::vector<double> zeroLine_;
+    };
+    
+    
+    /*! Edge preserving bilateral filter of 8-bit images on a bilateral grid (Paris and Durand).
+     *
+     * Pixels are splatted into the nearest cell of a grid that is subsampled by spatialSigma in x and y and by rangeSigma in
+     * intensity. The grid is blurred with a [1 2 1] kernel along its three axes and the output is the trilinear
+     * interpolation of the blurred grid at each pixel, normalised by the interpolated weight. The cost is linear in the
+     * number of pixels and nearly independent of spatialSigma. RGB images use their luminance as the range axis, so all
+     * three components are smoothed along the same edges.
+     *
+     * The splat is parallel over the rows of the grid, and the blur and slice over row bands, if OpenMP is available.*/
+    class FLITR_EXPORT BilateralGrid
+    {
+    public:
+        /*! Constructor
+         @param spatialSigma Spatial extent of the filter in pixels.
+         @param rangeSigma Range extent of the filter in grey levels.*/
+        BilateralGrid(const size_t spatialSigma=16, const size_t rangeSigma=16);
+        
+        void setSpatialSigma(const size_t spatialSigma)
+        {
+            spatialSigma_=std::max<size_t>(spatialSigma, 1);
+        }
+        
+        size_t getSpatialSigma() const
+        {
+            return spatialSigma_;
+        }
+        
+        void setRangeSigma(const size_t rangeSigma)
+        {
+            rangeSigma_=std::min<size_t>(std::max<size_t>(rangeSigma, 1), 255);
+        }
+        
+        size_t getRangeSigma() const
+        {
+            return rangeSigma_;
+        }
+        
+        /*!Filter an image with componentsPerPixel of 1 or 3 interleaved components. dataWrite may be equal to dataRead.*/
+        bool filter(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                    const size_t width, const size_t height, const size_t componentsPerPixel);
+    
+    private:
+        size_t spatialSigma_;
+        size_t rangeSigma_;
+        
+        //!Grid cells in [y][x][range] order, each holding the component sums followed by the weight.
+        std::vector<float> grid_;
+        std::vector<float> gridScratch_;
+        
+        //!Range of each pixel of the image: the pixel value or the luminance.
+        std::vector<uint8_t> range_;
+    };
+    
+    
+    /*! Gaussian image pyramid of float images. Each level is the previous level filtered with the 12 tap binomial kernel
+     * [1 11 55 165 330 462 462 330 165 55 11 1]/2048 (the kernel of FIPLKStabilise) and decimated by two. Level l is
+     * (width>>l) x (height>>l), but at least one pixel. Pixel l of a level lies between pixels 2l and 2l+1 of the level
+     * above it. Border pixels are filtered with clamped indices. The passes are run in parallel row bands if OpenMP is
+     * available.*/
+    class FLITR_EXPORT ImagePyramid
+    {
+    public:
+        /*! Constructor
+         @param numLevels The number of levels, including the full resolution level 0.*/
+        ImagePyramid(const size_t numLevels);
+        
+        void setNumLevels(const size_t numLevels)
+        {
+            numLevels_=std::max<size_t>(numLevels, 1);
+        }
+        
+        size_t getNumLevels() const
+        {
+            return numLevels_;
+        }
+        
+        //!Size of a level of an image of the given size.
+        static size_t getLevelSize(const size_t size, const size_t levelNum)
+        {
+            return std::max<size_t>(size >> levelNum, 1);
+        }
+        
+        /*!Filter and decimate an image by two into dataWrite, which must hold getLevelSize(widthUS, 1) x
+         * getLevelSize(heightUS, 1) pixels of componentsPerPixel interleaved components.*/
+        void downsample(float * const dataWrite, float const * const dataRead,
+                        const size_t widthUS, const size_t heightUS, const size_t componentsPerPixel);
+        
+        /*!Build levels 1 to numLevels-1 of an image into the pyramid's own storage. Level 0 is the image itself.*/
+        bool build(float const * const image, const size_t width, const size_t height, const size_t componentsPerPixel);
+        
+        /*!Gets a level built by build(). Level 0 is the image passed to build().*/
+        float const * getLevel(const size_t levelNum) const
+        {
+            return (levelNum==0) ? image_ : levelVec_[levelNum-1].data();
+        }
+    
+    private:
+        size_t numLevels_;
+        
+        //!Result of the horizontal pass.
+        std::vector<float> scratch_;
+        
+        //!The image of the last build and the levels 1, 2, ... built from it.
+        float const * image_;
+        std::vector<std::vector<float> > levelVec_;
+    };
+    
+    
+    /*! Resizes images to any size with separable filters. The filter taps of every output column and row are precomputed
+     * in tables that are rebuilt only when the sizes or the method change. When reducing, the bilinear, area and Lanczos
+     * filters are stretched by the reduction factor so that they average over the covered source pixels.
+     *
+     * The horizontal pass filters the source lines into a scratch image and the vertical pass sums whole weighted scratch
+     * lines, so that the inner loops vectorise. 8-bit data is filtered in fixed point: 14 bit weights and a scratch image
+     * with 6 fractional bits. 16-bit and float data is filtered in float. Both passes are run in parallel row bands if
+     * OpenMP is available.*/
+    class FLITR_EXPORT ImageResize
+    {
+    public:
+        enum class Method
+        {
+            NEAREST = 0,
+            BILINEAR = 1,
+            AREA = 2,
+            LANCZOS3 = 3
+        };
+        
+        ImageResize(const Method method=Method::BILINEAR);
+        
+        void setMethod(const Method method)
+        {
+            method_=method;
+        }
+        
+        Method getMethod() const
+        {
+            return method_;
+        }
+        
+        /*!Resize an image of componentsPerPixel interleaved components. dataWrite must not overlap dataRead.*/
+        bool resize(uint8_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                    uint8_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                    const size_t componentsPerPixel);
+        bool resize(uint16_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                    uint16_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                    const size_t componentsPerPixel);
+        bool resize(float * const dataWrite, const size_t widthDS, const size_t heightDS,
+                    float const * const dataRead, const size_t widthUS, const size_t heightUS,
+                    const size_t componentsPerPixel);
+    
+    private:
+        //!Filter taps of each output position along one axis, numTaps per position, zero padded.
+        struct FilterTable
+        {
+            Method method;
+            size_t sizeUS;
+            size_t sizeDS;
+            size_t numTaps;
+            std::vector<int32_t> start;
+            std::vector<float> weights;
+            std::vector<int16_t> weightsQ14;
+        };
+        
+        void updateFilterTable(FilterTable &table, const size_t sizeUS, const size_t sizeDS);
+        
+        //!The source rows and columns come from the filter tables, which keep them inside the upstream image.
+        template<typename T>
+        void resizeNearest(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                           T const * const dataRead, const size_t widthUS,
+                           const size_t componentsPerPixel);
+        
+        template<typename T>
+        void resizeFloat(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                         T const * const dataRead, const size_t widthUS, const size_t heightUS,
+                         const size_t componentsPerPixel);
+        
+        Method method_;
+        
+        FilterTable tableX_;
+        FilterTable tableY_;
+        
+        std::vector<int16_t> scratchQ6_;
+        std::vector<float> scratchF32_;
+        
+        //!Per row band accumulator lines of the vertical pass.
+        std::vector<std::vector<int32_t> > scratchQ20Bands_;
+        std::vector<std::vector<float> > scratchF32Bands_;
+    };
+    
+    
+    /*! Sparse pyramidal Lucas-Kanade (KLT) feature tracker for global motion estimation.
+     *
+     * Shi-Tomasi corners are detected on one level of the image pyramid, at most one per cell of minDistance pixels, and
+     * tracked from the previous image into the new one through the pyramid with a Lucas-Kanade solve over a small window
+     * per feature. A translation, similarity or homography is fitted to the tracks with RANSAC and refined on the inliers
+     * with least squares. Lost features and outliers are dropped, and the feature set is topped up with corners in cells
+     * without a feature when it falls below three quarters of the maximum.
+     *
+     * The transform maps coordinates in the new image to coordinates in the previous image, the same sense as the h-vector
+     * of FIPLKStabilise. Features are tracked in parallel if OpenMP is available.*/
+    class FLITR_EXPORT KLTTracker
+    {
+    public:
+        enum class MotionModel
+        {
+            TRANSLATION = 0,
+            SIMILARITY = 1,
+            HOMOGRAPHY = 2
+        };
+        
+        struct Feature
+        {
+            //!Position in the latest image.
+            float x;
+            float y;
+            //!Number of images in which the feature has been tracked.
+            uint32_t age;
+        };
+        
+        KLTTracker(const size_t maxFeatures=300, const MotionModel motionModel=MotionModel::SIMILARITY);
+        
+        void setMaxFeatures(const size_t maxFeatures)
+        {
+            maxFeatures_=std::max<size_t>(maxFeatures, 8);
+        }
+        
+        size_t getMaxFeatures() const
+        {
+            return maxFeatures_;
+        }
+        
+        void setMotionModel(const MotionModel motionModel)
+        {
+            motionModel_=motionModel;
+        }
+        
+        MotionModel getMotionModel() const
+        {
+            return motionModel_;
+        }
+        
+        //!Set the number of pyramid levels, including level 0. The levels below 16 pixels are not used.
+        void setNumLevels(const size_t numLevels)
+        {
+            numLevels_=std::max<size_t>(numLevels, 1);
+        }
+        
+        size_t getNumLevels() const
+        {
+            return numLevels_;
+        }
+        
+        //!Set the radius of the Lucas-Kanade window in pixels, at most 15.
+        void setWindowRadius(const size_t windowRadius)
+        {
+            windowRadius_=std::min<size_t>(std::max<size_t>(windowRadius, 1), 15);
+        }
+        
+        size_t getWindowRadius() const
+        {
+            return windowRadius_;
+        }
+        
+        //!Set the minimum distance between detected features in full resolution pixels.
+        void setMinDistance(const size_t minDistance)
+        {
+            minDistance_=std::max<size_t>(minDistance, 2);
+        }
+        
+        size_t getMinDistance() const
+        {
+            return minDistance_;
+        }
+        
+        /*!Set the finest pyramid level on which features are tracked. Level 1, the default, skips the full resolution
+         * level like FIPLKStabilise does, which halves the tracking cost and does not need a copy of the image. Only the
+         * levels that are tracked on are kept for the next image, so the first image after the level is lowered is still
+         * tracked on the previous finest level.*/
+        void setFinestLevel(const size_t finestLevel)
+        {
+            finestLevel_=finestLevel;
+        }
+        
+        size_t getFinestLevel() const
+        {
+            return finestLevel_;
+        }
+        
+        /*!Set the pyramid level on which features are detected. Level 1 detects on the half resolution image. The level is
+         * limited to the levels used for tracking.*/
+        void setDetectionLevel(const size_t detectionLevel)
+        {
+            detectionLevel_=detectionLevel;
+        }
+        
+        size_t getDetectionLevel() const
+        {
+            return detectionLevel_;
+        }
+        
+        //!Set the RANSAC inlier threshold on the transfer error in pixels.
+        void setInlierThreshold(const float inlierThreshold)
+        {
+            inlierThreshold_=std::max<float>(inlierThreshold, 0.01f);
+        }
+        
+        float getInlierThreshold() const
+        {
+            return inlierThreshold_;
+        }
+        
+        //!Set the maximum number of RANSAC hypotheses per image. Fewer are tried when the inlier ratio is high.
+        void setNumRansacIterations(const size_t numRansacIterations)
+        {
+            numRansacIterations_=std::max<size_t>(numRansacIterations, 1);
+        }
+        
+        size_t getNumRansacIterations() const
+        {
+            return numRansacIterations_;
+        }
+        
+        /*!Track the features of the previous image into a new single component image and estimate the global motion.
+         *@return True if the transform was estimated. False on the first image, after a size change, or if too few
+         * features were tracked, in which case the transform is the identity.*/
+        bool track(float const * const image, const size_t width, const size_t height);
+        
+        /*!Track the features of the previous image into a new image given by the levels of its pyramid, e.g. the levels
+         * of a FIPImagePyramid, instead of building the pyramid again. Level l is ImagePyramid::getLevelSize(width, l) x
+         * ImagePyramid::getLevelSize(height, l) pixels of componentsPerPixel interleaved components, of which component is
+         * tracked. Levels finer than the finest tracking and detection levels are not read and may be nullptr, except for
+         * the last one. Coarser levels that are not given are built from the last given level. The levels only have to be
+         * valid during the call: the tracked levels are copied.
+         *@return As for track(float const * const, const size_t, const size_t).*/
+        bool track(std::vector<float const *> const &levels, const size_t width, const size_t height,
+                   const size_t componentsPerPixel=1, const size_t component=0);
+        
+        //!Drop the features and the previous image.
+        void reset();
+        
+        //!Get the row major 3x3 transform from the latest image to the previous image.
+        void getTransform(float transform[9]) const
+        {
+            for (size_t i=0; i<9; ++i) transform[i]=transform_[i];
+        }
+        
+        //!Get the shift of the image centre by the latest transform, the same as the h-vector of FIPLKStabilise.
+        void getHVect(float &hx, float &hy) const
+        {
+            hx=hx_;
+            hy=hy_;
+        }
+        
+        //!Features tracked into the latest image, followed by the features newly detected in it.
+        std::vector<Feature> const &getFeatures() const
+        {
+            return features_;
+        }
+        
+        size_t getNumTracked() const
+        {
+            return numTracked_;
+        }
+        
+        size_t getNumInliers() const
+        {
+            return numInliers_;
+        }
+    
+    private:
+        size_t getNumUsableLevels(const size_t width, const size_t height) const;
+        
+        //!Track the previous features into the current pyramid. Returns the number tracked.
+        size_t trackFeatures(const size_t numLevels, const size_t finestLevel);
+        
+        //!Fit the motion model to the tracked features and drop the outliers.
+        bool fitTransform();
+        
+        //!Add features in the cells of the current image that do not have one.
+        void detectFeatures();
+        
+        size_t maxFeatures_;
+        MotionModel motionModel_;
+        size_t numLevels_;
+        size_t windowRadius_;
+        size_t minDistance_;
+        size_t finestLevel_;
+        size_t detectionLevel_;
+        float inlierThreshold_;
+        size_t numRansacIterations_;
+        
+        size_t width_;
+        size_t height_;
+        
+        /*!The pyramid levels of the previous and current images, swapped every image. The levels finer than the finest
+         * tracking level point at the caller's images and are only set during track().*/
+        std::vector<float const *> levelPtrVec_[2];
+        //!Copies of the given levels that are tracked on, and the levels built from the last given level.
+        std::vector<std::vector<float> > levelCopyVec_[2];
+        ImagePyramid pyramidVec_[2];
+        size_t current_;
+        bool hasPrevious_;
+        
+        std::vector<Feature> features_;
+        std::vector<float> trackedX_;
+        std::vector<float> trackedY_;
+        std::vector<uint8_t> trackedStatus_;
+        
+        size_t numTracked_;
+        size_t numInliers_;
+        
+        float transform_[9];
+        float hx_;
+        float hy_;
+        
+        uint32_t randomState_;
+        
+        //!Minimum eigenvalue image of the detection level and per row band accumulator lines.
+        std::vector<float> response_;
+        std::vector<float> gradientProducts_;
+        std::vector<std::vector<float> > bandSums_;
+    };
+    
 }
 
 #endif //IMAGE_PROCESSOR_UTILS_H
@@ -111,6 +111,16 @@ class FLITR_EXPORT ImageProducer : virtual public Parameters {
         return SharedImageBuffer_->getLeastNumReadSlotsAvailable();
     }
 
+    /** 
+     * Check whether all consumers accept images with non-contiguous rows.
+     * 
+     * \return True if ImageConsumer::acceptsStridedImages() is true for all consumers.
+     */
+    virtual bool allConsumersAcceptStridedImages()
+    {
+        return SharedImageBuffer_->allConsumersAcceptStridedImages();
+    }
+
     //Examples:
     // 1) producer->setCreateMetadataFunction(std::tr1::bind(&CustomMetadataClass::create, customMetadataObject))
     // 2) multiPlaybackFusionTextureCaptureProducer_->setCreateMetadataFunction(std::tr1::bind(&MultiOSGConsumerMetadataCreator::getCurrentMetadata, MultiOSGConsumerMetadataCreator(multiPlaybackOSGConsumer_.get(), 0, 0)));
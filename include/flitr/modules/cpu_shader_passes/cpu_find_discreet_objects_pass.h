@@ -23,6 +23,9 @@
 
 #include <flitr/flitr_export.h>
 #include <flitr/modules/cpu_shader_passes/cpu_shader_pass.h>
+#include <flitr/image_processor_utils.h>
+
+#include <vector>
 
 namespace flitr 
 {
@@ -30,6 +33,7 @@ namespace flitr
 /*!
 * Takes a binary input image and finds bounding rectangles for all discreet objects in the image. 
 * Bounding rectangles can be expanded and combined to improve results.
+* The objects are the eight connected components found by ConnectedComponents, which can also be used without OSG.
 */
 class FLITR_EXPORT CPUFindDiscreetObjectsPass : public flitr::CPUShaderPass::CPUShader
 {
@@ -133,6 +137,10 @@ private:
     int maxHeight_;
     Rect theROI_;
     bool useROI_;
+    
+    mutable ConnectedComponents connectedComponents_;
+    mutable std::vector<Rect> rectangles_;
+    mutable std::vector<unsigned char> edges_;
 };
 
 }
@@ -3,6 +3,7 @@
 
 #include <flitr/flitr_export.h>
 #include <flitr/modules/cpu_shader_passes/cpu_shader_pass.h>
+#include <flitr/image_processor_utils.h>
 #include <flitr/stats_collector.h>
 
 
@@ -45,161 +46,37 @@ public:
 
             const uint32_t numElements=numPixels*numComponents;
 
-            uint64_t sum=0;
-
-            //=== Calc integral image ===
-            int64_t * const integralImageData=new int64_t[numElements];
+            //The first component drives the equalisation of all the components, so its average is tracked.
+            double sum=0.0;
+            if (numComponents==1)
             {
-                unsigned long integralImageOffset=0;
-                unsigned long imageOffset=0;
-
-                integralImageData[0]=data[0];
-
-                imageOffset=numComponents;
-                integralImageOffset=1;
-
-                for (unsigned long x=1; x<width; x++)
-                {
-                    integralImageData[integralImageOffset]=((int64_t)data[imageOffset])
-                            + integralImageData[integralImageOffset-1];
-
-                    integralImageOffset++;
-                    imageOffset+=numComponents;
-                }
-
-                imageOffset=widthTimesNumComponents;
-                integralImageOffset=width;
-                for (unsigned long y=1; y<height; y++)
-                {
-                    integralImageData[integralImageOffset]=((int64_t)data[imageOffset])
-                            + integralImageData[integralImageOffset-width];
-
-                    integralImageOffset+=width;
-                    imageOffset+=widthTimesNumComponents;
-                }
-
-                imageOffset=widthTimesNumComponents;
-                integralImageOffset=width;
-                for (unsigned long y=1; y<height; y++)
+                sum=PhotometricEqualisation::sum(data, widthTimesNumComponents, height);
+            } else
+            {
+                uint64_t firstComponentSum=0;
+                for (uint32_t i=0; i<numElements; i+=numComponents)
                 {
-                    integralImageOffset++;
-                    unsigned long integralImageOffsetMinusOne=integralImageOffset-1;
-                    unsigned long integralImageOffsetMinusWidth=integralImageOffset-width;
-                    unsigned long integralImageOffsetMinusWidthMinusOne=integralImageOffset-width-1;
-
-                    imageOffset+=numComponents;
-
-                    for (unsigned long x=1; x<width; x++)
-                    {
-                        integralImageData[integralImageOffset]=((int64_t)data[imageOffset])
-                                + integralImageData[integralImageOffsetMinusOne]
-                                + integralImageData[integralImageOffsetMinusWidth]
-                                - integralImageData[integralImageOffsetMinusWidthMinusOne];
-
-                        integralImageOffset++;
-                        integralImageOffsetMinusOne++;
-                        integralImageOffsetMinusWidth++;
-                        integralImageOffsetMinusWidthMinusOne++;
-                        imageOffset+=numComponents;
-                    }
+                    firstComponentSum+=data[i];
                 }
+                sum=double(firstComponentSum);
             }
-            //=== ===
-
-
-            sum=integralImageData[numElements-1];
-            const double instAverage=(sum / (255.0*numElements));
+            const double instAverage=sum / (255.0*numPixels);
             *TargetAverage_=(*TargetAverage_)*(1.0-TargetAverageUpdateSpeed_) + instAverage*TargetAverageUpdateSpeed_;
 
 
             //=== Local photometric equalisation ===
-            {
-                const long localRegionSizeInPixels=width * localRegionSize_;
-                const long border=(localRegionSizeInPixels>>1)+1;
-                const float floatTargetAverage=(*TargetAverage_)*((border+border)*(border+border) * 255.0f);
-
-                const long startOffset=border*width;
-                const long widthMinusBorder=width - border;
-                const long heightMinusBorder=height - border;
-
-                long integralImageOffset=startOffset;
-                for (long y=border; y<heightMinusBorder; y++)
-                {
-                    integralImageOffset+=border;
-                    unsigned long integralImageOffsetMinusBorderMinusStartOffset=integralImageOffset-border-startOffset;
-                    unsigned long integralImageOffsetPlusBorderPlusStartOffset=integralImageOffset+border+startOffset;
-                    unsigned long integralImageOffsetPlusBorderMinusStartOffset=integralImageOffset+border-startOffset;
-                    unsigned long integralImageOffsetMinusBorderPlusStartOffset=integralImageOffset-border+startOffset;
-
-                    long imageOffset=integralImageOffset*numComponents;
-
-                    for (long x=border; x<widthMinusBorder; x++)
-                    {
-                        float average=(integralImageData[integralImageOffsetPlusBorderPlusStartOffset]
-                                       + integralImageData[integralImageOffsetMinusBorderMinusStartOffset]
-                                       - integralImageData[integralImageOffsetPlusBorderMinusStartOffset]
-                                       - integralImageData[integralImageOffsetMinusBorderPlusStartOffset]
-                                       );
-
-                        for (long i=0; i<numComponents; ++i)
-                        {
-                            data[imageOffset+i]=data[imageOffset+i] * (floatTargetAverage / average) + 0.5f;
-                        }
-
-                        integralImageOffset++;
-                        integralImageOffsetMinusBorderMinusStartOffset++;
-                        integralImageOffsetPlusBorderPlusStartOffset++;
-                        integralImageOffsetPlusBorderMinusStartOffset++;
-                        integralImageOffsetMinusBorderPlusStartOffset++;
-
-                        imageOffset+=numComponents;
-                    }
-                    integralImageOffset+=border;
-                }
-            }
+            //The equalisation reads unmodified neighbourhoods, so it works from a copy of the image.
+            inputCopy_.assign(data, data + numElements);
+
+            //The window is 2*((localRegionSizeInPixels>>1)+1) pixels wide, and all the components are scaled by the
+            //window average of the first component, as before the engine was used.
+            const size_t localRegionSizeInPixels=size_t(width * localRegionSize_);
+            equalisation_.equaliseLocal(data, inputCopy_.data(), width, height, numComponents,
+                                        2*((localRegionSizeInPixels>>1)+1), float(*TargetAverage_), true);
             //=== ===
 
-
-            /*
-=================================
-OLD PHOTOMETRIC EQUALISATION CODE
-        const double ef=(*TargetAverage_) / instAverage;
-
-
-        //=== set up lookup table for equalisation ===
-        unsigned char remap[256];
-        for (int i=0; i<256; i++)
-        {
-            const double equalisedValue=i*ef+0.5;
-            remap[i]=equalisedValue<255.5 ? equalisedValue : 255.5;
-        }
-        //=== ===
-
-
-#pragma omp parallel sections
-        {
-#pragma omp section
-            {
-                for (uint32_t i=0; i<numElementsDiv2; i++)
-                {
-                    data[i]=remap[data[i]];
-                }
-            }
-
-#pragma omp section
-            {
-                for (uint32_t i=numElementsDiv2; i<numElements; i++)
-                {
-                    data[i]=remap[data[i]];
-                }
-            }
-        }
-=================================
-*/
             Image_->dirty();
 
-            delete [] integralImageData;
-
             stats_->tock();
         }
     }
@@ -293,6 +170,9 @@ protected:
 
     std::shared_ptr<StatsCollector> stats_;
 
+    mutable PhotometricEqualisation equalisation_;
+    mutable std::vector<unsigned char> inputCopy_;
+
     bool enabled_;
 };
 }
@@ -3,6 +3,7 @@
 
 #include <flitr/flitr_export.h>
 #include <flitr/modules/cpu_shader_passes/cpu_shader_pass.h>
+#include <flitr/image_processor_utils.h>
 #include <flitr/stats_collector.h>
 #include <memory>
 
@@ -41,57 +42,16 @@ namespace flitr {
 
                 unsigned char * const data = (unsigned char *)Image_->data();
 
-                uint64_t sum0 = 0;
-                uint64_t sum1 = 0;
+                const unsigned long numElements = numPixels*numComponents;
 
-                const uint32_t numElements = numPixels*numComponents;
-                const uint32_t numElementsDiv2 = numElements >> 1;
-
-
-
-                //CPU out of order optimisation to calculate image sum.
-                for (uint32_t i = 0; i<numElements; i += 2)
-                {
-                    sum0 += data[i];
-                    sum1 += data[i + 1];
-                }
-                sum0 += sum1;
-
-
-                const double instAverage = (sum0 / (255.0*numElements));
+                const double instAverage = PhotometricEqualisation::sum(data, width*numComponents, height) / (255.0*numElements);
                 *TargetAverage_ = (*TargetAverage_)*(1.0 - TargetAverageUpdateSpeed_) + instAverage*TargetAverageUpdateSpeed_;
 
-                const double ef = (*TargetAverage_) / instAverage;
-
-
-                //=== set up lookup table for equalisation ===
-                unsigned char remap[256];
-                for (int i = 0; i<256; i++)
+                if (instAverage > 0.0)
                 {
-                    const double equalisedValue = i*ef + 0.5;
-                    remap[i] = equalisedValue<255.5 ? equalisedValue : 255;
+                    //Rounded and saturated, as the remap lookup table used to be.
+                    PhotometricEqualisation::scale(data, data, width*numComponents, height, float((*TargetAverage_) / instAverage));
                 }
-                //=== ===
-
-
-#pragma omp parallel sections
-            {
-#pragma omp section
-                {
-                    for (uint32_t i = 0; i<numElementsDiv2; i++)
-                    {
-                        data[i] = remap[data[i]];
-                    }
-                }
-
-#pragma omp section
-                {
-                    for (uint32_t i = numElementsDiv2; i<numElements; i++)
-                    {
-                        data[i] = remap[data[i]];
-                    }
-                }
-            }
 
             Image_->dirty();
 
@@ -25,10 +25,14 @@
 #include <flitr/image_processor_utils.h>
 #include <math.h>
 #include <atomic>
+#include <vector>
 
 namespace flitr {
     
-    /*! Applies Gaussian adaptive threshold filter. */
+    /*! Applies Gaussian adaptive threshold filter.
+     *
+     * The noise filtered image and the local average (each approximated by numIntegralImageLevels repeated box filters)
+     * are computed with running column sums and thresholded in one streaming pass over row bands.*/
     class FLITR_EXPORT FIPAdaptiveThreshold : public ImageProcessor
     {
     public:
@@ -137,13 +141,13 @@ namespace flitr {
     private:
         short _numIntegralImageLevels;
         
-        BoxFilterII _noiseFilter; //No significant state associated with this.
-        uint8_t *_noiseFilteredInputData;
+        const int _noiseKernelWidth;
         
-        uint8_t *_scratchData;
-        double *_integralImageScratchData;
-        
-        BoxFilterII _boxFilter; //No significant state associated with this.
+        //Per row band scratch: ring buffers of the intermediate box filter rows and the running column sums.
+        std::vector<std::vector<uint8_t> > _bandRows8;
+        std::vector<std::vector<uint32_t> > _bandColumnSums8;
+        std::vector<std::vector<float> > _bandRowsF32;
+        std::vector<std::vector<double> > _bandColumnSumsF32;
         
         bool _enabled;
         std::string _title;
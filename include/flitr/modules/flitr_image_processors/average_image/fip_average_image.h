@@ -25,18 +25,32 @@
 
 namespace flitr {
     
-    /*! Calculates the average image on the CPU. The performance is independent of the number of frames. */
+    /*! Calculates the average image on the CPU. The performance is independent of the number of frames.
+     *
+     * Supports Y_8, RGB_8, Y_16, Y_F32 and RGB_F32. The sliding window history is kept in the upstream pixel type and
+     * 8-bit and 16-bit images are summed exactly in 32-bit integer accumulators. The exponential moving average needs
+     * no history at all. */
     class FLITR_EXPORT FIPAverageImage : public ImageProcessor
     {
     public:
+        enum class AverageMode
+        {
+            //! Average of the last 2^base2WindowLength frames.
+            SLIDING_WINDOW,
+            //! Exponential moving average with update weight 2^-base2WindowLength.
+            EXPONENTIAL
+        };
         
         /*! Constructor given the upstream producer.
          *@param upStreamProducer The upstream image producer.
          *@param images_per_slot The number of images per image slot from the upstream producer.
-         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+         *@param base2WindowLength The base two exponent of the averaging window length. At most 24 for 8-bit and 16 for 16-bit formats.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.
+         *@param averageMode Sliding window average or exponential moving average.*/
         FIPAverageImage(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                         uint8_t base2WindowLength,
-                        uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+                        uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS,
+                        AverageMode averageMode=AverageMode::SLIDING_WINDOW);
         
         /*! Virtual destructor */
         virtual ~FIPAverageImage();
@@ -58,15 +72,21 @@ namespace flitr {
         const uint8_t base2WindowLength_;
         const size_t windowLength_;
         const float recipWindowLength_;
+        const AverageMode averageMode_;
         std::string Title_;
 
-        /*! The sum images per slot. */
-        std::vector<float *> sumImageVec_;
+        /*! The integer sum images per slot for 8-bit and 16-bit formats. Holds the scaled average in exponential mode. */
+        std::vector<std::vector<uint32_t> > sumIntImageVec_;
+        
+        /*! The float sum images per slot for float formats. Holds the average in exponential mode. */
+        std::vector<std::vector<float> > sumFloatImageVec_;
         
-        /*! The history ring buffer/vector for each image in the slot. */
-        std::vector<std::vector<float * > > historyImageVecVec_;
+        /*! The history ring buffer for each image in the slot. Holds windowLength_ images in the upstream pixel format. */
+        std::vector<std::vector<uint8_t> > historyImageVec_;
         
         size_t oldestHistorySlot_;
+        
+        bool firstFrame_;
     };
     
 }
@@ -25,10 +25,21 @@
 
 namespace flitr {
     
-    /*! Calculates the beat image on the CPU. The performance is independent of the number of frames. */
+    /*! Calculates the beat image on the CPU. The performance is independent of the number of frames.
+     *
+     * The output is the summed power of the tracked frequency bins of each component's time series over the last
+     * 2^base2WindowLength frames. By default a sliding DFT updates each tracked bin in O(1) per new frame. The
+     * per pixel FFT of the whole window is kept as a fallback. Supports Y_F32 and RGB_F32. */
     class FLITR_EXPORT FIPBeatImage : public ImageProcessor
     {
     public:
+        enum class BeatMethod
+        {
+            //! Update the tracked bins incrementally as each frame enters the window.
+            SLIDING_DFT,
+            //! Transform the whole window of every pixel with an FFT each frame.
+            FFT
+        };
         
         /*! Constructor given the upstream producer.
          *@param upStreamProducer The upstream image producer.
@@ -49,8 +60,42 @@ namespace flitr {
          *@sa ImageProcessor::startTriggerThread*/
         virtual bool trigger();
         
+        //!Sets the method used to calculate the beat. This method is thread safe.
+        void setBeatMethod(const BeatMethod beatMethod);
+        
+        //!Gets the method used to calculate the beat.
+        BeatMethod getBeatMethod() const
+        {
+            return beatMethod_;
+        }
+        
+        /*!Sets the frequency bins of which the power is summed into the output. Bins must be less than the window length.
+         * Defaults to bin 2. This method is thread safe.*/
+        void setBeatBins(const std::vector<size_t> &beatBins);
+        
+        //!Gets the tracked frequency bins.
+        std::vector<size_t> getBeatBins() const
+        {
+            return beatBins_;
+        }
+    
     private:
         
+        /*! Recalculate the twiddle factors of the tracked bins.*/
+        void updateTwiddles();
+        
+        /*! Recalculate the sliding DFT bins of an image from its history. Used to start tracking and to bound the accumulated rounding error.*/
+        void resyncSlidingDFT(const size_t imgNum);
+        
+        /*! Update the sliding DFT bins with the difference between the new and the replaced samples and calculate the beat image.
+         *@param deltaImage The sample differences. If nullptr the bins are not updated.*/
+        void slidingDFTBeat(float * const dataWrite, const size_t imgNum, const size_t componentsPerImage,
+                            float const * const deltaImage);
+        
+        /*! Calculate the beat image with a full FFT of each component's history.*/
+        void fftBeat(float * const dataWrite, const size_t imgNum, const size_t componentsPerImage);
+        
+        
         /*! Replaces data[1..2*nn] by its discrete Fourier transform, if isign is input as 1; or 
          replaces data[1..2*nn] by nn times its inverse discrete Fourier transform, if isign is 
          input as −1. data is a complex array of length nn or, equivalently, a real array of length 
@@ -116,13 +161,24 @@ namespace flitr {
         const uint8_t base2WindowLength_;
         const size_t windowLength_;
         
-        /*! The history ring buffer/vector for each image in the slot. Ring buffer slots next to each other in memory!*/
-        std::vector<float * > historyImageVec_;
+        /*! The history ring buffer for each image in the slot. Each ring buffer slot holds a whole image so that frames are read and written contiguously.*/
+        std::vector<std::vector<float> > historyImageVec_;
+        
+        /*! Real and imaginary parts of the tracked bins for each image in the slot. One image per tracked bin.*/
+        std::vector<std::vector<float> > binReImageVec_;
+        std::vector<std::vector<float> > binImImageVec_;
         
-        /*! The beat ring buffer/vector for each image in the slot. */
-        std::vector<float * > beatImageVec_;
+        /*! Twiddle factors of the tracked bins per ring buffer slot.*/
+        std::vector<float> twiddleReVec_;
+        std::vector<float> twiddleImVec_;
+        
+        std::vector<size_t> beatBins_;
+        BeatMethod beatMethod_;
         
         size_t oldestHistorySlot_;
+        
+        //! Frames since the sliding DFT bins were last recalculated from the history.
+        size_t framesSinceResync_;
     };
     
 }
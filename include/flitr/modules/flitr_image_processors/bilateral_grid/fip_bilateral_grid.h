@@ -0,0 +1,156 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_BILATERAL_GRID_H
+#define FIP_BILATERAL_GRID_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+#include <atomic>
+
+namespace flitr {
+    
+    /*! Fast edge preserving bilateral filter on a bilateral grid. Supports Y_8 and RGB_8 input. RGB images are smoothed
+     *  along the edges of their luminance. The cost is linear in the number of pixels and nearly independent of the
+     *  spatial sigma.
+     *@sa BilateralGrid*/
+    class FLITR_EXPORT FIPBilateralGrid : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param spatialSigma The spatial extent of the filter in pixels.
+         *@param rangeSigma The range extent of the filter in grey levels.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPBilateralGrid(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                         const uint32_t spatialSigma=16, const uint32_t rangeSigma=16,
+                         uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPBilateralGrid();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!Set the spatial extent of the filter in pixels. This method is thread safe.
+        void setSpatialSigma(const uint32_t spatialSigma)
+        {
+            spatialSigma_=std::max<uint32_t>(spatialSigma, 1);
+        }
+        
+        uint32_t getSpatialSigma() const
+        {
+            return spatialSigma_;
+        }
+        
+        //!Set the range extent of the filter in grey levels. This method is thread safe.
+        void setRangeSigma(const uint32_t rangeSigma)
+        {
+            rangeSigma_=std::min<uint32_t>(std::max<uint32_t>(rangeSigma, 1), 255);
+        }
+        
+        uint32_t getRangeSigma() const
+        {
+            return rangeSigma_;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 2;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_INT;
+                case 1: return flitr::Parameters::PARM_INT;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Spatial Sigma");
+                case 1 :return std::string("Range Sigma");
+            }
+            return std::string("???");
+        }
+        
+        virtual int getInt(int id)
+        {
+            switch (id)
+            {
+                case 0 : return int(getSpatialSigma());
+                case 1 : return int(getRangeSigma());
+            }
+            
+            return 0;
+        }
+        
+        virtual bool getIntRange(int id, int &low, int &high)
+        {
+            switch (id)
+            {
+                case 0 : low=2; high=64; return true;
+                case 1 : low=2; high=128; return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setInt(int id, int v)
+        {
+            switch (id)
+            {
+                case 0 : setSpatialSigma(uint32_t(std::max<int>(v, 1))); return true;
+                case 1 : setRangeSigma(uint32_t(std::max<int>(v, 1))); return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<uint32_t> spatialSigma_;
+        std::atomic<uint32_t> rangeSigma_;
+        
+        std::vector<BilateralGrid> bilateralGridVec_;
+    };
+    
+}
+
+#endif //FIP_BILATERAL_GRID_H
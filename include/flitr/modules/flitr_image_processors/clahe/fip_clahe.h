@@ -0,0 +1,226 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_CLAHE_H
+#define FIP_CLAHE_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+#include <atomic>
+#include <vector>
+
+namespace flitr {
+    
+    /*! Contrast limited adaptive histogram equalisation (CLAHE). Supports Y_8 and RGB_8 input.
+     *
+     *  The image is divided into a grid of tiles. The histogram of each tile is clipped at the clip limit, and the clipped
+     *  counts are spread over all the bins before the tile's equalisation map is made
+     *  (ImageHistogram::calcClipLimitedEqualisationMap). Each pixel is mapped through the maps of the four nearest tiles
+     *  and the results are bilinearly interpolated. RGB_8 images are equalised on their luminance, and the maps are
+     *  applied to each component.
+     *
+     *  The tile histograms are accumulated in one pass over the rows, with the rows of tiles in parallel. In the apply
+     *  pass each row first blends the maps of the tile rows above and below it, so that every pixel only interpolates
+     *  horizontally in fixed point. A much cheaper alternative to FIPMSR for local contrast enhancement.*/
+    class FLITR_EXPORT FIPCLAHE : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param numTilesX The number of tiles across the image.
+         *@param numTilesY The number of tiles down the image.
+         *@param clipLimit The maximum bin count of a tile histogram, as a multiple of the average bin count. 1 gives
+         *                 no equalisation and large values give ordinary adaptive histogram equalisation.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPCLAHE(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                 const uint32_t numTilesX=8, const uint32_t numTilesY=8,
+                 const float clipLimit=3.0f,
+                 uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPCLAHE();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!Set the clip limit as a multiple of the average bin count. This method is thread safe.
+        void setClipLimit(const float clipLimit)
+        {
+            clipLimit_=std::max<float>(clipLimit, 1.0f);
+        }
+        
+        float getClipLimit() const
+        {
+            return clipLimit_;
+        }
+        
+        //!Set the number of tiles across and down the image. This method is thread safe.
+        void setNumTiles(const uint32_t numTilesX, const uint32_t numTilesY)
+        {
+            numTilesX_=std::max<uint32_t>(numTilesX, 1);
+            numTilesY_=std::max<uint32_t>(numTilesY, 1);
+        }
+        
+        uint32_t getNumTilesX() const
+        {
+            return numTilesX_;
+        }
+        
+        uint32_t getNumTilesY() const
+        {
+            return numTilesY_;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 3;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_FLOAT;
+                case 1: return flitr::Parameters::PARM_INT;
+                case 2: return flitr::Parameters::PARM_INT;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Clip Limit");
+                case 1 :return std::string("Tiles X");
+                case 2 :return std::string("Tiles Y");
+            }
+            return std::string("???");
+        }
+        
+        virtual float getFloat(int id)
+        {
+            switch (id)
+            {
+                case 0 : return getClipLimit();
+            }
+            
+            return 0.0f;
+        }
+        
+        virtual int getInt(int id)
+        {
+            switch (id)
+            {
+                case 1 : return int(getNumTilesX());
+                case 2 : return int(getNumTilesY());
+            }
+            
+            return 0;
+        }
+        
+        virtual bool getFloatRange(int id, float &low, float &high)
+        {
+            if (id==0)
+            {
+                low=1.0f; high=16.0f;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool getIntRange(int id, int &low, int &high)
+        {
+            if ((id==1) || (id==2))
+            {
+                low=1; high=32;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setFloat(int id, float v)
+        {
+            switch (id)
+            {
+                case 0 : setClipLimit(v); return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setInt(int id, int v)
+        {
+            switch (id)
+            {
+                case 1 : setNumTiles(uint32_t(std::max<int>(v, 1)), getNumTilesY()); return true;
+                case 2 : setNumTiles(getNumTilesX(), uint32_t(std::max<int>(v, 1))); return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        /*! Tile index and Q8 weight of the next tile for the interpolation along one axis. pixelTile is the tile whose centre
+         *  is at or before the pixel, clamped to the first and last tile, so the weight is zero outside the outer centres.*/
+        static void calcInterpolation(std::vector<int32_t> &pixelTile, std::vector<uint16_t> &pixelWeight,
+                                      const size_t length, const size_t numTiles);
+        
+        std::string title_;
+        
+        std::atomic<float> clipLimit_;
+        std::atomic<uint32_t> numTilesX_;
+        std::atomic<uint32_t> numTilesY_;
+        
+        //!Histogram and equalisation map of each tile, numBins entries each, in raster order of the tiles.
+        std::vector<uint32_t> tileHistograms_;
+        std::vector<uint8_t> tileMaps_;
+        
+        std::vector<int32_t> columnTile_;
+        std::vector<uint16_t> columnWeight_;
+        std::vector<int32_t> rowTile_;
+        std::vector<uint16_t> rowWeight_;
+        
+        //!Per row of tiles: interleaved sub-histograms of the tiles of the row and a luminance line for RGB_8.
+        std::vector<std::vector<uint32_t> > tileRowScratch_;
+        std::vector<std::vector<uint8_t> > tileRowLuminance_;
+        
+        //!Per row band: the vertically blended Q8 maps of the current row, one per tile column.
+        std::vector<std::vector<uint16_t> > bandRowMaps_;
+    };
+    
+}
+
+#endif //FIP_CLAHE_H
@@ -0,0 +1,160 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_CONNECTED_COMPONENTS_H
+#define FIP_CONNECTED_COMPONENTS_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace flitr {
+    
+    /*! Finds the connected components (blobs) of binary Y_8 images, e.g. the output of FIPAdaptiveThreshold or FIPMotionDetect.
+     *  Non-zero pixels are foreground. The images are passed downstream unchanged, and the bounding boxes, areas and centroids
+     *  of the blobs of the latest frame are available from getLatestBlobs. Uses ConnectedComponents, which can also be
+     *  called directly.*/
+    class FLITR_EXPORT FIPConnectedComponents : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param connectivity The pixel neighbourhood that connects foreground pixels.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPConnectedComponents(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                               const ConnectedComponents::Connectivity connectivity=ConnectedComponents::Connectivity::EIGHT,
+                               uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPConnectedComponents();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        /*! Get the blobs of an image of the latest frame. Should be called after trigger().
+         *@param imgNum The index of the image in the slot.*/
+        virtual void getLatestBlobs(std::vector<ConnectedComponents::Blob> &blobs, size_t &frameNumber, const size_t imgNum=0) const
+        {
+            std::lock_guard<std::mutex> scopedLock(latestBlobsMutex_);
+            
+            blobs=latestBlobsVec_[imgNum];
+            frameNumber=latestFrameNumber_;
+        }
+        
+        //!Blobs with fewer pixels than this are discarded.
+        virtual void setMinArea(const int area)
+        {
+            minArea_=std::max<int>(area, 0);
+        }
+        
+        virtual int getMinArea() const
+        {
+            return minArea_;
+        }
+        
+        //!The labelling honours the upstream row stride, so views from FIPCrop are read without a copy.
+        virtual bool acceptsStridedImages() const
+        {
+            return true;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 1;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            return flitr::Parameters::PARM_INT;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Minimum Area");
+            }
+            return std::string("???");
+        }
+        
+        virtual int getInt(int id)
+        {
+            switch (id)
+            {
+                case 0 : return getMinArea();
+            }
+            
+            return 0;
+        }
+        
+        virtual bool getIntRange(int id, int &low, int &high)
+        {
+            if (id==0)
+            {
+                low=0; high=10000;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setInt(int id, int v)
+        {
+            switch (id)
+            {
+                case 0 : setMinArea(v); return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<int> minArea_;
+        
+        std::vector<ConnectedComponents> connectedComponentsVec_;
+        
+        //!Blobs of the frame being processed. Swapped with latestBlobsVec_ once the frame is done.
+        std::vector<std::vector<ConnectedComponents::Blob> > filteredBlobsVec_;
+        
+        mutable std::mutex latestBlobsMutex_;
+        std::vector<std::vector<ConnectedComponents::Blob> > latestBlobsVec_;
+        size_t latestFrameNumber_;
+    };
+    
+}
+
+#endif //FIP_CONNECTED_COMPONENTS_H
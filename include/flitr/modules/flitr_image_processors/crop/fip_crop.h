@@ -24,24 +24,46 @@
 #include <flitr/image_processor.h>
 
 #include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace flitr {
     
-    /*! Crops the image. */
+    /*! Crops the image.
+     *
+     *  The crop size is the downstream image format. It is clamped to the upstream image size in the constructor and
+     *  can only be changed before init() is called. The crop rectangle can be moved from any thread between frames.
+     *
+     *  In CropMode::VIEW the downstream images reference the upstream images with an offset and the upstream row
+     *  stride (Image::getBytesPerLine()) instead of copying. The upstream slot is held until all downstream
+     *  consumers have released the downstream slot. Views with non-contiguous rows are only produced when all
+     *  downstream consumers accept them (ImageConsumer::acceptsStridedImages()). Otherwise the crop rectangle is
+     *  copied into contiguous images for that frame, as in CropMode::COPY. */
     class FLITR_EXPORT FIPCrop : public ImageProcessor
     {
     public:
+        enum class CropMode
+        {
+            //! Copy the crop rectangle into contiguous downstream images.
+            COPY,
+            //! Produce views of the upstream images. Needs at least one downstream consumer to release the upstream slots.
+            VIEW
+        };
         
         /*! Constructor given the upstream producer.
          *@param upStreamProducer The upstream image producer.
          *@param images_per_slot The number of images per image slot from the upstream producer.
-         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+         *@param buffer_size The size of the shared image buffer of the downstream producer.
+         *@param cropMode Whether to copy the crop rectangle or to produce views of the upstream images.*/
         FIPCrop(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                 size_t startX,
                 size_t startY,
                 size_t width,
                 size_t height,
-                uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+                uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS,
+                const CropMode cropMode=CropMode::COPY);
         
         /*! Virtual destructor */
         virtual ~FIPCrop();
@@ -54,18 +76,20 @@ namespace flitr {
          *@sa ImageProcessor::startTriggerThread*/
         virtual bool trigger();
         
+        //!Sets the left edge of the crop rectangle. It is clamped so that the rectangle stays inside the image. This method is thread safe.
         virtual void setStartX(const float f)
         {
-            startX_ = std::min<float>(f,maxWidth_);
+            startX_ = size_t(std::min<float>(std::max<float>(f, 0.0f), maxWidth_ - width_));
         }
 
         virtual float getStartX() {
             return startX_;
         }
 
+        //!Sets the top edge of the crop rectangle. It is clamped so that the rectangle stays inside the image. This method is thread safe.
         virtual void setStartY(const float f)
         {
-            startY_ = std::min<float>(f,maxHeight_);
+            startY_ = size_t(std::min<float>(std::max<float>(f, 0.0f), maxHeight_ - height_));
         }
 
         virtual float getStartY() {
@@ -73,40 +97,29 @@ namespace flitr {
         }
 
 
-        virtual void setWidth(const float f)
-        {
-            width_ = std::min<float>(f,maxWidth_);
-
-            //Setup image format being produced to downstream.
-            for (uint32_t i=0; i<ImagesPerSlot_; i++)
-            {
-                ImageFormat_[i].setWidth(width_);
-            }
-
-        }
+        //!Sets the crop width and the downstream image width. Only valid before init() is called.
+        virtual void setWidth(const float f);
 
         virtual float getWidth() {
             return width_;
         }
 
 
-        virtual void setHeight(const float f)
-        {
-            height_ = std::min<float>(f,maxHeight_);
-
-            //Setup image format being produced to downstream.
-            for (uint32_t i=0; i<ImagesPerSlot_; i++)
-            {
-                ImageFormat_[i].setHeight(height_);
-            }
-
-        }
+        //!Sets the crop height and the downstream image height. Only valid before init() is called.
+        virtual void setHeight(const float f);
 
         virtual float getHeight() {
             return height_;
         }
 
 
+        //!The crop honours the row stride of the upstream images, so it may be fed by another FIPCrop in CropMode::VIEW.
+        virtual bool acceptsStridedImages() const
+        {
+            return true;
+        }
+
+
         virtual int getNumberOfParms()
         {
             return 2;
@@ -176,17 +189,31 @@ namespace flitr {
         }
 
 
+    protected:
+        /*! Called when all downstream consumers are done with the oldest slot. In CropMode::VIEW the upstream slot
+         *  that it views is released here.*/
+        virtual void releaseReadSlotCallback();
+    
     private:
         std::string Title_;
 
-        size_t startX_;
-        size_t startY_;
+        const CropMode cropMode_;
+        
+        std::atomic<size_t> startX_;
+        std::atomic<size_t> startY_;
         
+        //!Fixed once init() was called.
         size_t width_;
         size_t height_;
 
         int maxWidth_;
         int maxHeight_;
+        
+        //!The view images placed in the downstream slots in CropMode::VIEW, per slot. Created on first use of each slot.
+        std::map<Image**, std::unique_ptr<Image> > viewImages_;
+        
+        //!The contiguous images placed in the downstream slots in CropMode::VIEW when a consumer does not accept strided views.
+        std::map<Image**, std::unique_ptr<Image> > copyImages_;
     };
 }
 
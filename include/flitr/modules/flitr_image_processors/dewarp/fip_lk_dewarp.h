@@ -87,13 +87,10 @@ namespace flitr {
             data[offsetLT+(((ptrdiff_t)1)+width)] * (fx * fy);
         }
         
-        inline void bilinearAdd(const float value, float * const data, const ptrdiff_t offsetLT, const ptrdiff_t width, const float fx, const float fy)
-        {
-            data[offsetLT]                        += value * ((1.0f-fx) * (1.0f-fy));
-            data[offsetLT+((ptrdiff_t)1)]         += value * (fx * (1.0f-fy));
-            data[offsetLT+width]                  += value * ((1.0f-fx) * fy);
-            data[offsetLT+(((ptrdiff_t)1)+width)] += value * (fx * fy);
-        }
+        /*! Update the average reference image of a level with the previous input image of the level, and refresh the reference
+         *  gradients of the tiles in which the reference changed by more than gradientUpdateThreshold_ since they were last calculated.*/
+        void updateReferenceLevel(const size_t levelNum, const ptrdiff_t levelWidth, const ptrdiff_t levelHeight,
+                                  const float avrgImageLongevity);
         
         bool _enabled;
         std::string _title;
@@ -101,6 +98,10 @@ namespace flitr {
         const float avrgImageLongevity_;
         const float recipGradientThreshold_;
         
+        //!The reference gradients of a tile are recalculated once its reference image changed by more than this since the last calculation.
+        const float gradientUpdateThreshold_;
+        const ptrdiff_t gradientTileSize_;
+        
         const size_t numLevels_;
         
         //!Scale space stack of input images - Gaussian filter downsampled.
@@ -109,9 +110,13 @@ namespace flitr {
         //!Scale space stack of average reference images.
         std::vector<float *> refImgVec_;
         
+        //!Scale space stack of reference image gradients, divided by the squared gradient magnitude. Zero where the gradient is too small to use.
         std::vector<float *> dxVec_;
         std::vector<float *> dyVec_;
-        std::vector<float *> dSqRecipVec_;
+        
+        //!Per level and gradient tile, the largest change of the reference image since the tile's gradients were calculated.
+        std::vector<std::vector<float> > refChangeVec_;
+        std::vector<uint8_t> tileUpdateScratch_;
         
         std::vector<float *> hxVec_;
         std::vector<float *> hyVec_;
@@ -25,35 +25,22 @@
 
 namespace flitr {
     
-    #define RUN_ARCS 1
-    
-    struct Node
+    /*! One end of an arc of the DPT graph. Threaded into the arc end list of the pulse that owns the pixel.*/
+    struct ArcEnd
     {
     public:
-        int32_t index_;
-        uint8_t value_;
-        int32_t size_;
-        
-#ifdef RUN_ARCS
-        std::vector<int32_t> arcIndices_;
-#else
-        std::vector<int32_t> neighbourIndices_;
-#endif
-        
-        std::vector<int32_t> pixelIndices_;
+        int32_t pixelIndex_;
+        int32_t nextArcEnd_;
     };
     
-#ifdef RUN_ARCS
-    struct Arc
-    {
-    public:
-        int32_t index_;
-        bool active_;
-        int32_t nodeIndices_[2];
-    };
-#endif
-    
-    /*! Compute the DPT of image. Currently assumes 8-bit mono input! */
+    /*! Compute the DPT of image. Currently assumes 8-bit mono input!
+     *
+     *  The pulse graph is kept in flat per pixel and per arc arrays that are allocated once in init() and reused every frame:
+     *  - Pulses are merged with a union-find over the pixels (union by size, path halving). The root pixel of a pulse holds its value and size.
+     *  - The pixels of a pulse are an intrusive linked list threaded through the pixel array, so merging two pulses is O(1).
+     *  - The arcs of the 4-connected pixel grid are stored once. Each arc has two ends, and the ends belonging to a pulse are an intrusive
+     *    linked list threaded through the arc end array. Merging splices the lists. Arcs that became internal to a pulse are dropped lazily
+     *    the next time the list is walked.*/
     class FLITR_EXPORT FIPDPT : public ImageProcessor
     {
     public:
@@ -79,192 +66,172 @@ namespace flitr {
         
     private:
         
-#ifdef RUN_ARCS
-        inline int32_t retrieveNeighbourNodeIndex(const Arc &arc, const int32_t nodeIndex)
+        /*! Return the root pixel index of the pulse that pixelIndex belongs to. Halves the path on the way up.*/
+        inline int32_t findPulse(int32_t pixelIndex)
         {
-            return (arc.nodeIndices_[0]==nodeIndex) ? arc.nodeIndices_[1] : arc.nodeIndices_[0];
+            while (parentVect_[pixelIndex]!=pixelIndex)
+            {
+                parentVect_[pixelIndex]=parentVect_[parentVect_[pixelIndex]];
+                pixelIndex=parentVect_[pixelIndex];
+            }
+            
+            return pixelIndex;
         }
-#endif
         
-        inline bool isBump(const size_t nodeIndex)
+        /*! Call visitor(neighbourPulseIndex) once for each neighbouring pulse, until the visitor returns false.
+         *  Arcs internal to the pulse and repeated arcs to the same neighbour are unlinked from its arc list on the way,
+         *  so the list shrinks towards one arc per neighbour.
+         *@return False if the visitor stopped the walk early.*/
+        template<typename Visitor>
+        inline bool forEachNeighbourPulse(const int32_t pulseIndex, Visitor visitor)
         {
-            const Node &node=nodeVect_[nodeIndex];
+            ++walkStamp_;
+            
+            int32_t previousArcEnd=-1;
+            int32_t arcEnd=firstArcEndVect_[pulseIndex];
             
-#ifdef RUN_ARCS
-            for (const auto arcIndex : node.arcIndices_)
+            while (arcEnd!=-1)
             {
-                const auto &arc=arcVect_[arcIndex];
+                const int32_t nextArcEnd=arcEndVect_[arcEnd].nextArcEnd_;
+                const int32_t neighbourIndex=findPulse(arcEndVect_[arcEnd^1].pixelIndex_);
                 
-                if (arc.active_)
-                {
-                    const auto neighbourIndex=retrieveNeighbourNodeIndex(arc, nodeIndex);
-                    
-                    if (nodeVect_[neighbourIndex].value_ >= node.value_)
+                if ((neighbourIndex==pulseIndex) || (walkStampVect_[neighbourIndex]==walkStamp_))
+                {//Internal or repeated arc. Unlink it.
+                    if (previousArcEnd==-1)
                     {
-                        return false;
-                    }
-                }
-            }
-#else
-            for (const auto neighbourIndex : node.neighbourIndices_)
-            {
-                if (nodeVect_[neighbourIndex].size_)
-                {
-                    if (nodeVect_[neighbourIndex].value_ >= node.value_)
+                        firstArcEndVect_[pulseIndex]=nextArcEnd;
+                    } else
                     {
-                        return false;
+                        arcEndVect_[previousArcEnd].nextArcEnd_=nextArcEnd;
                     }
-                }
-            }
-#endif
-            return true;
-        }
-        
-        inline bool isPit(const size_t nodeIndex)
-        {
-            const Node &node=nodeVect_[nodeIndex];
-            
-#ifdef RUN_ARCS
-            for (const auto arcIndex : node.arcIndices_)
-            {
-                const auto &arc=arcVect_[arcIndex];
-                
-                if (arc.active_)
-                {
-                    const auto neighbourIndex=retrieveNeighbourNodeIndex(arc, nodeIndex);
                     
-                    if (nodeVect_[neighbourIndex].value_ <= node.value_)
+                    if (lastArcEndVect_[pulseIndex]==arcEnd)
                     {
-                        return false;
+                        lastArcEndVect_[pulseIndex]=previousArcEnd;
                     }
-                }
-            }
-#else
-            for (const auto neighbourIndex : node.neighbourIndices_)
-            {
-                if (nodeVect_[neighbourIndex].size_)
+                } else
                 {
-                    if (nodeVect_[neighbourIndex].value_ <= node.value_)
+                    walkStampVect_[neighbourIndex]=walkStamp_;
+                    
+                    if (!visitor(neighbourIndex))
                     {
                         return false;
                     }
+                    
+                    previousArcEnd=arcEnd;
                 }
+                
+                arcEnd=nextArcEnd;
             }
-#endif
             
             return true;
         }
         
-        int16_t flattenToFirstNeighbour(const size_t nodeIndex)
+        inline bool isBump(const int32_t pulseIndex)
         {
-            Node &node=nodeVect_[nodeIndex];
+            const uint8_t value=valueVect_[pulseIndex];
             
-#ifdef RUN_ARCS
-            size_t firstNeighbourIndex=nodeIndex;
+            return forEachNeighbourPulse(pulseIndex, [&](const int32_t neighbourIndex)
+                                         {
+                                             return valueVect_[neighbourIndex] < value;
+                                         });
+        }
+        
+        inline bool isPit(const int32_t pulseIndex)
+        {
+            const uint8_t value=valueVect_[pulseIndex];
             
-            for (const auto arcIndex : node.arcIndices_)
-            {
-                const auto &arc=arcVect_[arcIndex];
-                
-                if (arc.active_)
-                {
-                    firstNeighbourIndex=retrieveNeighbourNodeIndex(arc, nodeIndex);
-                    break;
-                }
-            }
-#else
-            size_t firstNeighbourIndex=nodeIndex;
+            return forEachNeighbourPulse(pulseIndex, [&](const int32_t neighbourIndex)
+                                         {
+                                             return valueVect_[neighbourIndex] > value;
+                                         });
+        }
+        
+        uint8_t flattenToFirstNeighbour(const int32_t pulseIndex)
+        {
+            int32_t firstNeighbourIndex=pulseIndex;
             
-            for (const auto neighbourIndex : node.neighbourIndices_)
-            {
-                if (nodeVect_[neighbourIndex].size_>0)
-                {
-                    firstNeighbourIndex=neighbourIndex;
-                    break;
-                }
-            }
-#endif
+            forEachNeighbourPulse(pulseIndex, [&](const int32_t neighbourIndex)
+                                  {
+                                      firstNeighbourIndex=neighbourIndex;
+                                      return false;
+                                  });
             
-            node.value_=nodeVect_[firstNeighbourIndex].value_;
+            valueVect_[pulseIndex]=valueVect_[firstNeighbourIndex];
             
-            return node.value_;
+            return valueVect_[pulseIndex];
         }
         
-        uint8_t flattenToNearestNeighbour(const size_t nodeIndex)
+        uint8_t flattenToNearestNeighbour(const int32_t pulseIndex)
         {
-            Node &node=nodeVect_[nodeIndex];
+            const int value=valueVect_[pulseIndex];
+            int32_t nearestNeighbourIndex=pulseIndex;
             
-            size_t nearestNeighbourIndex=nodeIndex;
+            forEachNeighbourPulse(pulseIndex, [&](const int32_t neighbourIndex)
+                                  {
+                                      if (( nearestNeighbourIndex==pulseIndex ) ||
+                                          ( abs(int(valueVect_[neighbourIndex])-value) <= abs(int(valueVect_[nearestNeighbourIndex])-value) ))
+                                      {
+                                          nearestNeighbourIndex=neighbourIndex;
+                                      }
+                                      return true;
+                                  });
             
-#ifdef RUN_ARCS
-            for (const auto arcIndex : node.arcIndices_)
-            {
-                const auto &arc=arcVect_[arcIndex];
-                
-                if (arc.active_)
-                {
-                    const auto neighbourIndex=retrieveNeighbourNodeIndex(arc, nodeIndex);
-                    
-                    if (( nearestNeighbourIndex==nodeIndex ) ||
-                        ( abs(int(nodeVect_[neighbourIndex].value_)-int(node.value_)) <= abs(int(nodeVect_[nearestNeighbourIndex].value_)-int(node.value_)) ))
-                    {
-                        nearestNeighbourIndex=neighbourIndex;
-                    }
-                }
-            }
-#else
-            for (const auto neighbourIndex : node.neighbourIndices_)
-            {
-                if (nodeVect_[neighbourIndex].size_>0)
-                {
-                    if (( nearestNeighbourIndex==nodeIndex ) ||
-                        ( abs(int(nodeVect_[neighbourIndex].value_)-int(node.value_)) <= abs(int(nodeVect_[nearestNeighbourIndex].value_)-int(node.value_)) ))
-                    {
-                        nearestNeighbourIndex=neighbourIndex;
-                    }
-                }
-            }
-#endif
+            valueVect_[pulseIndex]=valueVect_[nearestNeighbourIndex];
             
-            node.value_=nodeVect_[nearestNeighbourIndex].value_;
-            
-            return node.value_;
+            return valueVect_[pulseIndex];
         }
         
-        void updatePotentiallyActiveNodeIndexVect()
+        /*! Remove the pulses that were merged away from the potentially active list.*/
+        void updatePotentiallyActivePulseIndexVect()
         {
-            potentiallyActiveNodeIndexVect_.clear();
+            size_t numActive=0;
             
-            for (const auto & node : nodeVect_)
+            for (const auto pulseIndex : potentiallyActivePulseIndexVect_)
             {
-                if (node.size_>0)
+                if (sizeVect_[pulseIndex]>0)
                 {
-                    potentiallyActiveNodeIndexVect_.push_back(node.index_);
+                    potentiallyActivePulseIndexVect_[numActive]=pulseIndex;
+                    ++numActive;
                 }
             }
+            
+            potentiallyActivePulseIndexVect_.resize(numActive);
         }
         
-#ifdef RUN_ARCS
-        size_t mergeArc(const int32_t arcIndex);
-#else
-        size_t mergeNode(const int32_t nodeIndex);
-#endif
+        /*! Set up one pulse per pixel and the arcs of the 4-connected grid.*/
+        void setupGraph(uint8_t const * const data, const int32_t width, const int32_t height);
+        
+        /*! Merge two pulses given their root pixel indices. The smaller pulse is merged into the larger one.
+         *@return The number of pulses merged, 0 or 1.*/
+        size_t joinPulses(int32_t pulseIndex0, int32_t pulseIndex1);
         
         size_t mergeFromAll();
-        size_t mergeFromList(const std::vector<int32_t> nodeIndicesToMerge);
+        size_t mergeFromList(const std::vector<int32_t> &pulseIndicesToMerge);
         
         
     private:
         int32_t filterPulseSize_;
         
-        std::vector<Node> nodeVect_;
-        std::vector<size_t> potentiallyActiveNodeIndexVect_;
-        
-#ifdef RUN_ARCS
-        std::vector<Arc> arcVect_;
-#else
-        std::vector<int32_t> neighbourIndicesToAdd_;
-#endif
+        int32_t numArcs_;
+        int32_t walkStamp_;
+        
+        //Per pixel. Only valid at the root pixel of a pulse, except parentVect_ and nextPixelVect_.
+        std::vector<int32_t> parentVect_;
+        std::vector<int32_t> sizeVect_;
+        std::vector<uint8_t> valueVect_;
+        std::vector<int32_t> nextPixelVect_;
+        std::vector<int32_t> lastPixelVect_;
+        std::vector<int32_t> firstArcEndVect_;
+        std::vector<int32_t> lastArcEndVect_;
+        std::vector<int32_t> walkStampVect_;
+        
+        //Per arc end. Arc a has ends 2a and 2a+1, so both ends share a cache line.
+        std::vector<ArcEnd> arcEndVect_;
+        
+        std::vector<int32_t> potentiallyActivePulseIndexVect_;
+        std::vector<int32_t> pulseIndicesToMerge_;
+        std::vector<int32_t> pulsePairsToJoin_;
     };
     
 }
@@ -22,6 +22,7 @@
 #define FIP_FLIP_H 1
 
 #include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
 
 namespace flitr {
     
@@ -23,6 +23,7 @@
 
 #include <flitr/image_processor.h>
 #include <flitr/image_processor_utils.h>
+#include <flitr/modules/flitr_image_processors/image_pyramid/fip_image_pyramid.h>
 
 namespace flitr {
     
@@ -40,6 +41,17 @@ namespace flitr {
                               const size_t kernelWidth,//Width of filter kernel in pixels in US image.
                               uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
         
+        /*! Constructor given an upstream FIPImagePyramid. Level 1 of each pyramid is passed on instead of filtering the
+         *  image again, so the filter radius and kernel width are only used if the pyramid has a single level. Odd image
+         *  sizes are then rounded down like the pyramid levels, not up like the ImageProducer constructor does.
+         *@param upStreamPyramid The upstream pyramid.
+         *@param images_per_slot The number of pyramids per image slot, i.e. the number of images upstream of the pyramid.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPGaussianDownsample(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                              const float filterRadius,
+                              const size_t kernelWidth,
+                              uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
         /*! Virtual destructor */
         virtual ~FIPGaussianDownsample();
         
@@ -58,6 +70,9 @@ namespace flitr {
         /*! The result of the first pass of the seperable Gaussian downsample. */
         float *xFiltData_;
         
+        /*! The upstream pyramid, or nullptr if the upstream images are not pyramid levels. */
+        FIPImagePyramid const * const upStreamPyramid_;
+        
         GaussianDownsample gaussianDownsample_;
     };
     
@@ -0,0 +1,122 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_GRADIENT_H
+#define FIP_GRADIENT_H 1
+
+#include <flitr/image_processor.h>
+
+#include <vector>
+
+namespace flitr {
+    
+    /*! Calculates the x and y image gradients, the gradient magnitude and the quantised gradient orientation in one pass.
+     *
+     *  Only the outputs selected with the outputs bit mask are produced. They become separate images in the downstream slot.
+     *  The enabled outputs of upstream image i are at downstream indices i*getNumOutputsPerImage() onwards, in the order
+     *  x gradient, y gradient, magnitude, orientation. The gradients and magnitude are Y_F32 images. The orientation is a
+     *  Y_8 image of bin indices. Y_8 input is scaled by 1/256 like FIPCnvrtToYF32, so that the gradients are in the same units for
+     *  both input formats. Image edges are handled by replicating the border pixels.*/
+    class FLITR_EXPORT FIPGradient : public ImageProcessor
+    {
+    public:
+        enum class GradientOperator
+        {
+            //! (f(x+1) - f(x-1)) / 2.
+            CENTRAL_DIFFERENCE,
+            //! Central difference smoothed with [1 2 1]/4 across the derivative direction.
+            SOBEL,
+            //! Central difference smoothed with [3 10 3]/16 across the derivative direction. Rotationally more symmetric than Sobel.
+            SCHARR
+        };
+        
+        enum class MagnitudeNorm
+        {
+            //! |gx| + |gy|
+            L1,
+            //! sqrt(gx^2 + gy^2)
+            L2
+        };
+        
+        //! Bits of the outputs bit mask.
+        enum Output : uint32_t
+        {
+            OUTPUT_GRADIENT_X=1,
+            OUTPUT_GRADIENT_Y=2,
+            OUTPUT_MAGNITUDE=4,
+            OUTPUT_ORIENTATION=8
+        };
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param outputs Bit mask of the Output values to produce. At least one output must be selected.
+         *@param gradientOperator The derivative operator.
+         *@param magnitudeNorm The norm of the gradient magnitude.
+         *@param numOrientationBins The number of orientation bins over the full circle. Bin b is centred on angle b*2*pi/numOrientationBins
+         *                          measured from the +x axis towards +y. Pixels with a zero gradient are in bin 0.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPGradient(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                    const uint32_t outputs,
+                    const GradientOperator gradientOperator=GradientOperator::SCHARR,
+                    const MagnitudeNorm magnitudeNorm=MagnitudeNorm::L2,
+                    const uint32_t numOrientationBins=8,
+                    uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPGradient();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!The number of downstream images per upstream image, i.e. the number of selected outputs.
+        uint32_t getNumOutputsPerImage() const
+        {
+            return numOutputs_;
+        }
+        
+        virtual std::string getTitle() { return title_; }
+        virtual void setTitle(const std::string &title) { title_=title; }
+        
+    private:
+        static uint32_t countOutputs(const uint32_t outputs);
+        
+        const uint32_t outputs_;
+        const uint32_t numOutputs_;
+        const uint32_t numUpstreamImages_;
+        
+        const GradientOperator gradientOperator_;
+        const MagnitudeNorm magnitudeNorm_;
+        const uint32_t numOrientationBins_;
+        
+        //Per row band scratch for the gradient lines that are needed for the magnitude or orientation, but are not outputs.
+        std::vector<std::vector<float> > bandLines_;
+        
+        std::string title_;
+    };
+    
+}
+
+#endif //FIP_GRADIENT_H
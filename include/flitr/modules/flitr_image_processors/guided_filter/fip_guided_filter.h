@@ -0,0 +1,202 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_GUIDED_FILTER_H
+#define FIP_GUIDED_FILTER_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+#include <atomic>
+
+namespace flitr {
+    
+    /*! Edge preserving smoothing with the guided filter, each component guided by itself. Supports Y_8, RGB_8, Y_F32 and
+     *  RGB_F32 input. The window means come from integral images, so the cost does not depend on the radius. With a
+     *  subsample factor above one the fast guided filter is used, which fits the model on a downsampled image.
+     *@sa GuidedFilter*/
+    class FLITR_EXPORT FIPGuidedFilter : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param radius The radius of the filter window in pixels.
+         *@param epsilon The regularisation of the filter for data in [0,1]. Edges with a local variance well above epsilon are kept.
+         *@param subsample The downsampling factor of the fast guided filter. 1 for the full resolution filter.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPGuidedFilter(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                        const uint32_t radius=4, const float epsilon=0.01f, const uint32_t subsample=1,
+                        uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPGuidedFilter();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!Set the radius of the filter window. This method is thread safe.
+        void setRadius(const uint32_t radius)
+        {
+            radius_=std::max<uint32_t>(radius, 1);
+        }
+        
+        uint32_t getRadius() const
+        {
+            return radius_;
+        }
+        
+        //!Set the regularisation for data in [0,1]. This method is thread safe.
+        void setEpsilon(const float epsilon)
+        {
+            epsilon_=std::max<float>(epsilon, 1.0e-8f);
+        }
+        
+        float getEpsilon() const
+        {
+            return epsilon_;
+        }
+        
+        //!Set the downsampling factor of the fast guided filter. This method is thread safe.
+        void setSubsample(const uint32_t subsample)
+        {
+            subsample_=std::max<uint32_t>(subsample, 1);
+        }
+        
+        uint32_t getSubsample() const
+        {
+            return subsample_;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 3;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_INT;
+                case 1: return flitr::Parameters::PARM_FLOAT;
+                case 2: return flitr::Parameters::PARM_INT;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Radius");
+                case 1 :return std::string("Epsilon");
+                case 2 :return std::string("Subsample");
+            }
+            return std::string("???");
+        }
+        
+        virtual int getInt(int id)
+        {
+            switch (id)
+            {
+                case 0 : return int(getRadius());
+                case 2 : return int(getSubsample());
+            }
+            
+            return 0;
+        }
+        
+        virtual float getFloat(int id)
+        {
+            switch (id)
+            {
+                case 1 : return getEpsilon();
+            }
+            
+            return 0.0f;
+        }
+        
+        virtual bool getIntRange(int id, int &low, int &high)
+        {
+            switch (id)
+            {
+                case 0 : low=1; high=64; return true;
+                case 2 : low=1; high=8; return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool getFloatRange(int id, float &low, float &high)
+        {
+            if (id==1)
+            {
+                low=0.0001f; high=1.0f;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setInt(int id, int v)
+        {
+            switch (id)
+            {
+                case 0 : setRadius(uint32_t(std::max<int>(v, 1))); return true;
+                case 2 : setSubsample(uint32_t(std::max<int>(v, 1))); return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setFloat(int id, float v)
+        {
+            switch (id)
+            {
+                case 1 : setEpsilon(v); return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<uint32_t> radius_;
+        std::atomic<float> epsilon_;
+        std::atomic<uint32_t> subsample_;
+        
+        std::vector<GuidedFilter> guidedFilterVec_;
+    };
+    
+}
+
+#endif //FIP_GUIDED_FILTER_H
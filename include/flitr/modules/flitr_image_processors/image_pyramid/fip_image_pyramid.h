@@ -0,0 +1,88 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_IMAGE_PYRAMID_H
+#define FIP_IMAGE_PYRAMID_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+namespace flitr {
+    
+    /*! Builds the Gaussian pyramid of each image once per frame and passes all its levels downstream as images of the
+     *  same slot. Supports Y_F32 and RGB_F32 input.
+     *
+     *  Each upstream image is followed by numLevels downstream images: level 0 is a copy of the image and level l is
+     *  (width>>l) x (height>>l). Use getImageIndex() to find a level in the downstream slot. Downstream processors that
+     *  need a reduced resolution image can read the level they need instead of building their own pyramid.
+     *  FIPGaussianDownsample and FIPLKStabilise have constructors that take a FIPImagePyramid upstream.
+     *@sa ImagePyramid*/
+    class FLITR_EXPORT FIPImagePyramid : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param numLevels The number of pyramid levels per image, including the full resolution level 0.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPImagePyramid(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                        const uint32_t numLevels,
+                        uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPImagePyramid();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        uint32_t getNumLevels() const
+        {
+            return numLevels_;
+        }
+        
+        //!Index in the downstream slot of a pyramid level of an upstream image.
+        uint32_t getImageIndex(const uint32_t upstreamImageNum, const uint32_t levelNum) const
+        {
+            return upstreamImageNum*numLevels_ + levelNum;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+    
+    private:
+        const uint32_t numLevels_;
+        const uint32_t numUpstreamImages_;
+        
+        std::string title_;
+        
+        ImagePyramid imagePyramid_;
+    };
+    
+}
+
+#endif //FIP_IMAGE_PYRAMID_H
@@ -0,0 +1,304 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_KLT_TRACKER_H
+#define FIP_KLT_TRACKER_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+#include <flitr/modules/flitr_image_processors/image_pyramid/fip_image_pyramid.h>
+
+#include <atomic>
+#include <mutex>
+
+namespace flitr {
+    
+    /*! Estimates the global motion between consecutive images by tracking sparse corner features with a pyramidal KLT
+     *  tracker and fitting a translation, similarity or homography with RANSAC. Runs on the CPU only, and unlike
+     *  FIPLKStabilise it also estimates rotation and scale. Supports Y_8, Y_F32 and RGB_F32 input; the green channel of
+     *  RGB_F32 is tracked. The motion is estimated for the first image of the slot. The images are passed downstream
+     *  unchanged.
+     *@sa KLTTracker*/
+    class FLITR_EXPORT FIPKLTTracker : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param maxFeatures The maximum number of features tracked.
+         *@param motionModel The global motion model fitted to the tracks.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPKLTTracker(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                      const uint32_t maxFeatures=300,
+                      const KLTTracker::MotionModel motionModel=KLTTracker::MotionModel::SIMILARITY,
+                      uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Constructor given an upstream FIPImagePyramid. The features are tracked on the levels of the first pyramid of
+         *  the slot instead of building another pyramid. Level 0 of each pyramid is passed downstream.
+         *@param upStreamPyramid The upstream pyramid.
+         *@param images_per_slot The number of pyramids per image slot, i.e. the number of images upstream of the pyramid.
+         *@param maxFeatures The maximum number of features tracked.
+         *@param motionModel The global motion model fitted to the tracks.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPKLTTracker(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                      const uint32_t maxFeatures=300,
+                      const KLTTracker::MotionModel motionModel=KLTTracker::MotionModel::SIMILARITY,
+                      uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPKLTTracker();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        /*! Get the shift of the image centre between the latest and the previous image, in the same sense as
+         *  FIPLKStabilise::getLatestHVect. Should be called after trigger().*/
+        virtual void getLatestHVect(float &hx, float &hy, size_t &frameNumber) const
+        {
+            std::lock_guard<std::mutex> scopedLock(latestHMutex_);
+            
+            hx=latestHx_;
+            hy=latestHy_;
+            frameNumber=latestHFrameNumber_;
+        }
+        
+        /*! Get the row major 3x3 transform from the latest image to the previous image. It is the identity if the motion
+         *  could not be estimated. Should be called after trigger().*/
+        virtual void getLatestTransform(float transform[9], size_t &frameNumber) const
+        {
+            std::lock_guard<std::mutex> scopedLock(latestHMutex_);
+            
+            for (size_t i=0; i<9; ++i) transform[i]=latestTransform_[i];
+            frameNumber=latestHFrameNumber_;
+        }
+        
+        //!Get the number of features that agreed with the latest transform.
+        virtual size_t getLatestNumInliers() const
+        {
+            std::lock_guard<std::mutex> scopedLock(latestHMutex_);
+            return latestNumInliers_;
+        }
+        
+        //!Set the maximum number of features tracked. This method is thread safe.
+        void setMaxFeatures(const uint32_t maxFeatures)
+        {
+            maxFeatures_=std::max<uint32_t>(maxFeatures, 8);
+        }
+        
+        uint32_t getMaxFeatures() const
+        {
+            return maxFeatures_;
+        }
+        
+        //!Set the global motion model. This method is thread safe.
+        void setMotionModel(const KLTTracker::MotionModel motionModel)
+        {
+            motionModel_=motionModel;
+        }
+        
+        KLTTracker::MotionModel getMotionModel() const
+        {
+            return motionModel_;
+        }
+        
+        //!Set the RANSAC inlier threshold in pixels. This method is thread safe.
+        void setInlierThreshold(const float inlierThreshold)
+        {
+            inlierThreshold_=std::max<float>(inlierThreshold, 0.01f);
+        }
+        
+        float getInlierThreshold() const
+        {
+            return inlierThreshold_;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 3;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_INT;
+                case 1: return flitr::Parameters::PARM_ENUM;
+                case 2: return flitr::Parameters::PARM_FLOAT;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Max Features");
+                case 1 :return std::string("Motion Model");
+                case 2 :return std::string("Inlier Threshold");
+            }
+            return std::string("???");
+        }
+        
+        virtual int getInt(int id)
+        {
+            switch (id)
+            {
+                case 0 : return int(getMaxFeatures());
+            }
+            
+            return 0;
+        }
+        
+        virtual float getFloat(int id)
+        {
+            switch (id)
+            {
+                case 2 : return getInlierThreshold();
+            }
+            
+            return 0.0f;
+        }
+        
+        virtual int getEnum(int id)
+        {
+            switch (id)
+            {
+                case 1 : return int(getMotionModel());
+            }
+            
+            return 0;
+        }
+        
+        virtual std::string getEnumText(int id, int v)
+        {
+            if (id==1)
+            {
+                switch (v)
+                {
+                    case int(KLTTracker::MotionModel::TRANSLATION) : return std::string("Translation");
+                    case int(KLTTracker::MotionModel::SIMILARITY) : return std::string("Similarity");
+                    case int(KLTTracker::MotionModel::HOMOGRAPHY) : return std::string("Homography");
+                }
+            }
+            
+            return std::string("???");
+        }
+        
+        virtual bool getIntRange(int id, int &low, int &high)
+        {
+            if (id==0)
+            {
+                low=8; high=2000;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool getFloatRange(int id, float &low, float &high)
+        {
+            if (id==2)
+            {
+                low=0.1f; high=10.0f;
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool getEnumRange(int id, int &low, int &high)
+        {
+            if (id==1)
+            {
+                low=int(KLTTracker::MotionModel::TRANSLATION); high=int(KLTTracker::MotionModel::HOMOGRAPHY);
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setInt(int id, int v)
+        {
+            switch (id)
+            {
+                case 0 : setMaxFeatures(uint32_t(std::max<int>(v, 8))); return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setFloat(int id, float v)
+        {
+            switch (id)
+            {
+                case 2 : setInlierThreshold(v); return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setEnum(int id, int v)
+        {
+            if ((id==1) && (v>=int(KLTTracker::MotionModel::TRANSLATION)) && (v<=int(KLTTracker::MotionModel::HOMOGRAPHY)))
+            {
+                setMotionModel(KLTTracker::MotionModel(v));
+                return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<uint32_t> maxFeatures_;
+        std::atomic<KLTTracker::MotionModel> motionModel_;
+        std::atomic<float> inlierThreshold_;
+        
+        KLTTracker kltTracker_;
+        
+        //!The upstream pyramid, or nullptr if the upstream images are not pyramid levels.
+        FIPImagePyramid const *upStreamPyramid_;
+        
+        //!Single component float copy of Y_8 and RGB_F32 input.
+        std::vector<float> trackImage_;
+        
+        mutable std::mutex latestHMutex_;
+        float latestHx_;
+        float latestHy_;
+        float latestTransform_[9];
+        size_t latestNumInliers_;
+        size_t latestHFrameNumber_;
+    };
+    
+}
+
+#endif //FIP_KLT_TRACKER_H
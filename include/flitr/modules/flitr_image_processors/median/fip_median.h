@@ -22,17 +22,24 @@
 #define FIP_MEDIAN_H 1
 
 #include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
 
 namespace flitr {
     
     
-    /*! Compute Median of image. Currently assumes 8-bit mono input! */
+    /*! Computes the median filtered image. Supports 8-bit mono, 8-bit RGB and 16-bit mono input.
+     *
+     * The filter footprint is (2*filterSize-1)x(2*filterSize-1) pixels. The default HISTOGRAM mode
+     * computes the true median at a cost that is independent of the filter size. The QUADRANT_MIN_MAX
+     * mode is the faster max-of-quadrant-minima approximation. */
     class FLITR_EXPORT FIPMedian : public ImageProcessor
     {
     public:
+        enum class MedianMode {HISTOGRAM, QUADRANT_MIN_MAX};
         
         /*! Constructor given the upstream producer.
          *@param producer The upstream image producer.
+         *@param filterSize Half width of the filter footprint, including the centre pixel.
          *@param images_per_slot The number of images per image slot from the upstream producer.
          *@param buffer_size The size of the shared image buffer of the downstream producer.*/
         FIPMedian(ImageProducer& upStreamProducer, uint32_t filterSize,
@@ -50,10 +57,26 @@ namespace flitr {
          *@sa ImageProcessor::startTriggerThread*/
         virtual bool trigger();
         
+        /*! Select the true histogram median or the quadrant min-max approximation. */
+        void setMedianMode(const MedianMode medianMode)
+        {
+            std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+            medianMode_=medianMode;
+        }
+        
+        MedianMode getMedianMode() const
+        {
+            return medianMode_;
+        }
+    
     private:
         uint32_t filterSize_;
+        
+        MedianMode medianMode_;
+        
+        MedianFilter medianFilter_;
     };
     
 }
 
-#endif //FIP_DPT_H
+#endif //FIP_MEDIAN_H
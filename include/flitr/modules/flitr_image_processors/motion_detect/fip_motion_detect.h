@@ -24,10 +24,15 @@
 #include <flitr/image_processor.h>
 #include <flitr/image_processor_utils.h>
 #include <math.h>
+#include <vector>
 
 namespace flitr {
     
-    /*! Applies Gaussian filter. */
+    /*! Detects motion against a running average and variance background model. Supports Y_8 and RGB_8 input.
+     *
+     * The background average is kept in 8.8 and the variance in 16.8 fixed point. The model update,
+     * the motion threshold test, the marking of 16x16 pixel detection bins and the bin detection
+     * counts are computed in one row parallel pass over the image. */
     class FLITR_EXPORT FIPMotionDetect : public ImageProcessor
     {
     public:
@@ -207,15 +212,23 @@ namespace flitr {
         }
     
     private:
+        /*! Update the background model of one image and the detection counts of its bins.
+         *@param C The number of components per pixel.*/
+        template<size_t C>
+        void updateBackgroundAndDetections(uint8_t const * const dataReadUS, const size_t imgNum,
+                                           const int width, const int height);
+		
 		std::string _title;
 
         uint64_t _frameCounter;
 
-        float *_avrgImg;
-        float *_varImg;
+        //!Per image background average in 8.8 fixed point.
+        std::vector<std::vector<uint16_t> > _avrgImgVec;
+        //!Per image background variance in 16.8 fixed point, the same as the squared differences.
+        std::vector<std::vector<uint32_t> > _varImgVec;
         
-        uint8_t *_detectionImg;
-        int *_detectionCountImg;
+        //!Per image count of consecutive frames with motion in each 16x16 detection bin.
+        std::vector<std::vector<int> > _detectionCountImgVec;
         
         bool _showOverlays;
         bool _produceOnlyMotionImages;
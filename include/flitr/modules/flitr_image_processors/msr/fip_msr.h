@@ -26,7 +26,10 @@
 
 namespace flitr {
     
-    /*! Multi-Scale Retinex Implementation.*/
+    /*! Multi-Scale Retinex Implementation.
+     *
+     * The scales are built by a GaussianScaleSpace. The single scale retinex images and their histograms are computed
+     * for all the scales in parallel and are combined with the output in one fused pass.*/
     class FLITR_EXPORT FIPMSR : public ImageProcessor
     {
     public:
@@ -148,35 +151,25 @@ namespace flitr {
         const FilterType _filterType;
 	    std::string _Title;
         
-        //!Box filter helper. No significant state.
-        GaussianFilter _GFXY;
-        
-        //!Box filter helper. No significant state.
-        BoxFilterII _GFII;
-        
-        //!Box filter helper. No significant state.
-        BoxFilterRS _GFRS;
-        
+        //!The blurred intensity image at each of the scales.
+        GaussianScaleSpace _scaleSpace;
         
         size_t _GFScale;
         size_t _numScales;
         
         /*! The grayscale image per slot. */
-        float *_intensityScratchData;
-        
-        float *_GFScratchData;
-        float *_MSRScratchData;
-        float *_floatScratchData;
+        std::vector<float> _intensityScratchData;
         
-        //!Integral image of input image.
-        double *_doubleScratchData1;
+        //!log2 of the intensity image. Shared by all the scales.
+        std::vector<float> _logIntensityScratchData;
         
-        //!Integral image used for approximate gaussian filter.
-        double *_doubleScratchData2;
+        //!Single scale retinex image per scale.
+        std::vector<std::vector<float> > _SSRScratchDataVec;
         
 #define _histoBinArrSize 10000
         
-        size_t *_histoBins;
+        //!Histogram of the single scale retinex image per scale.
+        std::vector<std::vector<size_t> > _histoBinsVec;
         
         size_t _triggerCount;
     };
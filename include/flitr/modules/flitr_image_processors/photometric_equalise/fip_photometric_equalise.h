@@ -28,7 +28,8 @@
 
 namespace flitr {
     
-    /*! Applies photometric equalisation to the image stream. */
+    /*! Applies photometric equalisation to the image stream.
+     * The target average is a fraction of the full scale value of the pixel data type.*/
     class FLITR_EXPORT FIPPhotometricEqualise : public ImageProcessor
     {
     public:
@@ -119,66 +120,13 @@ namespace flitr {
         }
 
     private:
-        
-        //!Template method that does the equalisation. Pixel format agnostic, but pixel data type templated!
-        template<typename T>
-        void process(T * const dataWrite, T const * const dataRead,
-                     const size_t componentsPerLine, const size_t height)
-        {
-            
-            //Could be line parallel!
-            for (size_t y=0; y<height; y++)
-            {
-                const size_t lineOffset=y * componentsPerLine;
-                
-                double *lineSum = lineSumArray_ + y;
-                *lineSum=0.0;
-                
-                for (size_t compNum=0; compNum<componentsPerLine; compNum++)
-                {
-                    (*lineSum)+=dataRead[lineOffset + compNum];
-                }
-            }
-            
-            
-            double imageSum=0.0;
-            
-            //Single threaded!
-            for (size_t y=0; y<height; y++)
-            {
-                imageSum+=lineSumArray_[y];
-            }
-            
-            
-            const size_t componentsPerImage=componentsPerLine*height;
-            const float average = imageSum / ((double)componentsPerImage);
-
-            if(average > 0.0)
-            {
-                const float eScale=targetAverage_ / average;
-
-                //Could be pixel parallel.
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=y * componentsPerLine;
-
-                    for (size_t compNum=0; compNum<componentsPerLine; ++compNum)
-                    {
-                        dataWrite[lineOffset + compNum]=dataRead[lineOffset + compNum] * eScale;
-                    }
-                }
-            }
-        }
-        
         float targetAverage_;
         std::string Title_;
-
-        /*! The sum per line in an image. */
-        double * lineSumArray_;
     };
     
     
-    /*! Applies LOCAL photometric equalisation to the image stream. */
+    /*! Applies LOCAL photometric equalisation to the image stream. Each component is scaled by the target average over
+     * the average of that component in the window around the pixel. Windows are clipped at the image borders.*/
     class FLITR_EXPORT FIPLocalPhotometricEqualise : public ImageProcessor
     {
     public:
@@ -271,101 +219,11 @@ namespace flitr {
 
 
     private:
-        
-        //!Template method that does the equalisation. Pixel format agnostic, but pixel data type templated.
-        template<typename T>
-        void process(T * const dataWrite, T const * const dataRead,
-                     const size_t width, const size_t height)
-        {
-            const size_t halfWindowSize=windowSize_>>1;
-            const size_t widthMinusWindowSize=width - windowSize_;
-            const size_t heightMinusWindowSize=height - windowSize_;
-            const double recipWindowSizeSquared=1.0f / float(windowSize_*windowSize_);
-            
-            for (size_t y=1; y<heightMinusWindowSize; ++y)
-            {
-                const size_t lineOffsetUS=y * width;
-                const size_t lineOffsetDS=(y+halfWindowSize) * width + halfWindowSize;
-                
-                for (size_t x=1; x<widthMinusWindowSize; ++x)
-                {
-                    const double windowSum=integralImageData_[(lineOffsetUS+x) + (windowSize_-1) + (windowSize_-1)*width]
-                    - integralImageData_[(lineOffsetUS+x) + (windowSize_-1) - width]
-                    - integralImageData_[(lineOffsetUS+x) - 1 + (windowSize_-1)*width]
-                    + integralImageData_[(lineOffsetUS+x) - 1 - width];
-                    
-                    const float windowAvrg=float(windowSum * recipWindowSizeSquared);
-                    
-                    const float eScale=targetAverage_ / windowAvrg;
-                    
-                    dataWrite[lineOffsetDS + x]=dataRead[lineOffsetDS + x] * eScale;
-                }
-            }
-        }
-        
-        template<typename T>
-        void processRGB(T * const dataWrite, T const * const dataRead,
-                        const size_t width, const size_t height)
-        {
-            const size_t halfWindowSize=windowSize_>>1;
-            const size_t widthMinusWindowSize=width - windowSize_;
-            const size_t heightMinusWindowSize=height - windowSize_;
-            const double recipWindowSizeSquared=1.0f / float(windowSize_*windowSize_);
-            
-            for (size_t y=1; y<heightMinusWindowSize; ++y)
-            {
-                size_t lineOffsetTL=((y-1)*width + 0) * 3;
-                size_t lineOffsetTR=((y-1)*width + windowSize_) * 3;
-                size_t lineOffsetBL=((y-1)*width + windowSize_*width) * 3;
-                size_t lineOffsetBR=((y-1)*width + windowSize_*width + windowSize_) * 3;
-                
-                size_t lineOffset=((y+halfWindowSize) * width + halfWindowSize) * 3 + 3;
-                
-                for (size_t x=1; x<widthMinusWindowSize; ++x)
-                {
-                    const double windowSumR=integralImageData_[lineOffsetBR + 0]
-                    - integralImageData_[lineOffsetBL + 0]
-                    - integralImageData_[lineOffsetTR + 0]
-                    + integralImageData_[lineOffsetTL + 0];
-                    
-                    const double windowSumG=integralImageData_[lineOffsetBR + 1]
-                    - integralImageData_[lineOffsetBL + 1]
-                    - integralImageData_[lineOffsetTR + 1]
-                    + integralImageData_[lineOffsetTL + 1];
-                    
-                    const double windowSumB=integralImageData_[lineOffsetBR + 2]
-                    - integralImageData_[lineOffsetBL + 2]
-                    - integralImageData_[lineOffsetTR + 2]
-                    + integralImageData_[lineOffsetTL + 2];
-                    
-                    const float windowAvrgR=float(windowSumR * recipWindowSizeSquared);
-                    const float windowAvrgG=float(windowSumG * recipWindowSizeSquared);
-                    const float windowAvrgB=float(windowSumB * recipWindowSizeSquared);
-                    
-                    const float eScaleR=targetAverage_ / windowAvrgR;
-                    const float eScaleG=targetAverage_ / windowAvrgG;
-                    const float eScaleB=targetAverage_ / windowAvrgB;
-                    
-                    dataWrite[lineOffset + 0]=dataRead[lineOffset + 0] * eScaleR;
-                    dataWrite[lineOffset + 1]=dataRead[lineOffset + 1] * eScaleG;
-                    dataWrite[lineOffset + 2]=dataRead[lineOffset + 2] * eScaleB;
-                    
-                    lineOffset+=3;
-                    
-                    lineOffsetTL+=3;
-                    lineOffsetTR+=3;
-                    lineOffsetBL+=3;
-                    lineOffsetBR+=3;
-                }
-            }
-        }
-        
         float targetAverage_;
         const size_t windowSize_;
         std::string Title_;
 
-        IntegralImage integralImage_;
-        double *integralImageData_;
+        PhotometricEqualisation equalisation_;
     };
     
 }
@@ -0,0 +1,159 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_RESIZE_H
+#define FIP_RESIZE_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+
+#include <atomic>
+
+namespace flitr {
+    
+    /*! Resizes images to a fixed downstream size with nearest neighbour, bilinear, area or Lanczos-3 interpolation.
+     *  Supports all concrete pixel formats; the downstream pixel format is the upstream pixel format. The bilinear, area
+     *  and Lanczos filters are widened when reducing, so that they also act as anti-aliasing filters.
+     *@sa ImageResize*/
+    class FLITR_EXPORT FIPResize : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param widthDS The width of the downstream images.
+         *@param heightDS The height of the downstream images.
+         *@param method The interpolation method.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPResize(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                  const uint32_t widthDS, const uint32_t heightDS,
+                  const ImageResize::Method method=ImageResize::Method::BILINEAR,
+                  uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPResize();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!Set the interpolation method. This method is thread safe.
+        void setMethod(const ImageResize::Method method)
+        {
+            method_=method;
+        }
+        
+        ImageResize::Method getMethod() const
+        {
+            return method_;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 1;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_ENUM;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Method");
+            }
+            return std::string("???");
+        }
+        
+        virtual int getEnum(int id)
+        {
+            switch (id)
+            {
+                case 0 : return int(getMethod());
+            }
+            
+            return 0;
+        }
+        
+        virtual std::string getEnumText(int id, int v)
+        {
+            if (id==0)
+            {
+                switch (v)
+                {
+                    case int(ImageResize::Method::NEAREST) : return std::string("Nearest");
+                    case int(ImageResize::Method::BILINEAR) : return std::string("Bilinear");
+                    case int(ImageResize::Method::AREA) : return std::string("Area");
+                    case int(ImageResize::Method::LANCZOS3) : return std::string("Lanczos-3");
+                }
+            }
+            
+            return std::string("???");
+        }
+        
+        virtual bool getEnumRange(int id, int &low, int &high)
+        {
+            if (id==0)
+            {
+                low=int(ImageResize::Method::NEAREST); high=int(ImageResize::Method::LANCZOS3);
+                return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setEnum(int id, int v)
+        {
+            if ((id==0) && (v>=int(ImageResize::Method::NEAREST)) && (v<=int(ImageResize::Method::LANCZOS3)))
+            {
+                setMethod(ImageResize::Method(v));
+                return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<ImageResize::Method> method_;
+        
+        std::vector<ImageResize> imageResizeVec_;
+    };
+    
+}
+
+#endif //FIP_RESIZE_H
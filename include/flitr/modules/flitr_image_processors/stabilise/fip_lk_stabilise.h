@@ -22,7 +22,9 @@
 #define FIP_LK_STABILISE_H 1
 
 #include <flitr/image_processor.h>
+#include <flitr/modules/flitr_image_processors/image_pyramid/fip_image_pyramid.h>
 #include <mutex>
+#include <vector>
 
 namespace flitr {
 
@@ -42,6 +44,16 @@ public:
                    Mode outputMode,
                    uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
 
+    /*! Constructor given an upstream FIPImagePyramid. The coarser levels of the scale space are copied from the pyramid
+         *  levels instead of being filtered again. Levels beyond the pyramid's levels are still built here.
+         *@param upStreamPyramid The upstream pyramid. Level 0 of the first pyramid is stabilised.
+         *@param images_per_slot The number of pyramids per image slot, i.e. the number of images upstream of the pyramid.
+         *@param Mode Mode of transform applied to the output image.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+    FIPLKStabilise(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                   Mode outputMode,
+                   uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+
     /*! Virtual destructor */
     virtual ~FIPLKStabilise();
 
@@ -64,6 +76,27 @@ public:
         frameNumber=latestHFrameNumber_;//frameNumber_;
     }
 
+    /*! Get the h-vector that was calculated for the image with the given frame number, as counted by getFrameNumber().
+         *  The h-vectors of the latest HVectHistorySize images are kept.
+         *@return False if the h-vector of the image was not calculated yet or is no longer kept.*/
+    virtual bool getHVect(const size_t frameNumber, float &hx, float &hy) const
+    {
+        std::lock_guard<std::mutex> scopedLock(latestHMutex_);
+
+        const HVect &hVect=hVectHistory_[frameNumber % HVectHistorySize];
+        if (hVect.frameNumber!=frameNumber)
+        {
+            return false;
+        }
+
+        hx=hVect.hx;
+        hy=hVect.hy;
+        return true;
+    }
+
+    //!The number of images for which getHVect(const size_t, float&, float&) keeps the h-vector.
+    static const size_t HVectHistorySize=32;
+
     /*! Burns/filters the output image transform.
          *@param fx Factor [0..1] by which to reduce the output image transform in x.
          *@param fy Factor [0..1] by which to reduce the output image transform in y.
@@ -80,6 +113,34 @@ public:
         fy=burnFy_;
     }
 
+    /*! Set the Newton-Raphson convergence threshold. The iterations on a pyramid level stop early once both components of the
+         *  h-vector update are smaller than this, in pixels of that level.
+         *@param threshold The threshold in pixels. Zero always runs all the iterations.*/
+    virtual void setConvergenceThreshold(const float threshold)
+    {
+        std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+        convergenceThreshold_=threshold;
+    }
+
+    virtual float getConvergenceThreshold() const
+    {
+        return convergenceThreshold_;
+    }
+
+    /*! Estimate the h-vector from a sparse grid of high-gradient pixels instead of every pixel. The pixel with the strongest gradient in
+         *  each cell of cellSize x cellSize pixels is used. Coarse levels with fewer than 256 cells are still estimated densely.
+         *@param cellSize The cell size in pixels. Zero (the default) uses every pixel.*/
+    virtual void setSparseCellSize(const size_t cellSize)
+    {
+        std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+        sparseCellSize_=cellSize;
+    }
+
+    virtual size_t getSparseCellSize() const
+    {
+        return sparseCellSize_;
+    }
+
     virtual std::string getTitle() {
         return Title_;
     }
@@ -99,12 +160,21 @@ private:
     std::vector<float *> imgVec_;
     std::vector<float *> refImgVec_;
 
+    //Gradients divided by the squared gradient magnitude, zero where the gradient is too small to use.
     std::vector<float *> dxVec_;
     std::vector<float *> dyVec_;
-    std::vector<float *> dSqRecipVec_;
+    //1.0f where the gradient is large enough to use, else 0.0f.
+    std::vector<float *> gradientMaskVec_;
+
+    //Pixel coordinates of the sparse grid per level. Empty for levels estimated densely.
+    std::vector<std::vector<int32_t> > sparseXVec_;
+    std::vector<std::vector<int32_t> > sparseYVec_;
 
     float *scratchData_;
 
+    //The upstream pyramid, or nullptr if the upstream images are not pyramid levels.
+    FIPImagePyramid const *upStreamPyramid_;
+
     Mode outputMode_;
 
     mutable std::mutex latestHMutex_;
@@ -112,10 +182,22 @@ private:
     float latestHy_;
     size_t latestHFrameNumber_;
 
+    struct HVect
+    {
+        size_t frameNumber;
+        float hx;
+        float hy;
+    };
+    //!The latest h-vectors, indexed by frame number modulo HVectHistorySize.
+    std::vector<HVect> hVectHistory_;
+
     float sumHx_;
     float sumHy_;
     float burnFx_;
     float burnFy_;
+
+    float convergenceThreshold_;
+    size_t sparseCellSize_;
 };
 
 }
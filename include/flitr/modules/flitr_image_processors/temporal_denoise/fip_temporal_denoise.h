@@ -0,0 +1,216 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIP_TEMPORAL_DENOISE_H
+#define FIP_TEMPORAL_DENOISE_H 1
+
+#include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
+#include <flitr/modules/flitr_image_processors/stabilise/fip_lk_stabilise.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace flitr {
+    
+    /*! Motion adaptive recursive temporal noise reduction. Supports Y_8, RGB_8, Y_F32 and RGB_F32 input.
+     *
+     * Each pixel keeps one recursive accumulator: 8.8 fixed point for 8-bit data and float for float data. The new frame is
+     * blended into the accumulator with a per pixel weight that follows the absolute difference between the frame and the
+     * accumulator, as in FIPMotionDetect: differences within the noise level get the still weight, differences above
+     * motionThreshold times the noise level take the new frame, and the weight ramps linearly in between. The blend is one
+     * branch free, vectorised pass over the image in parallel row bands.
+     *
+     * If a FIPLKStabilise is set as the global motion source, the accumulator is moved by the h-vector that it calculated
+     * for the same frame number before each new frame is blended in. The move is rounded to whole pixels so that the
+     * accumulator is not blurred, and the sub-pixel remainder is carried to the next frame. Pixels that move in from
+     * outside the image restart from the new frame.*/
+    class FLITR_EXPORT FIPTemporalDenoise : public ImageProcessor
+    {
+    public:
+        
+        /*! Constructor given the upstream producer.
+         *@param upStreamProducer The upstream image producer.
+         *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param noiseLevel The noise level in 8-bit grey levels. Float data is taken to be in [0,1].
+         *@param motionThreshold The difference, as a multiple of the noise level, above which a pixel takes the new frame.
+         *@param stillWeight The weight of the new frame on still pixels in (0,1]. Smaller values average more frames.
+         *@param buffer_size The size of the shared image buffer of the downstream producer.*/
+        FIPTemporalDenoise(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                           const float noiseLevel=4.0f, const float motionThreshold=3.0f, const float stillWeight=0.125f,
+                           uint32_t buffer_size=FLITR_DEFAULT_SHARED_BUFFER_NUM_SLOTS);
+        
+        /*! Virtual destructor */
+        virtual ~FIPTemporalDenoise();
+        
+        /*! Method to initialise the object.
+         *@return Boolean result flag. True indicates successful initialisation.*/
+        virtual bool init();
+        
+        /*!Synchronous trigger method. Called automatically by the trigger thread in ImageProcessor base class if started.
+         *@sa ImageProcessor::startTriggerThread*/
+        virtual bool trigger();
+        
+        //!Set the noise level in 8-bit grey levels. This method is thread safe.
+        void setNoiseLevel(const float noiseLevel)
+        {
+            noiseLevel_=std::max<float>(noiseLevel, 0.0f);
+        }
+        
+        float getNoiseLevel() const
+        {
+            return noiseLevel_;
+        }
+        
+        //!Set the difference, as a multiple of the noise level, above which a pixel takes the new frame. This method is thread safe.
+        void setMotionThreshold(const float motionThreshold)
+        {
+            motionThreshold_=std::max<float>(motionThreshold, 1.0f);
+        }
+        
+        float getMotionThreshold() const
+        {
+            return motionThreshold_;
+        }
+        
+        //!Set the weight of the new frame on still pixels. This method is thread safe.
+        void setStillWeight(const float stillWeight)
+        {
+            stillWeight_=std::min<float>(std::max<float>(stillWeight, 1.0f/256.0f), 1.0f);
+        }
+        
+        float getStillWeight() const
+        {
+            return stillWeight_;
+        }
+        
+        /*!Set the processor whose h-vectors are used to move the accumulator with the global motion. The h-vectors are
+         * matched by frame number (FIPLKStabilise::getHVect), so both processors must consume the same image sequence from
+         * its first image, and the source must have processed a frame before this processor's trigger to compensate it.
+         * Set to nullptr to disable global motion compensation. This method is thread safe.*/
+        void setGlobalMotionSource(std::shared_ptr<FIPLKStabilise> globalMotionSource)
+        {
+            std::lock_guard<std::mutex> scopedLock(globalMotionSourceMutex_);
+            globalMotionSource_=globalMotionSource;
+        }
+        
+        //!Restart the accumulators from the next frame. This method is thread safe.
+        void reset()
+        {
+            resetRequested_=true;
+        }
+        
+        virtual std::string getTitle()
+        {
+            return title_;
+        }
+        
+        virtual int getNumberOfParms()
+        {
+            return 3;
+        }
+        
+        virtual flitr::Parameters::EParmType getParmType(int id)
+        {
+            switch (id)
+            {
+                case 0: return flitr::Parameters::PARM_FLOAT;
+                case 1: return flitr::Parameters::PARM_FLOAT;
+                case 2: return flitr::Parameters::PARM_FLOAT;
+            }
+            return flitr::Parameters::PARM_UNDF;
+        }
+        
+        virtual std::string getParmName(int id)
+        {
+            switch (id)
+            {
+                case 0 :return std::string("Noise Level");
+                case 1 :return std::string("Motion Threshold");
+                case 2 :return std::string("Still Weight");
+            }
+            return std::string("???");
+        }
+        
+        virtual float getFloat(int id)
+        {
+            switch (id)
+            {
+                case 0 : return getNoiseLevel();
+                case 1 : return getMotionThreshold();
+                case 2 : return getStillWeight();
+            }
+            
+            return 0.0f;
+        }
+        
+        virtual bool getFloatRange(int id, float &low, float &high)
+        {
+            switch (id)
+            {
+                case 0 : low=0.0f; high=32.0f; return true;
+                case 1 : low=1.0f; high=10.0f; return true;
+                case 2 : low=1.0f/256.0f; high=1.0f; return true;
+            }
+            
+            return false;
+        }
+        
+        virtual bool setFloat(int id, float v)
+        {
+            switch (id)
+            {
+                case 0 : setNoiseLevel(v); return true;
+                case 1 : setMotionThreshold(v); return true;
+                case 2 : setStillWeight(v); return true;
+            }
+            
+            return false;
+        }
+    
+    private:
+        std::string title_;
+        
+        std::atomic<float> noiseLevel_;
+        std::atomic<float> motionThreshold_;
+        std::atomic<float> stillWeight_;
+        std::atomic<bool> resetRequested_;
+        
+        std::mutex globalMotionSourceMutex_;
+        std::shared_ptr<FIPLKStabilise> globalMotionSource_;
+        //!Global motion that was not yet applied to the accumulators, below half a pixel.
+        float residualShiftX_;
+        float residualShiftY_;
+        
+        //!Accumulator per image in the slot, and a second one that the moved accumulator is written to.
+        std::vector<std::vector<uint16_t> > accumulator8Vec_;
+        std::vector<std::vector<uint16_t> > movedAccumulator8Vec_;
+        std::vector<std::vector<float> > accumulatorF32Vec_;
+        std::vector<std::vector<float> > movedAccumulatorF32Vec_;
+        
+        //!True for the images whose accumulators must restart from the next frame.
+        std::vector<bool> restartVec_;
+    };
+    
+}
+
+#endif //FIP_TEMPORAL_DENOISE_H
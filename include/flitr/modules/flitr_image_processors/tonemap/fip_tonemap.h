@@ -22,10 +22,14 @@
 #define FIP_TONEMAP_H 1
 
 #include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
 
 namespace flitr {
     
-    /*! Applies a power law tone mapping to the image. */
+    /*! Applies a power law tone mapping to the image. Supports Y_8, RGB_8, Y_16, Y_F32 and RGB_F32.
+     *
+     * Integer formats are mapped through exact lookup tables that are rebuilt lazily when the power changes.
+     * Float formats use a vectorised pow approximation with relative error below 1e-5.*/
     class FLITR_EXPORT FIPTonemap : public ImageProcessor
     {
     public:
@@ -33,6 +37,7 @@ namespace flitr {
         /*! Constructor given the upstream producer.
          *@param upStreamProducer The upstream image producer.
          *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param power The power law exponent.
          *@param buffer_size The size of the shared image buffer of the downstream producer.*/
         FIPTonemap(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                    float power,
@@ -49,8 +54,19 @@ namespace flitr {
          *@sa ImageProcessor::startTriggerThread*/
         virtual bool trigger();
         
+        //!Sets the power law exponent. This method is thread safe.
+        void setPower(const float power);
+        
+        //!Gets the power law exponent.
+        float getPower() const
+        {
+            return power_;
+        }
+    
     private:
         float power_;
+        
+        ToneCurveLUT toneCurve_;
     };
 }
 
@@ -22,10 +22,11 @@
 #define FIP_TRANSFORM_2D_H 1
 
 #include <flitr/image_processor.h>
+#include <flitr/image_processor_utils.h>
 
 namespace flitr {
     
-    /*! Applies a 2D matrix transform to the image. */
+    /*! Applies a 2D matrix transform about the image centre to the image. Pixels mapped from outside the upstream image are set to zero. */
     class FLITR_EXPORT FIPTransform2D : public ImageProcessor
     {
     public:
@@ -43,6 +44,7 @@ namespace flitr {
         /*! Constructor given the upstream producer.
          *@param upStreamProducer The upstream image producer.
          *@param images_per_slot The number of images per image slot from the upstream producer.
+         *@param transformVect The matrix per image that maps downstream pixel positions to upstream pixel positions.
          *@param buffer_size The size of the shared image buffer of the downstream producer.*/
         FIPTransform2D(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                        const std::vector<M2D> transformVect,
@@ -59,8 +61,20 @@ namespace flitr {
          *@sa ImageProcessor::startTriggerThread*/
         virtual bool trigger();
         
+        /*!Sets the sampling method. Bilinear sampling is supported for 8-bit, 16-bit and float pixel formats. This method is thread safe.*/
+        void setInterpolation(const AffineTransform::Interpolation interpolation);
+        
+        //!Gets the sampling method.
+        AffineTransform::Interpolation getInterpolation() const
+        {
+            return interpolation_;
+        }
+    
     private:
         std::vector<M2D> transformVect_;
+        
+        std::vector<AffineTransform> affineTransformVect_;
+        AffineTransform::Interpolation interpolation_;
     };
 }
 
@@ -24,9 +24,15 @@
 #include <flitr/image_processor_utils.h>
 #include <flitr/image_processor.h>
 
+#include <atomic>
+#include <vector>
+
 namespace flitr {
     
-    /*! Applies an unsharp mask to the image. */
+    /*! Applies an unsharp mask to the image.
+     *  Each row band keeps a ring of the horizontally filtered rows under the vertical kernel. The vertical pass
+     *  is fused with the sharpening, so no full frame intermediate images are needed. 8-bit images are filtered in
+     *  fixed point. The Gaussian is clamped at the image edges.*/
     class FLITR_EXPORT FIPUnsharpMask : public ImageProcessor
     {
     public:
@@ -56,7 +62,7 @@ namespace flitr {
         //!Gets the filter gain. This method is thread safe.
         float getGain() const;
         
-        //!Sets the filter radius. This method is thread safe.
+        //!Sets the filter radius. This method is thread safe and does not wait for trigger. The new kernel is used from the next trigger.
         virtual void setFilterRadius(const float filterRadius);
         //!Gets the filter radius. This method is thread safe.
         float getFilterRadius() const;
@@ -126,13 +132,23 @@ namespace flitr {
         }
 
     private:
-        float gain_;
+        //!Rebuild the float and fixed point half kernels if the filter radius changed since the last trigger.
+        void updateKernel(const float filterRadius);
+        
+        std::atomic<float> gain_;
+        std::atomic<float> filterRadius_;
+        
+        //Half kernels from the centre tap outwards, in float and in Q14 fixed point for the 8-bit formats.
+        float kernelRadius_;
+        std::vector<float> kernelF32_;
+        std::vector<uint16_t> kernelQ14_;
+        
+        //Per row band scratch: a ring of the horizontally filtered rows and one accumulator line.
+        std::vector<std::vector<float> > bandRowsF32_;
+        std::vector<std::vector<float> > bandAccumF32_;
+        std::vector<std::vector<uint16_t> > bandRows16_;
+        std::vector<std::vector<int32_t> > bandAccum32_;
         
-        float *xFiltData_;
-        float *filtData_;
-
-        GaussianFilter gaussianFilter_;
-
         std::string _title = "Unsharp Mask";
     };
     
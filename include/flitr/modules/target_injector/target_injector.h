@@ -24,6 +24,7 @@
 #include <flitr/image_processor.h>
 
 #include <algorithm>
+#include <vector>
 
 
 namespace flitr {
@@ -154,6 +155,19 @@ public:
             return 0.0f;
         }
 
+        /*! Gets the pixels, clipped to the image, for which getSupportDensity is non-zero. These are the pixels whose
+         *  centres lie within 4*sa of the target.
+         *@return False if there are no such pixels in the image. The box is [x0,x1) x [y0,y1).*/
+        bool getBoundingBox(const uint32_t width, const uint32_t height,
+                            int32_t &x0, int32_t &y0, int32_t &x1, int32_t &y1) const;
+        
+        /*! Multiplies (1 - getSupportDensity(x+0.5f, y+0.5f)) into the transmission of the pixels in [x0,x1) x [y0,y1).
+         *  The footprint is rasterised a row of subpixel samples at a time, without evaluating an exponential per sample.
+         *@param transmission Points at the transmission of pixel (0,0).
+         *@param stride Number of floats between consecutive rows of the transmission.*/
+        void multiplyTransmission(float * const transmission, const size_t stride,
+                                  const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1) const;
+    
     private:
         float px_, py_;
         float dx_, dy_, v_;
@@ -258,9 +272,21 @@ public:
 
 private:
 
+    //!The image is processed in square tiles so that only the tiles that targets touch are visited.
+    static const int32_t TileSize=32;
+    
     float targetBrightness_;
     std::vector<SyntheticTarget> targetVector_;
     double startTimeSec_;
+    
+    //!Product of (1 - support density) of all targets, per pixel. Only valid in the active tiles.
+    std::vector<float> transmission_;
+    
+    //!Indices of the targets that overlap each tile.
+    std::vector<std::vector<size_t> > tileTargets_;
+    
+    //!The tiles that at least one target overlaps.
+    std::vector<size_t> activeTiles_;
 };
 
 }
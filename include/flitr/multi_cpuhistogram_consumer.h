@@ -27,6 +27,7 @@
 #include <flitr/metadata_writer.h>
 
 #include <flitr/flitr_thread.h>
+#include <flitr/image_processor_utils.h>
 
 namespace flitr {
 
@@ -44,11 +45,15 @@ class MultiCPUHistogramConsumerThread : public FThread {
     bool ShouldExit_;
 };
 
+/*! Calculates the histograms of the images of every image_stride-th slot in its own thread, using ImageHistogram.
+ *  Each component of a pixel gets its own histogram. 8-bit and 16-bit values v are counted in bin (v*num_bins)>>bits and
+ *  float values are mapped onto the bins from the range set with setFloatRange, which defaults to [0,1).*/
 class FLITR_EXPORT MultiCPUHistogramConsumer : public ImageConsumer {
     friend class MultiCPUHistogramConsumerThread;
   public:
 
-    MultiCPUHistogramConsumer(ImageProducer& producer, uint32_t images_per_slot, uint32_t pixel_stride=1, uint32_t image_stride=1);
+    MultiCPUHistogramConsumer(ImageProducer& producer, uint32_t images_per_slot, uint32_t pixel_stride=1, uint32_t image_stride=1,
+                              uint32_t num_bins=256);
 
     virtual ~MultiCPUHistogramConsumer();
 
@@ -59,12 +64,32 @@ class FLITR_EXPORT MultiCPUHistogramConsumer : public ImageConsumer {
         return ImageFormat_[im_number].getWidth() * ImageFormat_[im_number].getHeight();
     }
 
-    std::vector<int32_t> getHistogram(uint32_t im_number)
+    //! Get the histogram of a component of an image. Component 0 is the only component of Y images.
+    std::vector<int32_t> getHistogram(uint32_t im_number, uint32_t component=0)
     {
         std::lock_guard<std::mutex> scopedLock(*(CalcMutexes_[im_number]));
 
         HistogramUpdatedVect_[im_number]=false;
-        return *(Histograms_[im_number]);
+        if (component>=Histograms_[im_number]->getNumComponents())
+        {
+            return std::vector<int32_t>(NumBins_, 0);
+        }
+        return Histograms_[im_number]->getHistogram(component);
+    }
+    
+    uint32_t getNumBins() const
+    {
+        return NumBins_;
+    }
+    
+    //! Set the range of float values that is mapped onto the bins.
+    void setFloatRange(const float low, const float high)
+    {
+        for (uint32_t i=0; i<ImagesPerSlot_; i++)
+        {
+            std::lock_guard<std::mutex> scopedLock(*(CalcMutexes_[i]));
+            Histograms_[i]->setRange(low, high);
+        }
     }
 
     bool isHistogramUpdated(uint32_t im_number) const
@@ -74,11 +99,24 @@ class FLITR_EXPORT MultiCPUHistogramConsumer : public ImageConsumer {
         return HistogramUpdatedVect_[im_number];
     }
 
-    static const std::vector<uint8_t> calcHistogramIdentityMap();
-    static const std::vector<int32_t> calcRefHistogramForEqualisation(uint32_t histoSum);
-    static const std::vector<uint8_t> calcHistogramMatchMap(const std::vector<int32_t> &inHisto, const std::vector<int32_t> &refHisto);
+    //! The histogram maps are also available without a consumer from ImageHistogram.
+    static const std::vector<uint8_t> calcHistogramIdentityMap()
+    {
+        return ImageHistogram::calcIdentityMap();
+    }
+    static const std::vector<int32_t> calcRefHistogramForEqualisation(uint32_t histoSum)
+    {
+        return ImageHistogram::calcRefHistogramForEqualisation(histoSum);
+    }
+    static const std::vector<uint8_t> calcHistogramMatchMap(const std::vector<int32_t> &inHisto, const std::vector<int32_t> &refHisto)
+    {
+        return ImageHistogram::calcMatchMap(inHisto, refHisto);
+    }
     static const std::vector<uint8_t> calcHistogramStretchMap(const std::vector<int32_t> &inHisto, const uint32_t histoSum,
-                                                              const double ignoreBelow=0.0, const double ignoreAbove=1.0);
+                                                              const double ignoreBelow=0.0, const double ignoreAbove=1.0)
+    {
+        return ImageHistogram::calcStretchMap(inHisto, histoSum, ignoreBelow, ignoreAbove);
+    }
 
   private:
     std::vector<ImageFormat> ImageFormat_;
@@ -86,11 +124,12 @@ class FLITR_EXPORT MultiCPUHistogramConsumer : public ImageConsumer {
     const uint32_t PixelStride_;
 
     const uint32_t ImageStride_;
+    const uint32_t NumBins_;
 
     MultiCPUHistogramConsumerThread *Thread_;
     std::vector< std::shared_ptr<std::mutex> > CalcMutexes_;
 
-    std::vector< std::shared_ptr< std::vector<int32_t> > > Histograms_;
+    std::vector< std::shared_ptr<ImageHistogram> > Histograms_;
     std::vector<bool> HistogramUpdatedVect_;
 
 };
@@ -150,6 +150,13 @@ class FLITR_EXPORT SharedImageBuffer {
      */
     virtual uint32_t getLeastNumReadSlotsAvailable();
 
+    /** 
+     * Check whether all consumers accept images with non-contiguous rows.
+     * 
+     * \return True if ImageConsumer::acceptsStridedImages() is true for all consumers.
+     */
+    virtual bool allConsumersAcceptStridedImages();
+
     
     
 //=== Start of the Consumer Methods ===//
@@ -26,10 +26,25 @@
 #include <flitr/image_processor_utils.h>
 #include <sstream>
 
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
 using namespace flitr;
 using std::shared_ptr;
 
 
+size_t flitr::getNumRowBands(const size_t height)
+{
+#ifdef USE_OPENMP
+    const size_t numThreads=size_t(omp_get_max_threads());
+#else
+    const size_t numThreads=1;
+#endif
+    return std::max<size_t>(1, std::min(numThreads, height));
+}
+
+
 //=========== BoxFilter ==========//
 
 BoxFilter::BoxFilter(const size_t kernelWidth) :
@@ -800,28 +815,33 @@ void GaussianFilter::updateKernel1D()
     
     kernel1D_=new float[kernelWidth_];
     
-    const float kernelCentre=kernelWidth_ * 0.5f;
-    const float sigma=filterRadius_ * 0.5f;
+    computeKernel1D(kernel1D_, filterRadius_, kernelWidth_);
+}
+
+void GaussianFilter::computeKernel1D(float * const kernel1D, const float filterRadius, const size_t kernelWidth)
+{
+    const float kernelCentre=kernelWidth * 0.5f;
+    const float sigma=filterRadius * 0.5f;
     
     const float twoSigmaSquared=2.0f * (sigma*sigma);
     const float stdNorm=1.0f / (sqrt(2.0f*float(M_PI))*sigma);
     
     float kernelSum=0.0f;
     
-    for (size_t i=0; i<kernelWidth_; ++i)
+    for (size_t i=0; i<kernelWidth; ++i)
     {
         const float r=(i + 0.5f) - kernelCentre;
         const float g=stdNorm * exp(-(r*r)/twoSigmaSquared);
-        kernel1D_[i]=g;
+        kernel1D[i]=g;
         kernelSum+=g;
     }
     
     const float recipKernelSum=1.0f / kernelSum;
     
     //=== Ensure that the kernel is normalised within the specified kernel width!
-    for (size_t i=0; i<kernelWidth_; ++i)
+    for (size_t i=0; i<kernelWidth; ++i)
     {
-        kernel1D_[i] *= recipKernelSum;
+        kernel1D[i] *= recipKernelSum;
     }
 }
 
@@ -853,41 +873,51 @@ bool GaussianFilter::filter(float * const dataWriteDS, float const * const dataR
     const size_t halfKernelWidth=(kernelWidth_>>1);
     const size_t widthMinusHalfKernel=width-halfKernelWidth;
     
-    for (size_t y=0; y<height; ++y)
+    //Both passes loop over the kernel taps on the outside and over x on the inside, so that the inner loops are
+    //contiguous and vectorise. The taps are still summed in the same order for each pixel.
+    int64_t y=0;
+#pragma omp parallel for
+    for (y=0; y<int64_t(height); ++y)
     {
-        const size_t lineOffsetFS=y * width + halfKernelWidth;
-        const size_t lineOffsetUS=y * width;
+        float * const lineFS=dataScratch + (y * width + halfKernelWidth);
+        float const * const lineUS=dataReadUS + y * width;
         
         for (size_t x=0; x<widthMinusKernel; ++x)
         {
-            float xFiltValue=0.0f;
+            lineFS[x]=lineUS[x] * kernel1D_[0];
+        }
+        
+        for (size_t j=1; j<kernelWidth; ++j)
+        {
+            const float kernelValue=kernel1D_[j];
             
-            for (size_t j=0; j<kernelWidth; ++j)
+            for (size_t x=0; x<widthMinusKernel; ++x)
             {
-                xFiltValue += dataReadUS[(lineOffsetUS + x) + j] * kernel1D_[j];
+                lineFS[x] += lineUS[x + j] * kernelValue;
             }
-            
-            dataScratch[lineOffsetFS + x]=xFiltValue;
         }
     }
     
-    for (size_t y=0; y<heightMinusKernel; ++y)
+#pragma omp parallel for
+    for (y=0; y<int64_t(heightMinusKernel); ++y)
     {
-        const size_t lineOffsetDS=(y + halfKernelWidth) * width;
-        const size_t lineOffsetFS=y * width;
+        float * const lineDS=dataWriteDS + (y + halfKernelWidth) * width;
+        float const * const lineFS=dataScratch + y * width;
         
         for (size_t x=halfKernelWidth; x<widthMinusHalfKernel; ++x)
         {
-            float filtValue=0.0f;
+            lineDS[x]=lineFS[x] * kernel1D_[0];
+        }
+        
+        for (size_t j=1; j<kernelWidth; ++j)
+        {
+            const float kernelValue=kernel1D_[j];
+            float const * const lineFSj=lineFS + j*width;
             
-            for (size_t j=0; j<kernelWidth; ++j)
+            for (size_t x=halfKernelWidth; x<widthMinusHalfKernel; ++x)
             {
-                filtValue += dataScratch[(lineOffsetFS + x) + j*width] * kernel1D_[j];
-                //Performance note: The XCode profiler shows that the above multiply by width has little performance overhead compared to the loop in x above.
-                //                  Is the code memory bandwidth limited?
+                lineDS[x] += lineFSj[x] * kernelValue;
             }
-            
-            dataWriteDS[lineOffsetDS + x]=filtValue;
         }
     }
     
@@ -1153,7 +1183,9 @@ bool GaussianDownsample::downsample(float * const dataWriteUS, float const * con
     
     const size_t halfKernelWidth=(kernelWidth_>>1);//kernelWidth_ is even!
     
-    for (size_t y=0; y<heightUS; ++y)
+    int64_t y=0;
+#pragma omp parallel for
+    for (y=0; y<int64_t(heightUS); ++y)
     {
         const size_t lineOffsetFS=y * widthDS + (halfKernelWidth>>1);
         const size_t lineOffsetUS=y * widthUS;
@@ -1171,7 +1203,8 @@ bool GaussianDownsample::downsample(float * const dataWriteUS, float const * con
         }
     }
     
-    for (size_t y=0; y<heightUSMinusKernel; y+=2)
+#pragma omp parallel for
+    for (y=0; y<int64_t(heightUSMinusKernel); y+=2)
     {
         const size_t lineOffsetDS=((y>>1) + (halfKernelWidth>>1)) * widthDS;
         const size_t lineOffsetFS=y * widthDS;
@@ -1197,3 +1230,4034 @@ bool GaussianDownsample::downsample(float * const dataWriteUS, float const * con
 
 
 
+//=========== MedianFilter ==========//
+
+MedianFilter::MedianFilter(const size_t kernelWidth) :
+kernelWidth_(std::min<size_t>(kernelWidth|1, 255))//Make sure the kernel width is odd and that the histogram counts fit in 16 bits.
+{}
+
+MedianFilter::~MedianFilter() {}
+
+void MedianFilter::setKernelWidth(const int kernelWidth)
+{
+    kernelWidth_=std::min<size_t>(size_t(kernelWidth)|1, 255);
+}
+
+namespace
+{
+    inline int32_t clampIndex(const int32_t i, const int32_t size)
+    {
+        return (i<0) ? 0 : ((i>=size) ? (size-1) : i);
+    }
+    
+    //!Add the 16 bins of histogram binsIn and subtract those of binsOut. Written so that the compiler emits one SIMD add/sub.
+    inline void slideHistogram16(uint16_t * __restrict dst, uint16_t const * __restrict binsIn, uint16_t const * __restrict binsOut)
+    {
+        for (int32_t b=0; b<16; ++b) dst[b]=uint16_t(dst[b] + binsIn[b] - binsOut[b]);
+    }
+    
+    inline void addHistogram16(uint16_t * __restrict dst, uint16_t const * __restrict bins)
+    {
+        for (int32_t b=0; b<16; ++b) dst[b]=uint16_t(dst[b] + bins[b]);
+    }
+}
+
+template<size_t C>
+bool MedianFilter::filterHistogram8(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                                    const size_t width, const size_t height)
+{
+    const int32_t w=int32_t(width);
+    const int32_t h=int32_t(height);
+    const int32_t r=int32_t(kernelWidth_>>1);
+    const int32_t medianRank=int32_t(kernelWidth_*kernelWidth_)>>1;
+    
+    //Each band is processed in vertical stripes so that its column histograms stay in the L2 cache.
+    // A column holds 16 coarse and 256 fine histogram bins.
+    const int32_t stripeWidth=std::min(w, 256);
+    const int32_t stripeColumns=std::min(w, stripeWidth + 2*r + 1);
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandScratchSize=size_t(stripeColumns) * (16 + 256);
+    
+    if (bandScratch_.size()<numBands) bandScratch_.resize(numBands);
+    for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+    {
+        if (bandScratch_[bandNum].size()<bandScratchSize) bandScratch_[bandNum].resize(bandScratchSize);
+    }
+    
+    const int32_t bandHeight=int32_t((height + numBands - 1) / numBands);
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const int32_t yStart=bandNum * bandHeight;
+        const int32_t yEnd=std::min(yStart + bandHeight, h);
+        
+        uint16_t * const colCoarse=bandScratch_[bandNum].data();
+        uint16_t * const colFine=colCoarse + stripeColumns*16;
+        
+        uint16_t kernCoarse[16];
+        uint16_t kernFine[256];
+        int32_t lastUpdatedColumn[16];
+        
+        for (int32_t xStart=0; xStart<w; xStart+=stripeWidth)
+        {
+            const int32_t xEnd=std::min(xStart + stripeWidth, w);
+            
+            //Range of image columns with histograms in this stripe and the column index mapping into it.
+            const int32_t colStart=std::max(0, xStart - r);
+            const int32_t colEnd=std::min(w, xEnd + r);
+            auto col=[&](const int32_t x) { return clampIndex(x, w) - colStart; };
+            
+            for (size_t c=0; c<C; ++c)
+            {
+                memset(colCoarse, 0, size_t(colEnd - colStart)*16*sizeof(uint16_t));
+                memset(colFine, 0, size_t(colEnd - colStart)*256*sizeof(uint16_t));
+                
+                //Column histograms for the first row of the band.
+                for (int32_t dy=-r; dy<=r; ++dy)
+                {
+                    uint8_t const * const lineRead=dataReadUS + clampIndex(yStart+dy, h)*w*C + c;
+                    
+                    for (int32_t x=colStart; x<colEnd; ++x)
+                    {
+                        const uint8_t v=lineRead[x*C];
+                        ++colCoarse[(x-colStart)*16 + (v>>4)];
+                        ++colFine[(x-colStart)*256 + v];
+                    }
+                }
+                
+                for (int32_t y=yStart; y<yEnd; ++y)
+                {
+                    if (y>yStart)
+                    {//Slide the column histograms down by one row.
+                        uint8_t const * const lineOut=dataReadUS + clampIndex(y-r-1, h)*w*C + c;
+                        uint8_t const * const lineIn=dataReadUS + clampIndex(y+r, h)*w*C + c;
+                        
+                        for (int32_t x=colStart; x<colEnd; ++x)
+                        {
+                            const uint8_t vOut=lineOut[x*C];
+                            const uint8_t vIn=lineIn[x*C];
+                            --colCoarse[(x-colStart)*16 + (vOut>>4)];
+                            --colFine[(x-colStart)*256 + vOut];
+                            ++colCoarse[(x-colStart)*16 + (vIn>>4)];
+                            ++colFine[(x-colStart)*256 + vIn];
+                        }
+                    }
+                    
+                    //Coarse kernel histogram of the first pixel in the stripe. The fine kernel histograms are updated lazily.
+                    memset(kernCoarse, 0, sizeof(kernCoarse));
+                    for (int32_t i=xStart-r; i<=xStart+r; ++i)
+                    {
+                        addHistogram16(kernCoarse, colCoarse + col(i)*16);
+                    }
+                    for (int32_t b=0; b<16; ++b) lastUpdatedColumn[b]=xStart-(2*r+2);
+                    
+                    uint8_t * const lineWrite=dataWriteDS + y*w*C + c;
+                    
+                    for (int32_t x=xStart; x<xEnd; ++x)
+                    {
+                        if (x>xStart)
+                        {
+                            slideHistogram16(kernCoarse, colCoarse + col(x+r)*16, colCoarse + col(x-r-1)*16);
+                        }
+                        
+                        //Find the coarse bin holding the median.
+                        int32_t sum=0;
+                        int32_t coarseBin=0;
+                        while ((sum + kernCoarse[coarseBin])<=medianRank)
+                        {
+                            sum+=kernCoarse[coarseBin];
+                            ++coarseBin;
+                        }
+                        
+                        //Bring the fine kernel histogram of the coarse bin up to date.
+                        uint16_t * const kf=kernFine + coarseBin*16;
+                        const int32_t fineOffset=coarseBin*16;
+                        
+                        if ((x - lastUpdatedColumn[coarseBin]) > (2*r+1))
+                        {
+                            memset(kf, 0, 16*sizeof(uint16_t));
+                            for (int32_t i=x-r; i<=x+r; ++i)
+                            {
+                                addHistogram16(kf, colFine + col(i)*256 + fineOffset);
+                            }
+                        } else
+                        {
+                            for (int32_t i=lastUpdatedColumn[coarseBin]+1; i<=x; ++i)
+                            {
+                                slideHistogram16(kf, colFine + col(i+r)*256 + fineOffset, colFine + col(i-r-1)*256 + fineOffset);
+                            }
+                        }
+                        lastUpdatedColumn[coarseBin]=x;
+                        
+                        int32_t fineBin=0;
+                        while ((sum + kf[fineBin])<=medianRank)
+                        {
+                            sum+=kf[fineBin];
+                            ++fineBin;
+                        }
+                        
+                        lineWrite[x*C]=uint8_t(fineOffset + fineBin);
+                    }
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool MedianFilter::filter(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                          const size_t width, const size_t height)
+{
+    return filterHistogram8<1>(dataWriteDS, dataReadUS, width, height);
+}
+
+bool MedianFilter::filterRGB(uint8_t * const dataWriteDS, uint8_t const * const dataReadUS,
+                             const size_t width, const size_t height)
+{
+    return filterHistogram8<3>(dataWriteDS, dataReadUS, width, height);
+}
+
+bool MedianFilter::filter(uint16_t * const dataWriteDS, uint16_t const * const dataReadUS,
+                          const size_t width, const size_t height)
+{
+    const int32_t w=int32_t(width);
+    const int32_t h=int32_t(height);
+    const int32_t r=int32_t(kernelWidth_>>1);
+    const int32_t medianRank=int32_t(kernelWidth_*kernelWidth_)>>1;
+    
+    //Each band holds a 256 bin coarse and a 65536 bin fine kernel histogram.
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandScratchSize=256 + 65536;
+    
+    if (bandScratch_.size()<numBands) bandScratch_.resize(numBands);
+    for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+    {
+        if (bandScratch_[bandNum].size()<bandScratchSize) bandScratch_[bandNum].resize(bandScratchSize);
+    }
+    
+    const int32_t bandHeight=int32_t((height + numBands - 1) / numBands);
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const int32_t yStart=bandNum * bandHeight;
+        const int32_t yEnd=std::min(yStart + bandHeight, h);
+        
+        uint16_t * const coarse=bandScratch_[bandNum].data();
+        uint16_t * const fine=coarse + 256;
+        memset(coarse, 0, bandScratchSize*sizeof(uint16_t));
+        
+        //The current median estimate and the number of window values below it.
+        int32_t median=0;
+        int32_t numBelow=0;
+        
+        auto addValue=[&](const uint16_t v)
+        {
+            ++fine[v];
+            ++coarse[v>>8];
+            if (v<median) ++numBelow;
+        };
+        
+        auto removeValue=[&](const uint16_t v)
+        {
+            --fine[v];
+            --coarse[v>>8];
+            if (v<median) --numBelow;
+        };
+        
+        auto updateMedian=[&]()
+        {
+            while ((numBelow + fine[median])<=medianRank)
+            {//Move up, skipping whole coarse bins where possible.
+                if (((median&255)==0) && ((numBelow + coarse[median>>8])<=medianRank))
+                {
+                    numBelow+=coarse[median>>8];
+                    median+=256;
+                } else
+                {
+                    numBelow+=fine[median];
+                    ++median;
+                }
+            }
+            
+            while (numBelow>medianRank)
+            {//Move down, skipping whole coarse bins where possible.
+                --median;
+                if (((median&255)==255) && ((numBelow - coarse[median>>8])>medianRank))
+                {
+                    numBelow-=coarse[median>>8];
+                    median-=255;
+                } else
+                {
+                    numBelow-=fine[median];
+                }
+            }
+        };
+        
+        auto pixel=[&](const int32_t x, const int32_t y)
+        {
+            return dataReadUS[clampIndex(y, h)*w + clampIndex(x, w)];
+        };
+        
+        //Window of the first pixel of the band.
+        for (int32_t dy=-r; dy<=r; ++dy)
+        {
+            for (int32_t dx=-r; dx<=r; ++dx)
+            {
+                addValue(pixel(dx, yStart+dy));
+            }
+        }
+        updateMedian();
+        
+        int32_t x=0;
+        for (int32_t y=yStart; y<yEnd; ++y)
+        {
+            const bool leftToRight=((y-yStart)&1)==0;
+            
+            if (y>yStart)
+            {//Move the window down by one row.
+                for (int32_t dx=-r; dx<=r; ++dx)
+                {
+                    removeValue(pixel(x+dx, y-r-1));
+                    addValue(pixel(x+dx, y+r));
+                }
+                updateMedian();
+            }
+            
+            const int32_t step=leftToRight ? 1 : -1;
+            
+            for (int32_t i=0; i<w; ++i)
+            {
+                if (i>0)
+                {//Move the window horizontally by one column.
+                    const int32_t xOut=(leftToRight) ? (x-r) : (x+r);
+                    x+=step;
+                    const int32_t xIn=(leftToRight) ? (x+r) : (x-r);
+                    
+                    for (int32_t dy=-r; dy<=r; ++dy)
+                    {
+                        removeValue(pixel(xOut, y+dy));
+                        addValue(pixel(xIn, y+dy));
+                    }
+                    updateMedian();
+                }
+                
+                dataWriteDS[y*w + x]=uint16_t(median);
+            }
+        }
+    }
+    
+    return true;
+}
+//=========================================//
+
+
+
+//=========== ToneCurveLUT ==========//
+
+ToneCurveLUT::ToneCurveLUT(CurveFunction curve) :
+curve_(curve),
+lut8Dirty_(true),
+lut16Dirty_(true)
+{
+}
+
+void ToneCurveLUT::setCurve(CurveFunction curve)
+{
+    curve_=curve;
+    lut8Dirty_=true;
+    lut16Dirty_=true;
+}
+
+template<typename T>
+void ToneCurveLUT::updateLUT(std::vector<T> &lut)
+{
+    const size_t maxValue=std::numeric_limits<T>::max();
+    const float maxValueF=float(maxValue);
+    
+    lut.resize(maxValue + 1);
+    
+    for (size_t i=0; i<=maxValue; ++i)
+    {
+        const float x=float(i) / maxValueF;
+        const float fx=curve_ ? curve_(x) : x;
+        
+        lut[i]=T(std::min(std::max(fx, 0.0f), 1.0f) * maxValueF + 0.5f);
+    }
+}
+
+void ToneCurveLUT::filter(uint8_t * const dataWrite, uint8_t const * const dataRead, const size_t numComponents)
+{
+    if (lut8Dirty_)
+    {
+        updateLUT(lut8_);
+        lut8Dirty_=false;
+    }
+    
+    uint8_t const * const lut=lut8_.data();
+    
+    int64_t i=0;
+#pragma omp parallel for
+    for (i=0; i<int64_t(numComponents); ++i)
+    {
+        dataWrite[i]=lut[dataRead[i]];
+    }
+}
+
+void ToneCurveLUT::filter(uint16_t * const dataWrite, uint16_t const * const dataRead, const size_t numComponents)
+{
+    if (lut16Dirty_)
+    {
+        updateLUT(lut16_);
+        lut16Dirty_=false;
+    }
+    
+    uint16_t const * const lut=lut16_.data();
+    
+    int64_t i=0;
+#pragma omp parallel for
+    for (i=0; i<int64_t(numComponents); ++i)
+    {
+        dataWrite[i]=lut[dataRead[i]];
+    }
+}
+
+void ToneCurveLUT::filter(float * const dataWrite, float const * const dataRead, const size_t numComponents) const
+{
+    if (!curve_)
+    {
+        if (dataWrite!=dataRead) memcpy(dataWrite, dataRead, numComponents * sizeof(float));
+        return;
+    }
+    
+    int64_t i=0;
+#pragma omp parallel for
+    for (i=0; i<int64_t(numComponents); ++i)
+    {
+        dataWrite[i]=curve_(dataRead[i]);
+    }
+}
+
+void ToneCurveLUT::power(float * const dataWrite, float const * const dataRead, const size_t numComponents, const float power)
+{
+    const float minNormal=std::numeric_limits<float>::min();
+    
+    int64_t i=0;
+#pragma omp parallel for
+    for (i=0; i<int64_t(numComponents); ++i)
+    {
+        const float x=dataRead[i];
+        const float p=approxExp2(power * approxLog2(std::max(x, minNormal)));
+        
+        dataWrite[i]=(x > 0.0f) ? p : 0.0f;
+    }
+}
+
+ToneCurveLUT::CurveFunction ToneCurveLUT::powerCurve(const float power)
+{
+    return [power](float x) { return powf(x, power); };
+}
+
+ToneCurveLUT::CurveFunction ToneCurveLUT::gainCurve(const float gain, const float offset)
+{
+    return [gain, offset](float x) { return std::min(std::max(gain*x + offset, 0.0f), 1.0f); };
+}
+
+ToneCurveLUT::CurveFunction ToneCurveLUT::sigmoidCurve(const float slope, const float centre)
+{
+    return [slope, centre](float x) { return 1.0f / (1.0f + expf(-slope*(x - centre))); };
+}
+//=========================================//
+
+
+
+//=========== AffineTransform ==========//
+namespace
+{
+    //!Source coordinates are stepped in 32.32 fixed point, so the accumulated stepping error stays far below a pixel.
+    const double affineFixedPointOne=4294967296.0;
+    
+    inline int64_t toAffineFixedPoint(const double v)
+    {
+        return int64_t(floor(v * affineFixedPointOne + 0.5));
+    }
+    
+    //!Copy n pixels of N bytes, reading the source from right to left.
+    template<size_t N>
+    void copyPixelsReversed(uint8_t * __restrict dst, uint8_t const * __restrict src, const size_t n)
+    {
+        for (size_t i=0; i<n; ++i)
+        {
+            memcpy(dst + i*N, src - i*N, N);
+        }
+    }
+    
+    void copyPixelsReversed(uint8_t * const dst, uint8_t const * const src, const size_t n, const size_t bytesPerPixel)
+    {
+        switch (bytesPerPixel)
+        {
+            case 1: copyPixelsReversed<1>(dst, src, n); break;
+            case 2: copyPixelsReversed<2>(dst, src, n); break;
+            case 3: copyPixelsReversed<3>(dst, src, n); break;
+            case 4: copyPixelsReversed<4>(dst, src, n); break;
+            case 6: copyPixelsReversed<6>(dst, src, n); break;
+            case 8: copyPixelsReversed<8>(dst, src, n); break;
+            case 12: copyPixelsReversed<12>(dst, src, n); break;
+            case 16: copyPixelsReversed<16>(dst, src, n); break;
+            default:
+                for (size_t i=0; i<n; ++i)
+                {
+                    memcpy(dst + i*bytesPerPixel, src - i*bytesPerPixel, bytesPerPixel);
+                }
+                break;
+        }
+    }
+    
+    //!Nearest neighbour sampling of one destination row. sFP and tFP already include the +0.5 rounding offset.
+    template<size_t N>
+    void sampleNearestRow(uint8_t * const dst, const size_t widthDS,
+                          uint8_t const * const src, const size_t widthUS, const size_t heightUS,
+                          int64_t sFP, int64_t tFP, const int64_t aFP, const int64_t cFP, const size_t bytesPerPixel)
+    {
+        const size_t pixelBytes=(N>0) ? N : bytesPerPixel;
+        const size_t bytesPerLineUS=widthUS * pixelBytes;
+        
+        for (size_t x=0; x<widthDS; ++x)
+        {
+            const uint64_t sx=uint64_t(sFP >> 32);//Negative coordinates wrap to large unsigned values.
+            const uint64_t sy=uint64_t(tFP >> 32);
+            
+            if ((sx<widthUS) && (sy<heightUS))
+            {
+                memcpy(dst + x*pixelBytes, src + sy*bytesPerLineUS + sx*pixelBytes, pixelBytes);
+            } else
+            {
+                memset(dst + x*pixelBytes, 0, pixelBytes);
+            }
+            
+            sFP+=aFP;
+            tFP+=cFP;
+        }
+    }
+    
+    //!Copy a tile of th rows of tw pixels of N bytes. Consecutive destination pixels are srcStepX bytes apart in the source and consecutive rows srcStepY bytes.
+    template<size_t N>
+    void copyTile(uint8_t * __restrict dst, const size_t dstStride,
+                  uint8_t const * __restrict src, const ptrdiff_t srcStepX, const ptrdiff_t srcStepY,
+                  const size_t tw, const size_t th, const size_t bytesPerPixel)
+    {
+        const size_t pixelBytes=(N>0) ? N : bytesPerPixel;
+        
+        for (size_t yy=0; yy<th; ++yy)
+        {
+            uint8_t * const lineWrite=dst + yy*dstStride;
+            uint8_t const * const lineRead=src + ptrdiff_t(yy)*srcStepY;
+            
+            for (size_t xx=0; xx<tw; ++xx)
+            {
+                memcpy(lineWrite + xx*pixelBytes, lineRead + ptrdiff_t(xx)*srcStepX, pixelBytes);
+            }
+        }
+    }
+    
+    void copyTile(uint8_t * const dst, const size_t dstStride,
+                  uint8_t const * const src, const ptrdiff_t srcStepX, const ptrdiff_t srcStepY,
+                  const size_t tw, const size_t th, const size_t bytesPerPixel)
+    {
+        switch (bytesPerPixel)
+        {
+            case 1: copyTile<1>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 2: copyTile<2>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 3: copyTile<3>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 4: copyTile<4>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 6: copyTile<6>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 8: copyTile<8>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 12: copyTile<12>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            case 16: copyTile<16>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+            default: copyTile<0>(dst, dstStride, src, srcStepX, srcStepY, tw, th, bytesPerPixel); break;
+        }
+    }
+    
+    //!Tile width and height of 90 degree rotations. A tile reads from this many source lines, which stay cache and TLB resident while the tile is copied.
+    const int64_t rotateTileSize=64;
+    
+    inline void storeInterpolated(uint8_t &dst, const float v) { dst=uint8_t(v + 0.5f); }
+    inline void storeInterpolated(uint16_t &dst, const float v) { dst=uint16_t(v + 0.5f); }
+    inline void storeInterpolated(float &dst, const float v) { dst=v; }
+}
+
+AffineTransform::AffineTransform() :
+a_(1.0f), b_(0.0f), c_(0.0f), d_(1.0f),
+tx_(0.0f), ty_(0.0f),
+interpolation_(Interpolation::NEAREST)
+{
+}
+
+void AffineTransform::setMatrix(const float a, const float b, const float c, const float d, const float tx, const float ty)
+{
+    a_=a; b_=b;
+    c_=c; d_=d;
+    tx_=tx; ty_=ty;
+}
+
+bool AffineTransform::transformNearest(uint8_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                       uint8_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                                       const size_t bytesPerPixel) const
+{
+    const size_t bytesPerLineUS=widthUS * bytesPerPixel;
+    const size_t bytesPerLineDS=widthDS * bytesPerPixel;
+    
+    if ((b_==0.0f) && (c_==0.0f) && (fabsf(a_)==1.0f) && (fabsf(d_)==1.0f))
+    {//Translation with optional flips: the nearest source pixels of a destination row form one contiguous span.
+        const int64_t kx=int64_t(floor(double(tx_) + 0.5));
+        const int64_t ky=int64_t(floor(double(ty_) + 0.5));
+        const bool flipX=(a_<0.0f);
+        const bool flipY=(d_<0.0f);
+        
+        const int64_t x0=flipX ? std::max<int64_t>(0, kx - int64_t(widthUS) + 1) : std::max<int64_t>(0, -kx);
+        const int64_t x1=flipX ? std::min<int64_t>(int64_t(widthDS), kx + 1) : std::min<int64_t>(int64_t(widthDS), int64_t(widthUS) - kx);
+        
+        int64_t y=0;
+#pragma omp parallel for
+        for (y=0; y<int64_t(heightDS); ++y)
+        {
+            uint8_t * const lineWrite=dataWrite + y*bytesPerLineDS;
+            const int64_t sy=flipY ? (ky - y) : (ky + y);
+            
+            if ((sy<0) || (sy>=int64_t(heightUS)) || (x1<=x0))
+            {
+                memset(lineWrite, 0, bytesPerLineDS);
+                continue;
+            }
+            
+            uint8_t const * const lineRead=dataRead + sy*bytesPerLineUS;
+            
+            memset(lineWrite, 0, x0*bytesPerPixel);
+            
+            if (flipX)
+            {
+                copyPixelsReversed(lineWrite + x0*bytesPerPixel, lineRead + (kx - x0)*bytesPerPixel, size_t(x1 - x0), bytesPerPixel);
+            } else
+            {
+                memcpy(lineWrite + x0*bytesPerPixel, lineRead + (kx + x0)*bytesPerPixel, (x1 - x0)*bytesPerPixel);
+            }
+            
+            memset(lineWrite + x1*bytesPerPixel, 0, (int64_t(widthDS) - x1)*bytesPerPixel);
+        }
+        
+        return true;
+    }
+    
+    if ((a_==0.0f) && (d_==0.0f) && (fabsf(b_)==1.0f) && (fabsf(c_)==1.0f))
+    {//Rotation by 90 or 270 degrees with optional flips: destination rows are source columns. Copied in cache blocked tiles.
+        const int64_t kx=int64_t(floor(double(tx_) + 0.5));
+        const int64_t ky=int64_t(floor(double(ty_) + 0.5));
+        const int64_t stepX=(c_>0.0f) ? 1 : -1;//Source line step per destination column.
+        const int64_t stepY=(b_>0.0f) ? 1 : -1;//Source pixel step per destination row.
+        
+        const int64_t numTileRows=(int64_t(heightDS) + rotateTileSize - 1) / rotateTileSize;
+        
+        int64_t tileRow=0;
+#pragma omp parallel for
+        for (tileRow=0; tileRow<numTileRows; ++tileRow)
+        {
+            const int64_t y0=tileRow*rotateTileSize;
+            const int64_t th=std::min(rotateTileSize, int64_t(heightDS) - y0);
+            
+            for (int64_t x0=0; x0<int64_t(widthDS); x0+=rotateTileSize)
+            {
+                const int64_t tw=std::min(rotateTileSize, int64_t(widthDS) - x0);
+                
+                //Source coordinates of the first and last destination pixels of the tile.
+                const int64_t sxFirst=stepY*y0 + kx;
+                const int64_t sxLast=stepY*(y0 + th - 1) + kx;
+                const int64_t syFirst=stepX*x0 + ky;
+                const int64_t syLast=stepX*(x0 + tw - 1) + ky;
+                
+                uint8_t * const tileWrite=dataWrite + y0*bytesPerLineDS + x0*bytesPerPixel;
+                
+                if ((std::min(sxFirst, sxLast)>=0) && (std::max(sxFirst, sxLast)<int64_t(widthUS)) &&
+                    (std::min(syFirst, syLast)>=0) && (std::max(syFirst, syLast)<int64_t(heightUS)))
+                {
+                    copyTile(tileWrite, bytesPerLineDS,
+                             dataRead + syFirst*bytesPerLineUS + sxFirst*bytesPerPixel,
+                             stepX*int64_t(bytesPerLineUS), stepY*int64_t(bytesPerPixel),
+                             size_t(tw), size_t(th), bytesPerPixel);
+                } else
+                {//The tile straddles the source image border.
+                    for (int64_t yy=0; yy<th; ++yy)
+                    {
+                        const int64_t sx=sxFirst + stepY*yy;
+                        
+                        for (int64_t xx=0; xx<tw; ++xx)
+                        {
+                            const int64_t sy=syFirst + stepX*xx;
+                            uint8_t * const pixelWrite=tileWrite + yy*bytesPerLineDS + xx*bytesPerPixel;
+                            
+                            if ((sx>=0) && (sx<int64_t(widthUS)) && (sy>=0) && (sy<int64_t(heightUS)))
+                            {
+                                memcpy(pixelWrite, dataRead + sy*bytesPerLineUS + sx*bytesPerPixel, bytesPerPixel);
+                            } else
+                            {
+                                memset(pixelWrite, 0, bytesPerPixel);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        return true;
+    }
+    
+    const int64_t aFP=toAffineFixedPoint(a_);
+    const int64_t cFP=toAffineFixedPoint(c_);
+    
+    int64_t y=0;
+#pragma omp parallel for
+    for (y=0; y<int64_t(heightDS); ++y)
+    {
+        uint8_t * const lineWrite=dataWrite + y*bytesPerLineDS;
+        
+        const int64_t sFP=toAffineFixedPoint(double(b_)*y + tx_ + 0.5);
+        const int64_t tFP=toAffineFixedPoint(double(d_)*y + ty_ + 0.5);
+        
+        switch (bytesPerPixel)
+        {
+            case 1: sampleNearestRow<1>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+            case 2: sampleNearestRow<2>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+            case 3: sampleNearestRow<3>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+            case 4: sampleNearestRow<4>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+            case 12: sampleNearestRow<12>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+            default: sampleNearestRow<0>(lineWrite, widthDS, dataRead, widthUS, heightUS, sFP, tFP, aFP, cFP, bytesPerPixel); break;
+        }
+    }
+    
+    return true;
+}
+
+template<typename T>
+bool AffineTransform::transform(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                T const * const dataRead, const size_t widthUS, const size_t heightUS,
+                                const size_t componentsPerPixel) const
+{
+    const bool integerTranslation=(b_==0.0f) && (c_==0.0f) && (fabsf(a_)==1.0f) && (fabsf(d_)==1.0f) &&
+                                  (tx_==floorf(tx_)) && (ty_==floorf(ty_));
+    
+    if ((interpolation_==Interpolation::NEAREST) || integerTranslation)
+    {//Bilinear sampling of integer positions is a copy.
+        return transformNearest((uint8_t *)dataWrite, widthDS, heightDS,
+                                (uint8_t const *)dataRead, widthUS, heightUS,
+                                sizeof(T) * componentsPerPixel);
+    }
+    
+    const size_t componentsPerLineUS=widthUS * componentsPerPixel;
+    const size_t componentsPerLineDS=widthDS * componentsPerPixel;
+    const int64_t maxX=int64_t(widthUS) - 1;
+    const int64_t maxY=int64_t(heightUS) - 1;
+    const int64_t halfFP=int64_t(1) << 31;
+    const float fractionScale=float(1.0 / affineFixedPointOne);
+    
+    const int64_t aFP=toAffineFixedPoint(a_);
+    const int64_t cFP=toAffineFixedPoint(c_);
+    
+    int64_t y=0;
+#pragma omp parallel for
+    for (y=0; y<int64_t(heightDS); ++y)
+    {
+        T * const lineWrite=dataWrite + y*componentsPerLineDS;
+        
+        int64_t sFP=toAffineFixedPoint(double(b_)*y + tx_);
+        int64_t tFP=toAffineFixedPoint(double(d_)*y + ty_);
+        
+        for (size_t x=0; x<widthDS; ++x)
+        {
+            T * const pixelWrite=lineWrite + x*componentsPerPixel;
+            
+            //A destination pixel is inside the image if its nearest source pixel is.
+            const int64_t nx=(sFP + halfFP) >> 32;
+            const int64_t ny=(tFP + halfFP) >> 32;
+            
+            if ((nx<0) || (nx>maxX) || (ny<0) || (ny>maxY))
+            {
+                for (size_t c=0; c<componentsPerPixel; ++c) pixelWrite[c]=T(0);
+            } else
+            {
+                const int64_t sx=sFP >> 32;
+                const int64_t sy=tFP >> 32;
+                const float fx=float(sFP & 0xFFFFFFFF) * fractionScale;
+                const float fy=float(tFP & 0xFFFFFFFF) * fractionScale;
+                
+                const int64_t x0=std::min(std::max<int64_t>(sx, 0), maxX);
+                const int64_t x1=std::min(std::max<int64_t>(sx+1, 0), maxX);
+                const int64_t y0=std::min(std::max<int64_t>(sy, 0), maxY);
+                const int64_t y1=std::min(std::max<int64_t>(sy+1, 0), maxY);
+                
+                T const * const p00=dataRead + y0*componentsPerLineUS + x0*componentsPerPixel;
+                T const * const p01=dataRead + y0*componentsPerLineUS + x1*componentsPerPixel;
+                T const * const p10=dataRead + y1*componentsPerLineUS + x0*componentsPerPixel;
+                T const * const p11=dataRead + y1*componentsPerLineUS + x1*componentsPerPixel;
+                
+                for (size_t c=0; c<componentsPerPixel; ++c)
+                {
+                    const float top=float(p00[c]) + (float(p01[c]) - float(p00[c]))*fx;
+                    const float bottom=float(p10[c]) + (float(p11[c]) - float(p10[c]))*fx;
+                    
+                    storeInterpolated(pixelWrite[c], top + (bottom - top)*fy);
+                }
+            }
+            
+            sFP+=aFP;
+            tFP+=cFP;
+        }
+    }
+    
+    return true;
+}
+
+template bool AffineTransform::transform<uint8_t>(uint8_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                                  uint8_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                                                  const size_t componentsPerPixel) const;
+template bool AffineTransform::transform<uint16_t>(uint16_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                                   uint16_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                                                   const size_t componentsPerPixel) const;
+template bool AffineTransform::transform<float>(float * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                                float const * const dataRead, const size_t widthUS, const size_t heightUS,
+                                                const size_t componentsPerPixel) const;
+//=========================================//
+
+
+
+//=========== GaussianScaleSpace ==========//
+
+namespace
+{
+    //!Standard deviation of a GAUSSIAN scale relative to its kernel width.
+    const float scaleSpaceSigmaPerKernelWidth=0.375f;
+    
+    //!Pyramid level at which the standard deviation of a scale is between two and four pixels.
+    size_t scaleSpaceLevel(const float sigma)
+    {
+        size_t level=0;
+        while ((sigma / float(size_t(1) << (level+1)))>=2.0f) ++level;
+        return level;
+    }
+}
+
+GaussianScaleSpace::GaussianScaleSpace(const FilterType filterType) :
+filterType_(filterType),
+inputImage_(nullptr)
+{
+}
+
+void GaussianScaleSpace::setKernelWidths(const std::vector<size_t> &kernelWidths)
+{
+    if (kernelWidths==kernelWidths_) return;
+    
+    kernelWidths_=kernelWidths;
+    
+    const size_t numScales=kernelWidths_.size();
+    
+    scaleImageVec_.resize(numScales);
+    scratchImageVec_.resize(numScales);
+    scratchImage2Vec_.resize(numScales);
+    integralImageScratchVec_.resize(numScales);
+    boxFilterIIVec_.resize(numScales);
+    boxFilterRSVec_.resize(numScales);
+    
+    for (size_t scaleIndex=0; scaleIndex<numScales; ++scaleIndex)
+    {
+        if (filterType_==FilterType::BOX_INTEGRAL_IMAGE)
+        {
+            boxFilterIIVec_[scaleIndex]=std::make_shared<BoxFilterII>(kernelWidths_[scaleIndex]);
+        } else
+            if (filterType_==FilterType::BOX_RUNNING_SUM)
+            {
+                boxFilterRSVec_[scaleIndex]=std::make_shared<BoxFilterRS>(kernelWidths_[scaleIndex]);
+            }
+    }
+}
+
+void GaussianScaleSpace::buildPyramid(float const * const image, const size_t width, const size_t height, const size_t numLevels)
+{
+    pyramidLevelVec_.resize(numLevels);
+    pyramidWidthVec_.resize(numLevels);
+    pyramidHeightVec_.resize(numLevels);
+    
+    float const * levelUS=image;
+    size_t widthUS=width;
+    size_t heightUS=height;
+    
+    for (size_t level=0; level<numLevels; ++level)
+    {
+        const size_t widthDS=std::max<size_t>(widthUS >> 1, 1);
+        const size_t heightDS=std::max<size_t>(heightUS >> 1, 1);
+        
+        pyramidLevelVec_[level].resize(widthDS * heightDS);
+        pyramidWidthVec_[level]=widthDS;
+        pyramidHeightVec_[level]=heightDS;
+        
+        float * const levelDS=pyramidLevelVec_[level].data();
+        
+        int64_t y=0;
+#pragma omp parallel for
+        for (y=0; y<int64_t(heightDS); ++y)
+        {
+            float const * const lineUS0=levelUS + std::min<size_t>(2*y, heightUS-1) * widthUS;
+            float const * const lineUS1=levelUS + std::min<size_t>(2*y+1, heightUS-1) * widthUS;
+            float * const lineDS=levelDS + y*widthDS;
+            
+            for (size_t x=0; x<widthDS; ++x)
+            {
+                const size_t x0=std::min(2*x, widthUS-1);
+                const size_t x1=std::min(2*x+1, widthUS-1);
+                
+                lineDS[x]=(lineUS0[x0] + lineUS0[x1] + lineUS1[x0] + lineUS1[x1]) * 0.25f;
+            }
+        }
+        
+        levelUS=levelDS;
+        widthUS=widthDS;
+        heightUS=heightDS;
+    }
+}
+
+void GaussianScaleSpace::buildGaussianScale(const size_t scaleIndex, const size_t width, const size_t height)
+{
+    const float sigma=kernelWidths_[scaleIndex] * scaleSpaceSigmaPerKernelWidth;
+    const size_t level=scaleSpaceLevel(sigma);
+    const float levelScale=float(size_t(1) << level);
+    
+    //Remove the blur already introduced by the 2x2 box downsampling: variance (4^level-1)/12 full resolution pixels.
+    const float pyramidVariance=(levelScale*levelScale - 1.0f) * (1.0f/12.0f);
+    const float levelSigma=sqrtf(std::max(sigma*sigma - pyramidVariance, 0.25f)) / levelScale;
+    
+    float const * const levelImage=(level==0) ? inputImage_ : pyramidLevelVec_[level-1].data();
+    const size_t levelWidth=(level==0) ? width : pyramidWidthVec_[level-1];
+    const size_t levelHeight=(level==0) ? height : pyramidHeightVec_[level-1];
+    
+    //Normalised kernel of width 8 sigma, similar to the truncation of GaussianFilter as used by FIPMSR.
+    const int64_t radius=std::max<int64_t>(int64_t(ceilf(4.0f * levelSigma)), 1);
+    std::vector<float> kernel(2*radius + 1);
+    float kernelSum=0.0f;
+    for (int64_t j=-radius; j<=radius; ++j)
+    {
+        kernel[j+radius]=expf(-(j*j) / (2.0f*levelSigma*levelSigma));
+        kernelSum+=kernel[j+radius];
+    }
+    for (float &k : kernel) k/=kernelSum;
+    
+    std::vector<float> &scaleImage=scaleImageVec_[scaleIndex];
+    std::vector<float> &rowFiltered=scratchImageVec_[scaleIndex];
+    std::vector<float> &levelFiltered=scratchImage2Vec_[scaleIndex];
+    
+    scaleImage.resize(width * height);
+    rowFiltered.resize(levelWidth * levelHeight);
+    levelFiltered.resize(levelWidth * levelHeight);
+    
+    //Horizontal pass with replicated borders.
+    std::vector<float> paddedLine(levelWidth + 2*radius);
+    for (size_t y=0; y<levelHeight; ++y)
+    {
+        float const * const lineRead=levelImage + y*levelWidth;
+        float * const lineWrite=rowFiltered.data() + y*levelWidth;
+        
+        for (int64_t x=0; x<int64_t(paddedLine.size()); ++x)
+        {
+            paddedLine[x]=lineRead[std::min(std::max<int64_t>(x - radius, 0), int64_t(levelWidth)-1)];
+        }
+        
+        for (size_t x=0; x<levelWidth; ++x)
+        {
+            float sum=0.0f;
+            for (size_t j=0; j<kernel.size(); ++j)
+            {
+                sum+=paddedLine[x + j] * kernel[j];
+            }
+            lineWrite[x]=sum;
+        }
+    }
+    
+    //Vertical pass with replicated borders. Written straight to the scale image at full resolution.
+    float * const verticalWrite=(level==0) ? scaleImage.data() : levelFiltered.data();
+    for (int64_t y=0; y<int64_t(levelHeight); ++y)
+    {
+        float * const lineWrite=verticalWrite + y*levelWidth;
+        std::fill(lineWrite, lineWrite + levelWidth, 0.0f);
+        
+        for (int64_t j=-radius; j<=radius; ++j)
+        {
+            const float k=kernel[j+radius];
+            float const * const lineRead=rowFiltered.data() + std::min(std::max<int64_t>(y + j, 0), int64_t(levelHeight)-1) * levelWidth;
+            
+            for (size_t x=0; x<levelWidth; ++x)
+            {
+                lineWrite[x]+=lineRead[x] * k;
+            }
+        }
+    }
+    
+    if (level==0) return;
+    
+    //Bilinear upsampling to full resolution. Level pixels cover exactly levelScale x levelScale full resolution pixels.
+    const float scaleX=1.0f / levelScale;
+    const float scaleY=1.0f / levelScale;
+    
+    std::vector<size_t> x0Vec(width), x1Vec(width);
+    std::vector<float> fxVec(width);
+    for (size_t x=0; x<width; ++x)
+    {
+        const float sx=std::max((x + 0.5f)*scaleX - 0.5f, 0.0f);
+        const size_t x0=std::min(size_t(sx), levelWidth-1);
+        x0Vec[x]=x0;
+        x1Vec[x]=std::min(x0+1, levelWidth-1);
+        fxVec[x]=sx - float(x0);
+    }
+    
+    for (size_t y=0; y<height; ++y)
+    {
+        const float sy=std::max((y + 0.5f)*scaleY - 0.5f, 0.0f);
+        const size_t y0=std::min(size_t(sy), levelHeight-1);
+        const size_t y1=std::min(y0+1, levelHeight-1);
+        const float fy=sy - float(y0);
+        
+        float const * const line0=levelFiltered.data() + y0*levelWidth;
+        float const * const line1=levelFiltered.data() + y1*levelWidth;
+        float * const lineWrite=scaleImage.data() + y*width;
+        
+        for (size_t x=0; x<width; ++x)
+        {
+            const float top=line0[x0Vec[x]] + (line0[x1Vec[x]] - line0[x0Vec[x]])*fxVec[x];
+            const float bottom=line1[x0Vec[x]] + (line1[x1Vec[x]] - line1[x0Vec[x]])*fxVec[x];
+            
+            lineWrite[x]=top + (bottom - top)*fy;
+        }
+    }
+}
+
+bool GaussianScaleSpace::build(float const * const image, const size_t width, const size_t height)
+{
+    const int64_t numScales=int64_t(kernelWidths_.size());
+    
+    if (filterType_==FilterType::GAUSSIAN)
+    {
+        size_t numLevels=0;
+        for (const size_t kernelWidth : kernelWidths_)
+        {
+            numLevels=std::max(numLevels, scaleSpaceLevel(kernelWidth * scaleSpaceSigmaPerKernelWidth));
+        }
+        
+        //The pyramid is shared by all the scales.
+        buildPyramid(image, width, height, numLevels);
+        inputImage_=image;
+    }
+    
+    int64_t scaleIndex=0;
+#pragma omp parallel for schedule(dynamic)
+    for (scaleIndex=0; scaleIndex<numScales; ++scaleIndex)
+    {
+        std::vector<float> &scaleImage=scaleImageVec_[scaleIndex];
+        std::vector<float> &scratchImage=scratchImageVec_[scaleIndex];
+        
+        if (filterType_==FilterType::GAUSSIAN)
+        {
+            buildGaussianScale(scaleIndex, width, height);
+        } else
+        {
+            //Three box filter passes approximate a Gaussian. The box filters only write the image interior.
+            scaleImage.resize(width * height, 0.0f);
+            scratchImage.resize(width * height, 0.0f);
+            
+            if (filterType_==FilterType::BOX_INTEGRAL_IMAGE)
+            {
+                std::vector<double> &integralImageScratch=integralImageScratchVec_[scaleIndex];
+                integralImageScratch.resize(width * height);
+                
+                BoxFilterII &boxFilter=*boxFilterIIVec_[scaleIndex];
+                boxFilter.filter(scaleImage.data(), image, width, height, integralImageScratch.data(), true);
+                boxFilter.filter(scratchImage.data(), scaleImage.data(), width, height, integralImageScratch.data(), true);
+                boxFilter.filter(scaleImage.data(), scratchImage.data(), width, height, integralImageScratch.data(), true);
+            } else
+            {
+                std::vector<float> &scratchImage2=scratchImage2Vec_[scaleIndex];
+                scratchImage2.resize(width * height);
+                
+                BoxFilterRS &boxFilter=*boxFilterRSVec_[scaleIndex];
+                boxFilter.filter(scaleImage.data(), image, width, height, scratchImage2.data());
+                boxFilter.filter(scratchImage.data(), scaleImage.data(), width, height, scratchImage2.data());
+                boxFilter.filter(scaleImage.data(), scratchImage.data(), width, height, scratchImage2.data());
+            }
+        }
+    }
+    
+    return true;
+}
+//=========================================//
+//=========== PhotometricEqualisation ==========//
+
+namespace
+{
+    inline float fullScaleValue(uint8_t) { return 255.0f; }
+    inline float fullScaleValue(uint16_t) { return 65535.0f; }
+    inline float fullScaleValue(float) { return 1.0f; }
+    
+    //!Line sums accumulate in uint32 chunks that cannot overflow, which vectorise better than a uint64 sum.
+    inline double sumLine(uint8_t const * const data, const size_t numComponents)
+    {
+        const size_t chunkSize=size_t(1)<<24;
+        uint64_t lineSum=0;
+        
+        for (size_t chunkStart=0; chunkStart<numComponents; chunkStart+=chunkSize)
+        {
+            const size_t chunkEnd=std::min(chunkStart + chunkSize, numComponents);
+            uint32_t chunkSum=0;
+            
+            for (size_t i=chunkStart; i<chunkEnd; ++i)
+            {
+                chunkSum+=data[i];
+            }
+            
+            lineSum+=chunkSum;
+        }
+        
+        return double(lineSum);
+    }
+    
+    inline double sumLine(uint16_t const * const data, const size_t numComponents)
+    {
+        const size_t chunkSize=size_t(1)<<16;
+        uint64_t lineSum=0;
+        
+        for (size_t chunkStart=0; chunkStart<numComponents; chunkStart+=chunkSize)
+        {
+            const size_t chunkEnd=std::min(chunkStart + chunkSize, numComponents);
+            uint32_t chunkSum=0;
+            
+            for (size_t i=chunkStart; i<chunkEnd; ++i)
+            {
+                chunkSum+=data[i];
+            }
+            
+            lineSum+=chunkSum;
+        }
+        
+        return double(lineSum);
+    }
+    
+    inline double sumLine(float const * const data, const size_t numComponents)
+    {
+        const size_t chunkSize=4096;
+        double lineSum=0.0;
+        
+        for (size_t chunkStart=0; chunkStart<numComponents; chunkStart+=chunkSize)
+        {
+            const size_t chunkEnd=std::min(chunkStart + chunkSize, numComponents);
+            float chunkSum=0.0f;
+            
+            for (size_t i=chunkStart; i<chunkEnd; ++i)
+            {
+                chunkSum+=data[i];
+            }
+            
+            lineSum+=chunkSum;
+        }
+        
+        return lineSum;
+    }
+    
+    //!Scaled value rounded and saturated to the range of T. Converted through int32, which the compiler vectorises.
+    template<typename T>
+    inline T scaleValue(const float value, const float scale)
+    {
+        return T(int32_t(std::min(value * scale + 0.5f, fullScaleValue(T()))));
+    }
+    
+    template<>
+    inline float scaleValue<float>(const float value, const float scale)
+    {
+        return value * scale;
+    }
+    
+    //!The line length is a parameter, so that 8-bit stores cannot alias it and the loop vectorises.
+    template<typename T>
+    inline void scaleLine(T * __restrict lineWrite, T const * __restrict lineRead, const size_t numComponents, const float scale)
+    {
+        for (size_t i=0; i<numComponents; ++i)
+        {
+            lineWrite[i]=scaleValue<T>(float(lineRead[i]), scale);
+        }
+    }
+    
+    template<typename T>
+    double sumImage(T const * const data, const size_t componentsPerLine, const size_t height)
+    {
+        double imageSum=0.0;
+        
+        int64_t y=0;
+#pragma omp parallel for reduction(+:imageSum)
+        for (y=0; y<int64_t(height); ++y)
+        {
+            imageSum+=sumLine(data + y * componentsPerLine, componentsPerLine);
+        }
+        
+        return imageSum;
+    }
+    
+    template<typename T>
+    void scaleImage(T * const dataWrite, T const * const dataRead,
+                    const size_t componentsPerLine, const size_t height, const float scale)
+    {
+        int64_t y=0;
+#pragma omp parallel for
+        for (y=0; y<int64_t(height); ++y)
+        {
+            scaleLine(dataWrite + y * componentsPerLine, dataRead + y * componentsPerLine, componentsPerLine, scale);
+        }
+    }
+    
+    template<typename T>
+    float equaliseImage(T * const dataWrite, T const * const dataRead,
+                        const size_t componentsPerLine, const size_t height, const float targetAverage)
+    {
+        const double componentsPerImage=double(componentsPerLine * height);
+        const float average=float(sumImage(dataRead, componentsPerLine, height) / (componentsPerImage * fullScaleValue(T())));
+        
+        if (average > 0.0f)
+        {
+            scaleImage(dataWrite, dataRead, componentsPerLine, height, targetAverage / average);
+        } else
+            if (dataWrite!=dataRead)
+            {
+                memcpy(dataWrite, dataRead, componentsPerLine * height * sizeof(T));
+            }
+        
+        return average;
+    }
+}
+
+double PhotometricEqualisation::sum(uint8_t const * const data, const size_t componentsPerLine, const size_t height)
+{
+    return sumImage(data, componentsPerLine, height);
+}
+
+double PhotometricEqualisation::sum(uint16_t const * const data, const size_t componentsPerLine, const size_t height)
+{
+    return sumImage(data, componentsPerLine, height);
+}
+
+double PhotometricEqualisation::sum(float const * const data, const size_t componentsPerLine, const size_t height)
+{
+    return sumImage(data, componentsPerLine, height);
+}
+
+void PhotometricEqualisation::scale(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                                    const size_t componentsPerLine, const size_t height, const float scale)
+{
+    scaleImage(dataWrite, dataRead, componentsPerLine, height, scale);
+}
+
+void PhotometricEqualisation::scale(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                                    const size_t componentsPerLine, const size_t height, const float scale)
+{
+    scaleImage(dataWrite, dataRead, componentsPerLine, height, scale);
+}
+
+void PhotometricEqualisation::scale(float * const dataWrite, float const * const dataRead,
+                                    const size_t componentsPerLine, const size_t height, const float scale)
+{
+    scaleImage(dataWrite, dataRead, componentsPerLine, height, scale);
+}
+
+float PhotometricEqualisation::equalise(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                                        const size_t componentsPerLine, const size_t height, const float targetAverage)
+{
+    return equaliseImage(dataWrite, dataRead, componentsPerLine, height, targetAverage);
+}
+
+float PhotometricEqualisation::equalise(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                                        const size_t componentsPerLine, const size_t height, const float targetAverage)
+{
+    return equaliseImage(dataWrite, dataRead, componentsPerLine, height, targetAverage);
+}
+
+float PhotometricEqualisation::equalise(float * const dataWrite, float const * const dataRead,
+                                        const size_t componentsPerLine, const size_t height, const float targetAverage)
+{
+    return equaliseImage(dataWrite, dataRead, componentsPerLine, height, targetAverage);
+}
+
+void PhotometricEqualisation::equaliseLocal(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                                            const size_t width, const size_t height, const size_t componentsPerPixel,
+                                            const size_t windowSize, const float targetAverage,
+                                            const bool scaleByFirstComponent)
+{
+    if (windowSize<=2901)
+    {//The window sums fit in int32.
+        equaliseLocal(dataWrite, dataRead, width, height, componentsPerPixel, windowSize, targetAverage, scaleByFirstComponent, bandScratchInt32_);
+    } else
+    {
+        equaliseLocal(dataWrite, dataRead, width, height, componentsPerPixel, windowSize, targetAverage, scaleByFirstComponent, bandScratchF64_);
+    }
+}
+
+void PhotometricEqualisation::equaliseLocal(uint16_t * const dataWrite, uint16_t const * const dataRead,
+                                            const size_t width, const size_t height, const size_t componentsPerPixel,
+                                            const size_t windowSize, const float targetAverage,
+                                            const bool scaleByFirstComponent)
+{
+    equaliseLocal(dataWrite, dataRead, width, height, componentsPerPixel, windowSize, targetAverage, scaleByFirstComponent, bandScratchF64_);
+}
+
+void PhotometricEqualisation::equaliseLocal(float * const dataWrite, float const * const dataRead,
+                                            const size_t width, const size_t height, const size_t componentsPerPixel,
+                                            const size_t windowSize, const float targetAverage,
+                                            const bool scaleByFirstComponent)
+{
+    equaliseLocal(dataWrite, dataRead, width, height, componentsPerPixel, windowSize, targetAverage, scaleByFirstComponent, bandScratchF64_);
+}
+
+namespace
+{
+    //!Scale each component by the target sum of its window over its window sum. Components of which the window sum
+    //! is zero, e.g. in a black border, are set to zero instead of being scaled by infinity.
+    template<typename T, typename SumT>
+    inline void equaliseLine(T * __restrict lineWrite, T const * __restrict lineRead,
+                             float const * __restrict columnTargetScale, SumT const * __restrict windowSums,
+                             const ptrdiff_t n, const float numWindowRows)
+    {
+        const float maxScale=std::numeric_limits<float>::max();
+        
+        for (ptrdiff_t i=0; i<n; ++i)
+        {
+            const float windowSum=float(windowSums[i]);
+            const float scale=(windowSum>0.0f) ? std::min((numWindowRows * columnTargetScale[i]) / windowSum, maxScale) : 0.0f;
+            lineWrite[i]=scaleValue<T>(float(lineRead[i]), scale);
+        }
+    }
+}
+
+template<typename T, typename SumT>
+void PhotometricEqualisation::equaliseLocal(T * const dataWrite, T const * const dataRead,
+                                            const size_t width, const size_t height, const size_t componentsPerPixel,
+                                            const size_t windowSize, const float targetAverage,
+                                            const bool scaleByFirstComponent,
+                                            std::vector<std::vector<SumT> > &bandScratch)
+{
+    const ptrdiff_t w=ptrdiff_t(width);
+    const ptrdiff_t hgt=ptrdiff_t(height);
+    const ptrdiff_t c=ptrdiff_t(componentsPerPixel);
+    //Even windows reach one pixel further to the right and down than to the left and up.
+    const ptrdiff_t rBefore=ptrdiff_t((std::max<size_t>(windowSize, 1)-1)>>1);
+    const ptrdiff_t rAfter=ptrdiff_t(std::max<size_t>(windowSize, 1)>>1);
+    const ptrdiff_t numWindowComponents=scaleByFirstComponent ? 1 : c;
+    const ptrdiff_t cpl=ptrdiff_t(width * componentsPerPixel);
+    
+    //The number of window columns inside the image only depends on x.
+    columnTargetScale_.resize(cpl);
+    const float targetSum=targetAverage * fullScaleValue(T());
+    for (ptrdiff_t x=0; x<w; ++x)
+    {
+        const float numWindowColumns=float(std::min(x+rAfter, w-1) - std::max<ptrdiff_t>(x-rBefore, 0) + 1);
+        std::fill(columnTargetScale_.begin() + x*c, columnTargetScale_.begin() + (x+1)*c, targetSum * numWindowColumns);
+    }
+    
+    //The window sums along a line are running sums. The line is split into numChains segments whose running sums
+    // are interleaved, so that the additions do not wait on each other.
+    const ptrdiff_t numChains=4;
+    const ptrdiff_t segmentWidth=(w + numChains - 1) / numChains;
+    
+    //Per band: the column sums with zero padding on either side and the window sums.
+    const ptrdiff_t padding=(rAfter + numChains) * c;
+    const size_t bandScratchSize=size_t(cpl + 2*padding + cpl + numChains*c);
+    const size_t numBands=getNumRowBands(height);
+    
+    if (bandScratch.size()<numBands) bandScratch.resize(numBands);
+    for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+    {
+        if (bandScratch[bandNum].size()<bandScratchSize) bandScratch[bandNum].resize(bandScratchSize);
+    }
+    
+    const ptrdiff_t bandHeight=ptrdiff_t((height + numBands - 1) / numBands);
+    float const * const columnTargetScale=columnTargetScale_.data();
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const ptrdiff_t yStart=bandNum * bandHeight;
+        const ptrdiff_t yEnd=std::min(yStart + bandHeight, hgt);
+        
+        SumT * const columnSums=bandScratch[bandNum].data() + padding;
+        SumT * const windowSums=columnSums + cpl + padding;
+        
+        //Column sums of the window rows of the first row of the band.
+        std::fill(columnSums - padding, columnSums + cpl + padding, SumT(0));
+        for (ptrdiff_t j=std::max<ptrdiff_t>(yStart-rBefore, 0); j<=std::min(yStart+rAfter, hgt-1); ++j)
+        {
+            T const * const lineIn=dataRead + j * cpl;
+            
+            for (ptrdiff_t i=0; i<cpl; ++i)
+            {
+                columnSums[i]+=SumT(lineIn[i]);
+            }
+        }
+        
+        for (ptrdiff_t y=yStart; y<yEnd; ++y)
+        {
+            if (y>yStart)
+            {//Slide the column sums down by one row.
+                if ((y+rAfter)<hgt)
+                {
+                    T const * const lineIn=dataRead + (y+rAfter) * cpl;
+                    
+                    for (ptrdiff_t i=0; i<cpl; ++i)
+                    {
+                        columnSums[i]+=SumT(lineIn[i]);
+                    }
+                }
+                
+                if ((y-rBefore-1)>=0)
+                {
+                    T const * const lineOut=dataRead + (y-rBefore-1) * cpl;
+                    
+                    for (ptrdiff_t i=0; i<cpl; ++i)
+                    {
+                        columnSums[i]-=SumT(lineOut[i]);
+                    }
+                }
+            }
+            
+            for (ptrdiff_t k=0; k<numWindowComponents; ++k)
+            {
+                SumT windowSum[numChains];
+                for (ptrdiff_t chain=0; chain<numChains; ++chain)
+                {
+                    windowSum[chain]=SumT(0);
+                    for (ptrdiff_t x=-rBefore; x<=rAfter; ++x)
+                    {
+                        windowSum[chain]+=columnSums[(chain*segmentWidth + x)*c + k];
+                    }
+                }
+                
+                for (ptrdiff_t x=0; x<segmentWidth; ++x)
+                {
+                    for (ptrdiff_t chain=0; chain<numChains; ++chain)
+                    {
+                        const ptrdiff_t i=(chain*segmentWidth + x)*c + k;
+                        windowSums[i]=windowSum[chain];
+                        windowSum[chain]+=columnSums[i + (rAfter+1)*c] - columnSums[i - rBefore*c];
+                    }
+                }
+            }
+            
+            if (numWindowComponents<c)
+            {//All the components are scaled by the window of the first component.
+                for (ptrdiff_t x=0; x<w; ++x)
+                {
+                    for (ptrdiff_t k=1; k<c; ++k)
+                    {
+                        windowSums[x*c + k]=windowSums[x*c];
+                    }
+                }
+            }
+            
+            const float numWindowRows=float(std::min(y+rAfter, hgt-1) - std::max<ptrdiff_t>(y-rBefore, 0) + 1);
+            equaliseLine(dataWrite + y * cpl, dataRead + y * cpl, columnTargetScale, windowSums, cpl, numWindowRows);
+        }
+    }
+}
+
+//=========================================//
+//=========== ConnectedComponents ==========//
+
+ConnectedComponents::ConnectedComponents(const Connectivity connectivity) :
+connectivity_(connectivity)
+{
+}
+
+void ConnectedComponents::extractRuns(uint8_t const * const line, const int32_t width, std::vector<Run> &runs)
+{
+    const uint64_t ones=0x0101010101010101ULL;
+    const uint64_t highBits=0x8080808080808080ULL;
+    
+    int32_t x=0;
+    while (x<width)
+    {
+        //Skip background eight pixels at a time.
+        for (; x+8<=width; x+=8)
+        {
+            uint64_t word;
+            memcpy(&word, line+x, 8);
+            if (word!=0) break;
+        }
+        while ((x<width) && (line[x]==0)) ++x;
+        
+        if (x>=width) break;
+        
+        const int32_t start=x;
+        
+        //Skip foreground eight pixels at a time, while the word has no zero byte.
+        for (; x+8<=width; x+=8)
+        {
+            uint64_t word;
+            memcpy(&word, line+x, 8);
+            if ((word - ones) & ~word & highBits) break;
+        }
+        while ((x<width) && (line[x]!=0)) ++x;
+        
+        runs.push_back(Run{start, x});
+    }
+}
+
+uint32_t ConnectedComponents::findRoot(uint32_t runIndex)
+{
+    //Path halving.
+    while (parent_[runIndex]!=runIndex)
+    {
+        parent_[runIndex]=parent_[parent_[runIndex]];
+        runIndex=parent_[runIndex];
+    }
+    
+    return runIndex;
+}
+
+size_t ConnectedComponents::label(uint8_t const * const data, const size_t width, const size_t height, const size_t bytesPerLine,
+                                  uint32_t * const labels)
+{
+    blobs_.clear();
+    blobSumX2_.clear();
+    blobSumY_.clear();
+    
+    if ((width==0) || (height==0))
+    {
+        return 0;
+    }
+    
+    //Find the runs of each row band in parallel.
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandHeight=(height + numBands - 1) / numBands;
+    
+    if (bandRuns_.size()<numBands) bandRuns_.resize(numBands);
+    rowNumRuns_.resize(height);
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        std::vector<Run> &runs=bandRuns_[bandNum];
+        runs.clear();
+        
+        const size_t yStart=bandNum * bandHeight;
+        const size_t yEnd=std::min(yStart + bandHeight, height);
+        
+        for (size_t y=yStart; y<yEnd; ++y)
+        {
+            const size_t numRunsBefore=runs.size();
+            extractRuns(data + y * bytesPerLine, int32_t(width), runs);
+            rowNumRuns_[y]=uint32_t(runs.size() - numRunsBefore);
+        }
+    }
+    
+    runs_.clear();
+    for (size_t b=0; b<numBands; ++b)
+    {
+        runs_.insert(runs_.end(), bandRuns_[b].begin(), bandRuns_[b].end());
+    }
+    
+    rowRunStart_.resize(height+1);
+    rowRunStart_[0]=0;
+    for (size_t y=0; y<height; ++y)
+    {
+        rowRunStart_[y+1]=rowRunStart_[y] + rowNumRuns_[y];
+    }
+    
+    const uint32_t numRuns=uint32_t(runs_.size());
+    parent_.resize(numRuns);
+    for (uint32_t i=0; i<numRuns; ++i)
+    {
+        parent_[i]=i;
+    }
+    
+    //Merge the runs that touch a run of the previous row. With eight connectivity runs that touch diagonally also merge.
+    const int32_t slack=(connectivity_==Connectivity::EIGHT) ? 1 : 0;
+    
+    for (size_t y=1; y<height; ++y)
+    {
+        const uint32_t prevEnd=rowRunStart_[y];
+        const uint32_t curEnd=rowRunStart_[y+1];
+        
+        uint32_t p=rowRunStart_[y-1];
+        for (uint32_t c=rowRunStart_[y]; c<curEnd; ++c)
+        {
+            const Run &run=runs_[c];
+            
+            while ((p<prevEnd) && (runs_[p].end + slack <= run.start)) ++p;
+            
+            for (uint32_t q=p; (q<prevEnd) && (runs_[q].start < run.end + slack); ++q)
+            {
+                const uint32_t rootC=findRoot(c);
+                const uint32_t rootQ=findRoot(q);
+                
+                //Link to the smaller index so that roots are the first run of their blob.
+                if (rootC<rootQ)
+                {
+                    parent_[rootQ]=rootC;
+                } else
+                {
+                    parent_[rootC]=rootQ;
+                }
+            }
+        }
+    }
+    
+    //Collect the blobs. The root of a run never has a larger index, so it is numbered before the run.
+    runBlob_.resize(numRuns);
+    
+    for (size_t y=0; y<height; ++y)
+    {
+        uint32_t * const labelLine=(labels!=nullptr) ? (labels + y * width) : nullptr;
+        if (labelLine!=nullptr)
+        {
+            std::fill(labelLine, labelLine + width, 0);
+        }
+        
+        for (uint32_t i=rowRunStart_[y]; i<rowRunStart_[y+1]; ++i)
+        {
+            const Run &run=runs_[i];
+            const uint32_t root=findRoot(i);
+            
+            if (root==i)
+            {
+                runBlob_[i]=uint32_t(blobs_.size());
+                
+                Blob blob;
+                blob.left=run.start;
+                blob.top=int32_t(y);
+                blob.right=run.end-1;
+                blob.bottom=int32_t(y);
+                blob.area=0;
+                blob.centroidX=0.0f;
+                blob.centroidY=0.0f;
+                
+                blobs_.push_back(blob);
+                blobSumX2_.push_back(0);
+                blobSumY_.push_back(0);
+            } else
+            {
+                runBlob_[i]=runBlob_[root];
+            }
+            
+            const uint32_t blobIndex=runBlob_[i];
+            const uint64_t length=uint64_t(run.end - run.start);
+            
+            Blob &blob=blobs_[blobIndex];
+            blob.left=std::min(blob.left, run.start);
+            blob.right=std::max(blob.right, run.end-1);
+            blob.bottom=int32_t(y);
+            blob.area+=size_t(length);
+            
+            blobSumX2_[blobIndex]+=length * uint64_t(run.start + run.end - 1);
+            blobSumY_[blobIndex]+=length * y;
+            
+            if (labelLine!=nullptr)
+            {
+                std::fill(labelLine + run.start, labelLine + run.end, blobIndex+1);
+            }
+        }
+    }
+    
+    for (size_t blobIndex=0; blobIndex<blobs_.size(); ++blobIndex)
+    {
+        Blob &blob=blobs_[blobIndex];
+        blob.centroidX=float(double(blobSumX2_[blobIndex]) / (2.0 * double(blob.area)));
+        blob.centroidY=float(double(blobSumY_[blobIndex]) / double(blob.area));
+    }
+    
+    return blobs_.size();
+}
+
+//=========================================//
+//=========== ImageHistogram ==========//
+
+namespace
+{
+    //!Bin of an integer value with the given number of bits. The number of bins is limited so that v*numBins fits in 32 bits.
+    struct IntegerBin
+    {
+        IntegerBin(const size_t numBins, const uint32_t bits) :
+        numBins_(uint32_t(std::min<size_t>(numBins, size_t(1) << (32 - bits)))), bits_(bits)
+        {}
+        
+        size_t operator()(const uint32_t v) const
+        {
+            return (v * numBins_) >> bits_;
+        }
+        
+        const uint32_t numBins_;
+        const uint32_t bits_;
+    };
+    
+    //!Bin of an 8-bit value with 256 bins.
+    struct IdentityBin
+    {
+        size_t operator()(const uint8_t v) const
+        {
+            return v;
+        }
+    };
+    
+    //!Bin of a float value. Values outside the range, and NaNs, are clamped to the first or last bin.
+    struct FloatBin
+    {
+        FloatBin(const size_t numBins, const float low, const float high) :
+        low_(low), scale_((high>low) ? (float(numBins) / (high - low)) : 0.0f), maxBin_(float(numBins - 1))
+        {}
+        
+        size_t operator()(const float v) const
+        {
+            return size_t(std::max(0.0f, std::min((v - low_) * scale_, maxBin_)));
+        }
+        
+        const float low_;
+        const float scale_;
+        const float maxBin_;
+    };
+}
+
+ImageHistogram::ImageHistogram(const size_t numBins) :
+numBins_(std::max<size_t>(numBins, 1)),
+low_(0.0f),
+high_(1.0f)
+{
+}
+
+template<typename T, typename BinFunction>
+void ImageHistogram::calculate(T const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                               const size_t pixelStride, const BinFunction &binOf)
+{
+    const size_t numBins=numBins_;
+    const size_t nc=componentsPerPixel;
+    const size_t stride=std::max<size_t>(pixelStride, 1);
+    const size_t numPixels=width * height;
+    
+    histograms_.resize(nc);
+    for (size_t c=0; c<nc; ++c)
+    {
+        histograms_[c].assign(numBins, 0);
+    }
+    
+    if ((numPixels==0) || (nc==0))
+    {
+        return;
+    }
+    
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandHeight=(height + numBands - 1) / numBands;
+    
+    //Interleaved sub-histograms hide the latency of repeated increments of the same bin, but they only pay off if each
+    // gets several counts per bin. Otherwise, e.g. 16-bit images with 65536 bins, zeroing and summing them costs more
+    // than the counting. Sub-histogram s of component c is at (c*numSubHistograms + s)*numBins.
+    const size_t numCountedPixelsPerBand=(bandHeight * width) / stride;
+    const size_t numSubHistograms=(numCountedPixelsPerBand>=16*numBins) ? 4 : 1;
+    
+    if (bandScratch_.size()<numBands) bandScratch_.resize(numBands);
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        std::vector<uint32_t> &bandHistograms=bandScratch_[bandNum];
+        bandHistograms.assign(nc * numSubHistograms * numBins, 0);
+        
+        const size_t pixelStart=std::min(bandNum * bandHeight * width, numPixels);
+        const size_t pixelEnd=std::min(pixelStart + bandHeight * width, numPixels);
+        
+        //The first counted pixel of the band, in raster order over the whole image.
+        const size_t firstPixel=((pixelStart + stride - 1) / stride) * stride;
+        
+        for (size_t c=0; c<nc; ++c)
+        {
+            //With a single sub-histogram the four pointers are equal.
+            uint32_t * const h0=bandHistograms.data() + (c*numSubHistograms) * numBins;
+            uint32_t * const h1=bandHistograms.data() + (c*numSubHistograms + 1 % numSubHistograms) * numBins;
+            uint32_t * const h2=bandHistograms.data() + (c*numSubHistograms + 2 % numSubHistograms) * numBins;
+            uint32_t * const h3=bandHistograms.data() + (c*numSubHistograms + 3 % numSubHistograms) * numBins;
+            
+            const size_t step=stride * nc;
+            T const * component=data + firstPixel * nc + c;
+            
+            size_t p=firstPixel;
+            for (; p + 3*stride < pixelEnd; p+=4*stride, component+=4*step)
+            {
+                ++h0[binOf(component[0])];
+                ++h1[binOf(component[step])];
+                ++h2[binOf(component[2*step])];
+                ++h3[binOf(component[3*step])];
+            }
+            for (; p<pixelEnd; p+=stride, component+=step)
+            {
+                ++h0[binOf(component[0])];
+            }
+        }
+    }
+    
+    //Sum the sub-histograms of all the bands. Each thread sums a range of bins.
+    const size_t binChunkSize=1024;
+    const int32_t numBinChunks=int32_t((numBins + binChunkSize - 1) / binChunkSize);
+    
+    int32_t binChunkNum=0;
+#pragma omp parallel for
+    for (binChunkNum=0; binChunkNum<numBinChunks; ++binChunkNum)
+    {
+        const size_t binStart=binChunkNum * binChunkSize;
+        const size_t binEnd=std::min(binStart + binChunkSize, numBins);
+        
+        for (size_t c=0; c<nc; ++c)
+        {
+            int32_t * const histogram=histograms_[c].data();
+            
+            for (size_t b=0; b<numBands; ++b)
+            {
+                for (size_t s=0; s<numSubHistograms; ++s)
+                {
+                    uint32_t const * const subHistogram=bandScratch_[b].data() + (c*numSubHistograms + s) * numBins;
+                    
+                    for (size_t bin=binStart; bin<binEnd; ++bin)
+                    {
+                        histogram[bin]+=int32_t(subHistogram[bin]);
+                    }
+                }
+            }
+            
+            if (stride>1)
+            {
+                for (size_t bin=binStart; bin<binEnd; ++bin)
+                {
+                    histogram[bin]*=int32_t(stride);
+                }
+            }
+        }
+    }
+}
+
+void ImageHistogram::calculate(uint8_t const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                               const size_t pixelStride)
+{
+    if (numBins_==256)
+    {
+        calculate(data, width, height, componentsPerPixel, pixelStride, IdentityBin());
+    } else
+    {
+        calculate(data, width, height, componentsPerPixel, pixelStride, IntegerBin(numBins_, 8));
+    }
+}
+
+void ImageHistogram::calculate(uint16_t const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                               const size_t pixelStride)
+{
+    calculate(data, width, height, componentsPerPixel, pixelStride, IntegerBin(numBins_, 16));
+}
+
+void ImageHistogram::calculate(float const * const data, const size_t width, const size_t height, const size_t componentsPerPixel,
+                               const size_t pixelStride)
+{
+    calculate(data, width, height, componentsPerPixel, pixelStride, FloatBin(numBins_, low_, high_));
+}
+
+const std::vector<uint8_t> ImageHistogram::calcIdentityMap(const size_t numBins)
+{
+    std::vector<uint8_t> histoIdentityMap;
+    histoIdentityMap.resize(numBins);
+    
+    for (size_t binNum=0; binNum<numBins; binNum++)
+    {//More than 256 bins are mapped onto the 8-bit level that each bin covers.
+        histoIdentityMap[binNum]=uint8_t((numBins>256) ? (binNum * 256) / numBins : binNum);
+    }
+    
+    return histoIdentityMap;
+}
+
+const std::vector<int32_t> ImageHistogram::calcRefHistogramForEqualisation(const uint32_t histoSum, const size_t numBins)
+{
+    std::vector<int32_t> refHisto;
+    refHisto.resize(numBins);
+    
+    uint32_t binsTotal=0;
+    
+    for (size_t binNum=0; binNum<numBins; binNum++)
+    {
+        float targetBinsTotal=((binNum+1)/((float)numBins))*histoSum;
+        
+        uint32_t binValue=(uint32_t)(targetBinsTotal - binsTotal + 0.5);
+        
+        refHisto[binNum]=binValue;
+        
+        binsTotal+=binValue;
+    }
+    
+    return refHisto;
+}
+
+const std::vector<uint8_t> ImageHistogram::calcMatchMap(const std::vector<int32_t> &inHisto, const std::vector<int32_t> &refHisto)
+{
+    const size_t numBins=inHisto.size();
+    const size_t numRefBins=std::min<size_t>(refHisto.size(), 256);
+    
+    std::vector<uint8_t> histoMatchMap;
+    histoMatchMap.resize(numBins);
+    
+    float binTotal=0.0f;
+    float refBinTotal=0.0f;
+    
+    size_t binNum=0;
+    size_t refBinNum=0;
+    
+    for (; refBinNum<numRefBins; refBinNum++)
+    {
+        refBinTotal+=refHisto[refBinNum];
+        
+        while ((binTotal<refBinTotal)&&(binNum<numBins))
+        {
+            binTotal+=inHisto[binNum];
+            histoMatchMap[binNum]=uint8_t(refBinNum);
+            binNum++;
+        }
+    }
+    for (; binNum<numBins; binNum++)
+    {
+        histoMatchMap[binNum]=uint8_t(numRefBins-1);
+    }
+    
+    return histoMatchMap;
+}
+
+const std::vector<uint8_t> ImageHistogram::calcStretchMap(const std::vector<int32_t> &inHisto, const uint32_t histoSum,
+                                                          const double ignoreBelow, const double ignoreAbove)
+{
+    const size_t numBins=inHisto.size();
+    
+    if ((numBins==0)||(histoSum==0))
+    {
+        return calcIdentityMap(numBins);
+    }
+    
+    std::vector<uint8_t> histoStretchMap;
+    histoStretchMap.resize(numBins);
+    
+    uint32_t binTotal=0;
+    size_t startBin=0;
+    size_t endBin=numBins-1;
+    
+    for (size_t binNum=0; binNum<numBins; binNum++)
+    {
+        if ( (binTotal/((double)histoSum))<ignoreBelow )
+        {
+            startBin=binNum;
+        }
+        
+        if ( (binTotal/((double)histoSum))<ignoreAbove )
+        {
+            endBin=binNum;
+        }
+        
+        binTotal+=inHisto[binNum];
+    }
+    
+    for (size_t binNum=0; binNum<startBin; binNum++)
+    {//leading 0 entries.
+        histoStretchMap[binNum]=0;
+    }
+    if (endBin==startBin)
+    {//Nothing to stretch, so the bin keeps its own level.
+        histoStretchMap[startBin]=calcIdentityMap(numBins)[startBin];
+    } else
+    {
+        for (size_t binNum=startBin; binNum<=endBin; binNum++)
+        {
+            histoStretchMap[binNum]=uint8_t(std::min<double>((binNum-startBin)/((double)(endBin-startBin))*255.0 + 0.5, 255.0));
+        }
+    }
+    for (size_t binNum=(endBin+1); binNum<numBins; binNum++)
+    {//trailing 255 entries.
+        histoStretchMap[binNum]=255;
+    }
+    
+    return histoStretchMap;
+}
+
+void ImageHistogram::calcClipLimitedEqualisationMap(uint8_t * const map, uint32_t const * const histogram, const size_t numBins,
+                                                    const uint32_t clipLimit)
+{
+    if (numBins==0)
+    {
+        return;
+    }
+    
+    uint64_t excess=0;
+    uint64_t total=0;
+    for (size_t binNum=0; binNum<numBins; binNum++)
+    {
+        excess+=(histogram[binNum]>clipLimit) ? (histogram[binNum] - clipLimit) : 0;
+        total+=histogram[binNum];
+    }
+    
+    if (total==0)
+    {
+        for (size_t binNum=0; binNum<numBins; binNum++)
+        {
+            map[binNum]=uint8_t(std::min<size_t>((binNum * 255) / std::max<size_t>(numBins-1, 1), 255));
+        }
+        return;
+    }
+    
+    //Every bin gets excess/numBins of the clipped counts. The cumulative count is kept scaled by numBins so that the
+    //spread is exact in integer arithmetic.
+    const uint64_t denominator=total * numBins;
+    uint64_t cumulativeClipped=0;
+    
+    for (size_t binNum=0; binNum<numBins; binNum++)
+    {
+        cumulativeClipped+=std::min<uint64_t>(histogram[binNum], clipLimit);
+        const uint64_t cumulative=cumulativeClipped * numBins + excess * (binNum + 1);
+        
+        map[binNum]=uint8_t(std::min<uint64_t>((cumulative * 255 + denominator / 2) / denominator, 255));
+    }
+}
+
+//=========================================//
+
+
+//=========== GuidedFilter ==========//
+
+namespace
+{
+    inline void storeFiltered(uint8_t &dst, const float value)
+    {
+        dst=uint8_t(std::min<float>(std::max<float>(value + 0.5f, 0.0f), 255.0f));
+    }
+    
+    inline void storeFiltered(float &dst, const float value)
+    {
+        dst=value;
+    }
+    
+    /*!Means of the (2*radius+1)^2 windows centred on the pixels of line y, clipped at the image borders, from a single
+     * component integral image. zeroLine holds width zeros and stands in for the line above the first line.*/
+    void calcWindowMeans(float * const means, double const * const integralImage, double const * const zeroLine,
+                         const size_t width, const size_t height, const size_t y, const size_t radius)
+    {
+        const size_t y0=(y>radius) ? (y - radius) : 0;
+        const size_t y1=std::min<size_t>(y + radius, height - 1);
+        double const * const lineBottom=integralImage + y1*width;
+        double const * const lineAbove=(y0>0) ? (integralImage + (y0-1)*width) : zeroLine;
+        const double numRows=double(y1 - y0 + 1);
+        
+        size_t x=0;
+        
+        //Windows clipped on the left, and possibly on the right for narrow images.
+        for (; (x<width) && (x<=radius); ++x)
+        {
+            const size_t x1=std::min<size_t>(x + radius, width - 1);
+            means[x]=float((lineBottom[x1] - lineAbove[x1]) / (numRows * double(x1 + 1)));
+        }
+        
+        const double recipCount=1.0 / (numRows * double(2*radius + 1));
+        for (; x+radius<width; ++x)
+        {
+            means[x]=float((lineBottom[x + radius] - lineAbove[x + radius] - lineBottom[x - radius - 1] + lineAbove[x - radius - 1]) * recipCount);
+        }
+        
+        //Windows clipped on the right.
+        for (; x<width; ++x)
+        {
+            means[x]=float((lineBottom[width - 1] - lineAbove[width - 1] - lineBottom[x - radius - 1] + lineAbove[x - radius - 1])
+                           / (numRows * double(width + radius - x)));
+        }
+    }
+}
+
+GuidedFilter::GuidedFilter(const size_t radius, const float epsilon, const size_t subsample) :
+radius_(std::max<size_t>(radius, 1)),
+epsilon_(std::max<float>(epsilon, 1.0e-8f)),
+subsample_(std::max<size_t>(subsample, 1))
+{
+}
+
+bool GuidedFilter::filter(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                          const size_t width, const size_t height, const size_t componentsPerPixel)
+{
+    return filter<uint8_t>(dataWrite, dataRead, width, height, componentsPerPixel, epsilon_*(255.0f*255.0f));
+}
+
+bool GuidedFilter::filter(float * const dataWrite, float const * const dataRead,
+                          const size_t width, const size_t height, const size_t componentsPerPixel)
+{
+    return filter<float>(dataWrite, dataRead, width, height, componentsPerPixel, epsilon_);
+}
+
+template<typename T>
+bool GuidedFilter::filter(T * const dataWrite, T const * const dataRead,
+                          const size_t width, const size_t height, const size_t componentsPerPixel,
+                          const float epsilon)
+{
+    if ((width==0) || (height==0) || (componentsPerPixel==0))
+    {
+        return false;
+    }
+    
+    const size_t subsample=std::min<size_t>(subsample_, std::min<size_t>(width, height));
+    const size_t fitWidth=(width + subsample - 1) / subsample;
+    const size_t fitHeight=(height + subsample - 1) / subsample;
+    const size_t radius=std::max<size_t>((radius_ + subsample/2) / subsample, 1);
+    
+    guide_.resize(width*height);
+    fitImage_.resize(fitWidth*fitHeight);
+    fitImageSquared_.resize(fitWidth*fitHeight);
+    integralImageI_.resize(fitWidth*fitHeight);
+    integralImageII_.resize(fitWidth*fitHeight);
+    coefficientA_.resize(fitWidth*fitHeight);
+    coefficientB_.resize(fitWidth*fitHeight);
+    
+    float * const guide=guide_.data();
+    float * const fitImage=(subsample>1) ? fitImage_.data() : guide;
+    float * const fitImageSquared=fitImageSquared_.data();
+    double * const integralImageI=integralImageI_.data();
+    double * const integralImageII=integralImageII_.data();
+    float * const coefficientA=coefficientA_.data();
+    float * const coefficientB=coefficientB_.data();
+    
+    zeroLine_.assign(fitWidth, 0.0);
+    double const * const zeroLine=zeroLine_.data();
+    
+    //Bilinear upsampling positions of the pixels in the subsampled image.
+    std::vector<size_t> upsampleX0(width), upsampleX1(width);
+    std::vector<float> upsampleWX(width);
+    for (size_t x=0; x<width; ++x)
+    {
+        const float fx=std::min<float>(std::max<float>((x + 0.5f) / subsample - 0.5f, 0.0f), float(fitWidth - 1));
+        upsampleX0[x]=size_t(fx);
+        upsampleX1[x]=std::min<size_t>(upsampleX0[x] + 1, fitWidth - 1);
+        upsampleWX[x]=fx - float(upsampleX0[x]);
+    }
+    
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandHeight=(height + numBands - 1) / numBands;
+    const size_t numFitBands=getNumRowBands(fitHeight);
+    const size_t fitBandHeight=(fitHeight + numFitBands - 1) / numFitBands;
+    
+    if (bandLines_.size()<numFitBands) bandLines_.resize(numFitBands);
+    for (size_t bandNum=0; bandNum<numFitBands; ++bandNum)
+    {
+        if (bandLines_[bandNum].size()<2*fitWidth) bandLines_[bandNum].resize(2*fitWidth);
+    }
+    
+    IntegralImage &integralImage=integralImage_;
+    
+    for (size_t component=0; component<componentsPerPixel; ++component)
+    {
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, height);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                T const * const lineRead=dataRead + y*width*componentsPerPixel + component;
+                float * const lineGuide=guide + y*width;
+                
+                for (size_t x=0; x<width; ++x)
+                {
+                    lineGuide[x]=float(lineRead[x*componentsPerPixel]);
+                }
+            }
+        }
+        
+        //The image the linear model is fitted on, box downsampled for the fast guided filter, and its square.
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numFitBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * fitBandHeight, fitHeight);
+            for (size_t y=bandNum * fitBandHeight; y<yEnd; ++y)
+            {
+                if (subsample>1)
+                {
+                    const size_t yGuideStart=y*subsample;
+                    const size_t yGuideEnd=std::min<size_t>(yGuideStart + subsample, height);
+                    
+                    for (size_t x=0; x<fitWidth; ++x)
+                    {
+                        const size_t xGuideStart=x*subsample;
+                        const size_t xGuideEnd=std::min<size_t>(xGuideStart + subsample, width);
+                        
+                        float sum=0.0f;
+                        for (size_t yGuide=yGuideStart; yGuide<yGuideEnd; ++yGuide)
+                        {
+                            for (size_t xGuide=xGuideStart; xGuide<xGuideEnd; ++xGuide)
+                            {
+                                sum+=guide[yGuide*width + xGuide];
+                            }
+                        }
+                        
+                        fitImage[y*fitWidth + x]=sum / float((yGuideEnd - yGuideStart) * (xGuideEnd - xGuideStart));
+                    }
+                }
+                
+                float const * const lineFit=fitImage + y*fitWidth;
+                float * const lineFitSquared=fitImageSquared + y*fitWidth;
+                for (size_t x=0; x<fitWidth; ++x)
+                {
+                    lineFitSquared[x]=lineFit[x] * lineFit[x];
+                }
+            }
+        }
+        
+        int32_t imageNum=0;
+#pragma omp parallel for
+        for (imageNum=0; imageNum<2; ++imageNum)
+        {
+            integralImage.process((imageNum==0) ? integralImageI : integralImageII,
+                                  (imageNum==0) ? fitImage : fitImageSquared, fitWidth, fitHeight);
+        }
+        
+        //Linear model of each window. The guide is the image itself, so the covariance is the variance.
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numFitBands); ++bandNum)
+        {
+            float * const means=bandLines_[bandNum].data();
+            float * const meanSquares=means + fitWidth;
+            
+            const size_t yEnd=std::min<size_t>((bandNum+1) * fitBandHeight, fitHeight);
+            for (size_t y=bandNum * fitBandHeight; y<yEnd; ++y)
+            {
+                calcWindowMeans(means, integralImageI, zeroLine, fitWidth, fitHeight, y, radius);
+                calcWindowMeans(meanSquares, integralImageII, zeroLine, fitWidth, fitHeight, y, radius);
+                
+                float * const lineA=coefficientA + y*fitWidth;
+                float * const lineB=coefficientB + y*fitWidth;
+                
+                for (size_t x=0; x<fitWidth; ++x)
+                {
+                    const float mean=means[x];
+                    const float variance=std::max<float>(meanSquares[x] - mean*mean, 0.0f);
+                    const float a=variance / (variance + epsilon);
+                    
+                    lineA[x]=a;
+                    lineB[x]=mean - a*mean;
+                }
+            }
+        }
+
+#pragma omp parallel for
+        for (imageNum=0; imageNum<2; ++imageNum)
+        {
+            integralImage.process((imageNum==0) ? integralImageI : integralImageII,
+                                  (imageNum==0) ? coefficientA : coefficientB, fitWidth, fitHeight);
+        }
+        
+        //Window means of the coefficients.
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numFitBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * fitBandHeight, fitHeight);
+            for (size_t y=bandNum * fitBandHeight; y<yEnd; ++y)
+            {
+                calcWindowMeans(coefficientA + y*fitWidth, integralImageI, zeroLine, fitWidth, fitHeight, y, radius);
+                calcWindowMeans(coefficientB + y*fitWidth, integralImageII, zeroLine, fitWidth, fitHeight, y, radius);
+            }
+        }
+        
+        //Output of the mean linear model at full resolution.
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, height);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                T * const lineWrite=dataWrite + y*width*componentsPerPixel + component;
+                float const * const lineGuide=guide + y*width;
+                
+                if (subsample==1)
+                {
+                    float const * const lineA=coefficientA + y*width;
+                    float const * const lineB=coefficientB + y*width;
+                    
+                    for (size_t x=0; x<width; ++x)
+                    {
+                        storeFiltered(lineWrite[x*componentsPerPixel], lineA[x]*lineGuide[x] + lineB[x]);
+                    }
+                } else
+                {
+                    const float fy=std::min<float>(std::max<float>((y + 0.5f) / subsample - 0.5f, 0.0f), float(fitHeight - 1));
+                    const size_t y0=size_t(fy);
+                    const size_t y1=std::min<size_t>(y0 + 1, fitHeight - 1);
+                    const float wy=fy - float(y0);
+                    
+                    float const * const lineA0=coefficientA + y0*fitWidth;
+                    float const * const lineA1=coefficientA + y1*fitWidth;
+                    float const * const lineB0=coefficientB + y0*fitWidth;
+                    float const * const lineB1=coefficientB + y1*fitWidth;
+                    
+                    for (size_t x=0; x<width; ++x)
+                    {
+                        const size_t x0=upsampleX0[x];
+                        const size_t x1=upsampleX1[x];
+                        const float wx=upsampleWX[x];
+                        
+                        const float a0=lineA0[x0] + (lineA0[x1] - lineA0[x0])*wx;
+                        const float a1=lineA1[x0] + (lineA1[x1] - lineA1[x0])*wx;
+                        const float b0=lineB0[x0] + (lineB0[x1] - lineB0[x0])*wx;
+                        const float b1=lineB1[x0] + (lineB1[x1] - lineB1[x0])*wx;
+                        
+                        const float a=a0 + (a1 - a0)*wy;
+                        const float b=b0 + (b1 - b0)*wy;
+                        
+                        storeFiltered(lineWrite[x*componentsPerPixel], a*lineGuide[x] + b);
+                    }
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+//=========================================//
+
+
+//=========== BilateralGrid ==========//
+
+BilateralGrid::BilateralGrid(const size_t spatialSigma, const size_t rangeSigma) :
+spatialSigma_(std::max<size_t>(spatialSigma, 1)),
+rangeSigma_(std::min<size_t>(std::max<size_t>(rangeSigma, 1), 255))
+{
+}
+
+bool BilateralGrid::filter(uint8_t * const dataWrite, uint8_t const * const dataRead,
+                           const size_t width, const size_t height, const size_t componentsPerPixel)
+{
+    if ((width==0) || (height==0) || ((componentsPerPixel!=1) && (componentsPerPixel!=3)))
+    {
+        return false;
+    }
+    
+    const size_t spatialSigma=spatialSigma_;
+    const size_t rangeSigma=rangeSigma_;
+    
+    //One cell of zero padding around the grid so that the blur and the slice need no border checks.
+    const size_t gridWidth=(width - 1 + spatialSigma/2) / spatialSigma + 3;
+    const size_t gridHeight=(height - 1 + spatialSigma/2) / spatialSigma + 3;
+    const size_t gridDepth=(255 + rangeSigma/2) / rangeSigma + 3;
+    const size_t cellSize=componentsPerPixel + 1;
+    const size_t lineSize=gridDepth*cellSize;
+    const size_t rowSize=gridWidth*lineSize;
+    
+    grid_.assign(gridHeight*rowSize, 0.0f);
+    gridScratch_.resize(gridHeight*rowSize);
+    range_.resize(width*height);
+    
+    float * const grid=grid_.data();
+    float * const gridScratch=gridScratch_.data();
+    uint8_t * const range=range_.data();
+    
+    memset(gridScratch, 0, rowSize*sizeof(float));
+    memset(gridScratch + (gridHeight-1)*rowSize, 0, rowSize*sizeof(float));
+    
+    const size_t numBands=getNumRowBands(height);
+    const size_t bandHeight=(height + numBands - 1) / numBands;
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, height);
+        for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+        {
+            uint8_t const * const lineRead=dataRead + y*width*componentsPerPixel;
+            uint8_t * const lineRange=range + y*width;
+            
+            if (componentsPerPixel==3)
+            {
+                for (size_t x=0; x<width; ++x)
+                {
+                    lineRange[x]=uint8_t((uint32_t(lineRead[x*3]) + 2*uint32_t(lineRead[x*3+1]) + uint32_t(lineRead[x*3+2]) + 2) >> 2);
+                }
+            } else
+            {
+                memcpy(lineRange, lineRead, width);
+            }
+        }
+    }
+    
+    //Offsets of the nearest cells along x and range.
+    std::vector<size_t> splatX(width);
+    for (size_t x=0; x<width; ++x)
+    {
+        splatX[x]=((x + spatialSigma/2) / spatialSigma + 1)*lineSize;
+    }
+    
+    size_t splatZ[256];
+    for (size_t v=0; v<256; ++v)
+    {
+        splatZ[v]=((v + rangeSigma/2) / rangeSigma + 1)*cellSize;
+    }
+    
+    //Splat: each task owns one row of the grid and the image rows that are nearest to it.
+    int32_t gridRow=0;
+#pragma omp parallel for
+    for (gridRow=1; gridRow<int32_t(gridHeight-1); ++gridRow)
+    {
+        const size_t cellRow=size_t(gridRow) - 1;
+        const size_t yStart=(cellRow*spatialSigma > spatialSigma/2) ? (cellRow*spatialSigma - spatialSigma/2) : 0;
+        const size_t yEnd=std::min<size_t>((cellRow + 1)*spatialSigma - spatialSigma/2, height);
+        float * const row=grid + size_t(gridRow)*rowSize;
+        
+        for (size_t y=yStart; y<yEnd; ++y)
+        {
+            uint8_t const * const lineRead=dataRead + y*width*componentsPerPixel;
+            uint8_t const * const lineRange=range + y*width;
+            
+            for (size_t x=0; x<width; ++x)
+            {
+                float * const cell=row + splatX[x] + splatZ[lineRange[x]];
+                
+                for (size_t c=0; c<componentsPerPixel; ++c)
+                {
+                    cell[c]+=float(lineRead[x*componentsPerPixel + c]);
+                }
+                cell[componentsPerPixel]+=1.0f;
+            }
+        }
+    }
+    
+    //[1 2 1] blur along x and range within each grid row, then along y. The padding cells stay zero in the blurred grid.
+#pragma omp parallel for
+    for (gridRow=1; gridRow<int32_t(gridHeight-1); ++gridRow)
+    {
+        float const * const row=grid + size_t(gridRow)*rowSize;
+        float * const rowScratch=gridScratch + size_t(gridRow)*rowSize;
+        
+        memset(rowScratch, 0, lineSize*sizeof(float));
+        memset(rowScratch + (gridWidth-1)*lineSize, 0, lineSize*sizeof(float));
+        
+        for (size_t gridX=1; gridX<gridWidth-1; ++gridX)
+        {
+            float const * const line=row + gridX*lineSize;
+            float * const lineScratch=rowScratch + gridX*lineSize;
+            
+            for (size_t i=0; i<lineSize; ++i)
+            {
+                lineScratch[i]=line[i - lineSize] + 2.0f*line[i] + line[i + lineSize];
+            }
+        }
+        
+        //The range blur writes back into the grid.
+        float * const rowOut=grid + size_t(gridRow)*rowSize;
+        for (size_t gridX=1; gridX<gridWidth-1; ++gridX)
+        {
+            float const * const lineScratch=rowScratch + gridX*lineSize;
+            float * const line=rowOut + gridX*lineSize;
+            
+            for (size_t i=cellSize; i<lineSize-cellSize; ++i)
+            {
+                line[i]=lineScratch[i - cellSize] + 2.0f*lineScratch[i] + lineScratch[i + cellSize];
+            }
+        }
+    }
+
+#pragma omp parallel for
+    for (gridRow=1; gridRow<int32_t(gridHeight-1); ++gridRow)
+    {
+        float const * const row=grid + size_t(gridRow)*rowSize;
+        float * const rowScratch=gridScratch + size_t(gridRow)*rowSize;
+        
+        for (size_t i=0; i<rowSize; ++i)
+        {
+            rowScratch[i]=row[i - rowSize] + 2.0f*row[i] + row[i + rowSize];
+        }
+    }
+    
+    //Slice: trilinear interpolation of the blurred grid.
+    std::vector<size_t> sliceX(width);
+    std::vector<float> sliceWX(width);
+    for (size_t x=0; x<width; ++x)
+    {
+        sliceX[x]=x / spatialSigma + 1;
+        sliceWX[x]=float(x % spatialSigma) / float(spatialSigma);
+    }
+    
+    size_t sliceZ[256];
+    float sliceWZ[256];
+    for (size_t v=0; v<256; ++v)
+    {
+        sliceZ[v]=v / rangeSigma + 1;
+        sliceWZ[v]=float(v % rangeSigma) / float(rangeSigma);
+    }
+
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, height);
+        for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+        {
+            float const * const row0=gridScratch + (y / spatialSigma + 1)*rowSize;
+            float const * const row1=row0 + rowSize;
+            const float wy=float(y % spatialSigma) / float(spatialSigma);
+            
+            uint8_t const * const lineRange=range + y*width;
+            uint8_t * const lineWrite=dataWrite + y*width*componentsPerPixel;
+            
+            for (size_t x=0; x<width; ++x)
+            {
+                const size_t offset=sliceX[x]*lineSize + sliceZ[lineRange[x]]*cellSize;
+                const float wx=sliceWX[x];
+                const float wz=sliceWZ[lineRange[x]];
+                
+                const float w00=(1.0f - wy)*(1.0f - wx);
+                const float w01=(1.0f - wy)*wx;
+                const float w10=wy*(1.0f - wx);
+                const float w11=wy*wx;
+                
+                float sums[4];
+                for (size_t c=0; c<cellSize; ++c)
+                {
+                    const size_t i=offset + c;
+                    const float z0=w00*row0[i] + w01*row0[i + lineSize] + w10*row1[i] + w11*row1[i + lineSize];
+                    const size_t j=i + cellSize;
+                    const float z1=w00*row0[j] + w01*row0[j + lineSize] + w10*row1[j] + w11*row1[j + lineSize];
+                    sums[c]=z0 + (z1 - z0)*wz;
+                }
+                
+                const float weight=sums[componentsPerPixel];
+                if (weight>0.0f)
+                {
+                    const float recipWeight=1.0f / weight;
+                    for (size_t c=0; c<componentsPerPixel; ++c)
+                    {
+                        lineWrite[x*componentsPerPixel + c]=uint8_t(std::min<float>(sums[c]*recipWeight + 0.5f, 255.0f));
+                    }
+                } else
+                {
+                    for (size_t c=0; c<componentsPerPixel; ++c)
+                    {
+                        lineWrite[x*componentsPerPixel + c]=dataRead[(y*width + x)*componentsPerPixel + c];
+                    }
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+//=========================================//
+
+
+//=========== ImagePyramid ==========//
+
+namespace
+{
+    //!Half of the symmetric 12 tap binomial kernel, from the centre outwards.
+    const float pyramidKernel[6]={462.0f/2048.0f, 330.0f/2048.0f, 165.0f/2048.0f, 55.0f/2048.0f, 11.0f/2048.0f, 1.0f/2048.0f};
+    
+    inline ptrdiff_t clampPyramidIndex(const ptrdiff_t i, const ptrdiff_t size)
+    {
+        return (i<0) ? 0 : ((i>=size) ? (size-1) : i);
+    }
+}
+
+ImagePyramid::ImagePyramid(const size_t numLevels) :
+numLevels_(std::max<size_t>(numLevels, 1)),
+image_(nullptr)
+{
+}
+
+void ImagePyramid::downsample(float * const dataWrite, float const * const dataRead,
+                              const size_t widthUS, const size_t heightUS, const size_t componentsPerPixel)
+{
+    const ptrdiff_t widthDS=ptrdiff_t(getLevelSize(widthUS, 1));
+    const ptrdiff_t heightDS=ptrdiff_t(getLevelSize(heightUS, 1));
+    const ptrdiff_t componentsPerLineUS=ptrdiff_t(widthUS*componentsPerPixel);
+    const ptrdiff_t componentsPerLineDS=widthDS*ptrdiff_t(componentsPerPixel);
+    const ptrdiff_t cpp=ptrdiff_t(componentsPerPixel);
+    
+    scratch_.resize(size_t(componentsPerLineDS)*heightUS);
+    float * const scratch=scratch_.data();
+    
+    //Pixels whose 12 taps lie inside the line: 2x-5>=0 and 2x+6<=widthUS-1.
+    const ptrdiff_t xInteriorStart=std::min<ptrdiff_t>(3, widthDS);
+    const ptrdiff_t xInteriorEnd=std::max<ptrdiff_t>(std::min<ptrdiff_t>((ptrdiff_t(widthUS) - 7) / 2 + 1, widthDS), xInteriorStart);
+    
+    //=== Horizontal pass into the scratch image ===
+    const size_t numBandsUS=getNumRowBands(heightUS);
+    const ptrdiff_t bandHeightUS=ptrdiff_t((heightUS + numBandsUS - 1) / numBandsUS);
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBandsUS); ++bandNum)
+    {
+        const ptrdiff_t yEnd=std::min<ptrdiff_t>((bandNum+1) * bandHeightUS, ptrdiff_t(heightUS));
+        for (ptrdiff_t y=bandNum * bandHeightUS; y<yEnd; ++y)
+        {
+            float const * const lineRead=dataRead + y*componentsPerLineUS;
+            float * const lineScratch=scratch + y*componentsPerLineDS;
+            
+            for (ptrdiff_t x=0; x<widthDS; ++x)
+            {
+                if (x==xInteriorStart)
+                {//Interior pixels without index clamping.
+                    if (cpp==1)
+                    {
+                        for (; x<xInteriorEnd; ++x)
+                        {
+                            float const * const centre=lineRead + 2*x;
+                            
+                            lineScratch[x]=(centre[0] + centre[1]) * pyramidKernel[0] + (centre[-1] + centre[2]) * pyramidKernel[1] +
+                            (centre[-2] + centre[3]) * pyramidKernel[2] + (centre[-3] + centre[4]) * pyramidKernel[3] +
+                            (centre[-4] + centre[5]) * pyramidKernel[4] + (centre[-5] + centre[6]) * pyramidKernel[5];
+                        }
+                    }
+                    
+                    for (; x<xInteriorEnd; ++x)
+                    {
+                        float const * const centre=lineRead + (2*x)*cpp;
+                        
+                        for (ptrdiff_t c=0; c<cpp; ++c)
+                        {
+                            float sum=0.0f;
+                            for (ptrdiff_t j=0; j<6; ++j)
+                            {
+                                sum+=(centre[c - j*cpp] + centre[c + (j+1)*cpp]) * pyramidKernel[j];
+                            }
+                            lineScratch[x*cpp + c]=sum;
+                        }
+                    }
+                    
+                    if (x>=widthDS) break;
+                }
+                
+                for (ptrdiff_t c=0; c<cpp; ++c)
+                {
+                    float sum=0.0f;
+                    for (ptrdiff_t j=0; j<6; ++j)
+                    {
+                        sum+=(lineRead[clampPyramidIndex(2*x - j, ptrdiff_t(widthUS))*cpp + c] +
+                              lineRead[clampPyramidIndex(2*x + j + 1, ptrdiff_t(widthUS))*cpp + c]) * pyramidKernel[j];
+                    }
+                    lineScratch[x*cpp + c]=sum;
+                }
+            }
+        }
+    }
+    
+    //=== Vertical pass. Whole lines are weighted and summed so that the inner loop vectorises. ===
+    const size_t numBandsDS=getNumRowBands(size_t(heightDS));
+    const ptrdiff_t bandHeightDS=ptrdiff_t((size_t(heightDS) + numBandsDS - 1) / numBandsDS);
+
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBandsDS); ++bandNum)
+    {
+        const ptrdiff_t yEnd=std::min<ptrdiff_t>((bandNum+1) * bandHeightDS, heightDS);
+        for (ptrdiff_t y=bandNum * bandHeightDS; y<yEnd; ++y)
+        {
+            float * const lineWrite=dataWrite + y*componentsPerLineDS;
+            
+            for (ptrdiff_t j=0; j<6; ++j)
+            {
+                float const * const lineAbove=scratch + clampPyramidIndex(2*y - j, ptrdiff_t(heightUS))*componentsPerLineDS;
+                float const * const lineBelow=scratch + clampPyramidIndex(2*y + j + 1, ptrdiff_t(heightUS))*componentsPerLineDS;
+                const float weight=pyramidKernel[j];
+                
+                if (j==0)
+                {
+                    for (ptrdiff_t i=0; i<componentsPerLineDS; ++i)
+                    {
+                        lineWrite[i]=(lineAbove[i] + lineBelow[i]) * weight;
+                    }
+                } else
+                {
+                    for (ptrdiff_t i=0; i<componentsPerLineDS; ++i)
+                    {
+                        lineWrite[i]+=(lineAbove[i] + lineBelow[i]) * weight;
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool ImagePyramid::build(float const * const image, const size_t width, const size_t height, const size_t componentsPerPixel)
+{
+    if ((image==nullptr) || (width==0) || (height==0))
+    {
+        return false;
+    }
+    
+    image_=image;
+    levelVec_.resize(numLevels_-1);
+    
+    for (size_t levelNum=1; levelNum<numLevels_; ++levelNum)
+    {
+        const size_t widthUS=getLevelSize(width, levelNum-1);
+        const size_t heightUS=getLevelSize(height, levelNum-1);
+        
+        std::vector<float> &level=levelVec_[levelNum-1];
+        level.resize(getLevelSize(width, levelNum) * getLevelSize(height, levelNum) * componentsPerPixel);
+        
+        downsample(level.data(), getLevel(levelNum-1), widthUS, heightUS, componentsPerPixel);
+    }
+    
+    return true;
+}
+
+//=========================================//
+
+
+//=========== ImageResize ==========//
+
+namespace
+{
+    const int32_t resizeWeightBits=14;
+    
+    //!Radius of the kernel at unit scale.
+    double getResizeKernelSupport(const ImageResize::Method method)
+    {
+        switch (method)
+        {
+            case ImageResize::Method::AREA:
+                return 0.5;
+            case ImageResize::Method::LANCZOS3:
+                return 3.0;
+            default:
+                return 1.0;
+        }
+    }
+    
+    double evalResizeKernel(const ImageResize::Method method, const double t)
+    {
+        switch (method)
+        {
+            case ImageResize::Method::AREA:
+                return ((t>=-0.5) && (t<0.5)) ? 1.0 : 0.0;
+            case ImageResize::Method::LANCZOS3:
+            {
+                if (t==0.0) return 1.0;
+                if ((t<=-3.0) || (t>=3.0)) return 0.0;
+                const double pit=M_PI * t;
+                return (3.0 * sin(pit) * sin(pit / 3.0)) / (pit * pit);
+            }
+            default:
+            {
+                const double at=fabs(t);
+                return (at<1.0) ? (1.0 - at) : 0.0;
+            }
+        }
+    }
+    
+    inline void storeResized(uint16_t &dst, const float value)
+    {
+        dst=uint16_t(std::min(std::max(value + 0.5f, 0.0f), 65535.0f));
+    }
+    
+    inline void storeResized(float &dst, const float value)
+    {
+        dst=value;
+    }
+    
+    /*!Horizontally filter one line. CPP is the number of components per pixel when it is known at compile time, which
+     * lets the compiler unroll the component loop, or 0 to use componentsPerPixel.*/
+    template<size_t CPP, typename T>
+    void filterResizeLine(float * const lineWrite, T const * const lineRead, const size_t widthDS,
+                          int32_t const * const start, float const * const weights, const size_t numTaps,
+                          const size_t componentsPerPixel)
+    {
+        const size_t cpp=(CPP>0) ? CPP : componentsPerPixel;
+        float sums[(CPP>0) ? CPP : 1];
+        
+        for (size_t x=0; x<widthDS; ++x)
+        {
+            T const * const pixelsRead=lineRead + size_t(start[x]) * cpp;
+            float const * const pixelWeights=weights + x * numTaps;
+            
+            if (CPP>0)
+            {
+                for (size_t c=0; c<cpp; ++c) sums[c]=0.0f;
+                for (size_t k=0; k<numTaps; ++k)
+                {
+                    const float weight=pixelWeights[k];
+                    for (size_t c=0; c<cpp; ++c)
+                    {
+                        sums[c]+=weight * float(pixelsRead[k * cpp + c]);
+                    }
+                }
+                for (size_t c=0; c<cpp; ++c) lineWrite[x * cpp + c]=sums[c];
+            } else
+            {
+                for (size_t c=0; c<cpp; ++c)
+                {
+                    float sum=0.0f;
+                    for (size_t k=0; k<numTaps; ++k)
+                    {
+                        sum+=pixelWeights[k] * float(pixelsRead[k * cpp + c]);
+                    }
+                    lineWrite[x * cpp + c]=sum;
+                }
+            }
+        }
+    }
+    
+    //!Fixed point version of filterResizeLine for 8-bit data. Writes the result with 6 fractional bits.
+    template<size_t CPP>
+    void filterResizeLine(int16_t * const lineWrite, uint8_t const * const lineRead, const size_t widthDS,
+                          int32_t const * const start, int16_t const * const weights, const size_t numTaps,
+                          const size_t componentsPerPixel)
+    {
+        const size_t cpp=(CPP>0) ? CPP : componentsPerPixel;
+        int32_t sums[(CPP>0) ? CPP : 1];
+        
+        for (size_t x=0; x<widthDS; ++x)
+        {
+            uint8_t const * const pixelsRead=lineRead + size_t(start[x]) * cpp;
+            int16_t const * const pixelWeights=weights + x * numTaps;
+            
+            if (CPP>0)
+            {
+                for (size_t c=0; c<cpp; ++c) sums[c]=1<<7;
+                for (size_t k=0; k<numTaps; ++k)
+                {
+                    const int32_t weight=pixelWeights[k];
+                    for (size_t c=0; c<cpp; ++c)
+                    {
+                        sums[c]+=weight * int32_t(pixelsRead[k * cpp + c]);
+                    }
+                }
+                for (size_t c=0; c<cpp; ++c) lineWrite[x * cpp + c]=int16_t(sums[c] >> 8);
+            } else
+            {
+                for (size_t c=0; c<cpp; ++c)
+                {
+                    int32_t sum=1<<7;
+                    for (size_t k=0; k<numTaps; ++k)
+                    {
+                        sum+=int32_t(pixelWeights[k]) * int32_t(pixelsRead[k * cpp + c]);
+                    }
+                    lineWrite[x * cpp + c]=int16_t(sum >> 8);
+                }
+            }
+        }
+    }
+    
+    template<typename TW, typename TR, typename TK>
+    void filterResizeLine(TW * const lineWrite, TR const * const lineRead, const size_t widthDS,
+                          int32_t const * const start, TK const * const weights, const size_t numTaps,
+                          const size_t componentsPerPixel)
+    {
+        switch (componentsPerPixel)
+        {
+            case 1:
+                filterResizeLine<1>(lineWrite, lineRead, widthDS, start, weights, numTaps, componentsPerPixel);
+                break;
+            case 3:
+                filterResizeLine<3>(lineWrite, lineRead, widthDS, start, weights, numTaps, componentsPerPixel);
+                break;
+            case 4:
+                filterResizeLine<4>(lineWrite, lineRead, widthDS, start, weights, numTaps, componentsPerPixel);
+                break;
+            default:
+                filterResizeLine<0>(lineWrite, lineRead, widthDS, start, weights, numTaps, componentsPerPixel);
+                break;
+        }
+    }
+}
+
+ImageResize::ImageResize(const Method method) :
+method_(method)
+{
+    tableX_.method=tableY_.method=method;
+    tableX_.sizeUS=tableY_.sizeUS=0;
+    tableX_.sizeDS=tableY_.sizeDS=0;
+    tableX_.numTaps=tableY_.numTaps=0;
+}
+
+void ImageResize::updateFilterTable(FilterTable &table, const size_t sizeUS, const size_t sizeDS)
+{
+    if ((table.method==method_) && (table.sizeUS==sizeUS) && (table.sizeDS==sizeDS))
+    {
+        return;
+    }
+    
+    table.method=method_;
+    table.sizeUS=sizeUS;
+    table.sizeDS=sizeDS;
+    table.start.resize(sizeDS);
+    
+    const double scale=double(sizeUS) / double(sizeDS);
+    
+    if (method_==Method::NEAREST)
+    {
+        table.numTaps=1;
+        for (size_t x=0; x<sizeDS; ++x)
+        {
+            table.start[x]=int32_t(std::min(size_t((x + 0.5) * scale), sizeUS-1));
+        }
+        table.weights.assign(sizeDS, 1.0f);
+        table.weightsQ14.assign(sizeDS, int16_t(1<<resizeWeightBits));
+        return;
+    }
+    
+    //Stretch the kernel when reducing so that it covers all the source pixels under an output pixel.
+    const double filterScale=std::max(scale, 1.0);
+    const double support=getResizeKernelSupport(method_) * filterScale;
+    
+    //Every position gets the same number of taps so that the tap loops have a fixed length. The taps of the windows
+    //that would run past the end of the line are moved back inside and zero padded.
+    const size_t numTaps=std::min(size_t(ceil(support)) * 2 + 1, sizeUS);
+    table.numTaps=numTaps;
+    table.weights.assign(sizeDS*numTaps, 0.0f);
+    table.weightsQ14.assign(sizeDS*numTaps, int16_t(0));
+    
+    std::vector<double> tapWeights(numTaps);
+    
+    for (size_t x=0; x<sizeDS; ++x)
+    {
+        const double centre=(x + 0.5) * scale;
+        const ptrdiff_t iBegin=std::max<ptrdiff_t>(ptrdiff_t(centre - support + 0.5), 0);
+        const ptrdiff_t iEnd=std::min<ptrdiff_t>(std::min<ptrdiff_t>(ptrdiff_t(centre + support + 0.5), ptrdiff_t(sizeUS)), iBegin + ptrdiff_t(numTaps));
+        
+        const ptrdiff_t start=std::min<ptrdiff_t>(iBegin, ptrdiff_t(sizeUS - numTaps));
+        table.start[x]=int32_t(start);
+        
+        double sum=0.0;
+        std::fill(tapWeights.begin(), tapWeights.end(), 0.0);
+        for (ptrdiff_t i=iBegin; i<iEnd; ++i)
+        {
+            const double weight=evalResizeKernel(method_, (i + 0.5 - centre) / filterScale);
+            tapWeights[size_t(i - start)]=weight;
+            sum+=weight;
+        }
+        
+        if (sum==0.0)
+        {
+            tapWeights[size_t(std::min<ptrdiff_t>(ptrdiff_t(centre), ptrdiff_t(sizeUS)-1) - start)]=1.0;
+            sum=1.0;
+        }
+        
+        float * const weights=table.weights.data() + x*numTaps;
+        int16_t * const weightsQ14=table.weightsQ14.data() + x*numTaps;
+        
+        //Round the fixed point weights so that they still sum to one.
+        int32_t sumQ14=0;
+        size_t largestTap=0;
+        for (size_t k=0; k<numTaps; ++k)
+        {
+            const double weight=tapWeights[k] / sum;
+            weights[k]=float(weight);
+            weightsQ14[k]=int16_t(lround(weight * (1<<resizeWeightBits)));
+            sumQ14+=weightsQ14[k];
+            if (tapWeights[k]>tapWeights[largestTap]) largestTap=k;
+        }
+        weightsQ14[largestTap]=int16_t(weightsQ14[largestTap] + ((1<<resizeWeightBits) - sumQ14));
+    }
+}
+
+template<typename T>
+void ImageResize::resizeNearest(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                                T const * const dataRead, const size_t widthUS,
+                                const size_t componentsPerPixel)
+{
+    int32_t const * const startX=tableX_.start.data();
+    int32_t const * const startY=tableY_.start.data();
+    
+    const size_t bytesPerPixel=componentsPerPixel*sizeof(T);
+    
+    const size_t numBands=getNumRowBands(heightDS);
+    const size_t bandHeight=(heightDS + numBands - 1) / numBands;
+    
+    int32_t bandNum=0;
+#pragma omp parallel for
+    for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+    {
+        const size_t yStart=bandNum * bandHeight;
+        const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, heightDS);
+        for (size_t y=yStart; y<yEnd; ++y)
+        {
+            T const * const lineRead=dataRead + size_t(startY[y]) * widthUS * componentsPerPixel;
+            T * const lineWrite=dataWrite + y * widthDS * componentsPerPixel;
+            
+            //Repeated source lines are copied from the previous output line of the band.
+            if ((y>yStart) && (startY[y]==startY[y-1]))
+            {
+                memcpy(lineWrite, lineWrite - widthDS * componentsPerPixel, widthDS * bytesPerPixel);
+                continue;
+            }
+            
+            for (size_t x=0; x<widthDS; ++x)
+            {
+                memcpy(lineWrite + x * componentsPerPixel, lineRead + size_t(startX[x]) * componentsPerPixel, bytesPerPixel);
+            }
+        }
+    }
+}
+
+template<typename T>
+void ImageResize::resizeFloat(T * const dataWrite, const size_t widthDS, const size_t heightDS,
+                              T const * const dataRead, const size_t widthUS, const size_t heightUS,
+                              const size_t componentsPerPixel)
+{
+    const size_t componentsPerLineUS=widthUS * componentsPerPixel;
+    const size_t componentsPerLineDS=widthDS * componentsPerPixel;
+    
+    scratchF32_.resize(componentsPerLineDS * heightUS);
+    float * const scratch=scratchF32_.data();
+    
+    //=== Horizontal pass into the scratch image ===
+    {
+        const size_t numTaps=tableX_.numTaps;
+        int32_t const * const start=tableX_.start.data();
+        float const * const weights=tableX_.weights.data();
+        
+        const size_t numBands=getNumRowBands(heightUS);
+        const size_t bandHeight=(heightUS + numBands - 1) / numBands;
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, heightUS);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                filterResizeLine(scratch + y * componentsPerLineDS, dataRead + y * componentsPerLineUS, widthDS,
+                                 start, weights, numTaps, componentsPerPixel);
+            }
+        }
+    }
+    
+    //=== Vertical pass from the scratch image ===
+    {
+        const size_t numTaps=tableY_.numTaps;
+        int32_t const * const start=tableY_.start.data();
+        float const * const weights=tableY_.weights.data();
+        
+        const size_t numBands=getNumRowBands(heightDS);
+        const size_t bandHeight=(heightDS + numBands - 1) / numBands;
+        
+        if (scratchF32Bands_.size()<numBands) scratchF32Bands_.resize(numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            std::vector<float> &sumLine=scratchF32Bands_[bandNum];
+            sumLine.resize(componentsPerLineDS);
+            float * const sums=sumLine.data();
+            
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, heightDS);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                float const * const lineRead=scratch + size_t(start[y]) * componentsPerLineDS;
+                float const * const lineWeights=weights + y * numTaps;
+                T * const lineWrite=dataWrite + y * componentsPerLineDS;
+                
+                std::fill(sums, sums + componentsPerLineDS, 0.0f);
+                for (size_t k=0; k<numTaps; ++k)
+                {
+                    const float weight=lineWeights[k];
+                    if (weight==0.0f) continue;
+                    
+                    float const * const tapLine=lineRead + k * componentsPerLineDS;
+                    for (size_t i=0; i<componentsPerLineDS; ++i)
+                    {
+                        sums[i]+=weight * tapLine[i];
+                    }
+                }
+                
+                for (size_t i=0; i<componentsPerLineDS; ++i)
+                {
+                    storeResized(lineWrite[i], sums[i]);
+                }
+            }
+        }
+    }
+}
+
+bool ImageResize::resize(uint8_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                         uint8_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                         const size_t componentsPerPixel)
+{
+    if ((widthDS==0) || (heightDS==0) || (widthUS==0) || (heightUS==0) || (componentsPerPixel==0))
+    {
+        return false;
+    }
+    
+    updateFilterTable(tableX_, widthUS, widthDS);
+    updateFilterTable(tableY_, heightUS, heightDS);
+    
+    if (method_==Method::NEAREST)
+    {
+        resizeNearest(dataWrite, widthDS, heightDS, dataRead, widthUS, componentsPerPixel);
+        return true;
+    }
+    
+    const size_t componentsPerLineUS=widthUS * componentsPerPixel;
+    const size_t componentsPerLineDS=widthDS * componentsPerPixel;
+    
+    //The scratch image holds the horizontally filtered lines with 6 fractional bits. The Lanczos overshoot stays well
+    //within the int16 range.
+    scratchQ6_.resize(componentsPerLineDS * heightUS);
+    int16_t * const scratch=scratchQ6_.data();
+    
+    //=== Horizontal pass into the scratch image ===
+    {
+        const size_t numTaps=tableX_.numTaps;
+        int32_t const * const start=tableX_.start.data();
+        int16_t const * const weights=tableX_.weightsQ14.data();
+        
+        const size_t numBands=getNumRowBands(heightUS);
+        const size_t bandHeight=(heightUS + numBands - 1) / numBands;
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, heightUS);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                filterResizeLine(scratch + y * componentsPerLineDS, dataRead + y * componentsPerLineUS, widthDS,
+                                 start, weights, numTaps, componentsPerPixel);
+            }
+        }
+    }
+    
+    //=== Vertical pass from the scratch image ===
+    {
+        const size_t numTaps=tableY_.numTaps;
+        int32_t const * const start=tableY_.start.data();
+        int16_t const * const weights=tableY_.weightsQ14.data();
+        
+        const size_t numBands=getNumRowBands(heightDS);
+        const size_t bandHeight=(heightDS + numBands - 1) / numBands;
+        
+        if (scratchQ20Bands_.size()<numBands) scratchQ20Bands_.resize(numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            std::vector<int32_t> &sumLine=scratchQ20Bands_[bandNum];
+            sumLine.resize(componentsPerLineDS);
+            int32_t * const sums=sumLine.data();
+            
+            const size_t yEnd=std::min<size_t>((bandNum+1) * bandHeight, heightDS);
+            for (size_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                int16_t const * const lineRead=scratch + size_t(start[y]) * componentsPerLineDS;
+                int16_t const * const lineWeights=weights + y * numTaps;
+                uint8_t * const lineWrite=dataWrite + y * componentsPerLineDS;
+                
+                //Start from the rounding offset of the final shift.
+                std::fill(sums, sums + componentsPerLineDS, int32_t(1<<19));
+                for (size_t k=0; k<numTaps; ++k)
+                {
+                    const int32_t weight=lineWeights[k];
+                    if (weight==0) continue;
+                    
+                    int16_t const * const tapLine=lineRead + k * componentsPerLineDS;
+                    for (size_t i=0; i<componentsPerLineDS; ++i)
+                    {
+                        sums[i]+=weight * int32_t(tapLine[i]);
+                    }
+                }
+                
+                for (size_t i=0; i<componentsPerLineDS; ++i)
+                {
+                    lineWrite[i]=uint8_t(std::min(std::max(sums[i] >> 20, int32_t(0)), int32_t(255)));
+                }
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool ImageResize::resize(uint16_t * const dataWrite, const size_t widthDS, const size_t heightDS,
+                         uint16_t const * const dataRead, const size_t widthUS, const size_t heightUS,
+                         const size_t componentsPerPixel)
+{
+    if ((widthDS==0) || (heightDS==0) || (widthUS==0) || (heightUS==0) || (componentsPerPixel==0))
+    {
+        return false;
+    }
+    
+    updateFilterTable(tableX_, widthUS, widthDS);
+    updateFilterTable(tableY_, heightUS, heightDS);
+    
+    if (method_==Method::NEAREST)
+    {
+        resizeNearest(dataWrite, widthDS, heightDS, dataRead, widthUS, componentsPerPixel);
+    } else
+    {
+        resizeFloat(dataWrite, widthDS, heightDS, dataRead, widthUS, heightUS, componentsPerPixel);
+    }
+    
+    return true;
+}
+
+bool ImageResize::resize(float * const dataWrite, const size_t widthDS, const size_t heightDS,
+                         float const * const dataRead, const size_t widthUS, const size_t heightUS,
+                         const size_t componentsPerPixel)
+{
+    if ((widthDS==0) || (heightDS==0) || (widthUS==0) || (heightUS==0) || (componentsPerPixel==0))
+    {
+        return false;
+    }
+    
+    updateFilterTable(tableX_, widthUS, widthDS);
+    updateFilterTable(tableY_, heightUS, heightDS);
+    
+    if (method_==Method::NEAREST)
+    {
+        resizeNearest(dataWrite, widthDS, heightDS, dataRead, widthUS, componentsPerPixel);
+    } else
+    {
+        resizeFloat(dataWrite, widthDS, heightDS, dataRead, widthUS, heightUS, componentsPerPixel);
+    }
+    
+    return true;
+}
+
+//=========================================//
+
+
+//=========== KLTTracker ==========//
+
+namespace
+{
+    const size_t kltMaxWindowRadius=15;
+    const size_t kltMaxIterations=10;
+    const size_t kltMinLevelSize=16;
+    
+    /*!Bilinearly sample size x size pixels starting at (x, y) with a unit step. Coordinates outside the image are clamped
+     * to the border. Images must be at least 2x2.*/
+    void sampleKLTPatch(float * const patch, const ptrdiff_t size,
+                        float const * const data, const ptrdiff_t width, const ptrdiff_t height,
+                        const float x, const float y)
+    {
+        const float floorX=floorf(x);
+        const float floorY=floorf(y);
+        const ptrdiff_t ix=ptrdiff_t(floorX);
+        const ptrdiff_t iy=ptrdiff_t(floorY);
+        
+        if ((ix>=0) && (iy>=0) && ((ix+size)<width) && ((iy+size)<height))
+        {//The whole patch is inside the image, so all samples share the same weights.
+            const float fx=x - floorX;
+            const float fy=y - floorY;
+            const float wLT=(1.0f-fx) * (1.0f-fy);
+            const float wRT=fx * (1.0f-fy);
+            const float wLB=(1.0f-fx) * fy;
+            const float wRB=fx * fy;
+            
+            for (ptrdiff_t j=0; j<size; ++j)
+            {
+                float const * const lineT=data + (iy+j)*width + ix;
+                float const * const lineB=lineT + width;
+                float * const linePatch=patch + j*size;
+                
+                for (ptrdiff_t i=0; i<size; ++i)
+                {
+                    linePatch[i]=lineT[i]*wLT + lineT[i+1]*wRT + lineB[i]*wLB + lineB[i+1]*wRB;
+                }
+            }
+        } else
+        {
+            for (ptrdiff_t j=0; j<size; ++j)
+            {
+                const float sy=std::min(std::max(y + float(j), 0.0f), float(height-1));
+                const ptrdiff_t sIY=std::min<ptrdiff_t>(ptrdiff_t(sy), height-2);
+                const float fy=sy - float(sIY);
+                
+                for (ptrdiff_t i=0; i<size; ++i)
+                {
+                    const float sx=std::min(std::max(x + float(i), 0.0f), float(width-1));
+                    const ptrdiff_t sIX=std::min<ptrdiff_t>(ptrdiff_t(sx), width-2);
+                    const float fx=sx - float(sIX);
+                    
+                    float const * const pixelLT=data + sIY*width + sIX;
+                    patch[j*size + i]=(pixelLT[0]*(1.0f-fx) + pixelLT[1]*fx) * (1.0f-fy) +
+                                      (pixelLT[width]*(1.0f-fx) + pixelLT[width+1]*fx) * fy;
+                }
+            }
+        }
+    }
+    
+    //!Solve the n x n system a*x=b in place by Gaussian elimination with partial pivoting. The solution is left in b.
+    bool solveKLTLinearSystem(double * const a, double * const b, const size_t n)
+    {
+        double maxAbs=0.0;
+        for (size_t i=0; i<n*n; ++i) maxAbs=std::max(maxAbs, fabs(a[i]));
+        if (maxAbs==0.0) return false;
+        
+        for (size_t col=0; col<n; ++col)
+        {
+            size_t pivotRow=col;
+            for (size_t row=col+1; row<n; ++row)
+            {
+                if (fabs(a[row*n + col])>fabs(a[pivotRow*n + col])) pivotRow=row;
+            }
+            
+            if (fabs(a[pivotRow*n + col])<(maxAbs*1.0e-12)) return false;
+            
+            if (pivotRow!=col)
+            {
+                for (size_t i=0; i<n; ++i) std::swap(a[col*n + i], a[pivotRow*n + i]);
+                std::swap(b[col], b[pivotRow]);
+            }
+            
+            for (size_t row=col+1; row<n; ++row)
+            {
+                const double factor=a[row*n + col] / a[col*n + col];
+                for (size_t i=col; i<n; ++i) a[row*n + i]-=factor * a[col*n + i];
+                b[row]-=factor * b[col];
+            }
+        }
+        
+        for (size_t col=n; col-->0; )
+        {
+            double sum=b[col];
+            for (size_t i=col+1; i<n; ++i) sum-=a[col*n + i] * b[i];
+            b[col]=sum / a[col*n + col];
+        }
+        
+        return true;
+    }
+    
+    /*!Least squares fit of a motion model that maps the points (srcX, srcY) to (dstX, dstY), using the points listed in
+     * indices. The result is a row major 3x3 matrix.*/
+    bool fitKLTMotionModel(const KLTTracker::MotionModel motionModel,
+                           float const * const srcX, float const * const srcY,
+                           float const * const dstX, float const * const dstY,
+                           uint32_t const * const indices, const size_t numIndices, double transform[9])
+    {
+        if (numIndices==0) return false;
+        
+        double srcCX=0.0, srcCY=0.0, dstCX=0.0, dstCY=0.0;
+        for (size_t k=0; k<numIndices; ++k)
+        {
+            const uint32_t i=indices[k];
+            srcCX+=srcX[i]; srcCY+=srcY[i];
+            dstCX+=dstX[i]; dstCY+=dstY[i];
+        }
+        srcCX/=double(numIndices); srcCY/=double(numIndices);
+        dstCX/=double(numIndices); dstCY/=double(numIndices);
+        
+        transform[6]=0.0; transform[7]=0.0; transform[8]=1.0;
+        
+        if (motionModel==KLTTracker::MotionModel::TRANSLATION)
+        {
+            transform[0]=1.0; transform[1]=0.0; transform[2]=dstCX - srcCX;
+            transform[3]=0.0; transform[4]=1.0; transform[5]=dstCY - srcCY;
+            return true;
+        }
+        
+        if (motionModel==KLTTracker::MotionModel::SIMILARITY)
+        {//Closed form fit of [a -b; b a] to the centred points.
+            double sumDot=0.0, sumCross=0.0, sumSq=0.0;
+            for (size_t k=0; k<numIndices; ++k)
+            {
+                const uint32_t i=indices[k];
+                const double sx=srcX[i] - srcCX, sy=srcY[i] - srcCY;
+                const double dx=dstX[i] - dstCX, dy=dstY[i] - dstCY;
+                sumDot+=sx*dx + sy*dy;
+                sumCross+=sx*dy - sy*dx;
+                sumSq+=sx*sx + sy*sy;
+            }
+            if (sumSq<1.0e-6) return false;
+            
+            const double a=sumDot / sumSq;
+            const double b=sumCross / sumSq;
+            transform[0]=a; transform[1]=-b; transform[2]=dstCX - (a*srcCX - b*srcCY);
+            transform[3]=b; transform[4]=a;  transform[5]=dstCY - (b*srcCX + a*srcCY);
+            return true;
+        }
+        
+        //Homography with h33=1 from the normal equations of the direct linear transform, on points normalised to a
+        //mean distance of sqrt(2) from their centroid.
+        if (numIndices<4) return false;
+        
+        double srcDist=0.0, dstDist=0.0;
+        for (size_t k=0; k<numIndices; ++k)
+        {
+            const uint32_t i=indices[k];
+            srcDist+=sqrt((srcX[i]-srcCX)*(srcX[i]-srcCX) + (srcY[i]-srcCY)*(srcY[i]-srcCY));
+            dstDist+=sqrt((dstX[i]-dstCX)*(dstX[i]-dstCX) + (dstY[i]-dstCY)*(dstY[i]-dstCY));
+        }
+        if ((srcDist<1.0e-6) || (dstDist<1.0e-6)) return false;
+        const double srcScale=sqrt(2.0) * double(numIndices) / srcDist;
+        const double dstScale=sqrt(2.0) * double(numIndices) / dstDist;
+        
+        double ata[64]={0.0};
+        double atb[8]={0.0};
+        for (size_t k=0; k<numIndices; ++k)
+        {
+            const uint32_t i=indices[k];
+            const double x=(srcX[i] - srcCX) * srcScale, y=(srcY[i] - srcCY) * srcScale;
+            const double u=(dstX[i] - dstCX) * dstScale, v=(dstY[i] - dstCY) * dstScale;
+            
+            const double rowU[8]={x, y, 1.0, 0.0, 0.0, 0.0, -x*u, -y*u};
+            const double rowV[8]={0.0, 0.0, 0.0, x, y, 1.0, -x*v, -y*v};
+            
+            for (size_t r=0; r<8; ++r)
+            {
+                for (size_t c=r; c<8; ++c) ata[r*8 + c]+=rowU[r]*rowU[c] + rowV[r]*rowV[c];
+                atb[r]+=rowU[r]*u + rowV[r]*v;
+            }
+        }
+        for (size_t r=1; r<8; ++r)
+        {
+            for (size_t c=0; c<r; ++c) ata[r*8 + c]=ata[c*8 + r];
+        }
+        
+        if (!solveKLTLinearSystem(ata, atb, 8)) return false;
+        
+        //transform = inverse(dstNormalisation) * h * srcNormalisation
+        const double h[9]={atb[0], atb[1], atb[2], atb[3], atb[4], atb[5], atb[6], atb[7], 1.0};
+        double hs[9];
+        for (size_t r=0; r<3; ++r)
+        {
+            hs[r*3 + 0]=h[r*3 + 0] * srcScale;
+            hs[r*3 + 1]=h[r*3 + 1] * srcScale;
+            hs[r*3 + 2]=h[r*3 + 2] - (h[r*3 + 0]*srcCX + h[r*3 + 1]*srcCY) * srcScale;
+        }
+        for (size_t c=0; c<3; ++c)
+        {
+            transform[0 + c]=hs[0 + c] / dstScale + dstCX * hs[6 + c];
+            transform[3 + c]=hs[3 + c] / dstScale + dstCY * hs[6 + c];
+            transform[6 + c]=hs[6 + c];
+        }
+        
+        if (fabs(transform[8])<1.0e-12) return false;
+        for (size_t i=0; i<9; ++i) transform[i]/=transform[8];
+        transform[8]=1.0;
+        
+        return true;
+    }
+    
+    inline double getKLTTransferErrorSq(double const * const transform, const float srcX, const float srcY,
+                                        const float dstX, const float dstY)
+    {
+        const double w=transform[6]*srcX + transform[7]*srcY + transform[8];
+        if (fabs(w)<1.0e-12) return std::numeric_limits<double>::max();
+        
+        const double x=(transform[0]*srcX + transform[1]*srcY + transform[2]) / w;
+        const double y=(transform[3]*srcX + transform[4]*srcY + transform[5]) / w;
+        return (x-dstX)*(x-dstX) + (y-dstY)*(y-dstY);
+    }
+}
+
+KLTTracker::KLTTracker(const size_t maxFeatures, const MotionModel motionModel) :
+maxFeatures_(std::max<size_t>(maxFeatures, 8)),
+motionModel_(motionModel),
+numLevels_(4),
+windowRadius_(7),
+minDistance_(16),
+finestLevel_(1),
+detectionLevel_(1),
+inlierThreshold_(1.0f),
+numRansacIterations_(200),
+width_(0),
+height_(0),
+pyramidVec_{ImagePyramid(1), ImagePyramid(1)},
+current_(0),
+hasPrevious_(false),
+numTracked_(0),
+numInliers_(0),
+hx_(0.0f),
+hy_(0.0f),
+randomState_(1)
+{
+    for (size_t i=0; i<9; ++i) transform_[i]=((i%4)==0) ? 1.0f : 0.0f;
+}
+
+void KLTTracker::reset()
+{
+    hasPrevious_=false;
+    features_.clear();
+    numTracked_=0;
+    numInliers_=0;
+    
+    for (size_t i=0; i<9; ++i) transform_[i]=((i%4)==0) ? 1.0f : 0.0f;
+    hx_=0.0f;
+    hy_=0.0f;
+}
+
+size_t KLTTracker::getNumUsableLevels(const size_t width, const size_t height) const
+{
+    size_t numLevels=1;
+    while ((numLevels<numLevels_) && ((std::min(width, height) >> numLevels)>=kltMinLevelSize))
+    {
+        ++numLevels;
+    }
+    return numLevels;
+}
+
+bool KLTTracker::track(float const * const image, const size_t width, const size_t height)
+{
+    return track(std::vector<float const *>(1, image), width, height, 1, 0);
+}
+
+bool KLTTracker::track(std::vector<float const *> const &levels, const size_t width, const size_t height,
+                       const size_t componentsPerPixel, const size_t component)
+{
+    if (levels.empty() || (levels[0]==nullptr) || (width<kltMinLevelSize) || (height<kltMinLevelSize) ||
+        (component>=componentsPerPixel))
+    {
+        return false;
+    }
+    
+    if ((width!=width_) || (height!=height_))
+    {
+        reset();
+        width_=width;
+        height_=height;
+    }
+    
+    //The new image goes into the buffers of the image before the previous one.
+    if (hasPrevious_) current_=1-current_;
+    
+    const size_t numLevels=getNumUsableLevels(width, height);
+    const size_t finestLevel=std::min(finestLevel_, numLevels-1);
+    const size_t numGivenLevels=std::min(levels.size(), numLevels);
+    
+    //The finest level that is read during this call, by the tracking or the detection.
+    const size_t firstUsedLevel=std::min(finestLevel, std::min(detectionLevel_, numLevels-1));
+    
+    std::vector<float const *> &levelPtrs=levelPtrVec_[current_];
+    levelPtrs.assign(numLevels, nullptr);
+    levelCopyVec_[current_].resize(numLevels);
+    
+    for (size_t levelNum=0; levelNum<numGivenLevels; ++levelNum)
+    {
+        //The last given level is also needed to build the coarser levels.
+        if ((levelNum<firstUsedLevel) && (levelNum+1<numGivenLevels))
+        {
+            continue;
+        }
+        
+        if ((componentsPerPixel==1) && (levelNum<finestLevel))
+        {//Only read during this call, so it is not copied.
+            levelPtrs[levelNum]=levels[levelNum];
+            continue;
+        }
+        
+        //Levels that are tracked on are read again by the next call, so they are copied.
+        const size_t numPixels=ImagePyramid::getLevelSize(width, levelNum) * ImagePyramid::getLevelSize(height, levelNum);
+        std::vector<float> &levelCopy=levelCopyVec_[current_][levelNum];
+        levelCopy.resize(numPixels);
+        
+        float const * const levelData=levels[levelNum] + component;
+        for (size_t i=0; i<numPixels; ++i)
+        {
+            levelCopy[i]=levelData[i*componentsPerPixel];
+        }
+        levelPtrs[levelNum]=levelCopy.data();
+    }
+    
+    if (numGivenLevels<numLevels)
+    {//Build the coarser levels from the last given level.
+        const size_t baseLevel=numGivenLevels-1;
+        
+        ImagePyramid &pyramid=pyramidVec_[current_];
+        pyramid.setNumLevels(numLevels-baseLevel);
+        pyramid.build(levelPtrs[baseLevel], ImagePyramid::getLevelSize(width, baseLevel),
+                      ImagePyramid::getLevelSize(height, baseLevel), 1);
+        
+        for (size_t levelNum=numGivenLevels; levelNum<numLevels; ++levelNum)
+        {
+            levelPtrs[levelNum]=pyramid.getLevel(levelNum-baseLevel);
+        }
+    }
+    
+    for (size_t i=0; i<9; ++i) transform_[i]=((i%4)==0) ? 1.0f : 0.0f;
+    hx_=0.0f;
+    hy_=0.0f;
+    numTracked_=0;
+    numInliers_=0;
+    
+    bool rValue=false;
+    
+    if (hasPrevious_ && (!features_.empty()))
+    {
+        //The previous image only kept the levels that it was tracked on, which are coarser if the finest level was lowered since.
+        std::vector<float const *> const &levelPtrsPrev=levelPtrVec_[1-current_];
+        const size_t numTrackLevels=std::min(numLevels, levelPtrsPrev.size());
+        
+        size_t trackFinestLevel=std::min(finestLevel, numTrackLevels-1);
+        while ((trackFinestLevel+1<numTrackLevels) && (levelPtrsPrev[trackFinestLevel]==nullptr))
+        {
+            ++trackFinestLevel;
+        }
+        
+        numTracked_=trackFeatures(numTrackLevels, trackFinestLevel);
+        rValue=fitTransform();
+    } else
+    {
+        features_.clear();
+    }
+    
+    hasPrevious_=true;
+    
+    if ((features_.size()*4)<(maxFeatures_*3))
+    {
+        detectFeatures();
+    }
+    
+    //The levels that are not copied point at the caller's images, which are only valid during this call.
+    for (size_t levelNum=0; levelNum<finestLevel; ++levelNum)
+    {
+        levelPtrs[levelNum]=nullptr;
+    }
+    
+    return rValue;
+}
+
+size_t KLTTracker::trackFeatures(const size_t numLevels, const size_t finestLevel)
+{
+    std::vector<float const *> const &levelPtrsPrev=levelPtrVec_[1-current_];
+    std::vector<float const *> const &levelPtrsCur=levelPtrVec_[current_];
+    
+    const ptrdiff_t windowRadius=ptrdiff_t(windowRadius_);
+    const ptrdiff_t windowSize=2*windowRadius + 1;
+    const ptrdiff_t templateSize=windowSize + 2;
+    const float maxX=float(width_ - 1);
+    const float maxY=float(height_ - 1);
+    
+    const int64_t numFeatures=int64_t(features_.size());
+    trackedX_.resize(numFeatures);
+    trackedY_.resize(numFeatures);
+    trackedStatus_.resize(numFeatures);
+    
+    int64_t featureNum=0;
+#pragma omp parallel for schedule(dynamic, 16)
+    for (featureNum=0; featureNum<numFeatures; ++featureNum)
+    {
+        //The template has a one pixel border for the central difference gradients.
+        float templ[(2*kltMaxWindowRadius + 3) * (2*kltMaxWindowRadius + 3)];
+        float window[(2*kltMaxWindowRadius + 1) * (2*kltMaxWindowRadius + 1)];
+        float gradX[(2*kltMaxWindowRadius + 1) * (2*kltMaxWindowRadius + 1)];
+        float gradY[(2*kltMaxWindowRadius + 1) * (2*kltMaxWindowRadius + 1)];
+        
+        const Feature &feature=features_[featureNum];
+        bool tracked=true;
+        
+        //Displacement in the pixels of the current level.
+        float dispX=0.0f;
+        float dispY=0.0f;
+        
+        for (size_t levelNum=numLevels; (levelNum-->finestLevel) && tracked; )
+        {
+            const ptrdiff_t levelWidth=ptrdiff_t(ImagePyramid::getLevelSize(width_, levelNum));
+            const ptrdiff_t levelHeight=ptrdiff_t(ImagePyramid::getLevelSize(height_, levelNum));
+            
+            //Pixel i of a level lies between pixels 2i and 2i+1 of the level above it.
+            const float levelScale=1.0f / float(size_t(1) << levelNum);
+            const float x=(feature.x + 0.5f) * levelScale - 0.5f;
+            const float y=(feature.y + 0.5f) * levelScale - 0.5f;
+            
+            sampleKLTPatch(templ, templateSize, levelPtrsPrev[levelNum], levelWidth, levelHeight,
+                           x - float(windowRadius + 1), y - float(windowRadius + 1));
+            
+            float gxx=0.0f, gxy=0.0f, gyy=0.0f;
+            for (ptrdiff_t j=0; j<windowSize; ++j)
+            {
+                float const * const lineT=templ + (j+1)*templateSize + 1;
+                for (ptrdiff_t i=0; i<windowSize; ++i)
+                {
+                    const float gx=(lineT[i+1] - lineT[i-1]) * 0.5f;
+                    const float gy=(lineT[i+templateSize] - lineT[i-templateSize]) * 0.5f;
+                    gradX[j*windowSize + i]=gx;
+                    gradY[j*windowSize + i]=gy;
+                    gxx+=gx*gx;
+                    gxy+=gx*gy;
+                    gyy+=gy*gy;
+                }
+            }
+            
+            //Drop features on flat areas and straight edges, where the displacement is not defined.
+            const float det=gxx*gyy - gxy*gxy;
+            const float halfTrace=0.5f * (gxx + gyy);
+            const float root=sqrtf(std::max(halfTrace*halfTrace - det, 0.0f));
+            if ((det<=0.0f) || ((halfTrace - root)<(1.0e-4f * (halfTrace + root))))
+            {
+                tracked=false;
+                break;
+            }
+            const float recipDet=1.0f / det;
+            
+            for (size_t iteration=0; iteration<kltMaxIterations; ++iteration)
+            {
+                sampleKLTPatch(window, windowSize, levelPtrsCur[levelNum], levelWidth, levelHeight,
+                               x + dispX - float(windowRadius), y + dispY - float(windowRadius));
+                
+                float bx=0.0f, by=0.0f;
+                for (ptrdiff_t j=0; j<windowSize; ++j)
+                {
+                    float const * const lineT=templ + (j+1)*templateSize + 1;
+                    for (ptrdiff_t i=0; i<windowSize; ++i)
+                    {
+                        const float diff=lineT[i] - window[j*windowSize + i];
+                        bx+=diff * gradX[j*windowSize + i];
+                        by+=diff * gradY[j*windowSize + i];
+                    }
+                }
+                
+                const float updateX=(gyy*bx - gxy*by) * recipDet;
+                const float updateY=(gxx*by - gxy*bx) * recipDet;
+                dispX+=updateX;
+                dispY+=updateY;
+                
+                if ((updateX*updateX + updateY*updateY)<(0.01f*0.01f))
+                {
+                    break;
+                }
+            }
+            
+            if (levelNum>finestLevel)
+            {
+                dispX*=2.0f;
+                dispY*=2.0f;
+            }
+        }
+        
+        const float newX=feature.x + dispX * float(size_t(1) << finestLevel);
+        const float newY=feature.y + dispY * float(size_t(1) << finestLevel);
+        
+        tracked=tracked && (newX>=0.0f) && (newX<=maxX) && (newY>=0.0f) && (newY<=maxY);
+        
+        trackedX_[featureNum]=newX;
+        trackedY_[featureNum]=newY;
+        trackedStatus_[featureNum]=tracked ? 1 : 0;
+    }
+    
+    size_t numTracked=0;
+    for (size_t i=0; i<trackedStatus_.size(); ++i) numTracked+=trackedStatus_[i];
+    
+    return numTracked;
+}
+
+bool KLTTracker::fitTransform()
+{
+    const size_t minSamples=(motionModel_==MotionModel::TRANSLATION) ? 1 : ((motionModel_==MotionModel::SIMILARITY) ? 2 : 4);
+    
+    std::vector<float> prevX, prevY, curX, curY;
+    std::vector<uint32_t> ages;
+    for (size_t i=0; i<features_.size(); ++i)
+    {
+        if (trackedStatus_[i])
+        {
+            prevX.push_back(features_[i].x);
+            prevY.push_back(features_[i].y);
+            curX.push_back(trackedX_[i]);
+            curY.push_back(trackedY_[i]);
+            ages.push_back(features_[i].age);
+        }
+    }
+    
+    const size_t numPoints=curX.size();
+    
+    //Keep the tracked features, with their new positions.
+    features_.resize(numPoints);
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        features_[i].x=curX[i];
+        features_[i].y=curY[i];
+        features_[i].age=ages[i] + 1;
+    }
+    
+    if (numPoints<(minSamples*2))
+    {
+        return false;
+    }
+    
+    //=== RANSAC on the transform from the current to the previous image ===
+    const double thresholdSq=double(inlierThreshold_) * double(inlierThreshold_);
+    
+    double bestTransform[9];
+    size_t bestNumInliers=0;
+    size_t numIterations=numRansacIterations_;
+    
+    for (size_t iteration=0; iteration<numIterations; ++iteration)
+    {
+        uint32_t sample[4];
+        for (size_t s=0; s<minSamples; ++s)
+        {
+            bool unique=false;
+            while (!unique)
+            {
+                //Numerical Recipes linear congruential generator.
+                randomState_=randomState_*1664525u + 1013904223u;
+                sample[s]=uint32_t((uint64_t(randomState_ >> 8) * numPoints) >> 24);
+                
+                unique=true;
+                for (size_t t=0; t<s; ++t) unique=unique && (sample[t]!=sample[s]);
+            }
+        }
+        
+        double transform[9];
+        if (!fitKLTMotionModel(motionModel_, curX.data(), curY.data(), prevX.data(), prevY.data(), sample, minSamples, transform))
+        {
+            continue;
+        }
+        
+        size_t numInliers=0;
+        for (size_t i=0; i<numPoints; ++i)
+        {
+            numInliers+=(getKLTTransferErrorSq(transform, curX[i], curY[i], prevX[i], prevY[i])<thresholdSq) ? 1 : 0;
+        }
+        
+        if (numInliers>bestNumInliers)
+        {
+            bestNumInliers=numInliers;
+            for (size_t i=0; i<9; ++i) bestTransform[i]=transform[i];
+            
+            //Stop once a sample of inliers has been drawn with 99% probability.
+            const double inlierRatio=double(numInliers) / double(numPoints);
+            const double pGood=pow(inlierRatio, double(minSamples));
+            if (pGood>=1.0)
+            {
+                break;
+            }
+            numIterations=std::min(numRansacIterations_, size_t(ceil(log(0.01) / log(1.0 - pGood))));
+        }
+    }
+    
+    if (bestNumInliers<minSamples)
+    {
+        return false;
+    }
+    
+    //=== Refine on the inliers ===
+    std::vector<uint32_t> inliers;
+    for (size_t refinement=0; refinement<2; ++refinement)
+    {
+        inliers.clear();
+        for (size_t i=0; i<numPoints; ++i)
+        {
+            if (getKLTTransferErrorSq(bestTransform, curX[i], curY[i], prevX[i], prevY[i])<thresholdSq)
+            {
+                inliers.push_back(uint32_t(i));
+            }
+        }
+        
+        double transform[9];
+        if ((inliers.size()<minSamples) ||
+            (!fitKLTMotionModel(motionModel_, curX.data(), curY.data(), prevX.data(), prevY.data(), inliers.data(), inliers.size(), transform)))
+        {
+            break;
+        }
+        for (size_t i=0; i<9; ++i) bestTransform[i]=transform[i];
+    }
+    
+    //=== Drop the outliers ===
+    size_t numInliers=0;
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        if (getKLTTransferErrorSq(bestTransform, curX[i], curY[i], prevX[i], prevY[i])<thresholdSq)
+        {
+            features_[numInliers++]=features_[i];
+        }
+    }
+    features_.resize(numInliers);
+    numInliers_=numInliers;
+    
+    if (numInliers<minSamples)
+    {
+        return false;
+    }
+    
+    for (size_t i=0; i<9; ++i) transform_[i]=float(bestTransform[i]);
+    
+    const double centreX=0.5 * double(width_ - 1);
+    const double centreY=0.5 * double(height_ - 1);
+    const double w=bestTransform[6]*centreX + bestTransform[7]*centreY + bestTransform[8];
+    hx_=float((bestTransform[0]*centreX + bestTransform[1]*centreY + bestTransform[2]) / w - centreX);
+    hy_=float((bestTransform[3]*centreX + bestTransform[4]*centreY + bestTransform[5]) / w - centreY);
+    
+    return true;
+}
+
+void KLTTracker::detectFeatures()
+{
+    std::vector<float const *> const &levelPtrs=levelPtrVec_[current_];
+    const size_t levelNum=std::min(detectionLevel_, levelPtrs.size()-1);
+    const ptrdiff_t levelWidth=ptrdiff_t(ImagePyramid::getLevelSize(width_, levelNum));
+    const ptrdiff_t levelHeight=ptrdiff_t(ImagePyramid::getLevelSize(height_, levelNum));
+    const size_t numPixels=size_t(levelWidth * levelHeight);
+    float const * const levelData=levelPtrs[levelNum];
+    
+    if ((levelWidth<8) || (levelHeight<8))
+    {
+        return;
+    }
+    
+    gradientProducts_.assign(numPixels*3, 0.0f);
+    response_.assign(numPixels, 0.0f);
+    float * const gxxData=gradientProducts_.data();
+    float * const gxyData=gxxData + numPixels;
+    float * const gyyData=gxyData + numPixels;
+    float * const responseData=response_.data();
+    
+    //=== Products of the Scharr gradients ===
+    {
+        const size_t numBands=getNumRowBands(size_t(levelHeight-2));
+        const ptrdiff_t bandHeight=ptrdiff_t((size_t(levelHeight-2) + numBands - 1) / numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const ptrdiff_t yEnd=std::min<ptrdiff_t>(1 + (bandNum+1) * bandHeight, levelHeight-1);
+            for (ptrdiff_t y=1 + bandNum * bandHeight; y<yEnd; ++y)
+            {
+                float const * const lineA=levelData + (y-1)*levelWidth;
+                float const * const line=lineA + levelWidth;
+                float const * const lineB=line + levelWidth;
+                const ptrdiff_t lineOffset=y*levelWidth;
+                
+                for (ptrdiff_t x=1; x<(levelWidth-1); ++x)
+                {
+                    const float dx=(lineA[x+1]-lineA[x-1])*(3.0f/32.0f) + (line[x+1]-line[x-1])*(10.0f/32.0f) + (lineB[x+1]-lineB[x-1])*(3.0f/32.0f);
+                    const float dy=(lineB[x-1]-lineA[x-1])*(3.0f/32.0f) + (lineB[x]-lineA[x])*(10.0f/32.0f) + (lineB[x+1]-lineA[x+1])*(3.0f/32.0f);
+                    
+                    gxxData[lineOffset + x]=dx*dx;
+                    gxyData[lineOffset + x]=dx*dy;
+                    gyyData[lineOffset + x]=dy*dy;
+                }
+            }
+        }
+    }
+    
+    //=== Minimum eigenvalue of the 5x5 structure tensor ===
+    {
+        const ptrdiff_t yStart=3;
+        const ptrdiff_t yStop=levelHeight-3;
+        const size_t numBands=getNumRowBands(size_t(yStop-yStart));
+        const ptrdiff_t bandHeight=ptrdiff_t((size_t(yStop-yStart) + numBands - 1) / numBands);
+        
+        if (bandSums_.size()<numBands) bandSums_.resize(numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            std::vector<float> &sums=bandSums_[bandNum];
+            sums.resize(size_t(levelWidth)*3);
+            float * const sumXX=sums.data();
+            float * const sumXY=sumXX + levelWidth;
+            float * const sumYY=sumXY + levelWidth;
+            
+            const ptrdiff_t yEnd=std::min<ptrdiff_t>(yStart + (bandNum+1) * bandHeight, yStop);
+            for (ptrdiff_t y=yStart + bandNum * bandHeight; y<yEnd; ++y)
+            {
+                //Vertical sums of whole lines.
+                std::fill(sums.begin(), sums.end(), 0.0f);
+                for (ptrdiff_t j=y-2; j<=(y+2); ++j)
+                {
+                    const ptrdiff_t lineOffset=j*levelWidth;
+                    for (ptrdiff_t x=0; x<levelWidth; ++x)
+                    {
+                        sumXX[x]+=gxxData[lineOffset + x];
+                        sumXY[x]+=gxyData[lineOffset + x];
+                        sumYY[x]+=gyyData[lineOffset + x];
+                    }
+                }
+                
+                float * const lineResponse=responseData + y*levelWidth;
+                for (ptrdiff_t x=3; x<(levelWidth-3); ++x)
+                {
+                    const float sxx=sumXX[x-2] + sumXX[x-1] + sumXX[x] + sumXX[x+1] + sumXX[x+2];
+                    const float sxy=sumXY[x-2] + sumXY[x-1] + sumXY[x] + sumXY[x+1] + sumXY[x+2];
+                    const float syy=sumYY[x-2] + sumYY[x-1] + sumYY[x] + sumYY[x+1] + sumYY[x+2];
+                    
+                    const float halfDiff=0.5f * (sxx - syy);
+                    lineResponse[x]=0.5f * (sxx + syy) - sqrtf(halfDiff*halfDiff + sxy*sxy);
+                }
+            }
+        }
+    }
+    
+    //=== Strongest corner per free cell ===
+    const float levelScale=float(size_t(1) << levelNum);
+    const ptrdiff_t cellSize=std::max<ptrdiff_t>(ptrdiff_t(minDistance_ >> levelNum), 2);
+    const ptrdiff_t numCellsX=(levelWidth + cellSize - 1) / cellSize;
+    const ptrdiff_t numCellsY=(levelHeight + cellSize - 1) / cellSize;
+    
+    std::vector<uint8_t> cellUsed(size_t(numCellsX*numCellsY), 0);
+    for (size_t i=0; i<features_.size(); ++i)
+    {
+        const ptrdiff_t cellX=ptrdiff_t(std::max((features_[i].x + 0.5f) / levelScale - 0.5f, 0.0f)) / cellSize;
+        const ptrdiff_t cellY=ptrdiff_t(std::max((features_[i].y + 0.5f) / levelScale - 0.5f, 0.0f)) / cellSize;
+        cellUsed[size_t(std::min(cellY, numCellsY-1)*numCellsX + std::min(cellX, numCellsX-1))]=1;
+    }
+    
+    //Features need their tracking window inside the full resolution image.
+    const float margin=float(windowRadius_ + 2);
+    const float maxX=float(width_ - 1) - margin;
+    const float maxY=float(height_ - 1) - margin;
+    
+    std::vector<std::pair<float, Feature> > candidates;
+    float maxResponse=0.0f;
+    
+    for (ptrdiff_t cellY=0; cellY<numCellsY; ++cellY)
+    {
+        for (ptrdiff_t cellX=0; cellX<numCellsX; ++cellX)
+        {
+            if (cellUsed[size_t(cellY*numCellsX + cellX)]) continue;
+            
+            float bestResponse=0.0f;
+            ptrdiff_t bestX=-1;
+            ptrdiff_t bestY=-1;
+            
+            const ptrdiff_t yEnd=std::min<ptrdiff_t>((cellY+1)*cellSize, levelHeight);
+            const ptrdiff_t xEnd=std::min<ptrdiff_t>((cellX+1)*cellSize, levelWidth);
+            for (ptrdiff_t y=cellY*cellSize; y<yEnd; ++y)
+            {
+                for (ptrdiff_t x=cellX*cellSize; x<xEnd; ++x)
+                {
+                    const float value=responseData[y*levelWidth + x];
+                    if (value>bestResponse)
+                    {
+                        bestResponse=value;
+                        bestX=x;
+                        bestY=y;
+                    }
+                }
+            }
+            
+            if (bestX<0) continue;
+            
+            Feature feature;
+            feature.x=(float(bestX) + 0.5f) * levelScale - 0.5f;
+            feature.y=(float(bestY) + 0.5f) * levelScale - 0.5f;
+            feature.age=0;
+            
+            if ((feature.x<margin) || (feature.x>maxX) || (feature.y<margin) || (feature.y>maxY)) continue;
+            
+            candidates.push_back(std::make_pair(bestResponse, feature));
+            maxResponse=std::max(maxResponse, bestResponse);
+        }
+    }
+    
+    //Keep the strongest corners above 1% of the strongest one.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<float, Feature> &a, const std::pair<float, Feature> &b) { return a.first>b.first; });
+    
+    for (size_t i=0; (i<candidates.size()) && (features_.size()<maxFeatures_); ++i)
+    {
+        if (candidates[i].first<(maxResponse*0.01f)) break;
+        features_.push_back(candidates[i].second);
+    }
+}
+
+//=========================================//
@@ -7,19 +7,75 @@ using namespace flitr;
 
 namespace
 {
-    unsigned char * temp;
-
-    int delta[8][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1},{1, 1}, {-1, -1}, {1, -1}, {-1, 1}};
+    bool Intersect(const CPUFindDiscreetObjectsPass::Rect& r1, const CPUFindDiscreetObjectsPass::Rect& r2)
+    {
+        return ( (abs(int(r1.centerX) - int(r2.centerX)) <= (r1.width/2 + r2.width/2) )
+            && ( abs(int(r1.centerY) - int(r2.centerY)) <= (r1.height/2 + r2.height/2)) );
+    }
     
-    std::vector<int> used;
-    std::vector<int> edgelist;
-    int ucounter;
-    std::vector< CPUFindDiscreetObjectsPass::Rect > rectangles;
+    //The x range that Intersect tests.
+    inline int IntersectLeft(const CPUFindDiscreetObjectsPass::Rect& r) { return int(r.centerX) - r.width/2; }
+    inline int IntersectRight(const CPUFindDiscreetObjectsPass::Rect& r) { return int(r.centerX) + r.width/2; }
+    
+    /*!Combines intersecting rectangles until no two intersect. A combined rectangle that exceeds the maximum size is
+     * discarded together with the two rectangles it was combined from. Each pass sorts the rectangles on their left edge
+     * so that only the rectangles that overlap in x are tested against each other.*/
+    void MergeIntersectingRects(std::vector<CPUFindDiscreetObjectsPass::Rect>& rects, const int maxArea, const int maxWidth, const int maxHeight)
+    {
+        std::vector<size_t> order;
+        std::vector<char> alive;
+        
+        bool merged = true;
+        while (merged)
+        {
+            merged = false;
+            
+            order.resize(rects.size());
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            std::sort(order.begin(), order.end(), [&rects](const size_t a, const size_t b) { return IntersectLeft(rects[a]) < IntersectLeft(rects[b]); });
+            
+            alive.assign(rects.size(), 1);
+            
+            for (size_t oi = 0; oi < order.size(); oi++)
+            {
+                const size_t i = order[oi];
+                if (!alive[i]) continue;
+                
+                for (size_t oj = oi+1; oj < order.size(); oj++)
+                {
+                    const size_t j = order[oj];
+                    if (IntersectLeft(rects[j]) > IntersectRight(rects[i])) break;
+                    if (!alive[j] || !Intersect(rects[i], rects[j])) continue;
+                    
+                    const CPUFindDiscreetObjectsPass::Rect r(std::min(rects[i].left, rects[j].left), std::max(rects[i].right, rects[j].right),
+                                                             std::min(rects[i].top, rects[j].top), std::max(rects[i].bottom, rects[j].bottom));
+                    
+                    alive[j] = 0;
+                    merged = true;
+                    
+                    // max checks
+                    if (r.area <= maxArea && r.width <= maxWidth && r.height <= maxHeight)
+                    {
+                        rects[i] = r;
+                    }
+                    else
+                    {
+                        alive[i] = 0;
+                        break;
+                    }
+                }
+            }
+            
+            size_t numAlive = 0;
+            for (size_t i = 0; i < rects.size(); i++)
+            {
+                if (alive[i]) rects[numAlive++] = rects[i];
+            }
+            rects.resize(numAlive);
+        }
+    }
 }
 
-void FollowBorder(int idx, int width, int size, int w, int h, int &left, int &right, int &bottom, int &top);
-bool Intersect(const CPUFindDiscreetObjectsPass::Rect& r1, const CPUFindDiscreetObjectsPass::Rect& r2);
-
 CPUFindDiscreetObjectsPass::CPUFindDiscreetObjectsPass(osg::Image* image) 
     : Image_(image)
     , expandRects_(0.0f)
@@ -30,177 +86,92 @@ CPUFindDiscreetObjectsPass::CPUFindDiscreetObjectsPass(osg::Image* image)
     , maxWidth_(std::numeric_limits<int>::max())
     , maxHeight_(std::numeric_limits<int>::max())
     , useROI_(false)
+    , connectedComponents_(ConnectedComponents::Connectivity::EIGHT)
 {
-    temp = 0;
-    ucounter = 0;
     theROI_ = Rect(0, image->s()-1, 0, image->t()-1);
 }
-    
+
 CPUFindDiscreetObjectsPass::~CPUFindDiscreetObjectsPass()
 {
 }
 
 void CPUFindDiscreetObjectsPass::operator()(osg::RenderInfo& renderInfo) const
 {
-    rectangles.resize(0);
-    edgelist.resize(0);
-
-    int width = Image_->s();
-    int height = Image_->t();
-    int size = width*height;
-    if (used.size()!=size)
-    {
-        used.resize(size, 0);
-    }
-    ucounter++;
-
+    rectangles_.resize(0);
+    
+    const int width = Image_->s();
+    const int height = Image_->t();
+    
     unsigned char * const data=(unsigned char *)Image_->data();
-    if (!temp)
-        temp = new unsigned char[width*height];
-
-    // find edges
-    int i = 0;
-    for (i=0;i<size;i++)
-    {
-        if (data[i] == 0)
-        {
-            temp[i] = 0;
-            continue;
-        }
-        if (data[i+1] == 0 || ( i>0 && data[i-1] == 0 ) || ( (i+width)<size && data[i+width] == 0 ) || ( ((i-width)>0) && data[i-width] == 0 ))
-        {
-            edgelist.push_back(i);
-            temp[i] = 255;
-        }
-        else
-        {
-            temp[i] = 0;
-        }
-    }
-
-    int idx = 0;
-    for (size_t j=0;j<edgelist.size();j++)
+    
+    // find objects
+    connectedComponents_.label(data, width, height, width);
+    
+    const std::vector<ConnectedComponents::Blob>& blobs = connectedComponents_.getBlobs();
+    for (size_t i = 0; i < blobs.size(); i++)
     {
-        i = edgelist[j];
-        if (used[i]==ucounter)
-        {
-            continue;
-        }
-        int left = i%width, bottom = i/width, right = left, top = bottom;
-        FollowBorder(idx, width, size, left, bottom, left, right, bottom, top);
-
+        int left = blobs[i].left, right = blobs[i].right, top = blobs[i].top, bottom = blobs[i].bottom;
+        
         int growV = ((float)(right - left) * expandRects_) + 0.5f;
         int growH = ((float)(bottom - top) * expandRects_) + 0.5f;
-
+        
         left-=growV;
         right+=growV;
         bottom+=growH;
         top-=growH;
-
+        
         if (left < 0) left = 0;
         if (right >= (int)width) right = width-1;
         if (top < 0) top = 0;
         if (bottom >= (int)height) bottom = height-1;
-
-        Rect r = Rect(left, right, top, bottom);			
+        
+        Rect r = Rect(left, right, top, bottom);
         // max checks
         if (r.area <= maxArea_ && r.width <= maxWidth_ && r.height <= maxHeight_)
         {
-            rectangles.push_back(r);
+            rectangles_.push_back(r);
         }
-        
-        idx++;
     }
-
+    
     // intersections
-    bool intersect = true;
+    MergeIntersectingRects(rectangles_, maxArea_, maxWidth_, maxHeight_);
     
-    Rect *r1, *r2;
-    int left, top, bottom, right;
-    while (intersect)
+    // min and ROI checks
+    size_t numKept = 0;
+    for (size_t i = 0; i < rectangles_.size(); i++)
     {
-        if (rectangles.size() < 2) intersect = false;
-        for (i = 0; i < ((int)rectangles.size())-1; i++)
+        const Rect& r1 = rectangles_[i];
+        
+        if (!(r1.area < minArea_ || r1.width < minWidth_ || r1.height < minHeight_ || (useROI_ && !Intersect(r1, theROI_))))
         {
-            redo:
-            for (int j = i+1; j < (int)rectangles.size(); j++)
-            {
-                r1 = &rectangles[i];
-                r2 = &rectangles[j];
-                intersect = (Intersect(*r1, *r2));
-                if (intersect)
-                {
-                    left = std::min(r1->left, r2->left);
-                    right = std::max(r1->right, r2->right);
-                    top = std::min(r1->top, r2->top);
-                    bottom = std::max(r1->bottom, r2->bottom);
-
-                    Rect r = Rect(left, right, top, bottom);
-                    
-                    // max checks
-                    if (r.area <= maxArea_ && r.width <= maxWidth_ && r.height <= maxHeight_)
-                    {
-                        rectangles.push_back(r);
-                    }
-                    rectangles.erase(rectangles.begin()+j);
-                    rectangles.erase(rectangles.begin()+i);
-                    std::swap(rectangles[0], rectangles[rectangles.size()-1]);
-                    i = 0;
-                    goto redo;
-                    break;
-                }
-                if (intersect)
-                    break;
-            }
-            if (intersect)
-                break;
+            rectangles_[numKept++] = r1;
         }
     }
-
-    // min and ROI checks
-    for (i = rectangles.size()-1; i >= 0 ; i--)
+    rectangles_.resize(numKept);
+    
+    // draw edges: foreground pixels with a background pixel above, below, left or right
+    edges_.resize(width*height);
+    for (int y = 0; y < height; y++)
     {
-        r1 = &rectangles[i];
-
-        if (r1->area < minArea_ || r1->width < minWidth_ || r1->height < minHeight_ || (useROI_ && !Intersect(*r1, theROI_)))
+        unsigned char const * const line = data + y*width;
+        unsigned char const * const lineUp = (y > 0) ? line - width : line;
+        unsigned char const * const lineDown = (y < height-1) ? line + width : line;
+        unsigned char * const edgeLine = &edges_[y*width];
+        
+        for (int x = 0; x < width; x++)
         {
-            rectangles.erase(rectangles.begin()+i);
+            const bool background = (line[x] == 0);
+            const bool edge = (x > 0 && line[x-1] == 0) || (x < width-1 && line[x+1] == 0) || lineUp[x] == 0 || lineDown[x] == 0;
+            
+            edgeLine[x] = (!background && edge) ? 255 : 0;
         }
     }
+    memcpy(data, edges_.data(), width*height);
     
-    // draw edges
-    memcpy(data, temp, size);
-
     Image_->dirty();
 }
 
 void CPUFindDiscreetObjectsPass::GetBoundingRects(std::vector<Rect>& rects)
 {
-    rects.swap(rectangles); 
-}
-
-void FollowBorder(int idx, int width, int size, int w, int h, int &left, int &right, int &bottom, int &top)
-{
-    int i, dh, dw;
-    for (int l = 0; l < 8; l++)
-    {
-        dh = h+delta[l][0];
-        dw = w+delta[l][1];
-        i = (dh*width) + dw;
-        if (i >= size || i < 0 || temp[i] == 0 || used[i]==ucounter )
-            continue;
-        used[i] = ucounter;
-        left = std::min(left, dw);
-        right = std::max(right, dw);
-        top = std::min(top, dh);
-        bottom = std::max(bottom, dh);
-        FollowBorder(idx, width, size, dw, dh, left, right, bottom, top);
-    }
-}
-
-bool Intersect(const CPUFindDiscreetObjectsPass::Rect& r1, const CPUFindDiscreetObjectsPass::Rect& r2)
-{
-    return ( (abs(int(r1.centerX) - int(r2.centerX)) <= (r1.width/2 + r2.width/2) )
-        && ( abs(int(r1.centerY) - int(r2.centerY)) <= (r1.height/2 + r2.height/2)) );
-
+    rects.swap(rectangles_); 
 }
@@ -20,10 +20,232 @@
 
 #include <flitr/modules/flitr_image_processors/adaptive_threshold/fip_adaptive_threshold.h>
 
+#include <algorithm>
 
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    inline void normaliseBoxSum(uint8_t &value, const uint32_t sum, const float recipKernelArea)
+    {
+        value=uint8_t(float(sum) * recipKernelArea + 0.5f);
+    }
+    
+    inline void normaliseBoxSum(float &value, const double sum, const float recipKernelArea)
+    {
+        value=float(sum) * recipKernelArea;
+    }
+    
+    /*! One level of a repeated box filter that produces its output rows in sequence.
+     *  The column sums slide down by one row per output row and the output rows are kept in a ring buffer
+     *  for the next level. Rows and columns closer than half a kernel to the image edge are set to fillValue_.*/
+    template<typename T, typename SumT>
+    class BoxFilterStage
+    {
+    public:
+        BoxFilterStage(T const * const dataRead, BoxFilterStage * const inputStage,
+                       const ptrdiff_t width, const ptrdiff_t height, const ptrdiff_t kernelWidth,
+                       T * const ringRows, const ptrdiff_t numRingRows,
+                       SumT * const columnSums, const T fillValue, const ptrdiff_t firstRow) :
+        dataRead_(dataRead),
+        inputStage_(inputStage),
+        width_(width),
+        height_(height),
+        kernelWidth_(kernelWidth),
+        halfKernelWidth_(kernelWidth>>1),
+        ringRows_(ringRows),
+        numRingRows_(numRingRows),
+        columnSums_(columnSums),
+        columnSumsRow_(-2),
+        fillValue_(fillValue),
+        nextRow_(firstRow)
+        {}
+        
+        T const * row(const ptrdiff_t y) const
+        {
+            return ringRows_ + (y % numRingRows_) * width_;
+        }
+        
+        void advanceTo(const ptrdiff_t y)
+        {
+            for (; nextRow_<=y; ++nextRow_)
+            {
+                produceRow(nextRow_);
+            }
+        }
+    
+    private:
+        T const * inputRow(const ptrdiff_t y) const
+        {
+            return (inputStage_!=nullptr) ? inputStage_->row(y) : (dataRead_ + y * width_);
+        }
+        
+        void produceRow(const ptrdiff_t y)
+        {
+            T * const lineWrite=ringRows_ + (y % numRingRows_) * width_;
+            const ptrdiff_t h=halfKernelWidth_;
+            
+            if ((y<h) || (y>=(height_-h)) || (width_<kernelWidth_))
+            {
+                std::fill(lineWrite, lineWrite+width_, fillValue_);
+                return;
+            }
+            
+            if (inputStage_!=nullptr) inputStage_->advanceTo(y+h);
+            
+            if (columnSumsRow_==(y-1))
+            {//Slide the column sums down by one row.
+                T const * const lineIn=inputRow(y+h);
+                T const * const lineOut=inputRow(y-h-1);
+                
+                for (ptrdiff_t x=0; x<width_; ++x)
+                {
+                    columnSums_[x]+=SumT(lineIn[x]) - SumT(lineOut[x]);
+                }
+            } else
+            {
+                std::fill(columnSums_, columnSums_+width_, SumT(0));
+                
+                for (ptrdiff_t j=y-h; j<=(y+h); ++j)
+                {
+                    T const * const lineIn=inputRow(j);
+                    
+                    for (ptrdiff_t x=0; x<width_; ++x)
+                    {
+                        columnSums_[x]+=SumT(lineIn[x]);
+                    }
+                }
+            }
+            columnSumsRow_=y;
+            
+            const float recipKernelArea=1.0f / float(kernelWidth_*kernelWidth_);
+            
+            std::fill(lineWrite, lineWrite+h, fillValue_);
+            std::fill(lineWrite+(width_-h), lineWrite+width_, fillValue_);
+            
+            SumT sum=SumT(0);
+            for (ptrdiff_t x=0; x<kernelWidth_; ++x)
+            {
+                sum+=columnSums_[x];
+            }
+            normaliseBoxSum(lineWrite[h], sum, recipKernelArea);
+            
+            for (ptrdiff_t x=h+1; x<(width_-h); ++x)
+            {
+                sum+=columnSums_[x+h] - columnSums_[x-h-1];
+                normaliseBoxSum(lineWrite[x], sum, recipKernelArea);
+            }
+        }
+        
+        T const * const dataRead_;
+        BoxFilterStage * const inputStage_;
+        
+        const ptrdiff_t width_;
+        const ptrdiff_t height_;
+        const ptrdiff_t kernelWidth_;
+        const ptrdiff_t halfKernelWidth_;
+        
+        T * const ringRows_;
+        const ptrdiff_t numRingRows_;
+        
+        SumT * const columnSums_;
+        ptrdiff_t columnSumsRow_;
+        
+        const T fillValue_;
+        ptrdiff_t nextRow_;
+    };
+    
+    //!Set up the numLevels stages of a repeated box filter of which the last stage produces rows from yStart onwards.
+    template<typename T, typename SumT>
+    void setupBoxFilterStages(std::vector<BoxFilterStage<T, SumT> > &stages,
+                              T const * const dataRead, const ptrdiff_t width, const ptrdiff_t height,
+                              const ptrdiff_t kernelWidth, const ptrdiff_t numLevels,
+                              T * &rows, SumT * &columnSums, const T fillValue, const ptrdiff_t yStart)
+    {
+        stages.reserve(numLevels);//The stages point to each other and may not be reallocated.
+        
+        for (ptrdiff_t level=0; level<numLevels; ++level)
+        {
+            //The last stage only needs its current row. Earlier stages keep the rows under the next stage's kernel.
+            const ptrdiff_t numRingRows=(level==(numLevels-1)) ? 1 : (kernelWidth+1);
+            const ptrdiff_t firstRow=std::max<ptrdiff_t>(0, yStart - (numLevels-1-level)*(kernelWidth>>1));
+            
+            stages.push_back(BoxFilterStage<T, SumT>((level==0) ? dataRead : nullptr,
+                                                     (level==0) ? nullptr : &stages.back(),
+                                                     width, height, kernelWidth,
+                                                     rows, numRingRows,
+                                                     columnSums, fillValue, firstRow));
+            rows+=numRingRows*width;
+            columnSums+=width;
+        }
+    }
+    
+    /*! Threshold the noise filtered image against the local average in one streaming pass per row band.
+     *@return The number of pixels above the threshold.*/
+    template<typename T, typename SumT>
+    size_t adaptiveThreshold(T * const dataWriteDS, T const * const dataReadUS,
+                             const ptrdiff_t width, const ptrdiff_t height,
+                             const ptrdiff_t noiseKernelWidth, const ptrdiff_t kernelWidth, const ptrdiff_t numLevels,
+                             const float thresholdOffset, const T maxValue,
+                             std::vector<std::vector<T> > &bandRows, std::vector<std::vector<SumT> > &bandColumnSums)
+    {
+        const size_t numBands=getNumRowBands(height);
+        const size_t numRows=size_t(numLevels-1)*size_t(noiseKernelWidth+kernelWidth+2) + 2;
+        
+        if (bandRows.size()<numBands) bandRows.resize(numBands);
+        if (bandColumnSums.size()<numBands) bandColumnSums.resize(numBands);
+        for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+        {
+            if (bandRows[bandNum].size()<(numRows*width)) bandRows[bandNum].resize(numRows*width);
+            if (bandColumnSums[bandNum].size()<size_t(2*numLevels*width)) bandColumnSums[bandNum].resize(2*numLevels*width);
+        }
+        
+        const ptrdiff_t bandHeight=ptrdiff_t((height + numBands - 1) / numBands);
+        size_t numAboveThreshold=0;
+        
+        int32_t bandNum=0;
+#pragma omp parallel for reduction(+:numAboveThreshold)
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const ptrdiff_t yStart=bandNum * bandHeight;
+            const ptrdiff_t yEnd=std::min(yStart + bandHeight, height);
+            
+            T * rows=bandRows[bandNum].data();
+            SumT * columnSums=bandColumnSums[bandNum].data();
+            
+            std::vector<BoxFilterStage<T, SumT> > noiseStages;
+            std::vector<BoxFilterStage<T, SumT> > averageStages;
+            setupBoxFilterStages(noiseStages, dataReadUS, width, height, noiseKernelWidth, numLevels,
+                                 rows, columnSums, T(0), yStart);
+            setupBoxFilterStages(averageStages, dataReadUS, width, height, kernelWidth, numLevels,
+                                 rows, columnSums, maxValue, yStart);
+            
+            for (ptrdiff_t y=yStart; y<yEnd; ++y)
+            {
+                noiseStages.back().advanceTo(y);
+                averageStages.back().advanceTo(y);
+                
+                T const * const lineNoise=noiseStages.back().row(y);
+                T const * const lineAverage=averageStages.back().row(y);
+                T * const lineWrite=dataWriteDS + y * width;
+                size_t lineAboveThreshold=0;
+                
+                for (ptrdiff_t x=0; x<width; ++x)
+                {
+                    const bool above=(float(lineNoise[x]) - thresholdOffset) > float(lineAverage[x]);
+                    lineWrite[x]=above ? maxValue : T(0);
+                    lineAboveThreshold+=above;
+                }
+                
+                numAboveThreshold+=lineAboveThreshold;
+            }
+        }
+        
+        return numAboveThreshold;
+    }
+}
+
 FIPAdaptiveThreshold::FIPAdaptiveThreshold(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                                            const int kernelWidth,
                                            const short numIntegralImageLevels,
@@ -31,11 +253,7 @@ FIPAdaptiveThreshold::FIPAdaptiveThreshold(ImageProducer& upStreamProducer, uint
                                            uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 _numIntegralImageLevels(numIntegralImageLevels),
-_noiseFilter(7),
-_noiseFilteredInputData(nullptr),
-_scratchData(nullptr),
-_integralImageScratchData(nullptr),
-_boxFilter(kernelWidth),
+_noiseKernelWidth(7),
 _enabled(true),
 _title(std::string("Adaptive Threshold Filter")),
 _kernelWidth(kernelWidth),
@@ -52,15 +270,11 @@ _thresholdAvrg(0.0)
 
 FIPAdaptiveThreshold::~FIPAdaptiveThreshold()
 {
-    delete [] _noiseFilteredInputData;
-    delete [] _scratchData;
-    delete [] _integralImageScratchData;
 }
 
 
 void FIPAdaptiveThreshold::setKernelWidth(const int kernelWidth)
 {
-    _boxFilter.setKernelWidth(kernelWidth);
     _kernelWidth=kernelWidth;
 }
 
@@ -69,41 +283,7 @@ bool FIPAdaptiveThreshold::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
-    size_t maxScratchDataSize=0;
-    size_t maxScratchDataValues=0;
-    
-    for (uint32_t i=0; i<ImagesPerSlot_; i++)
-    {
-        const ImageFormat imFormat=getUpstreamFormat(i);
-        
-        const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
-        
-        const size_t bytesPerPixel=imFormat.getBytesPerPixel();
-        const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        
-        const size_t scratchDataSize = width * height * bytesPerPixel;
-        const size_t scratchDataValues = width * height * componentsPerPixel;
-        
-        if (scratchDataSize>maxScratchDataSize)
-        {
-            maxScratchDataSize=scratchDataSize;
-        }
-        
-        if (scratchDataValues>maxScratchDataValues)
-        {
-            maxScratchDataValues=scratchDataValues;
-        }
-    }
-    
-    //Allocate a buffer big enough for any of the image slots.
-    _noiseFilteredInputData=new uint8_t[maxScratchDataSize];
-    _scratchData=new uint8_t[maxScratchDataSize];
-    memset(_noiseFilteredInputData, 0, maxScratchDataSize);
-    memset(_scratchData, 0, maxScratchDataSize);
-    
-    _integralImageScratchData=new double[maxScratchDataValues];
-    memset(_integralImageScratchData, 0, maxScratchDataValues*sizeof(double));
+    //The per band scratch is sized on the first trigger, because it depends on the kernel width.
     
     return rValue;
 }
@@ -118,6 +298,11 @@ bool FIPAdaptiveThreshold::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
+        //Read the parameters once, because they may be changed from another thread.
+        const ptrdiff_t kernelWidth=ptrdiff_t(_kernelWidth|1);//Make sure the kernel width is odd.
+        const ptrdiff_t numLevels=std::max<ptrdiff_t>(1, _numIntegralImageLevels);
+        const float thresholdOffset=_thresholdOffset;
+        
         for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
         {
             Image const * const imReadUS = *(imvRead[imgNum]);
@@ -134,113 +319,30 @@ bool FIPAdaptiveThreshold::trigger()
             {
                 const size_t width=imFormat.getWidth();
                 const size_t height=imFormat.getHeight();
-                const size_t numElements=width * height * imFormat.getComponentsPerPixel();
                 
                 if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
                 {
                     float const * const dataReadUS=(float const * const)imReadUS->data();
                     float * const dataWriteDS=(float * const)imWriteDS->data();
                     
-                    //Small kernel noise filter.
-                    _noiseFilter.filter((float *)_noiseFilteredInputData, dataReadUS, width, height,
-                                        _integralImageScratchData, true);
-                    
-                    for (short i=1; i<_numIntegralImageLevels; ++i)
-                    {
-                        memcpy(_scratchData, _noiseFilteredInputData, width*height*sizeof(uint8_t));
-                        
-                        _noiseFilter.filter((float *)_noiseFilteredInputData, (float *)_scratchData, width, height,
-                                            _integralImageScratchData, true);
-                    }
-                    
-                    
-                    for (size_t i=0; i<numElements; ++i)
-                    {
-                        dataWriteDS[i]=1.0;
-                    }
-                    
-                    
-                    //Large kernel adaptive reference.
-                    _boxFilter.filter(dataWriteDS, dataReadUS, width, height,
-                                      _integralImageScratchData, true);
-                    
-                    for (short i=1; i<_numIntegralImageLevels; ++i)
-                    {
-                        memcpy(_scratchData, dataWriteDS, width*height*sizeof(float));
-                        
-                        _boxFilter.filter(dataWriteDS, (float *)_scratchData, width, height,
-                                          _integralImageScratchData, true);
-                    }
-                    
-                    
-                    const float tovF32=_thresholdOffset * 1.0f;
-                    size_t tpc=0;
-                    
-                    for (size_t i=0; i<numElements; ++i)
-                    {
-                        if (( ((float *)_noiseFilteredInputData)[i] - tovF32) > dataWriteDS[i])
-                        {
-                            dataWriteDS[i]=1.0;
-                            ++tpc;
-                        } else
-                        {
-                            dataWriteDS[i]=0.0;
-                        }
-                    }
+                    const size_t tpc=adaptiveThreshold(dataWriteDS, dataReadUS, width, height,
+                                                       _noiseKernelWidth, kernelWidth, numLevels,
+                                                       thresholdOffset, 1.0f,
+                                                       _bandRowsF32, _bandColumnSumsF32);
                     
-                    _thresholdAvrg=tpc;// / double(width*height);
+                    _thresholdAvrg=tpc / double(width*height);
                 } else
                     if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_8)
                     {
                         uint8_t const * const dataReadUS=(uint8_t const * const)imReadUS->data();
                         uint8_t * const dataWriteDS=(uint8_t * const)imWriteDS->data();
                         
-                        //Small kernel noise filter.
-                        _noiseFilter.filter((uint8_t *)_noiseFilteredInputData, dataReadUS, width, height,
-                                            _integralImageScratchData, true);
-                        
-                        for (short i=1; i<_numIntegralImageLevels; ++i)
-                        {
-                            memcpy(_scratchData, _noiseFilteredInputData, width*height*sizeof(uint8_t));
-                            
-                            _noiseFilter.filter((uint8_t *)_noiseFilteredInputData, (uint8_t *)_scratchData, width, height,
-                                                _integralImageScratchData, true);
-                        }
-                        
+                        const uint8_t tovUInt8=thresholdOffset * 255.5;
                         
-                        for (size_t i=0; i<numElements; ++i)
-                        {
-                            dataWriteDS[i]=255;
-                        }
-                        
-                        
-                        //Large kernel adaptive reference.
-                        _boxFilter.filter(dataWriteDS, dataReadUS, width, height,
-                                          _integralImageScratchData, true);
-                        
-                        for (short i=1; i<_numIntegralImageLevels; ++i)
-                        {
-                            memcpy(_scratchData, dataWriteDS, width*height*sizeof(uint8_t));
-                            
-                            _boxFilter.filter(dataWriteDS, (uint8_t *)_scratchData, width, height,
-                                              _integralImageScratchData, true);
-                        }
-                        
-                        
-                        const uint8_t tovUInt8=_thresholdOffset * 255.5;
-                        size_t tpc=0;
-                        
-                        for (size_t i=0; i<numElements; ++i)
-                        {
-                            if (( ((uint8_t *)_noiseFilteredInputData)[i] - tovUInt8) > dataWriteDS[i])
-                            {
-                                dataWriteDS[i]=255;
-                                ++tpc;
-                            } else
-                            {
-                                dataWriteDS[i]=0;
-                            }
-                        }
+                        const size_t tpc=adaptiveThreshold(dataWriteDS, dataReadUS, width, height,
+                                                           _noiseKernelWidth, kernelWidth, numLevels,
+                                                           float(tovUInt8), uint8_t(255),
+                                                           _bandRows8, _bandColumnSums8);
                         
                         _thresholdAvrg=tpc / double(width*height);
                     }
@@ -258,4 +360,3 @@ bool FIPAdaptiveThreshold::trigger()
     
     return false;
 }
-
@@ -23,15 +23,89 @@
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    //!Sliding window update of integer images. The sums are exact and the window length is 2^shift.
+    template<typename T>
+    void updateSlidingWindow(T * const dataWrite, T const * const dataRead, T * const oldestHistoryImage,
+                             uint32_t * const sumImage, const size_t numComponents, const uint8_t shift)
+    {
+        const uint32_t half=(uint32_t(1) << shift) >> 1;
+        
+        int64_t i=0;
+#pragma omp parallel for
+        for (i=0; i<int64_t(numComponents); ++i)
+        {
+            const uint32_t sum=sumImage[i] + dataRead[i] - oldestHistoryImage[i];
+            
+            sumImage[i]=sum;
+            oldestHistoryImage[i]=dataRead[i];
+            dataWrite[i]=T((sum + half) >> shift);
+        }
+    }
+    
+    void updateSlidingWindow(float * const dataWrite, float const * const dataRead, float * const oldestHistoryImage,
+                             float * const sumImage, const size_t numComponents, const float recipWindowLength)
+    {
+        int64_t i=0;
+#pragma omp parallel for
+        for (i=0; i<int64_t(numComponents); ++i)
+        {
+            const float sum=sumImage[i] + dataRead[i] - oldestHistoryImage[i];
+            
+            sumImage[i]=sum;
+            oldestHistoryImage[i]=dataRead[i];
+            dataWrite[i]=sum * recipWindowLength;
+        }
+    }
+    
+    //!Exponential moving average of integer images. The average is kept scaled by 2^shift.
+    template<typename T>
+    void updateExponential(T * const dataWrite, T const * const dataRead,
+                           uint32_t * const scaledAverageImage, const size_t numComponents, const uint8_t shift,
+                           const bool firstFrame)
+    {
+        int64_t i=0;
+#pragma omp parallel for
+        for (i=0; i<int64_t(numComponents); ++i)
+        {
+            const uint32_t scaledAverage=firstFrame ? (uint32_t(dataRead[i]) << shift) :
+                                                      (scaledAverageImage[i] - (scaledAverageImage[i] >> shift) + dataRead[i]);
+            
+            scaledAverageImage[i]=scaledAverage;
+            dataWrite[i]=T(scaledAverage >> shift);
+        }
+    }
+    
+    void updateExponential(float * const dataWrite, float const * const dataRead,
+                           float * const averageImage, const size_t numComponents, const float recipWindowLength,
+                           const bool firstFrame)
+    {
+        int64_t i=0;
+#pragma omp parallel for
+        for (i=0; i<int64_t(numComponents); ++i)
+        {
+            const float average=firstFrame ? dataRead[i] :
+                                             (averageImage[i] + (dataRead[i] - averageImage[i]) * recipWindowLength);
+            
+            averageImage[i]=average;
+            dataWrite[i]=average;
+        }
+    }
+}
+
 FIPAverageImage::FIPAverageImage(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                                  uint8_t base2WindowLength,
-                                 uint32_t buffer_size) :
+                                 uint32_t buffer_size,
+                                 AverageMode averageMode) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 base2WindowLength_(base2WindowLength),
 windowLength_((uint32_t)(powf(2.0f, base2WindowLength_)+0.5f)),
 recipWindowLength_(1.0f/((float)windowLength_)),
+averageMode_(averageMode),
 Title_(std::string("Average Image")),
-oldestHistorySlot_(0)
+oldestHistorySlot_(0),
+firstFrame_(true)
 {
     ProcessorStats_->setID("ImageProcessor::FIPAverageImage");
     //Setup image format being produced to downstream.
@@ -45,27 +119,13 @@ FIPAverageImage::~FIPAverageImage()
 {
     // First stop the trigger thread. The stopTriggerThread() function will
     // also wait for the thread to stop using the join() function.
-    // It is essential to wait for the thread to exit before starting
-    // to clean up otherwise if the thread is still in the trigger() function
-    // and cleaning up starts, the application will crash.
+    // It is essential to wait for the thread to exit before the history and
+    // sum images are destroyed, otherwise if the thread is still in the trigger()
+    // function the application will crash.
     // If the user called stopTriggerThread() manually, this call will do
     // nothing. stopTriggerThread() will get called in the base destructor, but
     // at that time it might be too late.
     stopTriggerThread();
-    // Thread should be done, cleaning up can start. This might still be a problem
-    // if the application calls trigger() and not the triggerThread.
-    for (uint32_t i=0; i<ImagesPerSlot_; ++i)
-    {
-        delete [] sumImageVec_[i];
-        
-        for (size_t historyIndex=0; historyIndex<windowLength_; ++historyIndex)
-        {
-            delete [] historyImageVecVec_[i][historyIndex];
-        }
-        historyImageVecVec_[i].clear();
-    }
-    
-    sumImageVec_.clear();
 }
 
 bool FIPAverageImage::init()
@@ -73,23 +133,47 @@ bool FIPAverageImage::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
+    sumIntImageVec_.resize(ImagesPerSlot_);
+    sumFloatImageVec_.resize(ImagesPerSlot_);
+    historyImageVec_.resize(ImagesPerSlot_);
+    
     for (uint32_t i=0; i<ImagesPerSlot_; ++i)
     {
         const ImageFormat imFormat=getUpstreamFormat(i);//Downstream format is same as upstream format.
         
-        const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
+        const size_t componentsPerImage=imFormat.getWidth() * imFormat.getHeight() * imFormat.getComponentsPerPixel();
         
-        const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        
-        sumImageVec_.push_back(new float[width*height*componentsPerPixel]);
-        memset(sumImageVec_[i], 0, width*height*componentsPerPixel*sizeof(float));
+        switch (imFormat.getPixelFormat())
+        {
+            case ImageFormat::FLITR_PIX_FMT_Y_8:
+            case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                if (base2WindowLength_>24)
+                {
+                    logMessage(LOG_CRITICAL) << "FIPAverageImage: base2WindowLength of 8-bit images may not exceed 24.\n";
+                    return false;
+                }
+                sumIntImageVec_[i].assign(componentsPerImage, 0);
+                break;
+            case ImageFormat::FLITR_PIX_FMT_Y_16:
+                if (base2WindowLength_>16)
+                {
+                    logMessage(LOG_CRITICAL) << "FIPAverageImage: base2WindowLength of 16-bit images may not exceed 16.\n";
+                    return false;
+                }
+                sumIntImageVec_[i].assign(componentsPerImage, 0);
+                break;
+            case ImageFormat::FLITR_PIX_FMT_Y_F32:
+            case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                sumFloatImageVec_[i].assign(componentsPerImage, 0.0f);
+                break;
+            default:
+                logMessage(LOG_CRITICAL) << "FIPAverageImage: Pixel format is not supported!\n";
+                return false;
+        }
         
-        historyImageVecVec_.push_back(std::vector<float *>());
-        for (size_t historyIndex=0; historyIndex<windowLength_; ++historyIndex)
+        if (averageMode_==AverageMode::SLIDING_WINDOW)
         {
-            historyImageVecVec_[i].push_back(new float[width*height*componentsPerPixel]);
-            memset(historyImageVecVec_[i][historyIndex], 0, width*height*componentsPerPixel*sizeof(float));
+            historyImageVec_[i].assign(windowLength_ * imFormat.getBytesPerImage(), 0);
         }
     }
     
@@ -121,66 +205,63 @@ bool FIPAverageImage::trigger()
             
             const ImageFormat imFormat=getUpstreamFormat(imgNum);//Downstream format is same as upstream format.
             
-            const size_t width=imFormat.getWidth();
-            const size_t height=imFormat.getHeight();
+            const size_t componentsPerImage=imFormat.getWidth() * imFormat.getHeight() * imFormat.getComponentsPerPixel();
+            
+            //Only allocated in sliding window mode.
+            uint8_t * const oldestHistoryImage=(averageMode_==AverageMode::SLIDING_WINDOW) ?
+                                               (historyImageVec_[imgNum].data() + oldestHistorySlot_ * imFormat.getBytesPerImage()) : nullptr;
             
             //Update this slot's average image here...
-            if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
+            switch (imFormat.getPixelFormat())
             {
-                float const * const dataRead = (float const * const)imRead->data();
-                float * const dataWrite = (float * const)imWrite->data();
-                float * const sumImage = sumImageVec_[imgNum];
-                float * const oldestHistoryImage = historyImageVecVec_[imgNum][oldestHistorySlot_];
-                
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=y * width;
-                    
-                    for (size_t x=0; x<width; ++x)
+                case ImageFormat::FLITR_PIX_FMT_Y_8:
+                case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                    if (averageMode_==AverageMode::SLIDING_WINDOW)
                     {
-                        sumImage[lineOffset + x]+=dataRead[lineOffset + x];
-                        sumImage[lineOffset + x]-=oldestHistoryImage[lineOffset + x];
-                        oldestHistoryImage[lineOffset + x]=dataRead[lineOffset + x];
-                        dataWrite[lineOffset + x]=sumImage[lineOffset + x] * recipWindowLength_;
+                        updateSlidingWindow((uint8_t * const)imWrite->data(), (uint8_t const * const)imRead->data(),
+                                            oldestHistoryImage, sumIntImageVec_[imgNum].data(),
+                                            componentsPerImage, base2WindowLength_);
+                    } else
+                    {
+                        updateExponential((uint8_t * const)imWrite->data(), (uint8_t const * const)imRead->data(),
+                                          sumIntImageVec_[imgNum].data(), componentsPerImage, base2WindowLength_,
+                                          firstFrame_);
                     }
-                }
-            } else
-                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
-                {
-                    float const * const dataRead = (float const * const)imRead->data();
-                    float * const dataWrite = (float * const)imWrite->data();
-                    float * const sumImage = sumImageVec_[imgNum];
-                    float * const oldestHistoryImage = historyImageVecVec_[imgNum][oldestHistorySlot_];
-                    
-                    for (size_t y=0; y<height; ++y)
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_16:
+                    if (averageMode_==AverageMode::SLIDING_WINDOW)
+                    {
+                        updateSlidingWindow((uint16_t * const)imWrite->data(), (uint16_t const * const)imRead->data(),
+                                            (uint16_t * const)oldestHistoryImage, sumIntImageVec_[imgNum].data(),
+                                            componentsPerImage, base2WindowLength_);
+                    } else
                     {
-                        size_t offset=y * width*3;
-                        
-                        for (size_t x=0; x<width; ++x)
-                        {
-                            sumImage[offset + 0]+=dataRead[offset + 0];
-                            sumImage[offset + 0]-=oldestHistoryImage[offset + 0];
-                            oldestHistoryImage[offset + 0]=dataRead[offset + 0];
-                            dataWrite[offset + 0]=sumImage[offset + 0] * recipWindowLength_;
-                            
-                            sumImage[offset + 1]+=dataRead[offset + 1];
-                            sumImage[offset + 1]-=oldestHistoryImage[offset + 1];
-                            oldestHistoryImage[offset + 1]=dataRead[offset + 1];
-                            dataWrite[offset + 1]=sumImage[offset + 1] * recipWindowLength_;
-                            
-                            sumImage[offset + 2]+=dataRead[offset + 2];
-                            sumImage[offset + 2]-=oldestHistoryImage[offset + 2];
-                            oldestHistoryImage[offset + 2]=dataRead[offset + 2];
-                            dataWrite[offset + 2]=sumImage[offset + 2] * recipWindowLength_;
-                            
-                            offset+=3;
-                        }
+                        updateExponential((uint16_t * const)imWrite->data(), (uint16_t const * const)imRead->data(),
+                                          sumIntImageVec_[imgNum].data(), componentsPerImage, base2WindowLength_,
+                                          firstFrame_);
                     }
-                }
-
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_F32:
+                case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                    if (averageMode_==AverageMode::SLIDING_WINDOW)
+                    {
+                        updateSlidingWindow((float * const)imWrite->data(), (float const * const)imRead->data(),
+                                            (float * const)oldestHistoryImage, sumFloatImageVec_[imgNum].data(),
+                                            componentsPerImage, recipWindowLength_);
+                    } else
+                    {
+                        updateExponential((float * const)imWrite->data(), (float const * const)imRead->data(),
+                                          sumFloatImageVec_[imgNum].data(), componentsPerImage, recipWindowLength_,
+                                          firstFrame_);
+                    }
+                    break;
+                default:
+                    break;
+            }
         }
         
         oldestHistorySlot_=(oldestHistorySlot_+1) % windowLength_;
+        firstFrame_=false;
         
         //Stop stats measurement event.
         ProcessorStats_->tock();
@@ -193,4 +274,3 @@ bool FIPAverageImage::trigger()
     
     return false;
 }
-
@@ -23,27 +23,40 @@
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    //!The sliding DFT bins are recalculated from the history this often (in frames) to bound the accumulated rounding error.
+    const size_t slidingDFTResyncInterval=4096;
+    
+    //!Scale and offset applied to the summed bin power.
+    const float beatPowerScale=2.625f;
+    const float beatPowerOffset=0.5f;
+}
+
 FIPBeatImage::FIPBeatImage(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                            uint8_t base2WindowLength,
                            uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 base2WindowLength_(base2WindowLength),
 windowLength_((uint32_t)(powf(2.0f, base2WindowLength_)+0.5f)),
-oldestHistorySlot_(0)
+beatBins_(1, 2),
+beatMethod_(BeatMethod::SLIDING_DFT),
+oldestHistorySlot_(0),
+framesSinceResync_(0)
 {
     //Setup image format being produced to downstream.
     for (uint32_t i=0; i<images_per_slot; i++) {
         ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
     }
+    
+    if (beatBins_[0]>=windowLength_)
+    {
+        beatBins_[0]=windowLength_-1;
+    }
 }
 
 FIPBeatImage::~FIPBeatImage()
 {
-    for (uint32_t i=0; i<ImagesPerSlot_; ++i)
-    {
-        delete [] historyImageVec_[i];
-        delete [] beatImageVec_[i];
-    }
 }
 
 bool FIPBeatImage::init()
@@ -51,26 +64,206 @@ bool FIPBeatImage::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
+    historyImageVec_.resize(ImagesPerSlot_);
+    binReImageVec_.resize(ImagesPerSlot_);
+    binImImageVec_.resize(ImagesPerSlot_);
+    
     for (uint32_t i=0; i<ImagesPerSlot_; ++i)
     {
         const ImageFormat imFormat=getUpstreamFormat(i);//Downstream format is same as upstream format.
         
-        const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
-        
-        const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
+        if ((imFormat.getPixelFormat()!=ImageFormat::FLITR_PIX_FMT_Y_F32) &&
+            (imFormat.getPixelFormat()!=ImageFormat::FLITR_PIX_FMT_RGB_F32))
+        {
+            logMessage(LOG_CRITICAL) << "FIPBeatImage: Pixel format is not supported!\n";
+            return false;
+        }
         
-        historyImageVec_.push_back(new float[width*height*componentsPerPixel * windowLength_]);
-        memset(historyImageVec_[i], 0, width*height*componentsPerPixel * windowLength_ * sizeof(float));
+        const size_t componentsPerImage=imFormat.getWidth() * imFormat.getHeight() * imFormat.getComponentsPerPixel();
         
-        beatImageVec_.push_back(new float[width*height*componentsPerPixel * windowLength_*2]);
-        memset(beatImageVec_[i], 0, width*height*componentsPerPixel * windowLength_*2 * sizeof(float));
+        historyImageVec_[i].assign(componentsPerImage * windowLength_, 0.0f);
+        binReImageVec_[i].assign(componentsPerImage * beatBins_.size(), 0.0f);
+        binImImageVec_[i].assign(componentsPerImage * beatBins_.size(), 0.0f);
     }
     
+    updateTwiddles();
+    
     return rValue;
 }
 
+void FIPBeatImage::setBeatMethod(const BeatMethod beatMethod)
+{
+    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+    
+    if ((beatMethod==BeatMethod::SLIDING_DFT) && (beatMethod_!=BeatMethod::SLIDING_DFT))
+    {//The bins were not tracked while the FFT was used.
+        for (size_t imgNum=0; imgNum<historyImageVec_.size(); ++imgNum)
+        {
+            resyncSlidingDFT(imgNum);
+        }
+    }
+    
+    beatMethod_=beatMethod;
+}
+
+void FIPBeatImage::setBeatBins(const std::vector<size_t> &beatBins)
+{
+    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+    
+    beatBins_.clear();
+    
+    for (const size_t bin : beatBins)
+    {
+        if (bin<windowLength_)
+        {
+            beatBins_.push_back(bin);
+        } else
+        {
+            logMessage(LOG_CRITICAL) << "FIPBeatImage: Ignoring beat bin " << bin << " that is not less than the window length.\n";
+        }
+    }
+    
+    updateTwiddles();
+    
+    for (size_t imgNum=0; imgNum<historyImageVec_.size(); ++imgNum)
+    {
+        const size_t componentsPerImage=historyImageVec_[imgNum].size() / windowLength_;
+        
+        binReImageVec_[imgNum].assign(componentsPerImage * beatBins_.size(), 0.0f);
+        binImImageVec_[imgNum].assign(componentsPerImage * beatBins_.size(), 0.0f);
+        
+        resyncSlidingDFT(imgNum);
+    }
+}
+
+void FIPBeatImage::updateTwiddles()
+{
+    twiddleReVec_.resize(beatBins_.size() * windowLength_);
+    twiddleImVec_.resize(beatBins_.size() * windowLength_);
+    
+    for (size_t b=0; b<beatBins_.size(); ++b)
+    {
+        for (size_t slot=0; slot<windowLength_; ++slot)
+        {
+            //Reduce k*slot modulo the window length so that the phase stays exact.
+            const double phase=(6.28318530717959*double((beatBins_[b]*slot) % windowLength_)) / double(windowLength_);
+            
+            twiddleReVec_[b*windowLength_ + slot]=float(cos(phase));
+            twiddleImVec_[b*windowLength_ + slot]=float(sin(phase));
+        }
+    }
+}
+
+void FIPBeatImage::resyncSlidingDFT(const size_t imgNum)
+{
+    std::vector<float> &binReImage=binReImageVec_[imgNum];
+    std::vector<float> &binImImage=binImImageVec_[imgNum];
+    float const * const historyImage=historyImageVec_[imgNum].data();
+    
+    const size_t componentsPerImage=historyImageVec_[imgNum].size() / windowLength_;
+    
+    std::fill(binReImage.begin(), binReImage.end(), 0.0f);
+    std::fill(binImImage.begin(), binImImage.end(), 0.0f);
+    
+    for (size_t b=0; b<beatBins_.size(); ++b)
+    {
+        float * const binRe=binReImage.data() + b*componentsPerImage;
+        float * const binIm=binImImage.data() + b*componentsPerImage;
+        
+        for (size_t slot=0; slot<windowLength_; ++slot)
+        {
+            const float twiddleRe=twiddleReVec_[b*windowLength_ + slot];
+            const float twiddleIm=twiddleImVec_[b*windowLength_ + slot];
+            float const * const slotImage=historyImage + slot*componentsPerImage;
+            
+            int64_t i=0;
+#pragma omp parallel for
+            for (i=0; i<int64_t(componentsPerImage); ++i)
+            {
+                binRe[i]+=slotImage[i] * twiddleRe;
+                binIm[i]+=slotImage[i] * twiddleIm;
+            }
+        }
+    }
+}
+
+void FIPBeatImage::slidingDFTBeat(float * const dataWrite, const size_t imgNum, const size_t componentsPerImage,
+                                  float const * const deltaImage)
+{
+    //Each bin is a sum over the ring buffer slots of history[slot]*twiddle[slot]. Replacing the sample in
+    //the oldest slot therefore only adds (new-old)*twiddle[slot]. The ring buffer order differs from the
+    //time order by a rotation, which only changes the phase of the bins and not their power.
+    float * const binReImage=binReImageVec_[imgNum].data();
+    float * const binImImage=binImImageVec_[imgNum].data();
+    
+    std::fill(dataWrite, dataWrite + componentsPerImage, 0.0f);
+    
+    for (size_t b=0; b<beatBins_.size(); ++b)
+    {
+        const float twiddleRe=twiddleReVec_[b*windowLength_ + oldestHistorySlot_];
+        const float twiddleIm=twiddleImVec_[b*windowLength_ + oldestHistorySlot_];
+        float * const binRe=binReImage + b*componentsPerImage;
+        float * const binIm=binImImage + b*componentsPerImage;
+        
+        int64_t i=0;
+#pragma omp parallel for
+        for (i=0; i<int64_t(componentsPerImage); ++i)
+        {
+            const float delta=(deltaImage!=nullptr) ? deltaImage[i] : 0.0f;
+            const float re=binRe[i] + delta * twiddleRe;
+            const float im=binIm[i] + delta * twiddleIm;
+            
+            binRe[i]=re;
+            binIm[i]=im;
+            dataWrite[i]+=re*re + im*im;
+        }
+    }
+}
 
+void FIPBeatImage::fftBeat(float * const dataWrite, const size_t imgNum, const size_t componentsPerImage)
+{
+    float const * const historyImage=historyImageVec_[imgNum].data();
+    const size_t windowLength_Minus1=windowLength_-1;
+    
+    //Components are transformed in blocks so that each thread reuses its FFT buffer.
+    const int64_t blockSize=256;
+    const int64_t numBlocks=(int64_t(componentsPerImage) + blockSize - 1) / blockSize;
+    
+    int64_t block=0;
+#pragma omp parallel for
+    for (block=0; block<numBlocks; ++block)
+    {
+        std::vector<float> beat(windowLength_*2);
+        
+        const size_t iEnd=std::min<size_t>((block+1)*blockSize, componentsPerImage);
+        
+        for (size_t i=block*blockSize; i<iEnd; ++i)
+        {
+            //Setup beat input...
+            //* Unring the history ring buffer.
+            //* beat will then be modified in place.
+            for (size_t n=0; n<windowLength_; ++n)
+            {
+                beat[(n << 1)]     = historyImage[((n+oldestHistorySlot_) & windowLength_Minus1)*componentsPerImage + i];
+                beat[(n << 1) + 1] = 0.0f;
+            }
+            
+            //Calculculate the beat...
+            four1(beat.data()-1, windowLength_, +1);
+            
+            float power=0.0f;
+            for (const size_t bin : beatBins_)
+            {
+                const float vx=beat[(bin << 1)];
+                const float vi=beat[(bin << 1) + 1];
+                
+                power+=vx*vx+vi*vi;
+            }
+            
+            dataWrite[i]=power;
+        }
+    }
+}
 
 bool FIPBeatImage::trigger()
 {
@@ -82,6 +275,8 @@ bool FIPBeatImage::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
+        const bool resync=(beatMethod_==BeatMethod::SLIDING_DFT) && (framesSinceResync_>=slidingDFTResyncInterval);
+        
         for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
         {
             Image const * const imRead = *(imvRead[imgNum]);
@@ -89,66 +284,60 @@ bool FIPBeatImage::trigger()
             
             const ImageFormat imFormat=getUpstreamFormat(imgNum);//Downstream format is same as upstream format.
             
-            const size_t width=imFormat.getWidth();
-            const size_t height=imFormat.getHeight();
-            const size_t windowLength_Minus1=windowLength_-1;
+            const size_t componentsPerImage=imFormat.getWidth() * imFormat.getHeight() * imFormat.getComponentsPerPixel();
             
+            float const * const dataRead = (float const * const)imRead->data();
+            float * const dataWrite = (float * const)imWrite->data();
+            float * const oldestHistoryImage = historyImageVec_[imgNum].data() + oldestHistorySlot_*componentsPerImage;
             
-            if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
+            if (beatMethod_==BeatMethod::SLIDING_DFT)
             {
-                float const * const dataRead = (float const * const)imRead->data();
-                float * const dataWrite = (float * const)imWrite->data();
-                
-                float * const historyImage = historyImageVec_[imgNum];
-                float * const beatImage = beatImageVec_[imgNum];
-                
-                for (size_t y=0; y<height; ++y)
+                if (resync)
                 {
-                    const size_t imgOffset=y * width;
-                    size_t histOffset=y * width * windowLength_;
-                    size_t beatOffset=y * width * (windowLength_<<1);
+                    memcpy(oldestHistoryImage, dataRead, componentsPerImage*sizeof(float));
+                    resyncSlidingDFT(imgNum);
                     
-                    for (size_t x=0; x<width; ++x)
+                    slidingDFTBeat(dataWrite, imgNum, componentsPerImage, nullptr);
+                } else
+                {
+                    //Store the new-old sample difference in the history slot, update the bins with it and then replace it with the new sample.
+                    int64_t i=0;
+#pragma omp parallel for
+                    for (i=0; i<int64_t(componentsPerImage); ++i)
                     {
-                        //Update history ring buffer.
-                        historyImage[histOffset + oldestHistorySlot_]=dataRead[imgOffset + x];
-                        
-                        
-                        //Setup beat input...
-                        //* Unring the history ring buffer.
-                        //* beatImage will then be modified in place.
-                        for (size_t n=0; n<windowLength_; ++n)
-                        {
-                            beatImage[beatOffset + (n << 1)]     = historyImage[histOffset + ((n+oldestHistorySlot_) & windowLength_Minus1)];
-                            beatImage[beatOffset + (n << 1) + 1] = 0.0f;
-                        }
-                        
-                        
-                        //Calculculate the beat...
-                        four1(beatImage+beatOffset-1, windowLength_, +1);
-                        
-                        
-                        //Update the output image.
-                        const size_t beatNum=4;//0,2,4,...
-                        const float vx=beatImage[beatOffset+beatNum];
-                        const float vi=beatImage[beatOffset+beatNum+1];
-                        
-                        dataWrite[imgOffset + x]=(vx*vx+vi*vi)*2.625f+0.5f;
-                        
-                        histOffset+=windowLength_;
-                        beatOffset+=windowLength_<<1;
+                        oldestHistoryImage[i]=dataRead[i] - oldestHistoryImage[i];
                     }
-                }
-            } else
-                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
-                {
-                    //float const * const dataRead = (float const * const)imRead->data();
-                    //float * const dataWrite = (float * const)imWrite->data();
                     
+                    slidingDFTBeat(dataWrite, imgNum, componentsPerImage, oldestHistoryImage);
+                    
+                    memcpy(oldestHistoryImage, dataRead, componentsPerImage*sizeof(float));
                 }
+            } else
+            {
+                //Update history ring buffer.
+                memcpy(oldestHistoryImage, dataRead, componentsPerImage*sizeof(float));
+                
+                fftBeat(dataWrite, imgNum, componentsPerImage);
+            }
+            
+            //Update the output image.
+            int64_t i=0;
+#pragma omp parallel for
+            for (i=0; i<int64_t(componentsPerImage); ++i)
+            {
+                dataWrite[i]=dataWrite[i]*beatPowerScale + beatPowerOffset;
+            }
             
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
         }
         
+        framesSinceResync_=resync ? 0 : (framesSinceResync_+1);
         oldestHistorySlot_=(oldestHistorySlot_+1) % windowLength_;
         
         //Stop stats measurement event.
@@ -162,4 +351,3 @@ bool FIPBeatImage::trigger()
     
     return false;
 }
-
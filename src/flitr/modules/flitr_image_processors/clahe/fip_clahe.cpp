@@ -0,0 +1,303 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/clahe/fip_clahe.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+namespace
+{
+    const size_t NumBins=256;
+    
+    //!Start of tile tileNum when length pixels are divided into numTiles tiles.
+    inline size_t tileStart(const size_t tileNum, const size_t length, const size_t numTiles)
+    {
+        return (tileNum * length) / numTiles;
+    }
+}
+
+FIPCLAHE::FIPCLAHE(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                   const uint32_t numTilesX, const uint32_t numTilesY,
+                   const float clipLimit,
+                   uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("CLAHE"),
+clipLimit_(std::max<float>(clipLimit, 1.0f)),
+numTilesX_(std::max<uint32_t>(numTilesX, 1)),
+numTilesY_(std::max<uint32_t>(numTilesY, 1))
+{
+    ProcessorStats_->setID("ImageProcessor::FIPCLAHE");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
+    }
+}
+
+FIPCLAHE::~FIPCLAHE()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPCLAHE::init()
+{
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_8) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_8))
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPCLAHE only supports Y_8 and RGB_8 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+void FIPCLAHE::calcInterpolation(std::vector<int32_t> &pixelTile, std::vector<uint16_t> &pixelWeight,
+                                 const size_t length, const size_t numTiles)
+{
+    pixelTile.resize(length);
+    pixelWeight.resize(length);
+    
+    //Twice the tile centres so that they stay integer.
+    size_t tileNum=0;
+    size_t centre2=tileStart(0, length, numTiles) + tileStart(1, length, numTiles) - 1;
+    size_t nextCentre2=(numTiles>1) ? (tileStart(1, length, numTiles) + tileStart(2, length, numTiles) - 1) : centre2;
+    
+    for (size_t p=0; p<length; ++p)
+    {
+        const size_t p2=p*2;
+        
+        while ((tileNum+1<numTiles) && (p2>=nextCentre2))
+        {
+            ++tileNum;
+            centre2=nextCentre2;
+            nextCentre2=(tileNum+1<numTiles) ?
+            (tileStart(tileNum+1, length, numTiles) + tileStart(tileNum+2, length, numTiles) - 1) : centre2;
+        }
+        
+        pixelTile[p]=int32_t(tileNum);
+        
+        if ((p2<=centre2) || (nextCentre2<=centre2))
+        {//Before the first centre or after the last centre.
+            pixelWeight[p]=0;
+        } else
+        {
+            pixelWeight[p]=uint16_t(((p2 - centre2) * 256 + (nextCentre2 - centre2) / 2) / (nextCentre2 - centre2));
+        }
+    }
+}
+
+bool FIPCLAHE::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        const float clipLimit=clipLimit_;
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const size_t width=imFormat.getWidth();
+            const size_t height=imFormat.getHeight();
+            const size_t componentsPerPixel=(imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_8) ? 3 : 1;
+            const size_t bytesPerLine=width*componentsPerPixel;
+            
+            uint8_t const * const dataRead=imRead->data();
+            uint8_t * const dataWrite=imWrite->data();
+            
+            const size_t tilesX=std::min<size_t>(numTilesX_, width);
+            const size_t tilesY=std::min<size_t>(numTilesY_, height);
+            const size_t numTiles=tilesX*tilesY;
+            
+            tileHistograms_.resize(numTiles*NumBins);
+            tileMaps_.resize(numTiles*NumBins);
+            if (tileRowScratch_.size()<tilesY) tileRowScratch_.resize(tilesY);
+            if (tileRowLuminance_.size()<tilesY) tileRowLuminance_.resize(tilesY);
+            
+            calcInterpolation(columnTile_, columnWeight_, width, tilesX);
+            calcInterpolation(rowTile_, rowWeight_, height, tilesY);
+            
+            //=== Tile histograms and maps: one row of tiles per task. ===
+            int32_t tileRow=0;
+#pragma omp parallel for schedule(dynamic)
+            for (tileRow=0; tileRow<int32_t(tilesY); ++tileRow)
+            {
+                const size_t y0=tileStart(size_t(tileRow), height, tilesY);
+                const size_t y1=tileStart(size_t(tileRow)+1, height, tilesY);
+                
+                //Four interleaved sub-histograms per tile so that runs of equal pixels do not stall on one counter.
+                std::vector<uint32_t> &scratch=tileRowScratch_[size_t(tileRow)];
+                scratch.assign(tilesX*4*NumBins, 0);
+                
+                std::vector<uint8_t> &luminance=tileRowLuminance_[size_t(tileRow)];
+                if ((componentsPerPixel==3) && (luminance.size()<width)) luminance.resize(width);
+                
+                for (size_t y=y0; y<y1; ++y)
+                {
+                    uint8_t const * line=dataRead + y*bytesPerLine;
+                    
+                    if (componentsPerPixel==3)
+                    {
+                        uint8_t * const lum=luminance.data();
+                        for (size_t x=0; x<width; ++x)
+                        {
+                            lum[x]=uint8_t((uint32_t(line[x*3]) + 2*uint32_t(line[x*3+1]) + uint32_t(line[x*3+2]) + 2) >> 2);
+                        }
+                        line=lum;
+                    }
+                    
+                    for (size_t tx=0; tx<tilesX; ++tx)
+                    {
+                        uint32_t * const h=scratch.data() + tx*4*NumBins;
+                        const size_t x0=tileStart(tx, width, tilesX);
+                        const size_t x1=tileStart(tx+1, width, tilesX);
+                        
+                        size_t x=x0;
+                        for (; x+4<=x1; x+=4)
+                        {
+                            ++h[line[x]];
+                            ++h[NumBins + line[x+1]];
+                            ++h[2*NumBins + line[x+2]];
+                            ++h[3*NumBins + line[x+3]];
+                        }
+                        for (; x<x1; ++x)
+                        {
+                            ++h[line[x]];
+                        }
+                    }
+                }
+                
+                for (size_t tx=0; tx<tilesX; ++tx)
+                {
+                    uint32_t const * const h=scratch.data() + tx*4*NumBins;
+                    const size_t tileNum=size_t(tileRow)*tilesX + tx;
+                    uint32_t * const histogram=tileHistograms_.data() + tileNum*NumBins;
+                    
+                    for (size_t b=0; b<NumBins; ++b)
+                    {
+                        histogram[b]=h[b] + h[NumBins + b] + h[2*NumBins + b] + h[3*NumBins + b];
+                    }
+                    
+                    const size_t tilePixels=(tileStart(tx+1, width, tilesX) - tileStart(tx, width, tilesX)) * (y1 - y0);
+                    const uint32_t clip=std::max<uint32_t>(uint32_t((clipLimit * tilePixels) / NumBins), 1);
+                    
+                    ImageHistogram::calcClipLimitedEqualisationMap(tileMaps_.data() + tileNum*NumBins, histogram, NumBins, clip);
+                }
+            }
+            
+            //=== Apply: blend the maps vertically per row, then interpolate horizontally per pixel. ===
+            const size_t numBands=getNumRowBands(height);
+            if (bandRowMaps_.size()<numBands) bandRowMaps_.resize(numBands);
+            for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+            {
+                if (bandRowMaps_[bandNum].size()<tilesX*NumBins) bandRowMaps_[bandNum].resize(tilesX*NumBins);
+            }
+            
+            const size_t bandHeight=(height + numBands - 1) / numBands;
+            
+            int32_t bandNum=0;
+#pragma omp parallel for
+            for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+            {
+                const size_t yStart=size_t(bandNum) * bandHeight;
+                const size_t yEnd=std::min<size_t>(yStart + bandHeight, height);
+                uint16_t * const rowMaps=bandRowMaps_[size_t(bandNum)].data();
+                
+                for (size_t y=yStart; y<yEnd; ++y)
+                {
+                    const size_t ty=size_t(rowTile_[y]);
+                    const size_t tyNext=std::min<size_t>(ty+1, tilesY-1);
+                    const uint16_t wy=rowWeight_[y];
+                    const uint16_t wyComplement=uint16_t(256 - wy);
+                    
+                    for (size_t tx=0; tx<tilesX; ++tx)
+                    {
+                        uint8_t const * const mapTop=tileMaps_.data() + (ty*tilesX + tx)*NumBins;
+                        uint8_t const * const mapBottom=tileMaps_.data() + (tyNext*tilesX + tx)*NumBins;
+                        uint16_t * const rowMap=rowMaps + tx*NumBins;
+                        
+                        for (size_t v=0; v<NumBins; ++v)
+                        {
+                            rowMap[v]=uint16_t(mapTop[v]*wyComplement + mapBottom[v]*wy);
+                        }
+                    }
+                    
+                    uint8_t const * const lineRead=dataRead + y*bytesPerLine;
+                    uint8_t * const lineWrite=dataWrite + y*bytesPerLine;
+                    
+                    for (size_t x=0; x<width; ++x)
+                    {
+                        const size_t tx=size_t(columnTile_[x]);
+                        uint16_t const * const mapLeft=rowMaps + tx*NumBins;
+                        uint16_t const * const mapRight=rowMaps + std::min<size_t>(tx+1, tilesX-1)*NumBins;
+                        const uint32_t wx=columnWeight_[x];
+                        const uint32_t wxComplement=256 - wx;
+                        
+                        for (size_t c=0; c<componentsPerPixel; ++c)
+                        {
+                            const uint8_t v=lineRead[x*componentsPerPixel + c];
+                            lineWrite[x*componentsPerPixel + c]=uint8_t((mapLeft[v]*wxComplement + mapRight[v]*wx + 32768) >> 16);
+                        }
+                    }
+                }
+            }
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
@@ -0,0 +1,146 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/connected_components/fip_connected_components.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+FIPConnectedComponents::FIPConnectedComponents(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                                               const ConnectedComponents::Connectivity connectivity,
+                                               uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("Connected Components"),
+minArea_(0),
+connectedComponentsVec_(images_per_slot, ConnectedComponents(connectivity)),
+filteredBlobsVec_(images_per_slot),
+latestBlobsVec_(images_per_slot),
+latestFrameNumber_(0)
+{
+    ProcessorStats_->setID("ImageProcessor::FIPConnectedComponents");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
+    }
+}
+
+FIPConnectedComponents::~FIPConnectedComponents()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPConnectedComponents::init()
+{
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        if (getUpstreamFormat(i).getPixelFormat()!=ImageFormat::FLITR_PIX_FMT_Y_8)
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPConnectedComponents only supports Y_8 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPConnectedComponents::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        const size_t minArea=size_t(int(minArea_));
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const size_t width=imFormat.getWidth();
+            const size_t height=imFormat.getHeight();
+            
+            uint8_t const * const dataRead=imRead->data();
+            uint8_t * const dataWrite=imWrite->data();
+            
+            //The upstream rows may be strided, e.g. a view from FIPCrop.
+            const size_t bytesPerLineRead=imRead->getBytesPerLine();
+            
+            //The image is passed downstream unchanged, with contiguous rows.
+            for (size_t y=0; y<height; ++y)
+            {
+                memcpy(dataWrite + y * width, dataRead + y * bytesPerLineRead, width);
+            }
+            
+            ConnectedComponents &connectedComponents=connectedComponentsVec_[imgNum];
+            connectedComponents.label(dataRead, width, height, bytesPerLineRead);
+            
+            std::vector<ConnectedComponents::Blob> &filteredBlobs=filteredBlobsVec_[imgNum];
+            filteredBlobs.clear();
+            
+            for (const ConnectedComponents::Blob &blob : connectedComponents.getBlobs())
+            {
+                if (blob.area>=minArea)
+                {
+                    filteredBlobs.push_back(blob);
+                }
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> scopedLock(latestBlobsMutex_);
+            latestBlobsVec_.swap(filteredBlobsVec_);
+            ++latestFrameNumber_;
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
@@ -28,9 +28,11 @@ FIPCrop::FIPCrop(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                  size_t startY,
                  size_t width,
                  size_t height,
-                 uint32_t buffer_size) :
+                 uint32_t buffer_size,
+                 const CropMode cropMode) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 Title_(std::string("Crop")),
+cropMode_(cropMode),
 startX_(startX),
 startY_(startY),
 width_(width),
@@ -41,6 +43,12 @@ height_(height)
     maxWidth_ = upStreamProducer.getFormat().getWidth();
     maxHeight_ = upStreamProducer.getFormat().getHeight();
 
+    //Keep the crop rectangle inside the upstream image, so that the downstream format is what is produced.
+    width_ = std::min<size_t>(std::max<size_t>(width_, 1), maxWidth_);
+    height_ = std::min<size_t>(std::max<size_t>(height_, 1), maxHeight_);
+    startX_ = std::min<size_t>(startX_, maxWidth_ - width_);
+    startY_ = std::min<size_t>(startY_, maxHeight_ - height_);
+
     //Setup image format being produced to downstream.
     for (uint32_t i=0; i<images_per_slot; i++)
     {
@@ -56,16 +64,69 @@ height_(height)
 
 FIPCrop::~FIPCrop()
 {
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
 }
 
 bool FIPCrop::init()
 {
+    if (cropMode_==CropMode::VIEW)
+    {
+        //The downstream slots only point at the view images or at the copies owned by the crop, so no storage is allocated.
+        SharedImageBuffer_ = shared_ptr<SharedImageBuffer>(new SharedImageBuffer(*this, buffer_size_, ImagesPerSlot_));
+        SharedImageBuffer_->initWithoutStorage();
+        
+        return true;
+    }
+    
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
     return rValue;
 }
 
+void FIPCrop::setWidth(const float f)
+{
+    if (SharedImageBuffer_)
+    {
+        logMessage(LOG_CRITICAL) << "FIPCrop::setWidth: The crop size cannot be changed after init() was called.\n";
+        logMessage(LOG_CRITICAL).flush();
+        return;
+    }
+    
+    width_ = size_t(std::min<float>(std::max<float>(f, 1.0f), maxWidth_));
+    startX_ = std::min<size_t>(startX_, maxWidth_ - width_);
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        ImageFormat_[i].setWidth(width_);
+    }
+}
+
+void FIPCrop::setHeight(const float f)
+{
+    if (SharedImageBuffer_)
+    {
+        logMessage(LOG_CRITICAL) << "FIPCrop::setHeight: The crop size cannot be changed after init() was called.\n";
+        logMessage(LOG_CRITICAL).flush();
+        return;
+    }
+    
+    height_ = size_t(std::min<float>(std::max<float>(f, 1.0f), maxHeight_));
+    startY_ = std::min<size_t>(startY_, maxHeight_ - height_);
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        ImageFormat_[i].setHeight(height_);
+    }
+}
+
 bool FIPCrop::trigger()
 {
     if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
@@ -76,40 +137,69 @@ bool FIPCrop::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
+        //Read the crop position once, because it may be changed from another thread.
+        const size_t startX=startX_;
+        const size_t startY=startY_;
+        
+        //Strided views are only produced if every downstream consumer can read them.
+        const bool stridedViewsAccepted=(cropMode_==CropMode::VIEW) && allConsumersAcceptStridedImages();
+        
         for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
         {
-            Image const * const imRead = *(imvRead[imgNum]);
-            Image * const imWrite = *(imvWrite[imgNum]);
-
-            // Pass the metadata from the read image to the write image.
-            // By Default the base implementation will copy the pointer if no custom
-            // pass function was set.
-            if(PassMetadataFunction_ != nullptr)
-            {
-                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
-            }
-            
-            uint8_t const * const dataRead=(uint8_t const * const)imRead->data();
-            uint8_t * const dataWrite=(uint8_t * const )imWrite->data();
+            Image * const imRead = *(imvRead[imgNum]);
+            Image ** const imWriteSlot = imvWrite[imgNum];
             
             //US and DS pixel formats are the same, but the image sizes are not.
-            const ImageFormat imFormatUS=getUpstreamFormat(imgNum);
             const ImageFormat imFormatDS=getDownstreamFormat(imgNum);
             
             const size_t bytesPerPixel=imFormatDS.getBytesPerPixel();
+            const size_t bytesPerLineUS=imRead->getBytesPerLine();
+            const size_t bytesPerLineDS=width_ * bytesPerPixel;
             
-            const size_t widthUS=imFormatUS.getWidth();
+            uint8_t * const dataRead=imRead->data() + startY * bytesPerLineUS + startX * bytesPerPixel;
             
-            const size_t widthDS=imFormatDS.getWidth();
-            const size_t heightDS=imFormatDS.getHeight();
-            
-            //Works for all pixel formats!
-            for (size_t yDS=0; yDS<heightDS; ++yDS)
+            if ((cropMode_==CropMode::VIEW) && (stridedViewsAccepted || (bytesPerLineUS==bytesPerLineDS)))
             {
-                const size_t lineOffsetUS=((yDS+startY_) * widthUS + startX_) * bytesPerPixel;
-                const size_t lineOffsetDS=(yDS * widthDS) * bytesPerPixel;
+                std::unique_ptr<Image> &viewImage=viewImages_[imWriteSlot];
+                
+                if (!viewImage)
+                {//First use of this slot.
+                    viewImage.reset(new Image(imFormatDS, dataRead, bytesPerLineUS));
+                } else
+                {
+                    viewImage->setView(imFormatDS, dataRead, bytesPerLineUS);
+                }
                 
-                memcpy(dataWrite+lineOffsetDS, dataRead+lineOffsetUS, widthDS * bytesPerPixel);
+                *imWriteSlot=viewImage.get();
+            } else
+            {
+                if (cropMode_==CropMode::VIEW)
+                {//A downstream consumer needs contiguous rows.
+                    std::unique_ptr<Image> &copyImage=copyImages_[imWriteSlot];
+                    
+                    if (!copyImage)
+                    {
+                        copyImage.reset(new Image(imFormatDS));
+                    }
+                    
+                    *imWriteSlot=copyImage.get();
+                }
+                
+                uint8_t * const dataWrite=(*imWriteSlot)->data();
+                
+                //Works for all pixel formats!
+                for (size_t yDS=0; yDS<height_; ++yDS)
+                {
+                    memcpy(dataWrite + yDS * bytesPerLineDS, dataRead + yDS * bytesPerLineUS, bytesPerLineDS);
+                }
+            }
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                (*imWriteSlot)->setMetadata(PassMetadataFunction_(imRead->metadata()));
             }
         }
         
@@ -118,7 +208,12 @@ bool FIPCrop::trigger()
         ProcessorStats_->tock();
         
         releaseWriteSlot();
-        releaseReadSlot();
+        
+        if (cropMode_==CropMode::COPY)
+        {
+            releaseReadSlot();
+        }
+        //In CropMode::VIEW the upstream slot is released in releaseReadSlotCallback once the downstream consumers are done with it.
         
         return true;
     }
@@ -126,5 +221,10 @@ bool FIPCrop::trigger()
     return false;
 }
 
-
-
+void FIPCrop::releaseReadSlotCallback()
+{
+    if (cropMode_==CropMode::VIEW)
+    {
+        releaseReadSlot();
+    }
+}
@@ -24,6 +24,8 @@
 #include <fstream>
 
 #include <math.h>
+#include <limits>
+#include <algorithm>
 
 
 using namespace flitr;
@@ -39,6 +41,8 @@ _enabled(true),
 _title(std::string("LK Dewarp")),
 avrgImageLongevity_(avrgImageLongevity),
 recipGradientThreshold_(1.0f / 0.00025f),
+gradientUpdateThreshold_(0.01f),
+gradientTileSize_(32),
 numLevels_(5),//Num levels searched for scint motion.
 gaussianFilter_(0.5f, 3),
 gaussianDownsample_(0.5f, 2),
@@ -97,9 +101,6 @@ FIPLKDewarp::~FIPLKDewarp()
         delete [] dyVec_.back();
         dyVec_.pop_back();
         
-        delete [] dSqRecipVec_.back();
-        dSqRecipVec_.pop_back();
-        
         delete [] hxVec_.back();
         hxVec_.pop_back();
         
@@ -161,8 +162,10 @@ bool FIPLKDewarp::init()
             dyVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
             memset(dyVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
             
-            dSqRecipVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
-            memset(dSqRecipVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
+            //Force the gradients of all tiles to be calculated on the first frame.
+            const size_t numTiles=((((croppedWidth>>levelNum) + gradientTileSize_ - 1) / gradientTileSize_) *
+                                   (((croppedHeight>>levelNum) + gradientTileSize_ - 1) / gradientTileSize_));
+            refChangeVec_.push_back(std::vector<float>(numTiles, std::numeric_limits<float>::max()));
             
             hxVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
             memset(hxVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
@@ -171,6 +174,8 @@ bool FIPLKDewarp::init()
             memset(hyVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
         }
         
+        tileUpdateScratch_.resize(refChangeVec_[0].size());
+        
         //avrgHxData_=new float[croppedWidth * croppedHeight];
         //memset(avrgHxData_, 0, croppedWidth * croppedHeight * sizeof(float));
         
@@ -187,6 +192,131 @@ bool FIPLKDewarp::init()
     return rValue;
 }
 
+void FIPLKDewarp::updateReferenceLevel(const size_t levelNum, const ptrdiff_t levelWidth, const ptrdiff_t levelHeight,
+                                       const float avrgImageLongevity)
+{
+    float const * const imgData=imgVec_[levelNum];
+    float * const refImgData=refImgVec_[levelNum];
+    float * const dxData=dxVec_[levelNum];
+    float * const dyData=dyVec_[levelNum];
+    
+    std::vector<float> &refChange=refChangeVec_[levelNum];
+    
+    const ptrdiff_t tileSize=gradientTileSize_;
+    const ptrdiff_t numTilesX=(levelWidth + tileSize - 1) / tileSize;
+    const ptrdiff_t numTilesY=(levelHeight + tileSize - 1) / tileSize;
+    
+    //=== Update ref/avrg img and track the largest change per tile ===//
+    int64_t tileY=0;
+#pragma omp parallel for
+    for (tileY=0; tileY<int64_t(numTilesY); ++tileY)
+    {
+        const ptrdiff_t endY=std::min<ptrdiff_t>((tileY+1)*tileSize, levelHeight);
+        
+        for (ptrdiff_t tileX=0; tileX<numTilesX; ++tileX)
+        {
+            const ptrdiff_t startX=tileX*tileSize;
+            const ptrdiff_t endX=std::min<ptrdiff_t>(startX+tileSize, levelWidth);
+            
+            float maxChange=0.0f;
+            
+            for (ptrdiff_t y=tileY*tileSize; y<endY; ++y)
+            {
+                const ptrdiff_t lineOffset=y*levelWidth;
+                
+                for (ptrdiff_t x=startX; x<endX; ++x)
+                {
+                    const ptrdiff_t offset=lineOffset + x;
+                    
+                    const float change=(imgData[offset] - refImgData[offset]) * (1.0f - avrgImageLongevity);
+                    
+                    refImgData[offset]+=change;
+                    maxChange=std::max(maxChange, fabsf(change));
+                }
+            }
+            
+            float &tileChange=refChange[tileY*numTilesX + tileX];
+            tileChange=std::min(tileChange + maxChange, std::numeric_limits<float>::max());
+        }
+    }
+    //=== ===//
+    
+    
+    //=== A tile's gradients also depend on the border pixels of its neighbours ===//
+    for (ptrdiff_t tileY=0; tileY<numTilesY; ++tileY)
+    {
+        for (ptrdiff_t tileX=0; tileX<numTilesX; ++tileX)
+        {
+            bool update=false;
+            
+            for (ptrdiff_t nY=std::max<ptrdiff_t>(tileY-1, 0); nY<=std::min<ptrdiff_t>(tileY+1, numTilesY-1); ++nY)
+            {
+                for (ptrdiff_t nX=std::max<ptrdiff_t>(tileX-1, 0); nX<=std::min<ptrdiff_t>(tileX+1, numTilesX-1); ++nX)
+                {
+                    update=update || (refChange[nY*numTilesX + nX]>gradientUpdateThreshold_);
+                }
+            }
+            
+            tileUpdateScratch_[tileY*numTilesX + tileX]=update;
+        }
+    }
+    //=== ===//
+    
+    
+    //=== Calculate the reference gradients of the tiles that changed ===//
+#pragma omp parallel for
+    for (tileY=0; tileY<int64_t(numTilesY); ++tileY)
+    {
+        const ptrdiff_t startY=std::max<ptrdiff_t>(tileY*tileSize, 1);
+        const ptrdiff_t endY=std::min<ptrdiff_t>((tileY+1)*tileSize, levelHeight-1);
+        
+        for (ptrdiff_t tileX=0; tileX<numTilesX; ++tileX)
+        {
+            if (!tileUpdateScratch_[tileY*numTilesX + tileX])
+            {
+                continue;
+            }
+            
+            const ptrdiff_t startX=std::max<ptrdiff_t>(tileX*tileSize, 1);
+            const ptrdiff_t endX=std::min<ptrdiff_t>((tileX+1)*tileSize, levelWidth-1);
+            
+            for (ptrdiff_t y=startY; y<endY; ++y)
+            {
+                const ptrdiff_t lineOffset=y*levelWidth;
+                
+                for (ptrdiff_t x=startX; x<endX; ++x)
+                {
+                    const ptrdiff_t offset=lineOffset + x;
+                    
+                    const float v1=refImgData[offset-levelWidth-1];
+                    const float v2=refImgData[offset-levelWidth];
+                    const float v3=refImgData[offset-levelWidth+1];
+                    const float v4=refImgData[offset-1];
+                    //const float v5=refImgData[offset];
+                    const float v6=refImgData[offset+1];
+                    const float v7=refImgData[offset+levelWidth-1];
+                    const float v8=refImgData[offset+levelWidth];
+                    const float v9=refImgData[offset+levelWidth+1];
+                    
+                    //Use Scharr operator for image gradient. It has good rotation independence!
+                    const float dx=(v3-v1)*(3.0f/32.0f) + (v6-v4)*(10.0f/32.0f) + (v9-v7)*(3.0f/32.0f); //32 = (3+10+3)*2
+                    const float dy=(v7-v1)*(3.0f/32.0f) + (v8-v2)*(10.0f/32.0f) + (v9-v3)*(3.0f/32.0f); //32 = (3+10+3)*2
+                    
+                    const float dSqRecip=1.0f/(dx*dx+dy*dy+0.000000001f);
+                    
+                    //Pixels with too small a gradient get zero weight, so the h-vector loop needs no branch.
+                    const float gradientMask=(dSqRecip<recipGradientThreshold_) ? 1.0f : 0.0f;
+                    
+                    dxData[offset]=dx*dSqRecip*gradientMask;
+                    dyData[offset]=dy*dSqRecip*gradientMask;
+                }
+            }
+            
+            refChange[tileY*numTilesX + tileX]=0.0f;
+        }
+    }
+    //=== ===//
+}
 
 bool FIPLKDewarp::trigger()
 {
@@ -249,21 +379,7 @@ bool FIPLKDewarp::trigger()
                     {//=== ===
                         
                         {//=== Update ref/avrg img before new data arrives. ===//
-                            float * const imgData=imgVec_[0];
-                            float * const refImgData=refImgVec_[0];
-                            
-                            for (ptrdiff_t y=0; y<croppedHeight; ++y)
-                            {
-                                const ptrdiff_t lineOffset=y*croppedWidth;
-                                
-                                for (ptrdiff_t x=0; x<croppedWidth; ++x)
-                                {
-                                    const ptrdiff_t offset=lineOffset + x;
-                                    
-                                    refImgData[offset]*=avrgImageLongevityConst;
-                                    refImgData[offset]+=imgData[offset] * (1.0f - avrgImageLongevityConst);
-                                }
-                            }
+                            updateReferenceLevel(0, croppedWidth, croppedHeight, avrgImageLongevityConst);
                         }
                         
                         //=== Crop input data ===//
@@ -280,7 +396,9 @@ bool FIPLKDewarp::trigger()
                         } else
                             if (imFormat.getPixelFormat()==flitr::ImageFormat::FLITR_PIX_FMT_RGB_F32)
                             {
-                                for (size_t y=startCroppedY; y<=endCroppedY; ++y)
+                                int64_t y=0;
+#pragma omp parallel for
+                                for (y=startCroppedY; y<=int64_t(endCroppedY); ++y)
                                 {
                                     const ptrdiff_t uncroppedLineOffset=(y*uncroppedWidth + startCroppedX)*3; //x*3 is optimised by compiler to (x<<1)+x.
                                     const ptrdiff_t croppedLineOffset=(y-startCroppedY)*croppedWidth;
@@ -301,95 +419,22 @@ bool FIPLKDewarp::trigger()
                     }//=== ===
                     
                     {//=== Calculate scale space pyramid. ===
-                        for (size_t levelNum=0; levelNum<numLevels_; ++levelNum)
+                        for (size_t levelNum=1; levelNum<numLevels_; ++levelNum)//First level (incoming data) is not a downsampled image.
                         {
-                            float * const imgData=imgVec_[levelNum];
-                            //float * const refImgData=refImgVec_[levelNum];
-                            
                             const ptrdiff_t levelHeight=croppedHeight >> levelNum;
                             const ptrdiff_t levelWidth=croppedWidth >> levelNum;
-                            const ptrdiff_t levelWidthMinus1 = levelWidth - ((ptrdiff_t)1);
-                            
-                            //=== Calculate the scale space images ===
-                            if (levelNum>0)//First level (incoming data) is not a downsampled image.
-                            {
-                                {//Update ref/avrg img before new data arrives.
-                                    float * const refImgData=refImgVec_[levelNum];
-                                    
-                                    for (ptrdiff_t y=0; y<levelHeight; ++y)
-                                    {
-                                        const ptrdiff_t lineOffset=y*levelWidth;
-                                        
-                                        for (ptrdiff_t x=0; x<levelWidth; ++x)
-                                        {
-                                            const ptrdiff_t offset=lineOffset + x;
-                                            
-                                            refImgData[offset]*=avrgImageLongevityConst;
-                                            refImgData[offset]+=imgData[offset] * (1.0f - avrgImageLongevityConst);
-                                        }
-                                    }
-                                }
-                                
-                                {//Downsample higher resolution level.
-                                    const ptrdiff_t heightUS=croppedHeight >> (levelNum-1);
-                                    const ptrdiff_t widthUS=croppedWidth >> (levelNum-1);
-                                    
-                                    gaussianDownsample_.downsample(imgData, imgVec_[levelNum-1],
-                                                                   widthUS, heightUS,
-                                                                   scratchData_);
-                                }//=== ===
-                                
-                            }//=== ===
                             
+                            {//Update ref/avrg img and its gradients before new data arrives.
+                                updateReferenceLevel(levelNum, levelWidth, levelHeight, avrgImageLongevityConst);
+                            }
                             
-                            {//=== Calculate scale space gradient images ===
-                                float * const dxData=dxVec_[levelNum];
-                                float * const dyData=dyVec_[levelNum];
-                                float * const dSqRecipData=dSqRecipVec_[levelNum];
+                            {//Downsample higher resolution level.
+                                const ptrdiff_t heightUS=croppedHeight >> (levelNum-1);
+                                const ptrdiff_t widthUS=croppedWidth >> (levelNum-1);
                                 
-                                for (ptrdiff_t y=1; y<(levelHeight - ((ptrdiff_t)1)); ++y)
-                                {
-                                    const ptrdiff_t lineOffset=y*levelWidth;
-                                    
-                                    for (ptrdiff_t x=((ptrdiff_t)1); x<levelWidthMinus1; ++x)
-                                    {
-                                        const ptrdiff_t offset=lineOffset + x;
-                                        
-                                        //#define DESCINT_SCATTER
-                                        
-#ifdef DESCINT_SCATTER
-                                        DESCINT_SCATTER CODE NOT REALLY USED
-                                        
-                                        const float v1=refImgData[offset-levelWidth-1];
-                                        const float v2=refImgData[offset-levelWidth];
-                                        const float v3=refImgData[offset-levelWidth+1];
-                                        const float v4=refImgData[offset-1];
-                                        //const float v5=refImgData[offset];
-                                        const float v6=refImgData[offset+1];
-                                        const float v7=refImgData[offset+levelWidth-1];
-                                        const float v8=refImgData[offset+levelWidth];
-                                        const float v9=refImgData[offset+levelWidth+1];
-#else//DESCINT_GATHER
-                                        const float v1=imgData[offset-levelWidth-1];
-                                        const float v2=imgData[offset-levelWidth];
-                                        const float v3=imgData[offset-levelWidth+1];
-                                        const float v4=imgData[offset-1];
-                                        //const float v5=imgData[offset];
-                                        const float v6=imgData[offset+1];
-                                        const float v7=imgData[offset+levelWidth-1];
-                                        const float v8=imgData[offset+levelWidth];
-                                        const float v9=imgData[offset+levelWidth+1];
-#endif
-                                        
-                                        //Use Scharr operator for image gradient. It has good rotation independence!
-                                        const float dx=(v3-v1)*(3.0f/32.0f) + (v6-v4)*(10.0f/32.0f) + (v9-v7)*(3.0f/32.0f); //32 = (3+10+3)*2
-                                        const float dy=(v7-v1)*(3.0f/32.0f) + (v8-v2)*(10.0f/32.0f) + (v9-v3)*(3.0f/32.0f); //32 = (3+10+3)*2
-                                        
-                                        dxData[offset]=dx;
-                                        dyData[offset]=dy;
-                                        dSqRecipData[offset]=1.0f/(dx*dx+dy*dy);
-                                    }
-                                }
+                                gaussianDownsample_.downsample(imgVec_[levelNum], imgVec_[levelNum-1],
+                                                               widthUS, heightUS,
+                                                               scratchData_);
                             }//=== ===
                         }
                     }//=== ===
@@ -407,7 +452,6 @@ bool FIPLKDewarp::trigger()
                         
                         float const * const dxData=dxVec_[levelNum];
                         float const * const dyData=dyVec_[levelNum];
-                        float const * const dSqRecipData=dSqRecipVec_[levelNum];
                         
                         float * const hxData=hxVec_[levelNum];
                         float * const hyData=hyVec_[levelNum];
@@ -420,7 +464,9 @@ bool FIPLKDewarp::trigger()
                         const ptrdiff_t levelWidthMinus1=levelWidth - ((ptrdiff_t)1);
                         
                         //=== Start with h-vectors from lower resolution scale space ===//
-                        for (ptrdiff_t y=1; y<(levelHeight - ((ptrdiff_t)1)); ++y)
+                        int64_t y=0;
+#pragma omp parallel for
+                        for (y=1; y<int64_t(levelHeight - ((ptrdiff_t)1)); ++y)
                         {
                             const ptrdiff_t lineOffset=y*levelWidth;
                             const ptrdiff_t lineOffsetLR=(y>>1)*levelWidthLR;
@@ -444,7 +490,10 @@ bool FIPLKDewarp::trigger()
                             for (size_t newtonRaphsonI=0; newtonRaphsonI<7; ++newtonRaphsonI)
                                 //5 or more iterations seem to work well.
                             {
-                                for (ptrdiff_t y=((ptrdiff_t)1); y<(levelHeight - ((ptrdiff_t)1)); ++y)
+                                //Each pixel only reads and writes its own h vector and gathers from the image, so the rows are independent.
+                                //The bounds check and the update clamp are arithmetic rather than branches so that the inner loop vectorises.
+#pragma omp parallel for
+                                for (y=1; y<int64_t(levelHeight - ((ptrdiff_t)1)); ++y)
                                 {
                                     const ptrdiff_t lineOffset=y*levelWidth;
                                     
@@ -452,81 +501,47 @@ bool FIPLKDewarp::trigger()
                                     {
                                         const ptrdiff_t offset=lineOffset + x;
                                         
-                                        const float dSqRecip=dSqRecipData[offset];
+                                        const float hx=hxData[offset];
+                                        const float hy=hyData[offset];
                                         
-                                        if (dSqRecip<(recipGradientThreshold_))
-                                        {
-                                            float hx=hxData[offset];
-                                            float hy=hyData[offset];
-                                            
-                                            //=== calc bilinear filter fractions ===//
-                                            const float floor_hx=floorf(hx);
-                                            const float floor_hy=floorf(hy);
-                                            const ptrdiff_t int_hx=lroundf(floor_hx);
-                                            const ptrdiff_t int_hy=lroundf(floor_hy);
-                                            const float frac_hx=hx - floor_hx;
-                                            const float frac_hy=hy - floor_hy;
-                                            //=== ===//
-                                            
+                                        //=== calc bilinear filter fractions ===//
+                                        const float floor_hx=floorf(hx);
+                                        const float floor_hy=floorf(hy);
+                                        const ptrdiff_t int_hx=ptrdiff_t(floor_hx);
+                                        const ptrdiff_t int_hy=ptrdiff_t(floor_hy);
+                                        const float frac_hx=hx - floor_hx;
+                                        const float frac_hy=hy - floor_hy;
+                                        //=== ===//
+                                        
+                                        const ptrdiff_t xLT=x+int_hx;
+                                        const ptrdiff_t yLT=y+int_hy;
+                                        
+                                        const float inside=((xLT>((ptrdiff_t)1))&&
+                                                            (yLT>((ptrdiff_t)1))&&
+                                                            ((xLT+((ptrdiff_t)2))<levelWidth)&&
+                                                            ((yLT+((ptrdiff_t)2))<levelHeight)) ? 1.0f : 0.0f;
+                                        
+                                        //Clamped so that the read stays in the image when the h vector points outside. Its result is then discarded.
+                                        const ptrdiff_t offsetLT=std::min(std::max<ptrdiff_t>(xLT, 0), levelWidth-2) +
+                                                                 std::min(std::max<ptrdiff_t>(yLT, 0), levelHeight-2) * levelWidth;
+                                        
+                                        const float img=bilinearRead(imgData, offsetLT, levelWidth, frac_hx, frac_hy);
+                                        
+                                        const float imgDiff=(img-refImgData[offset]) * inside;
+                                        
+                                        {//Calc h vector update, but clamp to certain deltaMax length.
+                                            //The reference gradients are already divided by the squared gradient magnitude, and zero where the gradient is too small.
+                                            const float delta_hx = imgDiff*dxData[offset]; //Adapted h displacement using Scharr gradient.
+                                            const float delta_hy = imgDiff*dyData[offset]; //Adapted h displacement using Scharr gradient.
                                             
-#ifdef DESCINT_SCATTER
-                                            DESCINT_SCATTER CODE NOT REALLY USED
+                                            const float delta=sqrtf(delta_hx*delta_hx+delta_hy*delta_hy);
+                                            const float deltaMax=0.75f;
                                             
-                                            if (((x+int_hx)>((ptrdiff_t)1))&&
-                                                ((y+int_hy)>((ptrdiff_t)1))&&
-                                                ((x+int_hx+((ptrdiff_t)2))<levelWidth)&&
-                                                ((y+int_hy+((ptrdiff_t)2))<levelHeight))
-                                            {
-                                                const ptrdiff_t offsetLT=offset + int_hx + int_hy * levelWidth;
-                                                
-                                                const float refImg=bilinearRead(refImgData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                
-                                                const float dx=bilinearRead(dxData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                const float dy=bilinearRead(dyData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                
-                                                const float imgDiff=imgData[offset]-refImg;
-                                                hx+=(imgDiff*dx)*dSqRecip;
-                                                hy+=(imgDiff*dy)*dSqRecip;
-                                            }
-#else //DESCINT_GATHER
-                                            if (((x+int_hx)>((ptrdiff_t)1))&&
-                                                ((y+int_hy)>((ptrdiff_t)1))&&
-                                                ((x+int_hx+((ptrdiff_t)2))<levelWidth)&&
-                                                ((y+int_hy+((ptrdiff_t)2))<levelHeight))
-                                            {
-                                                const ptrdiff_t offsetLT=offset + int_hx + int_hy * levelWidth;
-                                                
-                                                const float img=bilinearRead(imgData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                
-                                                const float dx=bilinearRead(dxData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                const float dy=bilinearRead(dyData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                                
-                                                const float imgDiff=img-refImgData[offset];
-                                                
-                                                
-                                                {//Calc h vector update, but clamp to certain deltaMax length.
-                                                    float delta_hx = (imgDiff*dx)*dSqRecip; //Adapted h displacement using Scharr gradient.
-                                                    float delta_hy = (imgDiff*dy)*dSqRecip; //Adapted h displacement using Scharr gradient.
-                                                    
-                                                    const float delta=sqrtf(delta_hx*delta_hx+delta_hy*delta_hy);
-                                                    const float deltaMax=0.75f;
-                                                    
-                                                    if (delta>deltaMax)
-                                                    {//If an error occurs then clamp the resulting h vector.
-                                                        const float recipH=deltaMax/delta;
-                                                        
-                                                        delta_hx*=recipH;
-                                                        delta_hy*=recipH;
-                                                    }
-                                                    
-                                                    hx-=delta_hx;
-                                                    hy-=delta_hy;
-                                                }
-                                            }
-#endif
+                                            //If an error occurs then clamp the resulting h vector.
+                                            const float deltaScale=deltaMax/std::max(delta, deltaMax);
                                             
-                                            hxData[offset]=hx;
-                                            hyData[offset]=hy;
+                                            hxData[offset]=hx - delta_hx*deltaScale;
+                                            hyData[offset]=hy - delta_hy*deltaScale;
                                         }
                                     }
                                 }
@@ -553,7 +568,11 @@ bool FIPLKDewarp::trigger()
                         float * const hxDataGF=hxVec_[0];
                         float * const hyDataGF=hyVec_[0];
                         
-                        for (ptrdiff_t y=0; y<croppedHeight; ++y)
+                        const bool isRGB=(imFormat.getPixelFormat() == flitr::ImageFormat::FLITR_PIX_FMT_RGB_F32);
+                        
+                        int64_t y=0;
+#pragma omp parallel for
+                        for (y=0; y<int64_t(croppedHeight); ++y)
                         {
                             const ptrdiff_t lineOffset=y*croppedWidth;
                             
@@ -568,39 +587,6 @@ bool FIPLKDewarp::trigger()
                                         //Note: Use a local contrast measure to control blending...
                                         //      It is assumed the the best lucky frame/region has the best local contrast.
                                         //      Could look at RMS contrast (the standard deviation) over an image patch centred at the desired location!
-#ifdef DESCINT_SCATTER
-                                        DESCINT_SCATTER CODE NOT REALLY USED
-                                        
-                                        const float hx=-hxDataGF[offset];
-                                        const float hy=-hyDataGF[offset];
-                                        
-                                        //const float f=0.1;
-                                        //avrgHxData_[offset]=avrgHxData_[offset]*(1.0f-f) + hx*f;
-                                        //avrgHyData_[offset]=avrgHyData_[offset]*(1.0f-f) + hy*f;
-                                        //const float avrgHSq = avrgHxData_[offset]*avrgHxData_[offset] + avrgHyData_[offset]*avrgHyData_[offset];
-                                        
-                                        const float floor_hx=floorf(hx);
-                                        const float floor_hy=floorf(hy);
-                                        const ptrdiff_t int_hx=lroundf(floor_hx);
-                                        const ptrdiff_t int_hy=lroundf(floor_hy);
-                                        
-                                        if ( ((x+int_hx)>((ptrdiff_t)1)) && ((y+int_hy)>((ptrdiff_t)1)) && ((x+int_hx)<(croppedWidth-1)) && ((y+int_hy)<(croppedHeight-1)) )
-                                        {
-                                            const float frac_hx=hx - floor_hx;
-                                            const float frac_hy=hy - floor_hy;
-                                            const ptrdiff_t offsetLT=offset + int_hx + int_hy * croppedWidth;
-                                            
-                                            finalImgDataG_[offset]=bilinearRead(inputImgDataG_, offsetLT, croppedWidth, frac_hx, frac_hy);
-                                            
-                                            if (imFormat.getPixelFormat() == flitr::ImageFormat::FLITR_PIX_FMT_RGB_F32)
-                                            {
-                                                finalImgDataR_[offset]=bilinearRead(inputImgDataR_, offsetLT, croppedWidth, frac_hx, frac_hy);
-                                                finalImgDataB_[offset]=bilinearRead(inputImgDataB_, offsetLT, croppedWidth, frac_hx, frac_hy);
-                                            }
-                                            //bilinearAdd(imgDataGF[offset], finalImgData_, offsetLT, croppedWidth, frac_hx, frac_hy);
-                                            //finalImgData_[offsetLT]=imgDataGF[offset];
-                                        }
-#else//DESCINT_GATHER
                                         const float hx=hxDataGF[offset];
                                         const float hy=hyDataGF[offset];
                                         
@@ -620,13 +606,12 @@ bool FIPLKDewarp::trigger()
                                             
                                             finalImgDataG_[offset]=bilinearRead(inputImgDataG_, offsetLT, croppedWidth, frac_hx, frac_hy);
                                             
-                                            if (imFormat.getPixelFormat() == flitr::ImageFormat::FLITR_PIX_FMT_RGB_F32)
+                                            if (isRGB)
                                             {
                                                 finalImgDataR_[offset]=bilinearRead(inputImgDataR_, offsetLT, croppedWidth, frac_hx, frac_hy);
                                                 finalImgDataB_[offset]=bilinearRead(inputImgDataB_, offsetLT, croppedWidth, frac_hx, frac_hy);
                                             }
                                         }
-#endif
                                     }
                                     //=== ===
                                 }
@@ -29,7 +29,9 @@ FIPDPT::FIPDPT(ImageProducer& upStreamProducer, int32_t filterPulseSize,
                uint32_t images_per_slot,
                uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
-filterPulseSize_(filterPulseSize)
+filterPulseSize_(filterPulseSize),
+numArcs_(0),
+walkStamp_(0)
 {
     //Setup image format being produced to downstream.
     for (uint32_t i=0; i<images_per_slot; i++) {
@@ -39,16 +41,6 @@ filterPulseSize_(filterPulseSize)
         
         ImageFormat_.push_back(downStreamFormat);
     }
-    
-    nodeVect_.reserve(upStreamProducer.getFormat().getWidth() * upStreamProducer.getFormat().getHeight());
-    nodeVect_.resize(upStreamProducer.getFormat().getWidth() * upStreamProducer.getFormat().getHeight());
-    
-#ifdef RUN_ARCS
-    arcVect_.reserve(upStreamProducer.getFormat().getWidth() * upStreamProducer.getFormat().getHeight() * 4);
-    arcVect_.resize(upStreamProducer.getFormat().getWidth() * upStreamProducer.getFormat().getHeight() * 4);
-#endif
-    
-    potentiallyActiveNodeIndexVect_.reserve(upStreamProducer.getFormat().getWidth() * upStreamProducer.getFormat().getHeight());
 }
 
 FIPDPT::~FIPDPT()
@@ -59,237 +51,190 @@ bool FIPDPT::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
+    //All the graph storage is allocated once here and reused by every frame.
+    const ImageFormat imFormat=getDownstreamFormat(0);
+    const size_t width=imFormat.getWidth();
+    const size_t height=imFormat.getHeight();
+    const size_t numPixels=width * height;
+    const size_t numArcs=(width>0 && height>0) ? ((width-1)*height + width*(height-1)) : 0;
+    
+    parentVect_.resize(numPixels);
+    sizeVect_.resize(numPixels);
+    valueVect_.resize(numPixels);
+    nextPixelVect_.resize(numPixels);
+    lastPixelVect_.resize(numPixels);
+    firstArcEndVect_.resize(numPixels);
+    lastArcEndVect_.resize(numPixels);
+    walkStampVect_.resize(numPixels);
+    
+    arcEndVect_.resize(numArcs*2);
+    
+    potentiallyActivePulseIndexVect_.reserve(numPixels);
+    pulseIndicesToMerge_.reserve(numPixels);
+    pulsePairsToJoin_.reserve(numArcs*2);
+    
     return rValue;
 }
 
-#ifdef RUN_ARCS
-size_t FIPDPT::mergeArc(const int32_t arcIndex)
+void FIPDPT::setupGraph(uint8_t const * const data, const int32_t width, const int32_t height)
 {
-    size_t numPulsesMerged=0;
-    Arc &arc=arcVect_[arcIndex];
+    const int32_t numPixels=width * height;
+    
+    //=== Setup the initial pulses, one per pixel ===//
+    for (int32_t pixelIndex=0; pixelIndex<numPixels; ++pixelIndex)
+    {
+        parentVect_[pixelIndex]=pixelIndex;
+        sizeVect_[pixelIndex]=1;
+        valueVect_[pixelIndex]=data[pixelIndex];
+        nextPixelVect_[pixelIndex]=-1;
+        lastPixelVect_[pixelIndex]=pixelIndex;
+        firstArcEndVect_[pixelIndex]=-1;
+        lastArcEndVect_[pixelIndex]=-1;
+        walkStampVect_[pixelIndex]=0;
+    }
+    
+    walkStamp_=0;
+    //=== ===//
+    
     
-    if (arc.active_)
+    //=== Setup the initial arcs, in the same order as the old per node arc lists ===//
+    int32_t arcEnd=0;
+    
+    auto addArc=[&](const int32_t pixelIndex0, const int32_t pixelIndex1)
     {
-        const auto index0 = arc.nodeIndices_[0];
-        const auto index1 = arc.nodeIndices_[1];
-        Node &node0       = nodeVect_[index0];
-        Node &node1       = nodeVect_[index1];
+        arcEndVect_[arcEnd].pixelIndex_=pixelIndex0;
+        arcEndVect_[arcEnd+1].pixelIndex_=pixelIndex1;
         
-        if (node0.value_ == node1.value_)
+        for (int32_t end=arcEnd; end<arcEnd+2; ++end)
         {
-            node0.size_+=node1.size_;
-            node0.pixelIndices_.insert(node0.pixelIndices_.end(),
-                                       node1.pixelIndices_.begin(),
-                                       node1.pixelIndices_.end());
+            const int32_t pixelIndex=arcEndVect_[end].pixelIndex_;
             
-            arc.active_=false;//Deactivate the now null link!
+            arcEndVect_[end].nextArcEnd_=-1;
             
-            for (const auto arcFromNode1Index : node1.arcIndices_)
+            if (firstArcEndVect_[pixelIndex]==-1)
             {
-                Arc &arcFromNode1=arcVect_[arcFromNode1Index];
-                
-                if (arcFromNode1.active_)
-                {
-                    const size_t neighbourOfNode1Index=retrieveNeighbourNodeIndex(arcFromNode1, index1);
-                    
-                    if (neighbourOfNode1Index!=index0)
-                    {
-                        bool neighbourOfNode1AlreadyNeighbourOfNode0=false;
-                        
-                        for (const auto arcFromNode0Index : node0.arcIndices_)
-                        {
-                            Arc &arcFromNode0=arcVect_[arcFromNode0Index];
-                            
-                            const size_t neighbourOfNode0Index=retrieveNeighbourNodeIndex(arcFromNode0, index0);
-                            
-                            if (neighbourOfNode0Index==neighbourOfNode1Index)
-                            {//Node0 and node1 already neighbours.
-                                neighbourOfNode1AlreadyNeighbourOfNode0=true;
-                                break;
-                            }
-                        }
-                        
-                        if (!neighbourOfNode1AlreadyNeighbourOfNode0)
-                        {
-                            node0.arcIndices_.push_back(arcFromNode1Index);
-                            
-                            if (arcFromNode1.nodeIndices_[0]==index1)
-                            {
-                                arcFromNode1.nodeIndices_[0]=index0;
-                            } else
-                                if (arcFromNode1.nodeIndices_[1]==index1)
-                                {
-                                    arcFromNode1.nodeIndices_[1]=index0;
-                                }
-                        } else
-                        {//De-activate redundent arcs.
-                            arcFromNode1.active_=false;
-                        }
-                    } else
-                    {//De-activate redundent arcs.
-                        arcFromNode1.active_=false;
-                    }
-                }
+                firstArcEndVect_[pixelIndex]=end;
+            } else
+            {
+                arcEndVect_[lastArcEndVect_[pixelIndex]].nextArcEnd_=end;
             }
             
-            node1.size_=0;
-            ++numPulsesMerged;
+            lastArcEndVect_[pixelIndex]=end;
         }
-    }
-    
-    return numPulsesMerged;
-}
-#else
-size_t FIPDPT::mergeNode(const int32_t index0)
-{
-    size_t numPulsesMerged=0;
-    Node &node0 = nodeVect_[index0];
-    
-    neighbourIndicesToAdd_.clear();
+        
+        arcEnd+=2;
+    };
     
-    for (int32_t &index1 : node0.neighbourIndices_)
+    for (int32_t y=0; y<height; ++y)
     {
-        Node &node1 = nodeVect_[index1];
+        const int32_t lineOffset=y * width;
         
-        if (node1.size_>0)
+        for (int32_t x=1; x<width; ++x)
         {
-            if (node0.value_ == node1.value_)
-            {//Merge node0 and node1.
-                node0.size_+=node1.size_;
-                node0.pixelIndices_.insert(node0.pixelIndices_.end(),
-                                           node1.pixelIndices_.begin(),
-                                           node1.pixelIndices_.end());
-                
-                
-                for (const int32_t neighbourOfNode1Index : node1.neighbourIndices_)
-                {
-                    Node &neighbourOfNode1 = nodeVect_[neighbourOfNode1Index];
-                    
-                    if (neighbourOfNode1.size_>0)
-                    {
-                        if (neighbourOfNode1Index!=index0)
-                        {
-                            bool neighbourOfNode1AlreadyNeighbourOfNode0=false;
-                            
-                            for (const int32_t neighbourOfNode0Index : node0.neighbourIndices_)
-                            {
-                                if (nodeVect_[neighbourOfNode0Index].size_>0)
-                                {
-                                    if (neighbourOfNode0Index==neighbourOfNode1Index)
-                                    {//Node0 and node1 already neighbours.
-                                        neighbourOfNode1AlreadyNeighbourOfNode0=true;
-                                        break;
-                                    }
-                                }
-                            }
-                            
-                            if (!neighbourOfNode1AlreadyNeighbourOfNode0)
-                            {
-                                //node0.neighbourIndices_.push_back(neighbourOfNode1Index);
-                                neighbourIndicesToAdd_.push_back(neighbourOfNode1Index);
-                            }
-                            
-                            std::vector<int32_t>::iterator it=neighbourOfNode1.neighbourIndices_.begin();
-                            while ( it != neighbourOfNode1.neighbourIndices_.end() )
-                            {
-                                int32_t & neighbourOfNeighbourOfNode1Index=*it;
-                                
-                                if (neighbourOfNeighbourOfNode1Index==index1)
-                                {
-                                    if (neighbourOfNode1AlreadyNeighbourOfNode0)
-                                    {//Remove neighbourOfNode1's neighbour.
-                                        neighbourOfNode1.neighbourIndices_.erase(it);
-                                    } else
-                                    {//Update neighbourOfNode1's neighbour.
-                                        neighbourOfNeighbourOfNode1Index=index0;
-                                        ++it;
-                                    }
-                                } else
-                                {
-                                    ++it;
-                                }
-                            }
-                        }
-                    }
-                }
-                
-                node1.size_=0;
-                index1=-1;
-                ++numPulsesMerged;
+            addArc(lineOffset+x-1, lineOffset+x);
+        }
+        
+        if (y<(height-1))
+        {
+            for (int32_t x=0; x<width; ++x)
+            {
+                addArc(lineOffset+x, lineOffset+x+width);
             }
         }
     }
     
-    //Remove all neighbour index entries of -1.
-    std::vector<int32_t>::iterator it=node0.neighbourIndices_.begin();
-    while (it!=node0.neighbourIndices_.end())
+    numArcs_=arcEnd/2;
+    //=== ===//
+}
+
+size_t FIPDPT::joinPulses(int32_t pulseIndex0, int32_t pulseIndex1)
+{
+    if (pulseIndex0==pulseIndex1)
     {
-        if ((*it) == -1)
+        return 0;
+    }
+    
+    if (sizeVect_[pulseIndex0]<sizeVect_[pulseIndex1])
+    {
+        std::swap(pulseIndex0, pulseIndex1);
+    }
+    
+    parentVect_[pulseIndex1]=pulseIndex0;
+    sizeVect_[pulseIndex0]+=sizeVect_[pulseIndex1];
+    sizeVect_[pulseIndex1]=0;
+    
+    //Append the pixels of pulse1. The root pixel is always the head of its list.
+    nextPixelVect_[lastPixelVect_[pulseIndex0]]=pulseIndex1;
+    lastPixelVect_[pulseIndex0]=lastPixelVect_[pulseIndex1];
+    
+    //Append the arc ends of pulse1.
+    if (firstArcEndVect_[pulseIndex1]!=-1)
+    {
+        if (firstArcEndVect_[pulseIndex0]==-1)
         {
-            node0.neighbourIndices_.erase(it);
+            firstArcEndVect_[pulseIndex0]=firstArcEndVect_[pulseIndex1];
         } else
         {
-            ++it;
+            arcEndVect_[lastArcEndVect_[pulseIndex0]].nextArcEnd_=firstArcEndVect_[pulseIndex1];
         }
+        
+        lastArcEndVect_[pulseIndex0]=lastArcEndVect_[pulseIndex1];
     }
     
-    node0.neighbourIndices_.insert(node0.neighbourIndices_.end(), neighbourIndicesToAdd_.begin(), neighbourIndicesToAdd_.end());
-    
-    return numPulsesMerged;
+    return 1;
 }
-#endif
 
 size_t FIPDPT::mergeFromAll()
 {
-    //=== Merge the nodes until no more merging possible ===//
+    //=== Merge all neighbouring pulses of the same value ===//
     size_t numPulsesMerged=0;
     
-    bool busyMerging=true;
-    while (busyMerging)
+    for (int32_t arcIndex=0; arcIndex<numArcs_; ++arcIndex)
     {
-        busyMerging=false;
-#ifdef RUN_ARCS
-        const size_t numArcs=arcVect_.size();
+        const int32_t pixelIndex0=arcEndVect_[arcIndex*2].pixelIndex_;
+        const int32_t pixelIndex1=arcEndVect_[arcIndex*2+1].pixelIndex_;
+        
+        const int32_t pulseIndex0=findPulse(pixelIndex0);
+        const int32_t pulseIndex1=findPulse(pixelIndex1);
         
-        for (size_t arcIndex=0; arcIndex<numArcs; ++arcIndex)
+        if (valueVect_[pulseIndex0]==valueVect_[pulseIndex1])
         {
-            numPulsesMerged+=mergeArc(arcIndex);
+            numPulsesMerged+=joinPulses(pulseIndex0, pulseIndex1);
         }
-#else
-        //Don't use the potential list here. It might not be updated.
-        for (const auto & node : nodeVect_)
-        {
-            if (node.size_>0)
-            {
-                numPulsesMerged+=mergeNode(node.index_);
-            }
-        }
-#endif
     }
     //=== ===//
     
     return numPulsesMerged;
 }
 
-size_t FIPDPT::mergeFromList(const std::vector<int32_t> nodeIndicesToMerge)
+size_t FIPDPT::mergeFromList(const std::vector<int32_t> &pulseIndicesToMerge)
 {
-    size_t numPulsesMerged=0;
+    //After a full merge no two neighbouring pulses have the same value, so only the flattened pulses can have
+    //neighbours to merge with. Gather all the pairs first so that each pulse only walks its own arcs, then join them.
+    pulsePairsToJoin_.clear();
     
-    for (const int32_t nodeIndex : nodeIndicesToMerge)
+    for (const int32_t pulseIndex : pulseIndicesToMerge)
     {
-        Node &node=nodeVect_[nodeIndex];
+        const uint8_t value=valueVect_[pulseIndex];
         
-#ifdef RUN_ARCS
-        for (auto arcIndexNum=0; arcIndexNum<node.arcIndices_.size(); ++arcIndexNum)
-        {
-            numPulsesMerged+=mergeArc(node.arcIndices_[arcIndexNum]);
-        }
-#else
-        if (node.size_>0)
-        {
-            numPulsesMerged+=mergeNode(nodeIndex);
-        }
-#endif
+        forEachNeighbourPulse(pulseIndex, [&](const int32_t neighbourIndex)
+                              {
+                                  if (valueVect_[neighbourIndex]==value)
+                                  {
+                                      pulsePairsToJoin_.push_back(pulseIndex);
+                                      pulsePairsToJoin_.push_back(neighbourIndex);
+                                  }
+                                  return true;
+                              });
+    }
+    
+    size_t numPulsesMerged=0;
+    
+    const size_t numPairs=pulsePairsToJoin_.size()/2;
+    for (size_t pairNum=0; pairNum<numPairs; ++pairNum)
+    {
+        numPulsesMerged+=joinPulses(findPulse(pulsePairsToJoin_[pairNum*2]),
+                                    findPulse(pulsePairsToJoin_[pairNum*2+1]));
     }
     
     return numPulsesMerged;
@@ -318,89 +263,7 @@ bool FIPDPT::trigger()
             const size_t width=imFormat.getWidth();
             const size_t height=imFormat.getHeight();
             
-            memset(dataWrite, 0, width*height);//Clear the downstream image.
-            
-            
-            //=== Setup the initial nodes ===//
-            for (size_t y=0; y<height; ++y)
-            {
-                const size_t lineOffset=y * width;
-                
-                for (size_t x=0; x<width; ++x)
-                {
-                    const auto writeValue=dataRead[lineOffset + x];
-                    
-                    Node &node=nodeVect_[lineOffset + x];
-                    node.index_=lineOffset + x;
-                    node.value_=writeValue;
-                    node.size_=1;
-                    
-#ifdef RUN_ARCS
-                    node.arcIndices_.clear();
-#else
-                    node.neighbourIndices_.clear();
-#endif
-                    
-                    node.pixelIndices_.clear();
-                    node.pixelIndices_.push_back(lineOffset + x);
-                }
-            }
-            //===  ==//
-            
-            
-            //=== Setup the initial arcs or node neighbours ===//
-            {
-#ifdef RUN_ARCS
-                size_t arcIndex=0;
-#endif
-                
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=y * width;
-                    
-                    for (size_t x=1; x<width; ++x)
-                    {
-#ifdef RUN_ARCS
-                        Arc &arc=arcVect_[arcIndex];
-                        arc.index_=arcIndex;
-                        arc.active_=true;
-                        
-                        arc.nodeIndices_[0]=lineOffset+x-1;
-                        arc.nodeIndices_[1]=lineOffset+x;
-                        
-                        nodeVect_[arc.nodeIndices_[0]].arcIndices_.push_back(arcIndex);
-                        nodeVect_[arc.nodeIndices_[1]].arcIndices_.push_back(arcIndex);
-                        arcIndex++;
-#else
-                        nodeVect_[lineOffset+x-1].neighbourIndices_.push_back(lineOffset+x);
-                        nodeVect_[lineOffset+x].neighbourIndices_.push_back(lineOffset+x-1);
-#endif
-                    }
-                    
-                    if (y<(height-1))
-                    {
-                        for (size_t x=0; x<width; ++x)
-                        {
-#ifdef RUN_ARCS
-                            Arc &arc=arcVect_[arcIndex];
-                            arc.index_=arcIndex;
-                            arc.active_=true;
-                            
-                            arc.nodeIndices_[0]=lineOffset+x;
-                            arc.nodeIndices_[1]=lineOffset+x+width;
-                            
-                            nodeVect_[arc.nodeIndices_[0]].arcIndices_.push_back(arcIndex);
-                            nodeVect_[arc.nodeIndices_[1]].arcIndices_.push_back(arcIndex);
-                            arcIndex++;
-#else
-                            nodeVect_[lineOffset+x].neighbourIndices_.push_back(lineOffset+x+width);
-                            nodeVect_[lineOffset+x+width].neighbourIndices_.push_back(lineOffset+x);
-#endif
-                        }
-                    }
-                }
-            }
-            //=== ===
+            setupGraph(dataRead, width, height);
             
             size_t policyCounter=0;
             
@@ -409,33 +272,34 @@ bool FIPDPT::trigger()
             
             size_t numPulsesMerged=mergeFromAll();//Initial merge.
             
-            updatePotentiallyActiveNodeIndexVect();
-            
-            std::vector<int32_t> nodeIndicesToMerge;
+            potentiallyActivePulseIndexVect_.clear();
+            for (int32_t pixelIndex=0; pixelIndex<int32_t(width*height); ++pixelIndex)
+            {
+                if (sizeVect_[pixelIndex]>0)
+                {
+                    potentiallyActivePulseIndexVect_.push_back(pixelIndex);
+                }
+            }
             
-            size_t loopCounter = 0;
             int32_t previousSmallestPulse = 0;
             
-            while ((previousSmallestPulse<filterPulseSize_)&&(potentiallyActiveNodeIndexVect_.size()>1))
+            while ((previousSmallestPulse<filterPulseSize_)&&(potentiallyActivePulseIndexVect_.size()>1))
             {
-                nodeIndicesToMerge.clear();
+                pulseIndicesToMerge_.clear();
                 
                 //=== Find smallest pulse ===//
                 int32_t smallestPulse=0;
                 
-                for (const auto & potentiallyActiveNodeIndex : potentiallyActiveNodeIndexVect_)
+                for (const auto pulseIndex : potentiallyActivePulseIndexVect_)
                 {
-                    Node &node=nodeVect_[potentiallyActiveNodeIndex];
+                    const int32_t size=sizeVect_[pulseIndex];
                     
-                    if (node.size_>0)
+                    if ((smallestPulse==0)||(size<smallestPulse))
                     {
-                        if ((smallestPulse==0)||(node.size_<smallestPulse))
+                        //if (isBump(pulseIndex)||isPit(pulseIndex))
+                        //if (size>previousSmallestPulse)
                         {
-                            //if (isBump(node.index_)||isPit(node.index_))
-                            //if (node.size_>previousSmallestPulse)
-                            {
-                                smallestPulse=node.size_;
-                            }
+                            smallestPulse=size;
                         }
                     }
                 }
@@ -453,30 +317,28 @@ bool FIPDPT::trigger()
                 
                 
                 //=== Remove pits and bumps according to policy ===//
-                for (const auto & potentiallyActiveNodeIndex : potentiallyActiveNodeIndexVect_)
+                for (const auto pulseIndex : potentiallyActivePulseIndexVect_)
                 {
-                    Node &node=nodeVect_[potentiallyActiveNodeIndex];
-                    
-                    if ((node.size_>0)&&(node.size_<=smallestPulse))
+                    if (sizeVect_[pulseIndex]<=smallestPulse)
                     {
                         if ((policyCounter%2)==0)
                         {
-                            //if (isPit(node.index_))
+                            //if (isPit(pulseIndex))
                             {
                                 //=== Remove pits ===//
-                                flattenToNearestNeighbour(node.index_);
-                                //flattenToFirstNeighbour(node.index_);
-                                nodeIndicesToMerge.push_back(node.index_);
+                                flattenToNearestNeighbour(pulseIndex);
+                                //flattenToFirstNeighbour(pulseIndex);
+                                pulseIndicesToMerge_.push_back(pulseIndex);
                                 ++numPitsRemoved;
                             }
                         } else
                         {
-                            //if (isBump(node.index_))
+                            //if (isBump(pulseIndex))
                             {
                                 //=== Remove bumps ===//
-                                flattenToNearestNeighbour(node.index_);
-                                //flattenToFirstNeighbour(node.index_);
-                                nodeIndicesToMerge.push_back(node.index_);
+                                flattenToNearestNeighbour(pulseIndex);
+                                //flattenToFirstNeighbour(pulseIndex);
+                                pulseIndicesToMerge_.push_back(pulseIndex);
                                 ++numBumpsRemoved;
                             }
                         }
@@ -492,15 +354,14 @@ bool FIPDPT::trigger()
                 //std::cout.flush();
                 
                 
-                //=== Merge over arcs of removed nodes ===//
-                numPulsesMerged=mergeFromList(nodeIndicesToMerge);
+                //=== Merge over arcs of removed pulses ===//
+                numPulsesMerged=mergeFromList(pulseIndicesToMerge_);
                 //=== ===//
                 
                 ++policyCounter;
                 previousSmallestPulse=smallestPulse;
                 
-                if ((loopCounter&15)==0) updatePotentiallyActiveNodeIndexVect();
-                ++loopCounter;
+                updatePotentiallyActivePulseIndexVect();
             }
             
             
@@ -510,43 +371,17 @@ bool FIPDPT::trigger()
             
             
             {
-                //=== Find smallest pulse ==
-                int32_t smallestPulse=0;
-                for (const auto & node : nodeVect_)
-                {
-                    if (node.size_>0)
-                    {
-                        if ((smallestPulse==0)||(node.size_<smallestPulse))
-                        {
-                            //if (isBump(node.index_)||isPit(node.index_))
-                            {
-                                smallestPulse=node.size_;
-                            }
-                        }
-                    }
-                }
-                //=== ===
-                
-                //std::cout << "Drawing pulses of size " << smallestPulse << "+.\n";
-                //std::cout.flush();
-                
                 //=== Draw the pulses on the sceen ==
-                for (const auto & node : nodeVect_)
+                //Every pixel belongs to exactly one active pulse, so the whole image is written.
+                for (const auto pulseIndex : potentiallyActivePulseIndexVect_)
                 {
-                    if (node.size_>0)
+                    const uint8_t value=valueVect_[pulseIndex];
+                    
+                    for (int32_t pixelIndex=pulseIndex; pixelIndex!=-1; pixelIndex=nextPixelVect_[pixelIndex])
                     {
-                        //if (node.size_==smallestPulse)
-                        {
-                            for (const auto pixelIndex : node.pixelIndices_)
-                            {
-                                dataWrite[pixelIndex]=node.value_;
-                            }
-                        }
+                        dataWrite[pixelIndex]=value;
                     }
                 }
-                
-                //std::cout << "\n";
-                //std::cout.flush();
                 //=== ===
             }
         }
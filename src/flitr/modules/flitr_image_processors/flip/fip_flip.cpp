@@ -86,61 +86,14 @@ bool FIPFlip::trigger()
             const int bytesPerPixel=imFormat.getBytesPerPixel();
 
 
-            if ((!flipLeftRightVect_[imgNum]) && (!flipTopBottomVect_[imgNum]))
-            {
-                memcpy(dataWrite, dataRead, width*height*bytesPerPixel);
-            } else
-                if ((flipLeftRightVect_[imgNum]) && (!flipTopBottomVect_[imgNum]))
-                {
-                    //=== Flip left-right ===//
-                    for (int y=0; y<height; ++y)
-                    {
-                        int readOffset=(y*width)*bytesPerPixel;
-                        int writeOffset=(y*width+width-1)*bytesPerPixel;
-
-                        for (int x=0; x<width; ++x)
-                        {
-                            memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                            readOffset+=bytesPerPixel;
-                            writeOffset-=bytesPerPixel;
-                        }
-                    }
-                    //=======================//
-                } else
-                    if ((!flipLeftRightVect_[imgNum]) && (flipTopBottomVect_[imgNum]))
-                    {
-                        //=== Flip top-bottom ===//
-                        for (int y=0; y<height; ++y)
-                        {
-                            int readOffset=(y*width)*bytesPerPixel;
-                            int writeOffset=((height-y-1)*width)*bytesPerPixel;
-
-                            for (int x=0; x<width; ++x)
-                            {
-                                memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                                readOffset+=bytesPerPixel;
-                                writeOffset+=bytesPerPixel;
-                            }
-                        }
-                        //=======================//
-                    } else
-                        if ((flipLeftRightVect_[imgNum]) && (flipTopBottomVect_[imgNum]))
-                        {
-                            //=== Flip left-right and top-bottom===//
-                            for (int y=0; y<height; ++y)
-                            {
-                                int readOffset=(y*width)*bytesPerPixel;
-                                int writeOffset=((height-y-1)*width+width-1)*bytesPerPixel;
-
-                                for (int x=0; x<width; ++x)
-                                {
-                                    memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                                    readOffset+=bytesPerPixel;
-                                    writeOffset-=bytesPerPixel;
-                                }
-                            }
-                            //=======================//
-                        }
+            //Flips are row span copies in the affine transform engine.
+            AffineTransform flipTransform;
+            flipTransform.setMatrix(flipLeftRightVect_[imgNum] ? -1.0f : 1.0f, 0.0f,
+                                    0.0f, flipTopBottomVect_[imgNum] ? -1.0f : 1.0f,
+                                    flipLeftRightVect_[imgNum] ? float(width-1) : 0.0f,
+                                    flipTopBottomVect_[imgNum] ? float(height-1) : 0.0f);
+            
+            flipTransform.transformNearest(dataWrite, width, height, dataRead, width, height, bytesPerPixel);
         }
         
         
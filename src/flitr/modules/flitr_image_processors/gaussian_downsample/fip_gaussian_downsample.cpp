@@ -29,6 +29,7 @@ FIPGaussianDownsample::FIPGaussianDownsample(ImageProducer& upStreamProducer, ui
                                              uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 xFiltData_(nullptr),
+upStreamPyramid_(nullptr),
 gaussianDownsample_(filterRadius, kernelWidth)
 {
     
@@ -43,6 +44,33 @@ gaussianDownsample_(filterRadius, kernelWidth)
     
 }
 
+FIPGaussianDownsample::FIPGaussianDownsample(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                                             const float filterRadius,
+                                             const size_t kernelWidth,
+                                             uint32_t buffer_size) :
+ImageProcessor(upStreamPyramid, images_per_slot, buffer_size),
+xFiltData_(nullptr),
+upStreamPyramid_(&upStreamPyramid),
+gaussianDownsample_(filterRadius, kernelWidth)
+{
+    
+    //Setup image format being produced to downstream. It is the format of pyramid level 1, which rounds odd sizes down.
+    for (uint32_t i=0; i<images_per_slot; i++) {
+        if (upStreamPyramid.getNumLevels()>1)
+        {
+            ImageFormat_.push_back(upStreamPyramid.getDownstreamFormat(upStreamPyramid.getImageIndex(i, 1)));
+        } else
+        {//Single level pyramid. Downsample level 0 like the ImageProducer constructor does.
+            ImageFormat downStreamFormat=upStreamPyramid.getDownstreamFormat(upStreamPyramid.getImageIndex(i, 0));
+            
+            downStreamFormat.downSampleByTwo();
+            
+            ImageFormat_.push_back(downStreamFormat);
+        }
+    }
+    
+}
+
 FIPGaussianDownsample::~FIPGaussianDownsample()
 {
     delete [] xFiltData_;
@@ -68,7 +96,7 @@ bool FIPGaussianDownsample::init()
     
     for (uint32_t i=0; i<ImagesPerSlot_; i++)
     {
-        const ImageFormat imFormat=getUpstreamFormat(i);
+        const ImageFormat imFormat=getUpstreamFormat(upStreamPyramid_ ? upStreamPyramid_->getImageIndex(i, 0) : i);
         
         const size_t width=imFormat.getWidth();
         const size_t height=imFormat.getHeight();
@@ -99,19 +127,27 @@ bool FIPGaussianDownsample::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
+        //Level 1 of an upstream pyramid is already filtered and downsampled.
+        const bool usePyramidLevel=(upStreamPyramid_!=nullptr) && (upStreamPyramid_->getNumLevels()>1);
+        
         for (size_t imgNum=0; imgNum<ImagesPerSlot_; imgNum++)
         {
-            Image const * const imReadUS = *(imvRead[imgNum]);
+            const size_t imgNumUS=upStreamPyramid_ ? upStreamPyramid_->getImageIndex(imgNum, usePyramidLevel ? 1 : 0) : imgNum;
+            
+            Image const * const imReadUS = *(imvRead[imgNumUS]);
             Image * const imWriteDS = *(imvWrite[imgNum]);
             
             //US and DS pixel formats are the same, but the image sizes are not.
             const ImageFormat imFormatDS=getDownstreamFormat(imgNum);
-            const ImageFormat imFormatUS=getUpstreamFormat(imgNum);
+            const ImageFormat imFormatUS=getUpstreamFormat(imgNumUS);
             
             const size_t widthUS=imFormatUS.getWidth();
             const size_t heightUS=imFormatUS.getHeight();
             
-
+            if (usePyramidLevel)
+            {
+                memcpy(imWriteDS->data(), imReadUS->data(), imFormatUS.getBytesPerImage());
+            } else
             if (imFormatDS.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
             {
                 float const * const dataReadUS=(float const * const)imReadUS->data();
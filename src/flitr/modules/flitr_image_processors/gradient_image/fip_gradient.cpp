@@ -0,0 +1,331 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/gradient_image/fip_gradient.h>
+#include <flitr/image_processor_utils.h>
+#include <flitr/log_message.h>
+
+#include <algorithm>
+
+using namespace flitr;
+using std::shared_ptr;
+
+namespace
+{
+    /*! x gradient of one line: k0*(mid[x+1]-mid[x-1]) + k1*((up[x+1]-up[x-1]) + (down[x+1]-down[x-1])).
+     *  The end pixels use the replicated border pixel as their outside neighbour.*/
+    template<typename T>
+    inline void gradientXLine(float * __restrict lineGX,
+                              T const * __restrict lineUp, T const * __restrict lineMid, T const * __restrict lineDown,
+                              const ptrdiff_t width, const float k0, const float k1)
+    {
+        for (ptrdiff_t x=1; x<(width-1); ++x)
+        {
+            lineGX[x]=k0*(float(lineMid[x+1]) - float(lineMid[x-1])) +
+                      k1*((float(lineUp[x+1]) - float(lineUp[x-1])) + (float(lineDown[x+1]) - float(lineDown[x-1])));
+        }
+        
+        const ptrdiff_t borderX[2]={0, width-1};
+        for (size_t i=0; i<((width>1) ? 2u : 1u); ++i)
+        {
+            const ptrdiff_t x=borderX[i];
+            const ptrdiff_t xLeft=std::max<ptrdiff_t>(x-1, 0);
+            const ptrdiff_t xRight=std::min<ptrdiff_t>(x+1, width-1);
+            
+            lineGX[x]=k0*(float(lineMid[xRight]) - float(lineMid[xLeft])) +
+                      k1*((float(lineUp[xRight]) - float(lineUp[xLeft])) + (float(lineDown[xRight]) - float(lineDown[xLeft])));
+        }
+    }
+    
+    //! y gradient of one line: k0*(down[x]-up[x]) + k1*((down[x-1]-up[x-1]) + (down[x+1]-up[x+1])).
+    template<typename T>
+    inline void gradientYLine(float * __restrict lineGY,
+                              T const * __restrict lineUp, T const * __restrict lineDown,
+                              const ptrdiff_t width, const float k0, const float k1)
+    {
+        for (ptrdiff_t x=1; x<(width-1); ++x)
+        {
+            lineGY[x]=k0*(float(lineDown[x]) - float(lineUp[x])) +
+                      k1*((float(lineDown[x-1]) - float(lineUp[x-1])) + (float(lineDown[x+1]) - float(lineUp[x+1])));
+        }
+        
+        const ptrdiff_t borderX[2]={0, width-1};
+        for (size_t i=0; i<((width>1) ? 2u : 1u); ++i)
+        {
+            const ptrdiff_t x=borderX[i];
+            const ptrdiff_t xLeft=std::max<ptrdiff_t>(x-1, 0);
+            const ptrdiff_t xRight=std::min<ptrdiff_t>(x+1, width-1);
+            
+            lineGY[x]=k0*(float(lineDown[x]) - float(lineUp[x])) +
+                      k1*((float(lineDown[xLeft]) - float(lineUp[xLeft])) + (float(lineDown[xRight]) - float(lineUp[xRight])));
+        }
+    }
+    
+    inline void magnitudeL1Line(float * __restrict lineMagnitude,
+                                float const * __restrict lineGX, float const * __restrict lineGY, const ptrdiff_t width)
+    {
+        for (ptrdiff_t x=0; x<width; ++x)
+        {
+            lineMagnitude[x]=fabsf(lineGX[x]) + fabsf(lineGY[x]);
+        }
+    }
+    
+    inline void magnitudeL2Line(float * __restrict lineMagnitude,
+                                float const * __restrict lineGX, float const * __restrict lineGY, const ptrdiff_t width)
+    {
+        for (ptrdiff_t x=0; x<width; ++x)
+        {
+            lineMagnitude[x]=sqrtf(lineGX[x]*lineGX[x] + lineGY[x]*lineGY[x]);
+        }
+    }
+    
+    //! Orientation bin of each pixel. Bin b is centred on angle b*2*pi/numBins.
+    inline void orientationLine(uint8_t * __restrict lineOrientation,
+                                float const * __restrict lineGX, float const * __restrict lineGY, const ptrdiff_t width,
+                                const int32_t numBins)
+    {
+        const float twoPi=6.28318531f;
+        const float binsPerRadian=float(numBins) / twoPi;
+        
+        for (ptrdiff_t x=0; x<width; ++x)
+        {
+            float angle=approxAtan2(lineGY[x], lineGX[x]);
+            angle=(angle < 0.0f) ? (angle + twoPi) : angle;
+            
+            int32_t bin=int32_t(angle * binsPerRadian + 0.5f);
+            bin=(bin >= numBins) ? (bin - numBins) : bin;
+            
+            lineOrientation[x]=uint8_t(bin);
+        }
+    }
+}
+
+uint32_t FIPGradient::countOutputs(const uint32_t outputs)
+{
+    return ((outputs & OUTPUT_GRADIENT_X) ? 1 : 0) + ((outputs & OUTPUT_GRADIENT_Y) ? 1 : 0) +
+           ((outputs & OUTPUT_MAGNITUDE) ? 1 : 0) + ((outputs & OUTPUT_ORIENTATION) ? 1 : 0);
+}
+
+FIPGradient::FIPGradient(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                         const uint32_t outputs,
+                         const GradientOperator gradientOperator,
+                         const MagnitudeNorm magnitudeNorm,
+                         const uint32_t numOrientationBins,
+                         uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot*countOutputs(outputs), buffer_size),
+outputs_(outputs),
+numOutputs_(countOutputs(outputs)),
+numUpstreamImages_(images_per_slot),
+gradientOperator_(gradientOperator),
+magnitudeNorm_(magnitudeNorm),
+numOrientationBins_(std::min<uint32_t>(std::max<uint32_t>(numOrientationBins, 1), 256)),//Bin indices are 8-bit.
+title_("Gradient")
+{
+    ProcessorStats_->setID("ImageProcessor::FIPGradient");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        const ImageFormat imFormat=upStreamProducer.getFormat(i);
+        const uint32_t width=imFormat.getWidth();
+        const uint32_t height=imFormat.getHeight();
+        
+        if (outputs_ & OUTPUT_GRADIENT_X) ImageFormat_.push_back(ImageFormat(width, height, ImageFormat::FLITR_PIX_FMT_Y_F32));
+        if (outputs_ & OUTPUT_GRADIENT_Y) ImageFormat_.push_back(ImageFormat(width, height, ImageFormat::FLITR_PIX_FMT_Y_F32));
+        if (outputs_ & OUTPUT_MAGNITUDE) ImageFormat_.push_back(ImageFormat(width, height, ImageFormat::FLITR_PIX_FMT_Y_F32));
+        if (outputs_ & OUTPUT_ORIENTATION) ImageFormat_.push_back(ImageFormat(width, height, ImageFormat::FLITR_PIX_FMT_Y_8));
+    }
+}
+
+FIPGradient::~FIPGradient()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPGradient::init()
+{
+    if (numOutputs_==0)
+    {
+        logMessage(LOG_CRITICAL) << "Error: FIPGradient needs at least one output " << __FILE__ <<":"<<__LINE__<<".\n";
+        logMessage(LOG_CRITICAL).flush();
+        return false;
+    }
+    
+    for (uint32_t i=0; i<numUpstreamImages_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_F32) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_8))
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPGradient only supports Y_F32 and Y_8 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPGradient::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        //Centre and side weights of the derivative operator.
+        float k0=0.5f;
+        float k1=0.0f;
+        if (gradientOperator_==GradientOperator::SOBEL)
+        {
+            k0=2.0f/8.0f;
+            k1=1.0f/8.0f;
+        } else
+            if (gradientOperator_==GradientOperator::SCHARR)
+            {
+                k0=10.0f/32.0f;
+                k1=3.0f/32.0f;
+            }
+        
+        const bool needGX=(outputs_ & (OUTPUT_GRADIENT_X | OUTPUT_MAGNITUDE | OUTPUT_ORIENTATION))!=0;
+        const bool needGY=(outputs_ & (OUTPUT_GRADIENT_Y | OUTPUT_MAGNITUDE | OUTPUT_ORIENTATION))!=0;
+        
+        for (size_t imgNum=0; imgNum<numUpstreamImages_; imgNum++)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            
+            //Downstream images of this upstream image, in the order of the Output bits. nullptr if not selected.
+            Image * imWrite[4]={nullptr, nullptr, nullptr, nullptr};
+            size_t writeIndex=imgNum * numOutputs_;
+            for (size_t outputNum=0; outputNum<4; ++outputNum)
+            {
+                if (outputs_ & (1u << outputNum))
+                {
+                    imWrite[outputNum]=*(imvWrite[writeIndex++]);
+                    
+                    // Pass the metadata from the read image to the write image.
+                    // By Default the base implementation will copy the pointer if no custom
+                    // pass function was set.
+                    if(PassMetadataFunction_ != nullptr)
+                    {
+                        imWrite[outputNum]->setMetadata(PassMetadataFunction_(imRead->metadata()));
+                    }
+                }
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const bool is8Bit=imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_8;
+            
+            const ptrdiff_t width=imFormat.getWidth();
+            const ptrdiff_t height=imFormat.getHeight();
+            
+            //Y_8 input is in units of 1/256 like FIPCnvrtToYF32.
+            const float inputScale=is8Bit ? 0.00390625f : 1.0f;
+            const float k0Scaled=k0 * inputScale;
+            const float k1Scaled=k1 * inputScale;
+            
+            float * const dataGX=imWrite[0] ? (float *)imWrite[0]->data() : nullptr;
+            float * const dataGY=imWrite[1] ? (float *)imWrite[1]->data() : nullptr;
+            float * const dataMagnitude=imWrite[2] ? (float *)imWrite[2]->data() : nullptr;
+            uint8_t * const dataOrientation=imWrite[3] ? imWrite[3]->data() : nullptr;
+            
+            const size_t numBands=getNumRowBands(height);
+            if (bandLines_.size()<numBands) bandLines_.resize(numBands);
+            for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+            {
+                if (bandLines_[bandNum].size()<size_t(2*width)) bandLines_[bandNum].resize(2*width);
+            }
+            
+            const ptrdiff_t bandHeight=ptrdiff_t((height + numBands - 1) / numBands);
+            
+            int32_t bandNum=0;
+#pragma omp parallel for
+            for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+            {
+                const ptrdiff_t yStart=bandNum * bandHeight;
+                const ptrdiff_t yEnd=std::min(yStart + bandHeight, height);
+                
+                float * const bandGX=bandLines_[bandNum].data();
+                float * const bandGY=bandGX + width;
+                
+                for (ptrdiff_t y=yStart; y<yEnd; ++y)
+                {
+                    //The border rows are replicated.
+                    const ptrdiff_t yUp=std::max<ptrdiff_t>(y-1, 0);
+                    const ptrdiff_t yDown=std::min<ptrdiff_t>(y+1, height-1);
+                    
+                    float * const lineGX=dataGX ? (dataGX + y*width) : bandGX;
+                    float * const lineGY=dataGY ? (dataGY + y*width) : bandGY;
+                    
+                    if (is8Bit)
+                    {
+                        uint8_t const * const dataRead=imRead->data();
+                        
+                        if (needGX) gradientXLine(lineGX, dataRead + yUp*width, dataRead + y*width, dataRead + yDown*width, width, k0Scaled, k1Scaled);
+                        if (needGY) gradientYLine(lineGY, dataRead + yUp*width, dataRead + yDown*width, width, k0Scaled, k1Scaled);
+                    } else
+                    {
+                        float const * const dataRead=(float const *)imRead->data();
+                        
+                        if (needGX) gradientXLine(lineGX, dataRead + yUp*width, dataRead + y*width, dataRead + yDown*width, width, k0Scaled, k1Scaled);
+                        if (needGY) gradientYLine(lineGY, dataRead + yUp*width, dataRead + yDown*width, width, k0Scaled, k1Scaled);
+                    }
+                    
+                    if (dataMagnitude)
+                    {
+                        if (magnitudeNorm_==MagnitudeNorm::L1)
+                        {
+                            magnitudeL1Line(dataMagnitude + y*width, lineGX, lineGY, width);
+                        } else
+                        {
+                            magnitudeL2Line(dataMagnitude + y*width, lineGX, lineGY, width);
+                        }
+                    }
+                    
+                    if (dataOrientation)
+                    {
+                        orientationLine(dataOrientation + y*width, lineGX, lineGY, width, int32_t(numOrientationBins_));
+                    }
+                }
+            }
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
@@ -0,0 +1,132 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/guided_filter/fip_guided_filter.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+FIPGuidedFilter::FIPGuidedFilter(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                                 const uint32_t radius, const float epsilon, const uint32_t subsample,
+                                 uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("Guided Filter"),
+radius_(std::max<uint32_t>(radius, 1)),
+epsilon_(std::max<float>(epsilon, 1.0e-8f)),
+subsample_(std::max<uint32_t>(subsample, 1)),
+guidedFilterVec_(images_per_slot)
+{
+    ProcessorStats_->setID("ImageProcessor::FIPGuidedFilter");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
+    }
+}
+
+FIPGuidedFilter::~FIPGuidedFilter()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPGuidedFilter::init()
+{
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_8) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_8) &&
+            (pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_F32) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_F32))
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPGuidedFilter only supports Y_8, RGB_8, Y_F32 and RGB_F32 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPGuidedFilter::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        const uint32_t radius=radius_;
+        const float epsilon=epsilon_;
+        const uint32_t subsample=subsample_;
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const size_t width=imFormat.getWidth();
+            const size_t height=imFormat.getHeight();
+            const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
+            
+            GuidedFilter &guidedFilter=guidedFilterVec_[imgNum];
+            guidedFilter.setRadius(radius);
+            guidedFilter.setEpsilon(epsilon);
+            guidedFilter.setSubsample(subsample);
+            
+            if (imFormat.getDataType()==ImageFormat::FLITR_PIX_DT_FLOAT32)
+            {
+                guidedFilter.filter((float *)imWrite->data(), (float const *)imRead->data(), width, height, componentsPerPixel);
+            } else
+            {
+                guidedFilter.filter(imWrite->data(), imRead->data(), width, height, componentsPerPixel);
+            }
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
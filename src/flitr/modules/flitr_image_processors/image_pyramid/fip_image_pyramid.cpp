@@ -0,0 +1,134 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/image_pyramid/fip_image_pyramid.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+FIPImagePyramid::FIPImagePyramid(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                                 const uint32_t numLevels,
+                                 uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot*std::max<uint32_t>(numLevels, 1), buffer_size),
+numLevels_(std::max<uint32_t>(numLevels, 1)),
+numUpstreamImages_(images_per_slot),
+title_("Image Pyramid"),
+imagePyramid_(numLevels_)
+{
+    ProcessorStats_->setID("ImageProcessor::FIPImagePyramid");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        const ImageFormat imFormat=upStreamProducer.getFormat(i);
+        
+        for (uint32_t levelNum=0; levelNum<numLevels_; ++levelNum)
+        {
+            ImageFormat_.push_back(ImageFormat(uint32_t(ImagePyramid::getLevelSize(imFormat.getWidth(), levelNum)),
+                                               uint32_t(ImagePyramid::getLevelSize(imFormat.getHeight(), levelNum)),
+                                               imFormat.getPixelFormat()));
+        }
+    }
+}
+
+FIPImagePyramid::~FIPImagePyramid()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPImagePyramid::init()
+{
+    for (uint32_t i=0; i<numUpstreamImages_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_F32) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_F32))
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPImagePyramid only supports Y_F32 and RGB_F32 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPImagePyramid::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        for (uint32_t imgNum=0; imgNum<numUpstreamImages_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
+            
+            for (uint32_t levelNum=0; levelNum<numLevels_; ++levelNum)
+            {
+                Image * const imWrite = *(imvWrite[getImageIndex(imgNum, levelNum)]);
+                
+                // Pass the metadata from the read image to the write image.
+                // By Default the base implementation will copy the pointer if no custom
+                // pass function was set.
+                if(PassMetadataFunction_ != nullptr)
+                {
+                    imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+                }
+                
+                if (levelNum==0)
+                {
+                    memcpy(imWrite->data(), imRead->data(), imFormat.getBytesPerImage());
+                } else
+                {
+                    //Each level is downsampled from the level above it in the downstream slot.
+                    Image const * const imLevelUS = *(imvWrite[getImageIndex(imgNum, levelNum-1)]);
+                    const ImageFormat levelFormatUS=getDownstreamFormat(getImageIndex(imgNum, levelNum-1));
+                    
+                    imagePyramid_.downsample((float *)imWrite->data(), (float const *)imLevelUS->data(),
+                                             levelFormatUS.getWidth(), levelFormatUS.getHeight(), componentsPerPixel);
+                }
+            }
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
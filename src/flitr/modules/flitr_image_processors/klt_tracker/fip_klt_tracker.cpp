@@ -0,0 +1,195 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/klt_tracker/fip_klt_tracker.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+FIPKLTTracker::FIPKLTTracker(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                             const uint32_t maxFeatures,
+                             const KLTTracker::MotionModel motionModel,
+                             uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("KLT Tracker"),
+maxFeatures_(std::max<uint32_t>(maxFeatures, 8)),
+motionModel_(motionModel),
+inlierThreshold_(1.0f),
+kltTracker_(maxFeatures_, motionModel),
+upStreamPyramid_(nullptr),
+latestHx_(0.0f),
+latestHy_(0.0f),
+latestNumInliers_(0),
+latestHFrameNumber_(0)
+{
+    ProcessorStats_->setID("ImageProcessor::FIPKLTTracker");
+    
+    for (size_t i=0; i<9; ++i) latestTransform_[i]=((i%4)==0) ? 1.0f : 0.0f;
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
+    }
+}
+
+FIPKLTTracker::FIPKLTTracker(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                             const uint32_t maxFeatures,
+                             const KLTTracker::MotionModel motionModel,
+                             uint32_t buffer_size) :
+FIPKLTTracker(static_cast<ImageProducer&>(upStreamPyramid), images_per_slot, maxFeatures, motionModel, buffer_size)
+{
+    upStreamPyramid_=&upStreamPyramid;
+    
+    //The downstream images have the format of level 0 of the pyramids.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_[i]=upStreamPyramid.getDownstreamFormat(upStreamPyramid.getImageIndex(i, 0));
+    }
+}
+
+FIPKLTTracker::~FIPKLTTracker()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPKLTTracker::init()
+{
+    const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(0).getPixelFormat();
+    
+    if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_8) && (pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_F32) &&
+        (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_F32))
+    {
+        logMessage(LOG_CRITICAL) << "Error: FIPKLTTracker only supports Y_8, Y_F32 and RGB_F32 input " << __FILE__ <<":"<<__LINE__<<".\n";
+        logMessage(LOG_CRITICAL).flush();
+        return false;
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPKLTTracker::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        kltTracker_.setMaxFeatures(maxFeatures_);
+        kltTracker_.setMotionModel(motionModel_);
+        kltTracker_.setInlierThreshold(inlierThreshold_);
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            const size_t imgNumUS=upStreamPyramid_ ? upStreamPyramid_->getImageIndex(imgNum, 0) : imgNum;
+            Image const * const imRead = *(imvRead[imgNumUS]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNumUS);
+            
+            //Copy input to output image slot.
+            memcpy(imWrite->data(), imRead->data(), imFormat.getBytesPerImage());
+        }
+        
+        {//=== Track the first image of the slot ===
+            Image const * const imRead = *(imvRead[0]);
+            const ImageFormat imFormat=getUpstreamFormat(0);
+            const size_t width=imFormat.getWidth();
+            const size_t height=imFormat.getHeight();
+            const size_t numPixels=width*height;
+            
+            if (upStreamPyramid_)
+            {//Track on the levels of the first pyramid. Level 0 is the first image of the slot.
+                std::vector<float const *> levels(upStreamPyramid_->getNumLevels());
+                for (uint32_t levelNum=0; levelNum<levels.size(); ++levelNum)
+                {
+                    levels[levelNum]=(float const *)(*(imvRead[upStreamPyramid_->getImageIndex(0, levelNum)]))->data();
+                }
+                
+                const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
+                
+                //Use the green channel of RGB_F32 to track!
+                kltTracker_.track(levels, width, height, componentsPerPixel, (componentsPerPixel==3) ? 1 : 0);
+            } else
+            {
+                float const * trackData=(float const *)imRead->data();
+                
+                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_8)
+                {
+                    trackImage_.resize(numPixels);
+                    uint8_t const * const dataRead=imRead->data();
+                    for (size_t i=0; i<numPixels; ++i)
+                    {
+                        trackImage_[i]=float(dataRead[i]) * (1.0f/255.0f);
+                    }
+                    trackData=trackImage_.data();
+                } else
+                    if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
+                    {
+                        trackImage_.resize(numPixels);
+                        float const * const dataRead=(float const *)imRead->data();
+                        for (size_t i=0; i<numPixels; ++i)
+                        {
+                            trackImage_[i]=dataRead[i*3 + 1];//Use the green channel to track!
+                        }
+                        trackData=trackImage_.data();
+                    }
+                
+                kltTracker_.track(trackData, width, height);
+            }
+            
+            std::lock_guard<std::mutex> scopedLock(latestHMutex_);
+            
+            kltTracker_.getHVect(latestHx_, latestHy_);
+            kltTracker_.getTransform(latestTransform_);
+            latestNumInliers_=kltTracker_.getNumInliers();
+            latestHFrameNumber_=frameNumber_;
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
@@ -29,13 +29,13 @@ FIPMedian::FIPMedian(ImageProducer& upStreamProducer, uint32_t filterSize,
                      uint32_t images_per_slot,
                      uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
-filterSize_(filterSize>=1 ? filterSize : 1)
+filterSize_(filterSize>=1 ? filterSize : 1),
+medianMode_(MedianMode::HISTOGRAM),
+medianFilter_(filterSize_*2 - 1)
 {
     //Setup image format being produced to downstream.
     for (uint32_t i=0; i<images_per_slot; i++) {
-        //ImageFormat(uint32_t w=0, uint32_t h=0, PixelFormat pix_fmt=FLITR_PIX_FMT_Y_8, bool flipV = false, bool flipH = false):
-        ImageFormat downStreamFormat(upStreamProducer.getFormat().getWidth(), upStreamProducer.getFormat().getHeight(),
-                                     upStreamProducer.getFormat().getPixelFormat());
+        ImageFormat downStreamFormat=upStreamProducer.getFormat(i);
         
         ImageFormat_.push_back(downStreamFormat);
     }
@@ -50,6 +50,19 @@ bool FIPMedian::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_8)&&
+            (pixelFormat!=ImageFormat::FLITR_PIX_FMT_RGB_8)&&
+            (pixelFormat!=ImageFormat::FLITR_PIX_FMT_Y_16))
+        {
+            logMessage(LOG_CRITICAL) << "FIPMedian: Pixel format is not supported. Use Y_8, RGB_8 or Y_16.\n";
+            rValue=false;
+        }
+    }
+    
     return rValue;
 }
 
@@ -63,7 +76,7 @@ bool FIPMedian::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
-        for (size_t imgNum=0; imgNum<1; ++imgNum)//For now, only process one image in each slot.
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
         {
             Image const * const imRead = *(imvRead[imgNum]);
             Image * const imWrite = *(imvWrite[imgNum]);
@@ -73,112 +86,46 @@ bool FIPMedian::trigger()
             
             const ImageFormat imFormat=getDownstreamFormat(imgNum);
             
-            const int32_t width=imFormat.getWidth();
-            const int32_t height=imFormat.getHeight();
+            const size_t width=imFormat.getWidth();
+            const size_t height=imFormat.getHeight();
             
-            memset(dataWrite, 0, width*height);//Clear the downstream image.
-            
-            const int32_t border=filterSize_-1;
-            const int32_t widthMinusBorder=width - border;
-            const int32_t heightMinusBorder=height - border;
-            
-            for (int32_t y=border; y<heightMinusBorder; ++y)
+            switch (imFormat.getPixelFormat())
             {
-                const int32_t lineOffset=y * width;
-                
-                for (int32_t x=border; x<widthMinusBorder; ++x)
-                {
-                    uint8_t minPixelValue;
-                    uint8_t maxMinValue=0;
-                    
-                    //=== TopLeft ===//
-                    minPixelValue=255;
-                    for (int32_t dy=-border; dy<=0; ++dy)
-                    {
-                        for (int32_t dx=-border; dx<=0; ++dx)
-                        {
-                            const uint8_t value=dataRead[lineOffset + x + dx + dy*width];
-                            
-                            if (value<minPixelValue)
-                            {
-                                minPixelValue=value;
-                            }
-                        }
-                    }
-                    //=== ===//
-                    
-                    if (minPixelValue>maxMinValue)
+                case ImageFormat::FLITR_PIX_FMT_Y_8:
+                    if (medianMode_==MedianMode::HISTOGRAM)
                     {
-                        maxMinValue=minPixelValue;
-                    }
-                    
-                    //=== TopRight ===//
-                    minPixelValue=255;
-                    for (int32_t dy=-border; dy<=0; ++dy)
+                        medianFilter_.filter(dataWrite, dataRead, width, height);
+                    } else
                     {
-                        for (int32_t dx=0; dx<=border; ++dx)
-                        {
-                            const uint8_t value=dataRead[lineOffset + x + dx + dy*width];
-                            
-                            if (value<minPixelValue)
-                            {
-                                minPixelValue=value;
-                            }
-                        }
+                        medianFilter_.filterQuadrantMinMax(dataWrite, dataRead, width, height, 1);
                     }
-                    //=== ===//
-                    
-                    if (minPixelValue>maxMinValue)
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                    if (medianMode_==MedianMode::HISTOGRAM)
                     {
-                        maxMinValue=minPixelValue;
-                    }
-                    
-                    //=== BottomLeft ===//
-                    minPixelValue=255;
-                    for (int32_t dy=0; dy<=border; ++dy)
+                        medianFilter_.filterRGB(dataWrite, dataRead, width, height);
+                    } else
                     {
-                        for (int32_t dx=-border; dx<=0; ++dx)
-                        {
-                            const uint8_t value=dataRead[lineOffset + x + dx + dy*width];
-                            
-                            if (value<minPixelValue)
-                            {
-                                minPixelValue=value;
-                            }
-                        }
+                        medianFilter_.filterQuadrantMinMax(dataWrite, dataRead, width, height, 3);
                     }
-                    //=== ===//
-                    
-                    if (minPixelValue>maxMinValue)
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_16:
+                    if (medianMode_==MedianMode::HISTOGRAM)
                     {
-                        maxMinValue=minPixelValue;
-                    }
-                    
-                    //=== BottomRight ===//
-                    minPixelValue=255;
-                    for (int32_t dy=0; dy<=border; ++dy)
-                    {
-                        for (int32_t dx=0; dx<=border; ++dx)
-                        {
-                            const uint8_t value=dataRead[lineOffset + x + dx + dy*width];
-                            
-                            if (value<minPixelValue)
-                            {
-                                minPixelValue=value;
-                            }
-                        }
-                    }
-                    //=== ===//
-                    
-                    if (minPixelValue>maxMinValue)
+                        medianFilter_.filter((uint16_t *)dataWrite, (uint16_t const *)dataRead, width, height);
+                    } else
                     {
-                        maxMinValue=minPixelValue;
+                        medianFilter_.filterQuadrantMinMax((uint16_t *)dataWrite, (uint16_t const *)dataRead, width, height, 1);
                     }
-
-                    dataWrite[lineOffset + x]=maxMinValue;
-                }
+                    break;
+                default:
+                    break;
             }
             
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
         }
         
         //Stop stats measurement event.
@@ -192,4 +139,3 @@ bool FIPMedian::trigger()
     
     return false;
 }
-
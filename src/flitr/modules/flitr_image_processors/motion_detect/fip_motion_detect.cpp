@@ -24,22 +24,30 @@
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    //!Width and height of the detection bins is (1<<detectBinShift) pixels.
+    const int detectBinShift=4;
+    
+    //!The frame avrg&var update filter parameter (1/100) in 0.16 fixed point. Smaller values could improve sensitivity to slow moving objects.
+    const int32_t backgroundUpdateRateQ16=655;
+    
+    //!Initial variance chosen quite large to suppress motion during early background learning. 16.8 fixed point.
+    const uint32_t initialVarianceQ8=100*256;
+}
+
 FIPMotionDetect::FIPMotionDetect(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                                  const bool showOverlays, const bool produceOnlyMotionImages, const bool forceRGBOutput,
                                  const float motionThreshold, const int detectionThreshold,
                                  uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+_title("Motion Detect"),
 _frameCounter(0),
-_avrgImg(nullptr),
-_varImg(nullptr),
-_detectionImg(nullptr),
-_detectionCountImg(nullptr),
 _showOverlays(showOverlays),
 _produceOnlyMotionImages(produceOnlyMotionImages),
 _forceRGBOutput(forceRGBOutput),
 _motionThreshold(motionThreshold),
-_detectionThreshold(detectionThreshold),
-_title("Motion Detect")
+_detectionThreshold(detectionThreshold)
 {
     //!@todo can we get images_per_slot from upstream producer?
 
@@ -67,10 +75,6 @@ _title("Motion Detect")
 
 FIPMotionDetect::~FIPMotionDetect()
 {
-    if (_avrgImg) delete [] _avrgImg;
-    if (_varImg) delete [] _varImg;
-    if (_detectionImg) delete [] _detectionImg;
-    if (_detectionCountImg) delete [] _detectionCountImg;
 }
 
 bool FIPMotionDetect::init()
@@ -78,8 +82,9 @@ bool FIPMotionDetect::init()
     if (!ImageProcessor::init()) return false;
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
-    size_t maxScratchDataSize=0;
-    size_t maxScratchDataValues=0;
+    _avrgImgVec.resize(ImagesPerSlot_);
+    _varImgVec.resize(ImagesPerSlot_);
+    _detectionCountImgVec.resize(ImagesPerSlot_);
     
     for (uint32_t i=0; i<ImagesPerSlot_; i++)
     {
@@ -88,37 +93,112 @@ bool FIPMotionDetect::init()
         const size_t width=imFormat.getWidth();
         const size_t height=imFormat.getHeight();
         
-        const size_t bytesPerPixel=imFormat.getBytesPerPixel();
-        const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        
-        const size_t scratchDataSize = width * height * bytesPerPixel;
-        const size_t scratchDataValues = width * height * componentsPerPixel;
-        
-        if (scratchDataSize>maxScratchDataSize)
+        if ((imFormat.getPixelFormat()!=ImageFormat::FLITR_PIX_FMT_Y_8)&&
+            (imFormat.getPixelFormat()!=ImageFormat::FLITR_PIX_FMT_RGB_8))
         {
-            maxScratchDataSize=scratchDataSize;
+            logMessage(LOG_CRITICAL) << "Pixel format is not supported yet!" << __FILE__ << " " << __LINE__ << "\n";
+            return false;
         }
         
-        if (scratchDataValues>maxScratchDataValues)
-        {
-            maxScratchDataValues=scratchDataValues;
-        }
+        const size_t componentsPerImage=width * height * imFormat.getComponentsPerPixel();
+        const size_t binsPerImage=((width + (1<<detectBinShift) - 1) >> detectBinShift) *
+                                  ((height + (1<<detectBinShift) - 1) >> detectBinShift);
+        
+        _avrgImgVec[i].assign(componentsPerImage, 0);
+        _varImgVec[i].assign(componentsPerImage, 0);
+        _detectionCountImgVec[i].assign(binsPerImage, 0);
     }
     
-    //Allocate a buffer big enough for any of the image slots.
-    _avrgImg=new float[maxScratchDataValues];
-    memset(_avrgImg, 0, maxScratchDataValues * sizeof(float));
-    
-    _varImg=new float[maxScratchDataValues];
-    memset(_varImg, 0, maxScratchDataValues * sizeof(float));
+    return true;
+}
+
+template<size_t C>
+void FIPMotionDetect::updateBackgroundAndDetections(uint8_t const * const dataReadUS, const size_t imgNum,
+                                                    const int width, const int height)
+{
+    uint16_t * const avrgImg=_avrgImgVec[imgNum].data();
+    uint32_t * const varImg=_varImgVec[imgNum].data();
+    int * const detectionCountImg=_detectionCountImgVec[imgNum].data();
     
-    _detectionImg=new uint8_t[maxScratchDataValues];
-    memset(_detectionImg, 0, maxScratchDataValues * sizeof(*_detectionImg));
+    const int binSize=1<<detectBinShift;
+    const int binsPerLine=(width + binSize - 1) >> detectBinShift;
+    const int binLines=(height + binSize - 1) >> detectBinShift;
+    const int componentsPerLine=width * int(C);
     
-    _detectionCountImg=new int[maxScratchDataValues];
-    memset(_detectionCountImg, 0, maxScratchDataValues * sizeof(int));
+    //|x-avrg|/sqrt(var) > threshold  <=>  d^2 > threshold^2 * var. d^2 and var are both in 16.8 fixed point.
+    const float varThreshold=_motionThreshold * _motionThreshold;
+    const bool firstFrame=(_frameCounter==0);
     
-    return true;
+    //Each iteration owns a line of detection bins, so the bin marking and counting need no synchronisation.
+    int binLine=0;
+#pragma omp parallel for
+    for (binLine=0; binLine<binLines; ++binLine)
+    {
+        std::vector<uint8_t> motionLine(componentsPerLine);
+        std::vector<uint8_t> motionBins(binsPerLine, 0);
+        
+        const int yEnd=std::min((binLine+1) << detectBinShift, height);
+        
+        for (int y=(binLine << detectBinShift); y<yEnd; ++y)
+        {
+            uint8_t const * const lineRead=dataReadUS + y*componentsPerLine;
+            uint16_t * const lineAvrg=avrgImg + y*componentsPerLine;
+            uint32_t * const lineVar=varImg + y*componentsPerLine;
+            uint8_t * const lineMotion=motionLine.data();
+            
+            if (firstFrame)
+            {//Initial pixel averages and variances.
+                for (int i=0; i<componentsPerLine; ++i)
+                {
+                    lineAvrg[i]=uint16_t(lineRead[i] << 8);
+                    lineVar[i]=initialVarianceQ8;
+                }
+            }
+            
+            //Update the background average and variance and test for motion. Branch free so that it vectorises.
+            for (int i=0; i<componentsPerLine; ++i)
+            {
+                const int32_t value=int32_t(lineRead[i]) << 8;
+                
+                int32_t avrg=lineAvrg[i];
+                if (!firstFrame) avrg+=((value - avrg) * backgroundUpdateRateQ16 + 32768) >> 16;
+                lineAvrg[i]=uint16_t(avrg);
+                
+                const int32_t d=(value - avrg) >> 4;//8.4 fixed point.
+                const int32_t dSq=d*d;//16.8 fixed point.
+                
+                //The variance keeps the 8 fractional bits of d^2, so the rounded update still moves it when it is within
+                // 0.2 px^2 of d^2. The product needs more than 32 bits.
+                int32_t var=int32_t(lineVar[i]);
+                if (!firstFrame) var+=int32_t((int64_t(dSq - var) * backgroundUpdateRateQ16 + 32768) >> 16);
+                lineVar[i]=uint32_t(var);
+                
+                lineMotion[i]=(float(dSq) > (varThreshold * var)) ? 1 : 0;
+            }
+            
+            //Mark the bins with motion in any component.
+            for (int binX=0; binX<binsPerLine; ++binX)
+            {
+                const int iStart=(binX << detectBinShift) * int(C);
+                const int iEnd=std::min(((binX+1) << detectBinShift) * int(C), componentsPerLine);
+                
+                uint8_t binMotion=0;
+                for (int i=iStart; i<iEnd; ++i)
+                {
+                    binMotion|=lineMotion[i];
+                }
+                
+                motionBins[binX]|=binMotion;
+            }
+        }
+        
+        //Count detections over time.
+        int * const lineCount=detectionCountImg + binLine*binsPerLine;
+        for (int binX=0; binX<binsPerLine; ++binX)
+        {
+            lineCount[binX]=(motionBins[binX]) ? (lineCount[binX] + 1) : 0;
+        }
+    }
 }
 
 bool FIPMotionDetect::trigger()
@@ -138,183 +218,109 @@ bool FIPMotionDetect::trigger()
             const ImageFormat imFormat=getUpstreamFormat(imgNum);//down stream and up stream image dimensions are the same.
             const int width=imFormat.getWidth();
             const int height=imFormat.getHeight();
-            const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-            const size_t componentsPerImage = width * height * componentsPerPixel;
             const size_t bytesPerImage=imFormat.getBytesPerImage();
+            const bool upStreamRGB=(imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_8);
             
+            uint8_t const * const dataReadUS=(uint8_t const * const)imReadUS->data();
             
-            //Mask that defines the detection bin width and height. Could be made configurable!
-            const uint32_t detectImgMask = 0xFFFFFFF0;
-            
-            if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_8)
+            if (upStreamRGB)
             {
-                logMessage(LOG_CRITICAL) << "Pixel format is not supported yet!" << __FILE__ << " " << __LINE__ << "\n";
+                updateBackgroundAndDetections<3>(dataReadUS, imgNum, width, height);
             } else
-                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_8)
+            {
+                updateBackgroundAndDetections<1>(dataReadUS, imgNum, width, height);
+            }
+            
+            int const * const detectionCountImg=_detectionCountImgVec[imgNum].data();
+            const int binsPerLine=(width + (1<<detectBinShift) - 1) >> detectBinShift;
+            const int detectionThreshold=_detectionThreshold;
+            
+            //int64_t M=0;
+            //for (int i=0; i<(width*height); ++i)
+            //{
+            //    M+=std::abs(currentFrame_[i] - previousFrame_[i]);
+            //}
+            const bool frameMotion = true;//(M / (width*height*0.001f) + 0.5f) > (motionThreshold_);
+            
+            
+            if ((!_produceOnlyMotionImages) || frameMotion)
+            {
+                std::vector<Image**> imvWrite=reserveWriteSlot();
+                
+                Image * const imWriteDS = *(imvWrite[imgNum]);
+                uint8_t * const dataWriteDS=(uint8_t * const)imWriteDS->data();
+                
+                // Pass the metadata from the read image to the write image.
+                // By Default the base implementation will copy the pointer if no custom
+                // pass function was set.
+                if(PassMetadataFunction_ != nullptr)
                 {
-                    uint8_t const * const dataReadUS=(uint8_t const * const)imReadUS->data();
-                    //boxFilter_.filter(currentFrame_, scratchData_, width, height, integralImageScratchData_, true);
-                    
-                    
-                    //Update the background variance and average.
-                    if (_frameCounter>0)
-                    {
-                        //The frame avrg&var update filter parameter. Could be made configurable: Smaller values of a could improve sensitivity to slow moving objects.
-                        const float a=1.0/100.0;
-                        
-                        for (size_t i=0; i<componentsPerImage; ++i)
-                        {
-                            _avrgImg[i]=dataReadUS[i]*a + _avrgImg[i]*(1.0f-a);
-                            const float d=(int(dataReadUS[i])-int(_avrgImg[i]));//uint8_t variables are promoted to int.
-                            _varImg[i]=(d*d) * a + _varImg[i]*(1.0f-a);
-                        }
-                    } else
-                    {
-                        //Initial pixel averages and variances.
-                        for (size_t i=0; i<componentsPerImage; ++i)
-                        {
-                            _avrgImg[i]=dataReadUS[i];
-                            _varImg[i]=100.0f;//Initial variance chosen quite large to suppress motion during early background learning.
-                        }
-                    }
-                    
-                    //Zero the detection image.
-                    memset(_detectionImg, 0, componentsPerImage * sizeof(*_detectionImg));
-                    
-                    //Mark cells with detections.
-                    for (int y=0; y<height; ++y)
+                    imWriteDS->setMetadata(PassMetadataFunction_(imReadUS->metadata()));
+                }
+                
+                const bool expandToRGB=(_forceRGBOutput) && (!upStreamRGB);
+                const bool addOverlay=(frameMotion) && (_showOverlays);
+                
+                if ((!addOverlay) && (!expandToRGB))
+                {//Don't add motion overlay. Just copy the data from the input.
+                    memcpy(dataWriteDS, dataReadUS, bytesPerImage);
+                } else
+                {
+                    int y=0;
+#pragma omp parallel for
+                    for (y=0; y<height; ++y)
                     {
-                        const int lineOffset=y*width;
-                        const int lineOffsetB=(y&detectImgMask)*width;
+                        int const * const lineCount=detectionCountImg + (y >> detectBinShift)*binsPerLine;
                         
-                        for (int x=0; x<width; ++x)
-                        {
-                            const int offset=lineOffset + x;
-                            const int offsetB=lineOffsetB + (x&detectImgMask);
-                            
-                            const float mvMag=fabsf(float(dataReadUS[offset]) - _avrgImg[offset]) / sqrtf(_varImg[offset]);
+                        if (upStreamRGB)
+                        {//Upstream is RGB8; Downstream is RGB8. Tint the detection bins magenta.
+                            uint8_t const * const lineRead=dataReadUS + y*width*3;
+                            uint8_t * const lineWrite=dataWriteDS + y*width*3;
                             
-                            if (mvMag > _motionThreshold)
+                            for (int x=0; x<width; ++x)
                             {
-                                _detectionImg[offsetB]=1;
+                                const bool detection=(lineCount[x >> detectBinShift] > detectionThreshold);
+                                
+                                lineWrite[x*3+0]=detection ? ((lineRead[x*3+0]>>1)+128) : lineRead[x*3+0];
+                                lineWrite[x*3+1]=lineRead[x*3+1];
+                                lineWrite[x*3+2]=detection ? ((lineRead[x*3+2]>>1)+128) : lineRead[x*3+2];
                             }
-                        }
-                    }
-                    
-                    //Count detections over time.
-                    for (size_t i=0; i<componentsPerImage; ++i)
-                    {
-                        if (_detectionImg[i])
-                        {
-                            _detectionCountImg[i]=_detectionCountImg[i] + 1;
                         } else
-                        {
-                            _detectionCountImg[i]=0;//_detectionCountImg[i] - 1;
-                            //if (_detectionCountImg[i] < 0) _detectionCountImg[i]=0;
-                        }
-                    }
-                    
-                    //int64_t M=0;
-                    //for (int i=0; i<(width*height); ++i)
-                    //{
-                    //    M+=std::abs(currentFrame_[i] - previousFrame_[i]);
-                    //}
-                    const bool frameMotion = true;//(M / (width*height*0.001f) + 0.5f) > (motionThreshold_);
-                    
-                    
-                    if ((!_produceOnlyMotionImages) || frameMotion)
-                    {
-                        std::vector<Image**> imvWrite=reserveWriteSlot();
-                        
-                        Image * const imWriteDS = *(imvWrite[imgNum]);
-                        uint8_t * const dataWriteDS=(uint8_t * const)imWriteDS->data();
-
-                        // Pass the metadata from the read image to the write image.
-                        // By Default the base implementation will copy the pointer if no custom
-                        // pass function was set.
-                        if(PassMetadataFunction_ != nullptr)
-                        {
-                            imWriteDS->setMetadata(PassMetadataFunction_(imReadUS->metadata()));
-                        }
-                        
-                        if ((frameMotion) && (_showOverlays))
-                        {//Add motion blob overlay.
-                            
-                            if (_forceRGBOutput)
+                            if (expandToRGB)
                             {//Upstream is Y8; Downstream is expected to be RGB8
-                                for (int y=0; y<height; ++y)
+                                uint8_t const * const lineRead=dataReadUS + y*width;
+                                uint8_t * const lineWrite=dataWriteDS + y*width*3;
+                                
+                                for (int x=0; x<width; ++x)
                                 {
-                                    const int lineOffsetDS=y * (width*3);
-                                    
-                                    const int lineOffset=y * width;
-                                    const int lineOffsetB=(y&detectImgMask)*width;
+                                    const bool detection=(addOverlay) && (lineCount[x >> detectBinShift] > detectionThreshold);
+                                    const uint8_t c=detection ? ((lineRead[x]>>1)+128) : lineRead[x];
                                     
-                                    for (int x=0; x<width; ++x)
-                                    {
-                                        const int offsetDS=lineOffsetDS + x*3;
-                                        
-                                        const int offset=lineOffset + x;
-                                        const int offsetB=lineOffsetB + (x & detectImgMask);
-                                        
-                                        const uint8_t c=(_detectionCountImg[offsetB] > _detectionThreshold) ? ((dataReadUS[offset]>>1)+128) : dataReadUS[offset];
-                                        
-                                        dataWriteDS[offsetDS+0]=c;
-                                        dataWriteDS[offsetDS+1]=dataReadUS[offset];
-                                        dataWriteDS[offsetDS+2]=c;
-                                    }
+                                    lineWrite[x*3+0]=c;
+                                    lineWrite[x*3+1]=lineRead[x];
+                                    lineWrite[x*3+2]=c;
                                 }
                             } else
                             {//Upstream is Y8; Downstream is expected to be Y8.
-                                for (int y=0; y<height; ++y)
-                                {
-                                    const int lineOffset=y*width;
-                                    const int lineOffsetB=(y&detectImgMask)*width;
-                                    
-                                    for (int x=0; x<width; ++x)
-                                    {
-                                        const int offset=lineOffset + x;
-                                        const int offsetB=lineOffsetB + (x & detectImgMask);
-                                        
-                                        const uint8_t c=(_detectionCountImg[offsetB] > _detectionThreshold) ? ((dataReadUS[offset]>>1)+128) : dataReadUS[offset];
-                                        
-                                        dataWriteDS[offset]=c;
-                                    }
-                                }
-                            }
-                        } else
-                        {//Don't add motion overlay. Just copy the data from the input.
-                            if (_forceRGBOutput)
-                            {//Upstream is Y8; Downstream is expected to be RGB8
-                                for (int y=0; y<height; ++y)
+                                uint8_t const * const lineRead=dataReadUS + y*width;
+                                uint8_t * const lineWrite=dataWriteDS + y*width;
+                                
+                                for (int x=0; x<width; ++x)
                                 {
-                                    const int lineOffsetUS=y * width;
-                                    const int lineOffsetDS=y * (width*3);
+                                    const bool detection=(lineCount[x >> detectBinShift] > detectionThreshold);
                                     
-                                    for (int x=0; x<width; ++x)
-                                    {
-                                        const int offsetUS=lineOffsetUS + x;
-                                        const int offsetDS=lineOffsetDS + x*3;
-                                        
-                                        const uint8_t c = dataReadUS[offsetUS];
-                                        
-                                        dataWriteDS[offsetDS+0]=c;
-                                        dataWriteDS[offsetDS+1]=c;
-                                        dataWriteDS[offsetDS+2]=c;
-                                    }
+                                    lineWrite[x]=detection ? ((lineRead[x]>>1)+128) : lineRead[x];
                                 }
-                            } else
-                            {//Upstream is Y8; Downstream is expected to be Y8.
-                                memcpy(dataWriteDS, dataReadUS, bytesPerImage);
                             }
-                        }
-                        
-                        releaseWriteSlot();
                     }
                 }
-            
-            ++_frameCounter;
+                
+                releaseWriteSlot();
+            }
         }
         
+        ++_frameCounter;
+        
         //Stop stats measurement event.
         ProcessorStats_->tock();
         
@@ -325,4 +331,3 @@ bool FIPMotionDetect::trigger()
     
     return false;
 }
-
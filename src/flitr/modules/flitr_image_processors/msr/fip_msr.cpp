@@ -21,30 +21,77 @@
 #include <flitr/modules/flitr_image_processors/msr/fip_msr.h>
 #include <iostream>
 #include <algorithm>
+#include <limits>
 
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    /*! Global min/max of a single scale retinex image minus outliers, from its histogram. MUCH faster than local min/max window;
+     *  Global min/max means filter is not strictly local, but results still very good.*/
+    void ssrRange(std::vector<size_t> &histoBins, const size_t numHistoSamples, float &rmin, float &rmax)
+    {
+        rmin=-1.0f;
+        rmax=1.0f;
+        
+        //Remove outliers.
+        size_t lowerToRemove=numHistoSamples*0.0001f;
+        size_t lowerRemoved=0;
+        
+        for (int binNum=0; binNum<_histoBinArrSize; ++binNum)
+        {
+            const size_t removedFromThisBin=std::min(histoBins[binNum], lowerToRemove - lowerRemoved);
+            lowerRemoved+=removedFromThisBin;
+            histoBins[binNum]=0;
+            
+            if (lowerRemoved>=lowerToRemove) break;
+        }
+        
+        size_t upperToRemove=numHistoSamples*0.0001f;
+        size_t upperRemoved=0;
+        
+        for (int binNum=_histoBinArrSize-1; binNum>=0; --binNum)
+        {
+            const size_t removedFromThisBin=std::min(histoBins[binNum], upperToRemove - upperRemoved);
+            upperRemoved+=removedFromThisBin;
+            histoBins[binNum]=0;
+            
+            if (upperRemoved>=upperToRemove) break;
+        }
+        
+        
+        //Find min/max from histoBins.
+        for (int binNum=0; binNum<_histoBinArrSize; ++binNum)
+        {
+            if (histoBins[binNum])
+            {
+                rmin=(binNum/float(_histoBinArrSize))*2.0f-1.0f;
+                break;
+            }
+        }
+        for (int binNum=_histoBinArrSize-1; binNum>=0; --binNum)
+        {
+            if (histoBins[binNum])
+            {
+                rmax=((binNum+1)/float(_histoBinArrSize))*2.0f-1.0f;
+                break;
+            }
+        }
+    }
+}
+
 FIPMSR::FIPMSR(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                const FilterType filterType,
                uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 _enabled(true),
 _filterType(filterType),
-_GFXY(1.0, 4),
-_GFII(1),
-_GFRS(1),
+_Title(std::string("MSR")),
+_scaleSpace(GaussianScaleSpace::FilterType(filterType)),//The filter type values of FIPMSR and GaussianScaleSpace are the same.
 _GFScale(20),
 _numScales(3),
-_intensityScratchData(nullptr),
-_GFScratchData(nullptr),
-_MSRScratchData(nullptr),
-_floatScratchData(nullptr),
-_doubleScratchData1(nullptr),
-_doubleScratchData2(nullptr),
-_histoBins(nullptr),
-_triggerCount(0),
-_Title(std::string("MSR"))
+_triggerCount(0)
 {
     ProcessorStats_->setID("ImageProcessor::FIPMSR");
 
@@ -70,15 +117,6 @@ FIPMSR::~FIPMSR()
     // nothing. stopTriggerThread() will get called in the base destructor, but
     // at that time it might be too late.
     stopTriggerThread();
-    // Thread should be done, cleaning up can start. This might still be a problem
-    // if the application calls trigger() and not the triggerThread.
-    delete [] _intensityScratchData;
-    delete [] _GFScratchData;
-    delete [] _MSRScratchData;
-    delete [] _floatScratchData;
-    delete [] _doubleScratchData1;
-    delete [] _doubleScratchData2;
-    delete [] _histoBins;
 }
 
 bool FIPMSR::init()
@@ -100,25 +138,8 @@ bool FIPMSR::init()
         if (height>maxHeight) maxHeight=height;
     }
     
-    _intensityScratchData=new float[maxWidth*maxHeight];
-    memset(_intensityScratchData, 0, maxWidth*maxHeight*sizeof(float));
-    
-    _GFScratchData=new float[maxWidth*maxHeight];
-    memset(_GFScratchData, 0, maxWidth*maxHeight*sizeof(float));
-    
-    _MSRScratchData=new float[maxWidth*maxHeight];
-    memset(_MSRScratchData, 0, maxWidth*maxHeight*sizeof(float));
-    
-    _floatScratchData=new float[maxWidth*maxHeight];
-    memset(_floatScratchData, 0, maxWidth*maxHeight*sizeof(float));
-    
-    _doubleScratchData1=new double[maxWidth*maxHeight];
-    memset(_doubleScratchData1, 0, maxWidth*maxHeight*sizeof(double));
-    
-    _doubleScratchData2=new double[maxWidth*maxHeight];
-    memset(_doubleScratchData2, 0, maxWidth*maxHeight*sizeof(double));
-    
-    _histoBins=new size_t[_histoBinArrSize];
+    _intensityScratchData.assign(maxWidth*maxHeight, 0.0f);
+    _logIntensityScratchData.assign(maxWidth*maxHeight, 0.0f);
     
     return rValue;
 }
@@ -174,8 +195,9 @@ bool FIPMSR::trigger()
                     F32Image=dataRead;
                 } else
                 {//Convert input image to Y_F32 and store in pre-allocated F32Image.
-                    // #parallel
-                    for (size_t y=0; y<height; ++y)
+                    int64_t y=0;
+#pragma omp parallel for
+                    for (y=0; y<int64_t(height); ++y)
                     {
                         size_t readOffset=y*width*3;
                         size_t writeOffset=y*width;
@@ -188,209 +210,133 @@ bool FIPMSR::trigger()
                         }
                     }
 
-                    F32Image=_intensityScratchData;
+                    F32Image=_intensityScratchData.data();
                 }
                 //=== ===//
 
-
-
-                memset(_MSRScratchData, 0, width*height*sizeof(float));
-
-                const float recipNumScales=1.0f/_numScales;
+                const size_t numScales=_numScales;
+                const float recipNumScales=1.0f/numScales;
 
                 const float gain=3.0f;//Boosts image intensity.
                 const float chromatGain=2.5f;//Boosts colour.
                 const float blacknessFloor=2.5f/255.0f;//Limits the enhancement of low signal (black) areas.
-
-                for (size_t scaleIndex=0; scaleIndex<_numScales; ++scaleIndex)
+                
+                //log10(a)-log10(b) = (log2(a)-log2(b))*log10(2). The fast log2 is clamped to the smallest normal float so that zero pixels stay finite.
+                const float log2ToLog10Gain=0.301029996f * gain;
+                const float minNormal=std::numeric_limits<float>::min();
+                
+                
+                //=== Blur all the scales ===//
+                std::vector<size_t> kernelWidths(numScales);
+                for (size_t scaleIndex=0; scaleIndex<numScales; ++scaleIndex)
                 {
-                    const size_t kernelWidth=(imFormatUS.getWidth() / (_GFScale*(1 << scaleIndex))) | 1; // | 1 to make sure kernelWidth is odd.
-
-                    if (_filterType==FilterType::GausXY)
+                    kernelWidths[scaleIndex]=(width / (_GFScale*(1 << scaleIndex))) | 1; // | 1 to make sure kernelWidth is odd.
+                }
+                
+                _scaleSpace.setKernelWidths(kernelWidths);
+                _scaleSpace.build(F32Image, width, height);
+                
+                
+                //=== The log of the intensity is the same for all the scales ===//
+                float * const logIntensity=_logIntensityScratchData.data();
+                {
+                    int64_t i=0;
+#pragma omp parallel for
+                    for (i=0; i<int64_t(width*height); ++i)
                     {
-                        _GFXY.setKernelWidth(kernelWidth * 3.0f);
-                        _GFXY.setFilterRadius(kernelWidth*0.25f * 3.0f);
-
-                        // #parallel
-                        _GFXY.filter(_GFScratchData, F32Image, width, height, _floatScratchData);
-                    } else
-                        if (_filterType==FilterType::BoxII)
-                        {
-                            _GFII.setKernelWidth(kernelWidth);
-
-                            // #parallel
-                            _GFII.filter(_GFScratchData, F32Image, width, height,
-                                         _doubleScratchData1,
-                                         scaleIndex==0 ? true : false);
-
-                            //Approximate Gaussian filt kernel...
-                            for (int i=0; i<2; ++i)
-                            {
-                                // #parallel?
-                                memcpy(_floatScratchData, _GFScratchData, width*height*sizeof(float));
-
-                                // #parallel
-                                _GFII.filter(_GFScratchData, _floatScratchData, width, height,
-                                             _doubleScratchData2, true);
-                            }
-                        } else
-                            if (_filterType==FilterType::BoxRS)
-                            {
-                                _GFRS.setKernelWidth(kernelWidth);
-
-                                // #parallel
-                                _GFRS.filter(_GFScratchData, F32Image, width, height, _floatScratchData);
-
-                                //Approximate Gaussian filt kernel...
-                                for (int i=0; i<2; ++i)
-                                {
-                                    // #parallel?
-                                    memcpy(_floatScratchData, _GFScratchData, width*height*sizeof(float));
-
-                                    // #parallel
-                                    _GFRS.filter(_GFScratchData, _floatScratchData, width, height, _floatScratchData);
-                                }
-                            }
-
-                    //Calc SSR image...
+                        logIntensity[i]=approxLog2(std::max(F32Image[i], minNormal));
+                    }
+                }
+                
+                
+                //=== Calc SSR image and its histogram per scale ===//
+                _SSRScratchDataVec.resize(numScales);
+                _histoBinsVec.resize(numScales);
+                std::vector<float> ssrOffset(numScales);
+                std::vector<float> ssrScale(numScales);
+                
+                int64_t scaleIndex=0;
+#pragma omp parallel for schedule(dynamic)
+                for (scaleIndex=0; scaleIndex<int64_t(numScales); ++scaleIndex)
+                {
+                    std::vector<float> &SSRImage=_SSRScratchDataVec[scaleIndex];
+                    std::vector<size_t> &histoBins=_histoBinsVec[scaleIndex];
+                    float const * const GFImage=_scaleSpace.getScaleImage(scaleIndex);
+                    
+                    SSRImage.resize(width*height);
+                    histoBins.assign(_histoBinArrSize, 0);
+                    
+                    size_t numHistoSamples=0;
+                    
                     for (size_t y=0; y<height; ++y)
                     {
-                        size_t offset=y*width;
-
+                        const size_t offset=y*width;
+                        
                         for (size_t x=0; x<width; ++x)
                         {
-                            //const float r=(F32Image[offset] - _GFScratchData[offset]) * gain;
-                            const float r=(log10f(F32Image[offset]) - log10f(_GFScratchData[offset])) * gain;//log is faster than power/gamma tonemapping.
-                            //const float r=log10f(F32Image[offset]/_GFScratchData[offset]) * gain;//log is faster than power/gamma tonemapping.
-
-                            _floatScratchData[offset]=r;
-
-                            ++offset;
+                            SSRImage[offset+x]=(logIntensity[offset+x] - approxLog2(std::max(GFImage[offset+x], minNormal))) * log2ToLog10Gain;//log is faster than power/gamma tonemapping.
                         }
-                    }
-
-                    //=== Update MSR with global min/max minus outliers : MUCH faster than local min/max window; Global min/max means filter is not strictly local, but results still very good ===//
-                    float rmin=-1.0f;
-                    float rmax=1.0f;
-
-                    size_t numHistoSamples=0;
-                    memset(_histoBins, 0, _histoBinArrSize*sizeof(size_t));
-
-                    for (size_t y=height/4; y<(height*3)/4; ++y)
-                    {
-                        const size_t offset=y*width;
-
-                        for (size_t x=width/4; x<(width*3/4); ++x)
+                        
+                        //Histogram of the centre of the image.
+                        if ((y>=height/4) && (y<(height*3)/4))
                         {
-                            const float r=_floatScratchData[offset+x];
-
-                            const int histoBinNum=int(((r + 1.0f)*0.5f) * (_histoBinArrSize-1) + 0.5f);
-
-                            if ((histoBinNum>=0) && (histoBinNum<_histoBinArrSize))
+                            for (size_t x=width/4; x<(width*3/4); ++x)
                             {
-                                _histoBins[histoBinNum]=_histoBins[histoBinNum]+1;
+                                const float r=SSRImage[offset+x];
+                                
+                                const int histoBinNum=int(((r + 1.0f)*0.5f) * (_histoBinArrSize-1) + 0.5f);
+                                
+                                if ((histoBinNum>=0) && (histoBinNum<_histoBinArrSize))
+                                {
+                                    histoBins[histoBinNum]=histoBins[histoBinNum]+1;
+                                }
+                                
+                                ++numHistoSamples;
                             }
-
-                            ++numHistoSamples;
                         }
                     }
-
-                    //Remove outliers.
-                    size_t lowerToRemove=numHistoSamples*0.0001f;
-                    size_t lowerRemoved=0;
-
-                    for (int binNum=0; binNum<_histoBinArrSize; ++binNum)
-                    {
-                        const size_t removedFromThisBin=std::min(_histoBins[binNum], lowerToRemove - lowerRemoved);
-                        lowerRemoved+=removedFromThisBin;
-                        _histoBins[binNum]=0;
-
-                        if (lowerRemoved>=lowerToRemove) break;
-                    }
-
-                    size_t upperToRemove=numHistoSamples*0.0001f;
-                    size_t upperRemoved=0;
-
-                    for (int binNum=_histoBinArrSize-1; binNum>=0; --binNum)
-                    {
-                        const size_t removedFromThisBin=std::min(_histoBins[binNum], upperToRemove - upperRemoved);
-                        upperRemoved+=removedFromThisBin;
-                        _histoBins[binNum]=0;
-
-                        if (upperRemoved>=upperToRemove) break;
-                    }
-
-
-                    //Find min/max from histoBins_.
-                    for (int binNum=0; binNum<_histoBinArrSize; ++binNum)
-                    {
-                        if (_histoBins[binNum])
-                        {
-                            rmin=(binNum/float(_histoBinArrSize))*2.0f-1.0f;
-                            break;
-                        }
-                    }
-                    for (int binNum=_histoBinArrSize-1; binNum>=0; --binNum)
-                    {
-                        if (_histoBins[binNum])
-                        {
-                            rmax=((binNum+1)/float(_histoBinArrSize))*2.0f-1.0f;
-                            break;
-                        }
-                    }
-
-
+                    
+                    float rmin=-1.0f;
+                    float rmax=1.0f;
+                    ssrRange(histoBins, numHistoSamples, rmin, rmax);
+                    
                     const float recipRange=1.0f/(rmax - rmin);
-
-                    //Update MSR image...
-                    for (size_t y=0; y<height; ++y)
-                    {
-                        const size_t offset=y*width;
-
-                        for (size_t x=0; x<width; ++x)
-                        {
-                            const float r=(_floatScratchData[offset+x]-rmin) * (recipRange * recipNumScales);
-                            _MSRScratchData[offset+x]+=r;
-                        }
-                    }
-                    //=====================================================//
+                    
+                    ssrOffset[scaleIndex]=rmin;
+                    ssrScale[scaleIndex]=recipRange * recipNumScales;
                 }
-
-                //MSR cont.
-
-                if (imFormatUS.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
+                
+                
+                //=== Combine the scales into the MSR image and apply it to the output in one pass ===//
+                int64_t y=0;
+#pragma omp parallel for
+                for (y=0; y<int64_t(height); ++y)
                 {
-                    for (size_t y=0; y<height; ++y)
+                    const size_t intensityLineOffset=y*width;
+                    
+                    for (size_t x=0; x<width; ++x)
                     {
-                        size_t intensityOffset=y*width;
-                        size_t colourOffset=y*width*3;
-
-                        for (size_t x=0; x<width; ++x)
+                        const size_t intensityOffset=intensityLineOffset + x;
+                        
+                        float r=0.0f;
+                        for (size_t s=0; s<numScales; ++s)
                         {
-                            const float r=_MSRScratchData[intensityOffset];
-                            const float intInput=F32Image[intensityOffset];
+                            r+=(_SSRScratchDataVec[s][intensityOffset] - ssrOffset[s]) * ssrScale[s];
+                        }
+                        
+                        const float intInput=F32Image[intensityOffset];
+                        
+                        if (imFormatUS.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
+                        {
+                            const size_t colourOffset=intensityOffset*3;
                             const float recipIntInput=1.0f/(intInput+blacknessFloor);//Bias very dark colours more towards black...
-
+                            
                             dataWrite[colourOffset+0]=r * (dataRead[colourOffset+0]*recipIntInput) + (chromatGain) * (dataRead[colourOffset+0]-intInput);
                             dataWrite[colourOffset+1]=r * (dataRead[colourOffset+1]*recipIntInput) + (chromatGain) * (dataRead[colourOffset+1]-intInput);
                             dataWrite[colourOffset+2]=r * (dataRead[colourOffset+2]*recipIntInput) + (chromatGain) * (dataRead[colourOffset+2]-intInput);
-
-                            ++intensityOffset;
-                            colourOffset+=3;
-                        }
-                    }
-                } else
-                {
-                    for (size_t y=0; y<height; ++y)
-                    {
-                        const size_t offset=y*width;
-
-                        for (size_t x=0; x<width; ++x)
+                        } else
                         {
-                            const float r=_MSRScratchData[offset+x];
-                            const float intInput=F32Image[offset+x];
-
-                            dataWrite[offset+x]=r * (intInput/(intInput+blacknessFloor));//Bias very dark colours more towards black...
+                            dataWrite[intensityOffset]=r * (intInput/(intInput+blacknessFloor));//Bias very dark colours more towards black...
                         }
                     }
                 }
@@ -407,4 +353,3 @@ bool FIPMSR::trigger()
     }
     return false;
 }
-
@@ -51,9 +51,6 @@ FIPPhotometricEqualise::~FIPPhotometricEqualise()
     // nothing. stopTriggerThread() will get called in the base destructor, but
     // at that time it might be too late.
     stopTriggerThread();
-    // Thread should be done, cleaning up can start. This might still be a problem
-    // if the application calls trigger() and not the triggerThread.
-    delete [] lineSumArray_;
 }
 
 bool FIPPhotometricEqualise::init()
@@ -61,27 +58,6 @@ bool FIPPhotometricEqualise::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
-    size_t maxHeight=0;
-    
-    for (uint32_t i=0; i<ImagesPerSlot_; i++)
-    {
-        const ImageFormat imFormat=getUpstreamFormat(i);//Downstream format is same as upstream format.
-        //const ImageFormat::PixelFormat pixelFormat=imFormat.getPixelFormat();
-        
-        //const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
-        
-        //const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        //const size_t bytesPerPixel=imFormat.getBytesPerPixel();
-        
-        if (height>maxHeight)
-        {
-            maxHeight=height;
-        }
-    }
-    
-    lineSumArray_ = new double[maxHeight];
-    
     return rValue;
 }
 
@@ -117,18 +93,18 @@ bool FIPPhotometricEqualise::trigger()
             
             if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_UINT8)
             {
-                process((uint8_t * const )imWrite->data(), (uint8_t const * const)imRead->data(),
-                        componentsPerLine, height);
+                PhotometricEqualisation::equalise((uint8_t * const )imWrite->data(), (uint8_t const * const)imRead->data(),
+                                                  componentsPerLine, height, targetAverage_);
             } else
                 if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_UINT16)
                 {
-                    process((uint16_t * const )imWrite->data(), (uint16_t const * const)imRead->data(),
-                            componentsPerLine, height);
+                    PhotometricEqualisation::equalise((uint16_t * const )imWrite->data(), (uint16_t const * const)imRead->data(),
+                                                      componentsPerLine, height, targetAverage_);
                 } else
                     if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_FLOAT32)
                     {
-                        process((float * const )imWrite->data(), (float const * const)imRead->data(),
-                                componentsPerLine, height);
+                        PhotometricEqualisation::equalise((float * const )imWrite->data(), (float const * const)imRead->data(),
+                                                          componentsPerLine, height, targetAverage_);
                     }
         }
         
@@ -175,22 +151,6 @@ bool FIPLocalPhotometricEqualise::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
-    size_t maxDataValues=0;
-    
-    for (uint32_t i=0; i<ImagesPerSlot_; ++i)
-    {
-        const ImageFormat imFormat=getUpstreamFormat(i);//Downstream format is same as upstream format.
-        
-        const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
-        const size_t dataValues=imFormat.getComponentsPerPixel() * width * height;
-        
-        if (dataValues > maxDataValues) maxDataValues=dataValues;
-    }
-    
-    integralImageData_=new double[maxDataValues];
-    memset(integralImageData_, 0, maxDataValues*sizeof(double));
-    
     return rValue;
 }
 
@@ -209,45 +169,27 @@ bool FIPLocalPhotometricEqualise::trigger()
             Image * const imWriteDS = *(imvWrite[imgNum]);
             
             const ImageFormat imFormat=getUpstreamFormat(imgNum);//Downstream format is same as upstream format.
-            //const ImageFormat::PixelFormat pixelFormat=imFormat.getPixelFormat();
-            //const ImageFormat::DataType pixelDataType=imFormat.getDataType();
+            const ImageFormat::DataType pixelDataType=imFormat.getDataType();
             
             const size_t width=imFormat.getWidth();
             const size_t height=imFormat.getHeight();
-
+            const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
             
-            if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
+            if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_UINT8)
             {
-                float const * const dataReadUS=(float const * const)imReadUS->data();
-                float * const dataWriteDS=(float * const)imWriteDS->data();
-                
-                integralImage_.process(integralImageData_, dataReadUS, width, height);
-                this->process(dataWriteDS, dataReadUS, width, height);//Also accesses integralImageData_ member.
+                equalisation_.equaliseLocal((uint8_t * const)imWriteDS->data(), (uint8_t const * const)imReadUS->data(),
+                                            width, height, componentsPerPixel, windowSize_, targetAverage_);
             } else
-                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_8)
+                if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_UINT16)
                 {
-                    uint8_t const * const dataReadUS=(uint8_t const * const)imReadUS->data();
-                    uint8_t * const dataWriteDS=(uint8_t * const)imWriteDS->data();
-                    
-                    integralImage_.process(integralImageData_, dataReadUS, width, height);
-                    this->process(dataWriteDS, dataReadUS, width, height);//Also accesses integralImageData_ member.
+                    equalisation_.equaliseLocal((uint16_t * const)imWriteDS->data(), (uint16_t const * const)imReadUS->data(),
+                                                width, height, componentsPerPixel, windowSize_, targetAverage_);
                 } else
-                    if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
+                    if (pixelDataType==ImageFormat::DataType::FLITR_PIX_DT_FLOAT32)
                     {
-                        float const * const dataReadUS=(float const * const)imReadUS->data();
-                        float * const dataWriteDS=(float * const)imWriteDS->data();
-                        
-                        integralImage_.processRGB(integralImageData_, dataReadUS, width, height);
-                        this->processRGB(dataWriteDS, dataReadUS, width, height);//Also accesses integralImageData_ member.
-                    } else
-                        if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_8)
-                        {
-                            uint8_t const * const dataReadUS=(uint8_t const * const)imReadUS->data();
-                            uint8_t * const dataWriteDS=(uint8_t * const)imWriteDS->data();
-                            
-                            integralImage_.processRGB(integralImageData_, dataReadUS, width, height);
-                            this->processRGB(dataWriteDS, dataReadUS, width, height);//Also accesses integralImageData_ member.
-                        }
+                        equalisation_.equaliseLocal((float * const)imWriteDS->data(), (float const * const)imReadUS->data(),
+                                                    width, height, componentsPerPixel, windowSize_, targetAverage_);
+                    }
         }
         
         ++frameNumber_;
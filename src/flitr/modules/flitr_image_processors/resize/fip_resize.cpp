@@ -0,0 +1,141 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/resize/fip_resize.h>
+
+using namespace flitr;
+using std::shared_ptr;
+
+FIPResize::FIPResize(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                     const uint32_t widthDS, const uint32_t heightDS,
+                     const ImageResize::Method method,
+                     uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("Resize"),
+method_(method),
+imageResizeVec_(images_per_slot, ImageResize(method))
+{
+    ProcessorStats_->setID("ImageProcessor::FIPResize");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat imFormat=upStreamProducer.getFormat(i);//Output format is the input format at the new size.
+        imFormat.setWidth(std::max<uint32_t>(widthDS, 1));
+        imFormat.setHeight(std::max<uint32_t>(heightDS, 1));
+        
+        ImageFormat_.push_back(imFormat);
+    }
+}
+
+FIPResize::~FIPResize()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPResize::init()
+{
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat::PixelFormat pixelFormat=getUpstreamFormat(i).getPixelFormat();
+        
+        if ((pixelFormat==ImageFormat::FLITR_PIX_FMT_ANY) || (pixelFormat==ImageFormat::FLITR_PIX_FMT_UNDF))
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPResize needs a concrete upstream pixel format " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPResize::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        const ImageResize::Method method=method_;
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormatUS=getUpstreamFormat(imgNum);
+            const ImageFormat imFormatDS=getDownstreamFormat(imgNum);
+            const size_t widthUS=imFormatUS.getWidth();
+            const size_t heightUS=imFormatUS.getHeight();
+            const size_t widthDS=imFormatDS.getWidth();
+            const size_t heightDS=imFormatDS.getHeight();
+            const size_t componentsPerPixel=imFormatUS.getComponentsPerPixel();
+            
+            ImageResize &imageResize=imageResizeVec_[imgNum];
+            imageResize.setMethod(method);
+            
+            switch (imFormatUS.getDataType())
+            {
+                case ImageFormat::FLITR_PIX_DT_UINT8 :
+                    imageResize.resize((uint8_t *)imWrite->data(), widthDS, heightDS,
+                                       (uint8_t const *)imRead->data(), widthUS, heightUS, componentsPerPixel);
+                    break;
+                case ImageFormat::FLITR_PIX_DT_UINT16 :
+                    imageResize.resize((uint16_t *)imWrite->data(), widthDS, heightDS,
+                                       (uint16_t const *)imRead->data(), widthUS, heightUS, componentsPerPixel);
+                    break;
+                case ImageFormat::FLITR_PIX_DT_FLOAT32 :
+                    imageResize.resize((float *)imWrite->data(), widthDS, heightDS,
+                                       (float const *)imRead->data(), widthUS, heightUS, componentsPerPixel);
+                    break;
+            }
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
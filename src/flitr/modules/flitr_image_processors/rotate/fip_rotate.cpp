@@ -92,63 +92,25 @@ bool FIPRotate::trigger()
 
             const size_t bytesPerPixel=imFormatUS.getBytesPerPixel();
             
-            const size_t bytesPerPixelTimesWidthDS=bytesPerPixel * widthDS;
-
-            if (rotate90CountVect_[imgNum] == 0)
+            //Rotations by 90 and 270 degrees are cache blocked tile copies and 180 degrees is a reversed row copy in the affine transform engine.
+            AffineTransform rotateTransform;
+            
+            switch (rotate90CountVect_[imgNum])
             {
-                memcpy(dataWrite, dataRead, widthUS*heightUS*bytesPerPixel);
-            } else
-                if (rotate90CountVect_[imgNum] == 1)
-                {
-                    //=== Rotate by 90 deg ===//
-                    for (int y=0; y<heightUS; ++y)
-                    {
-                        int readOffset=(y*widthUS)*bytesPerPixel;
-                        int writeOffset=(widthDS-y-1)*bytesPerPixel;
-
-                        for (int x=0; x<widthUS; ++x)
-                        {
-                            memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                            readOffset+=bytesPerPixel;
-                            writeOffset+=bytesPerPixel*widthDS;
-                        }
-                    }
-                    //=======================//
-                } else
-                    if (rotate90CountVect_[imgNum] == 2)
-                    {
-                        //=== Rotate by 180 deg ===//
-                        for (int y=0; y<heightUS; ++y)
-                        {
-                            int readOffset=(y*widthUS)*bytesPerPixel;
-                            int writeOffset=((heightDS-y-1)*widthDS + widthDS-1)*bytesPerPixel;
-
-                            for (int x=0; x<widthUS; ++x)
-                            {
-                                memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                                readOffset+=bytesPerPixel;
-                                writeOffset-=bytesPerPixel;
-                            }
-                        }
-                        //=======================//
-                    } else
-                        if (rotate90CountVect_[imgNum] == 3)
-                        {
-                            //=== Rotate by 270 deg ===//
-                            for (int y=0; y<heightUS; ++y)
-                            {
-                                int readOffset=(y*widthUS)*bytesPerPixel;
-                                int writeOffset=((heightDS-1)*widthDS + y)*bytesPerPixel;
-
-                                for (int x=0; x<widthUS; ++x)
-                                {
-                                    memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                                    readOffset+=bytesPerPixel;
-                                    writeOffset-=bytesPerPixelTimesWidthDS;
-                                }
-                            }
-                            //=======================//
-                        }
+                case 1:
+                    rotateTransform.setMatrix(0.0f, 1.0f, -1.0f, 0.0f, 0.0f, float(widthDS-1));
+                    break;
+                case 2:
+                    rotateTransform.setMatrix(-1.0f, 0.0f, 0.0f, -1.0f, float(widthDS-1), float(heightDS-1));
+                    break;
+                case 3:
+                    rotateTransform.setMatrix(0.0f, -1.0f, 1.0f, 0.0f, float(heightDS-1), 0.0f);
+                    break;
+                default:
+                    break;
+            }
+            
+            rotateTransform.transformNearest(dataWrite, widthDS, heightDS, dataRead, widthUS, heightUS, bytesPerPixel);
         }
         
         
@@ -24,6 +24,8 @@
 #include <fstream>
 
 #include <math.h>
+#include <algorithm>
+#include <limits>
 
 
 
@@ -39,14 +41,18 @@ ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 Title_(std::string("LK Stabilise")),
 numLevels_(0), //Setup numLevels_ automatically in init().
 scratchData_(0),
+upStreamPyramid_(nullptr),
 outputMode_(outputMode),
 latestHx_(0.0),
 latestHy_(0.0),
 latestHFrameNumber_(0),
+hVectHistory_(HVectHistorySize, HVect{std::numeric_limits<size_t>::max(), 0.0f, 0.0f}),
 sumHx_(0.0f),
 sumHy_(0.0f),
 burnFx_(1.0f),
-burnFy_(1.0f)
+burnFy_(1.0f),
+convergenceThreshold_(0.001f),
+sparseCellSize_(0)
 {
     ProcessorStats_->setID("ImageProcessor::FIPLKStabilise");
     //Setup image format being produced to downstream.
@@ -57,6 +63,20 @@ burnFy_(1.0f)
     }
 }
 
+FIPLKStabilise::FIPLKStabilise(FIPImagePyramid& upStreamPyramid, uint32_t images_per_slot,
+                               Mode outputMode,
+                               uint32_t buffer_size) :
+FIPLKStabilise(static_cast<ImageProducer&>(upStreamPyramid), images_per_slot, outputMode, buffer_size)
+{
+    upStreamPyramid_=&upStreamPyramid;
+    
+    //The downstream images have the format of level 0 of the pyramids.
+    for (uint32_t i=0; i<images_per_slot; ++i)
+    {
+        ImageFormat_[i]=upStreamPyramid.getDownstreamFormat(upStreamPyramid.getImageIndex(i, 0));
+    }
+}
+
 FIPLKStabilise::~FIPLKStabilise()
 {
     // First stop the trigger thread. The stopTriggerThread() function will
@@ -86,8 +106,8 @@ FIPLKStabilise::~FIPLKStabilise()
         delete [] dyVec_.back();
         dyVec_.pop_back();
         
-        delete [] dSqRecipVec_.back();
-        dSqRecipVec_.pop_back();
+        delete [] gradientMaskVec_.back();
+        gradientMaskVec_.pop_back();
     }
 }
 
@@ -130,9 +150,12 @@ bool FIPLKStabilise::init()
             dyVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
             memset(dyVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
             
-            dSqRecipVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
-            memset(dSqRecipVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
+            gradientMaskVec_.push_back(new float[(croppedWidth>>levelNum) * (croppedHeight>>levelNum)]);
+            memset(gradientMaskVec_.back(), 0, (croppedWidth>>levelNum) * (croppedHeight>>levelNum) * sizeof(float));
         }
+        
+        sparseXVec_.resize(numLevels_);
+        sparseYVec_.resize(numLevels_);
     }
     
     return rValue;
@@ -202,7 +225,9 @@ bool FIPLKStabilise::trigger()
                 } else
                     if (imFormat.getPixelFormat()==flitr::ImageFormat::FLITR_PIX_FMT_RGB_F32)
                     {
-                        for (size_t y=startCroppedY; y<=endCroppedY; ++y)
+                        int64_t y=0;
+#pragma omp parallel for
+                        for (y=startCroppedY; y<=int64_t(endCroppedY); ++y)
                         {
                             const ptrdiff_t uncroppedLineOffset=(y*uncroppedWidth + startCroppedX)*3;
                             const ptrdiff_t croppedLineOffset=(y-startCroppedY)*croppedWidth;
@@ -216,6 +241,13 @@ bool FIPLKStabilise::trigger()
             }//=== ===
             
             
+            //The finest levels are not used to calculate the h-vector.
+            const ptrdiff_t levelsToSkip=1;
+            
+            
+            //The levels that are copied from the upstream pyramid instead of being filtered here.
+            const size_t numPyramidLevels=(upStreamPyramid_!=nullptr) ? std::min<size_t>(upStreamPyramid_->getNumLevels(), numLevels_) : 0;
+            
             {//=== Calculate scale space pyramid. ===
                 for (size_t levelNum=0; levelNum<numLevels_; ++levelNum)
                 {
@@ -227,6 +259,39 @@ bool FIPLKStabilise::trigger()
                     const ptrdiff_t levelWidthMinus3 = levelWidth - ((ptrdiff_t)3);
                     
                     //=== Calculate the scale space images ===
+                    if ((levelNum>0) && (levelNum<numPyramidLevels))
+                    {//=== Crop copy the level of the upstream pyramid ===
+                        {//Update ref img before new data arrives.
+                            memcpy(refImgVec_[levelNum], imgData, levelWidth*levelHeight*sizeof(float));
+                        }
+                        
+                        const size_t pyramidImgNum=upStreamPyramid_->getImageIndex(imgNum, levelNum);
+                        float const * const pyramidData=(float const *)(*(imvRead[pyramidImgNum]))->data();
+                        const ptrdiff_t pyramidWidth=getUpstreamFormat(pyramidImgNum).getWidth();
+                        
+                        //The crop offset is rounded to the level's pixels. The same offset is used for the reference image.
+                        const ptrdiff_t levelStartX=startCroppedX >> levelNum;
+                        const ptrdiff_t levelStartY=startCroppedY >> levelNum;
+                        
+                        if (imFormat.getPixelFormat()==flitr::ImageFormat::FLITR_PIX_FMT_Y_F32)
+                        {
+                            for (ptrdiff_t y=0; y<levelHeight; ++y)
+                            {
+                                memcpy(imgData + y*levelWidth, pyramidData + (y+levelStartY)*pyramidWidth + levelStartX, levelWidth*sizeof(float));
+                            }
+                        } else
+                        {
+                            for (ptrdiff_t y=0; y<levelHeight; ++y)
+                            {
+                                float const * const pyramidLine=pyramidData + ((y+levelStartY)*pyramidWidth + levelStartX)*3;
+                                
+                                for (ptrdiff_t x=0; x<levelWidth; ++x)
+                                {
+                                    imgData[y*levelWidth + x]=pyramidLine[x*3 + 1];//Use the green channel to stabilise!
+                                }
+                            }
+                        }
+                    } else
                     if (levelNum>0)//First level (incoming data) is not a downsampled image.
                     {
                         {//Update ref img before new data arrives.
@@ -238,7 +303,9 @@ bool FIPLKStabilise::trigger()
                         const ptrdiff_t widthHR=croppedWidth >> (levelNum-1);
                         
                         //=== Seperable Gaussian first pass - down filter x ===
-                        for (size_t y=0; y<heightHR; ++y)
+                        int64_t y=0;
+#pragma omp parallel for
+                        for (y=0; y<int64_t(heightHR); ++y)
                         {
                             const ptrdiff_t lineOffsetScratch=y * levelWidth;
                             const ptrdiff_t lineOffsetHR=y * widthHR;
@@ -272,7 +339,8 @@ bool FIPLKStabilise::trigger()
                         //=== ===
                         
                         //=== Seperable Gaussian second pass - down filter y===
-                        for (ptrdiff_t y=((ptrdiff_t)3); y<(levelHeight-((ptrdiff_t)3)); ++y)
+#pragma omp parallel for
+                        for (y=((ptrdiff_t)3); y<int64_t(levelHeight-((ptrdiff_t)3)); ++y)
                         {
                             const ptrdiff_t lineOffset=y * levelWidth;
                             const ptrdiff_t lineOffsetScratch=(y<<1) * levelWidth;
@@ -305,13 +373,20 @@ bool FIPLKStabilise::trigger()
                         //=== ===
                     }//=== ===
                     
+                    if (ptrdiff_t(levelNum)<levelsToSkip)
+                    {//No gradients needed.
+                        continue;
+                    }
+                    
                     
                     {//=== Calculate scale space gradient images ===
                         float * const dxData=dxVec_[levelNum];
                         float * const dyData=dyVec_[levelNum];
-                        float * const dSqRecipData=dSqRecipVec_[levelNum];
+                        float * const gradientMaskData=gradientMaskVec_[levelNum];
                         
-                        for (ptrdiff_t y=1; y<(levelHeight - ((ptrdiff_t)1)); ++y)
+                        int64_t y=0;
+#pragma omp parallel for
+                        for (y=1; y<int64_t(levelHeight - ((ptrdiff_t)1)); ++y)
                         {
                             const ptrdiff_t lineOffset=y*levelWidth;
                             
@@ -333,12 +408,87 @@ bool FIPLKStabilise::trigger()
                                 const float dx=(v3-v1)*(3.0f/32.0f) + (v6-v4)*(10.0f/32.0f) + (v9-v7)*(3.0f/32.0f);
                                 const float dy=(v7-v1)*(3.0f/32.0f) + (v8-v2)*(10.0f/32.0f) + (v9-v3)*(3.0f/32.0f);
                                 
-                                dxData[offset]=dx;
-                                dyData[offset]=dy;
-                                dSqRecipData[offset]=1.0f/(dx*dx+dy*dy+0.000000001f);
+                                const float dSqRecip=1.0f/(dx*dx+dy*dy+0.000000001f);
+                                
+                                //Only use pixels where the image gradient is above a certain limit. The calculation seems inaccurate anyway for small gradients...
+                                //The mask is folded into the weighted gradients so that the h-vector loops need no branch.
+                                const float gradientMask=(dSqRecip<(1.0f/0.0001f)) ? 1.0f : 0.0f;
+                                
+                                dxData[offset]=dx*dSqRecip*gradientMask;
+                                dyData[offset]=dy*dSqRecip*gradientMask;
+                                gradientMaskData[offset]=gradientMask;
                             }
                         }
                     }//=== ===
+                    
+                    
+                    {//=== Select the sparse grid of pixels with the strongest gradients ===
+                        std::vector<int32_t> &sparseX=sparseXVec_[levelNum];
+                        std::vector<int32_t> &sparseY=sparseYVec_[levelNum];
+                        
+                        const ptrdiff_t cellSize=sparseCellSize_;
+                        const ptrdiff_t numCellsX=(cellSize>0) ? ((levelWidth-2)/cellSize) : 0;
+                        const ptrdiff_t numCellsY=(cellSize>0) ? ((levelHeight-2)/cellSize) : 0;
+                        
+                        if ((numCellsX*numCellsY)>=256)
+                        {
+                            float const * const dxData=dxVec_[levelNum];
+                            float const * const dyData=dyVec_[levelNum];
+                            
+                            sparseX.resize(numCellsX*numCellsY);
+                            sparseY.resize(numCellsX*numCellsY);
+                            
+                            int64_t cellY=0;
+#pragma omp parallel for
+                            for (cellY=0; cellY<int64_t(numCellsY); ++cellY)
+                            {
+                                for (ptrdiff_t cellX=0; cellX<numCellsX; ++cellX)
+                                {
+                                    //|weighted gradient|^2 is 1/|gradient|^2, so the strongest gradient has the smallest value.
+                                    float bestValue=0.0f;
+                                    int32_t bestX=-1;
+                                    int32_t bestY=-1;
+                                    
+                                    for (ptrdiff_t y=1+cellY*cellSize; y<1+(cellY+1)*cellSize; ++y)
+                                    {
+                                        for (ptrdiff_t x=1+cellX*cellSize; x<1+(cellX+1)*cellSize; ++x)
+                                        {
+                                            const ptrdiff_t offset=y*levelWidth + x;
+                                            const float value=dxData[offset]*dxData[offset] + dyData[offset]*dyData[offset];
+                                            
+                                            if ((value>0.0f) && ((bestX==-1) || (value<bestValue)))
+                                            {
+                                                bestValue=value;
+                                                bestX=x;
+                                                bestY=y;
+                                            }
+                                        }
+                                    }
+                                    
+                                    sparseX[cellY*numCellsX + cellX]=bestX;
+                                    sparseY[cellY*numCellsX + cellX]=bestY;
+                                }
+                            }
+                            
+                            //Remove the cells without a usable gradient.
+                            size_t numSparse=0;
+                            for (size_t i=0; i<sparseX.size(); ++i)
+                            {
+                                if (sparseX[i]!=-1)
+                                {
+                                    sparseX[numSparse]=sparseX[i];
+                                    sparseY[numSparse]=sparseY[i];
+                                    ++numSparse;
+                                }
+                            }
+                            sparseX.resize(numSparse);
+                            sparseY.resize(numSparse);
+                        } else
+                        {//Dense.
+                            sparseX.clear();
+                            sparseY.clear();
+                        }
+                    }//=== ===
                 }
             }//=== ===
             
@@ -349,8 +499,6 @@ bool FIPLKStabilise::trigger()
             float Hx=0.0f;
             float Hy=0.0f;
             
-            const ptrdiff_t levelsToSkip=1;
-            
             for (ptrdiff_t levelNum=(numLevels_-1); levelNum>=levelsToSkip; --levelNum)
             {
                 Hx*=2.0f;
@@ -361,63 +509,107 @@ bool FIPLKStabilise::trigger()
                 
                 float const * const dxData=dxVec_[levelNum];
                 float const * const dyData=dyVec_[levelNum];
-                float const * const dSqRecipData=dSqRecipVec_[levelNum];
+                float const * const gradientMaskData=gradientMaskVec_[levelNum];
+                
+                std::vector<int32_t> const &sparseX=sparseXVec_[levelNum];
+                std::vector<int32_t> const &sparseY=sparseYVec_[levelNum];
+                const int64_t numSparse=sparseX.size();
                 
                 const ptrdiff_t levelWidth=(croppedWidth>>levelNum);
                 const ptrdiff_t levelHeight=(croppedHeight>>levelNum);
-                const ptrdiff_t levelWidthMinus1=levelWidth - ((ptrdiff_t)1);
                 
                 
                 for (size_t newtonRaphsonI=0; newtonRaphsonI<7; ++newtonRaphsonI)
                 {
                     float dHx=0.0f;
                     float dHy=0.0f;
-                    size_t hCount=0;
+                    float hCount=0.0f;
                     
-                    for (ptrdiff_t y=((ptrdiff_t)1); y<(levelHeight - ((ptrdiff_t)1)); ++y)
-                    {
-                        const ptrdiff_t lineOffset=y*levelWidth;
+                    //=== calc bilinear filter fractions ===//
+                    const float floor_hx=floorf(Hx);
+                    const float floor_hy=floorf(Hy);
+                    const ptrdiff_t int_hx=lroundf(floor_hx);
+                    const ptrdiff_t int_hy=lroundf(floor_hy);
+                    const float frac_hx=Hx - floor_hx;
+                    const float frac_hy=Hy - floor_hy;
+                    //=== ===//
+                    
+                    if (numSparse==0)
+                    {//Dense. The range of pixels whose shifted bilinear footprint is inside the reference image is calculated up front, so the inner loop has no branches and vectorises.
+                        const ptrdiff_t startX=std::max<ptrdiff_t>(1, 2-int_hx);
+                        const ptrdiff_t endX=std::min<ptrdiff_t>(levelWidth-1, levelWidth-2-int_hx);
+                        const ptrdiff_t startY=std::max<ptrdiff_t>(1, 2-int_hy);
+                        const ptrdiff_t endY=std::min<ptrdiff_t>(levelHeight-1, levelHeight-2-int_hy);
                         
-                        for (ptrdiff_t x=((ptrdiff_t)1); x<levelWidthMinus1; ++x)
+                        const ptrdiff_t shiftOffset=int_hx + int_hy * levelWidth;
+                        
+                        int64_t y=0;
+#pragma omp parallel for reduction(+:dHx,dHy,hCount)
+                        for (y=startY; y<int64_t(endY); ++y)
                         {
-                            const ptrdiff_t offset=lineOffset + x;
+                            const ptrdiff_t lineOffset=y*levelWidth;
                             
-                            const float dSqRecip=dSqRecipData[offset];
+                            float lineDHx=0.0f;
+                            float lineDHy=0.0f;
+                            float lineHCount=0.0f;
                             
-                            if (dSqRecip<(1.0f/0.0001f)) //Only do processing when the image gradient is above a certain limit. The calculation seems inaccurate anyway for small gradients...
+                            for (ptrdiff_t x=startX; x<endX; ++x)
                             {
-                                //=== calc bilinear filter fractions ===//
-                                const float floor_hx=floorf(Hx);
-                                const float floor_hy=floorf(Hy);
-                                const ptrdiff_t int_hx=lroundf(floor_hx);
-                                const ptrdiff_t int_hy=lroundf(floor_hy);
-                                const float frac_hx=Hx - floor_hx;
-                                const float frac_hy=Hy - floor_hy;
-                                //=== ===//
+                                const ptrdiff_t offset=lineOffset + x;
                                 
-                                if (((x+int_hx)>((ptrdiff_t)1))&&((y+int_hy)>((ptrdiff_t)1))&&
-                                    ((x+int_hx+((ptrdiff_t)2))<levelWidth)&&((y+int_hy+((ptrdiff_t)2))<levelHeight))
-                                {
-                                    const ptrdiff_t offsetLT=offset + int_hx + int_hy * levelWidth;
-                                    
-                                    //Moving&interpolating the reference image allows one to avoid having to bilinear filter the img gradients dx and dy!!!
-                                    const float imgRef=bilinear(refImgData, offsetLT, levelWidth, frac_hx, frac_hy);
-                                    
-                                    const float imgDiff=imgData[offset]-imgRef;
-                                    
-                                    dHx+=(imgDiff*dxData[offset])*dSqRecip;
-                                    dHy+=(imgDiff*dyData[offset])*dSqRecip;
-                                    ++hCount;
-                                }
+                                //Moving&interpolating the reference image allows one to avoid having to bilinear filter the img gradients dx and dy!!!
+                                const float imgRef=bilinear(refImgData, offset + shiftOffset, levelWidth, frac_hx, frac_hy);
+                                
+                                const float imgDiff=imgData[offset]-imgRef;
+                                
+                                lineDHx+=imgDiff*dxData[offset];
+                                lineDHy+=imgDiff*dyData[offset];
+                                lineHCount+=gradientMaskData[offset];
+                            }
+                            
+                            dHx+=lineDHx;
+                            dHy+=lineDHy;
+                            hCount+=lineHCount;
+                        }
+                    } else
+                    {//Sparse grid of high-gradient pixels.
+                        int64_t i=0;
+#pragma omp parallel for reduction(+:dHx,dHy,hCount)
+                        for (i=0; i<numSparse; ++i)
+                        {
+                            const ptrdiff_t x=sparseX[i];
+                            const ptrdiff_t y=sparseY[i];
+                            
+                            if (((x+int_hx)>((ptrdiff_t)1))&&((y+int_hy)>((ptrdiff_t)1))&&
+                                ((x+int_hx+((ptrdiff_t)2))<levelWidth)&&((y+int_hy+((ptrdiff_t)2))<levelHeight))
+                            {
+                                const ptrdiff_t offset=y*levelWidth + x;
+                                const ptrdiff_t offsetLT=offset + int_hx + int_hy * levelWidth;
+                                
+                                const float imgRef=bilinear(refImgData, offsetLT, levelWidth, frac_hx, frac_hy);
+                                
+                                const float imgDiff=imgData[offset]-imgRef;
+                                
+                                dHx+=imgDiff*dxData[offset];
+                                dHy+=imgDiff*dyData[offset];
+                                hCount+=1.0f;
                             }
                         }
                     }
                     
-                    if (hCount>0)
+                    if (hCount>0.0f)
                     {
                         const float recipHCount=1.0f/hCount;
-                        Hx+=dHx*recipHCount;
-                        Hy+=dHy*recipHCount;
+                        const float updateHx=dHx*recipHCount;
+                        const float updateHy=dHy*recipHCount;
+                        
+                        Hx+=updateHx;
+                        Hy+=updateHy;
+                        
+                        if ((fabsf(updateHx)<convergenceThreshold_)&&(fabsf(updateHy)<convergenceThreshold_))
+                        {//Converged on this level.
+                            break;
+                        }
                     }
                 }
             }
@@ -436,6 +628,8 @@ bool FIPLKStabilise::trigger()
                 latestHx_=Hx;
                 latestHy_=Hy;
                 latestHFrameNumber_=frameNumber_;
+                
+                hVectHistory_[frameNumber_ % HVectHistorySize]=HVect{frameNumber_, Hx, Hy};
             }
             
             
@@ -0,0 +1,333 @@
+/* Framework for Live Image Transformation (FLITr)
+ * Copyright (c) 2010 CSIR
+ *
+ * This file is part of FLITr.
+ *
+ * FLITr is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * FLITr is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FLITr. If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <flitr/modules/flitr_image_processors/temporal_denoise/fip_temporal_denoise.h>
+
+#include <cmath>
+
+using namespace flitr;
+using std::shared_ptr;
+
+namespace
+{
+    //!Blend weight ramp of the 8-bit accumulator. Differences are in 8.8 fixed point and weights in 0.8 fixed point.
+    struct BlendRamp8
+    {
+        int32_t low;
+        int32_t range;
+        int32_t stillWeight;
+        int32_t slopeQ16;
+    };
+    
+    //!Blend weight ramp of the float accumulator.
+    struct BlendRampF32
+    {
+        float low;
+        float range;
+        float stillWeight;
+        float slope;
+    };
+    
+    //!Blend a line of components into the accumulator. accumulatorRead may be equal to accumulatorWrite. Branch free so that it vectorises.
+    void blendLine(uint8_t * const dataWrite, uint16_t * const accumulatorWrite,
+                   uint8_t const * const dataRead, uint16_t const * const accumulatorRead,
+                   const size_t numComponents, const BlendRamp8 &ramp)
+    {
+        for (size_t i=0; i<numComponents; ++i)
+        {
+            int32_t accumulator=accumulatorRead[i];
+            const int32_t difference=(int32_t(dataRead[i]) << 8) - accumulator;
+            
+            const int32_t rampPosition=std::min(std::max(std::abs(difference) - ramp.low, 0), ramp.range);
+            const int32_t weight=ramp.stillWeight + ((rampPosition * ramp.slopeQ16) >> 16);
+            
+            accumulator+=(difference * weight + 128) >> 8;
+            
+            accumulatorWrite[i]=uint16_t(accumulator);
+            dataWrite[i]=uint8_t((accumulator + 128) >> 8);
+        }
+    }
+    
+    void blendLine(float * const dataWrite, float * const accumulatorWrite,
+                   float const * const dataRead, float const * const accumulatorRead,
+                   const size_t numComponents, const BlendRampF32 &ramp)
+    {
+        for (size_t i=0; i<numComponents; ++i)
+        {
+            float accumulator=accumulatorRead[i];
+            const float difference=dataRead[i] - accumulator;
+            
+            const float rampPosition=std::min(std::max(std::fabs(difference) - ramp.low, 0.0f), ramp.range);
+            const float weight=ramp.stillWeight + rampPosition * ramp.slope;
+            
+            accumulator+=difference * weight;
+            
+            accumulatorWrite[i]=accumulator;
+            dataWrite[i]=accumulator;
+        }
+    }
+    
+    //!Restart a line of the accumulator from the new frame.
+    void restartLine(uint8_t * const dataWrite, uint16_t * const accumulatorWrite,
+                     uint8_t const * const dataRead, const size_t numComponents)
+    {
+        for (size_t i=0; i<numComponents; ++i)
+        {
+            accumulatorWrite[i]=uint16_t(dataRead[i] << 8);
+        }
+        memcpy(dataWrite, dataRead, numComponents);
+    }
+    
+    void restartLine(float * const dataWrite, float * const accumulatorWrite,
+                     float const * const dataRead, const size_t numComponents)
+    {
+        memcpy(accumulatorWrite, dataRead, numComponents*sizeof(float));
+        memcpy(dataWrite, dataRead, numComponents*sizeof(float));
+    }
+    
+    /*!Blend a frame into the accumulator, which is moved by (shiftX, shiftY) whole pixels first. With a shift the moved
+     * accumulator is written to movedAccumulator, which the caller swaps with the accumulator.*/
+    template<typename T, typename AccumulatorT, typename RampT>
+    void blendFrame(T * const dataWrite, T const * const dataRead,
+                    std::vector<AccumulatorT> &accumulator, std::vector<AccumulatorT> &movedAccumulator,
+                    const ptrdiff_t width, const ptrdiff_t height, const ptrdiff_t componentsPerPixel,
+                    const ptrdiff_t shiftX, const ptrdiff_t shiftY, const bool restart, const RampT &ramp)
+    {
+        const bool moved=(shiftX!=0) || (shiftY!=0);
+        if (moved) movedAccumulator.resize(accumulator.size());
+        
+        AccumulatorT const * const accumulatorRead=accumulator.data();
+        AccumulatorT * const accumulatorWrite=moved ? movedAccumulator.data() : accumulator.data();
+        
+        const ptrdiff_t componentsPerLine=width*componentsPerPixel;
+        
+        //Pixels whose moved accumulator comes from inside the image.
+        const ptrdiff_t xStart=std::min<ptrdiff_t>(std::max<ptrdiff_t>(-shiftX, 0), width);
+        const ptrdiff_t xEnd=std::max<ptrdiff_t>(std::min<ptrdiff_t>(width - shiftX, width), xStart);
+        
+        const size_t numBands=getNumRowBands(size_t(height));
+        const ptrdiff_t bandHeight=ptrdiff_t((size_t(height) + numBands - 1) / numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const ptrdiff_t yEnd=std::min<ptrdiff_t>((bandNum+1) * bandHeight, height);
+            for (ptrdiff_t y=bandNum * bandHeight; y<yEnd; ++y)
+            {
+                const ptrdiff_t lineOffset=y*componentsPerLine;
+                T * const lineWrite=dataWrite + lineOffset;
+                T const * const lineRead=dataRead + lineOffset;
+                AccumulatorT * const lineAccumulatorWrite=accumulatorWrite + lineOffset;
+                
+                const ptrdiff_t ySource=y + shiftY;
+                
+                if (restart || (ySource<0) || (ySource>=height))
+                {
+                    restartLine(lineWrite, lineAccumulatorWrite, lineRead, size_t(componentsPerLine));
+                    continue;
+                }
+                
+                AccumulatorT const * const lineAccumulatorRead=accumulatorRead + ySource*componentsPerLine + shiftX*componentsPerPixel;
+                
+                const ptrdiff_t iStart=xStart*componentsPerPixel;
+                const ptrdiff_t iEnd=xEnd*componentsPerPixel;
+                
+                restartLine(lineWrite, lineAccumulatorWrite, lineRead, size_t(iStart));
+                blendLine(lineWrite + iStart, lineAccumulatorWrite + iStart,
+                          lineRead + iStart, lineAccumulatorRead + iStart,
+                          size_t(iEnd - iStart), ramp);
+                restartLine(lineWrite + iEnd, lineAccumulatorWrite + iEnd, lineRead + iEnd, size_t(componentsPerLine - iEnd));
+            }
+        }
+        
+        if (moved) accumulator.swap(movedAccumulator);
+    }
+}
+
+FIPTemporalDenoise::FIPTemporalDenoise(ImageProducer& upStreamProducer, uint32_t images_per_slot,
+                                       const float noiseLevel, const float motionThreshold, const float stillWeight,
+                                       uint32_t buffer_size) :
+ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
+title_("Temporal Denoise"),
+noiseLevel_(std::max<float>(noiseLevel, 0.0f)),
+motionThreshold_(std::max<float>(motionThreshold, 1.0f)),
+stillWeight_(std::min<float>(std::max<float>(stillWeight, 1.0f/256.0f), 1.0f)),
+resetRequested_(false),
+residualShiftX_(0.0f),
+residualShiftY_(0.0f),
+accumulator8Vec_(images_per_slot),
+movedAccumulator8Vec_(images_per_slot),
+accumulatorF32Vec_(images_per_slot),
+movedAccumulatorF32Vec_(images_per_slot),
+restartVec_(images_per_slot, true)
+{
+    ProcessorStats_->setID("ImageProcessor::FIPTemporalDenoise");
+    
+    //Setup image format being produced to downstream.
+    for (uint32_t i=0; i<images_per_slot; i++)
+    {
+        ImageFormat_.push_back(upStreamProducer.getFormat(i));//Output format is same as input format.
+    }
+}
+
+FIPTemporalDenoise::~FIPTemporalDenoise()
+{
+    // First stop the trigger thread. The stopTriggerThread() function will
+    // also wait for the thread to stop using the join() function.
+    // It is essential to wait for the thread to exit before starting
+    // to clean up otherwise if the thread is still in the trigger() function
+    // and cleaning up starts, the application will crash.
+    stopTriggerThread();
+}
+
+bool FIPTemporalDenoise::init()
+{
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat imFormat=getUpstreamFormat(i);
+        const ImageFormat::PixelFormat pixelFormat=imFormat.getPixelFormat();
+        const size_t componentsPerImage=size_t(imFormat.getWidth()) * imFormat.getHeight() * imFormat.getComponentsPerPixel();
+        
+        if ((pixelFormat==ImageFormat::FLITR_PIX_FMT_Y_8) || (pixelFormat==ImageFormat::FLITR_PIX_FMT_RGB_8))
+        {
+            accumulator8Vec_[i].assign(componentsPerImage, 0);
+        } else
+        if ((pixelFormat==ImageFormat::FLITR_PIX_FMT_Y_F32) || (pixelFormat==ImageFormat::FLITR_PIX_FMT_RGB_F32))
+        {
+            accumulatorF32Vec_[i].assign(componentsPerImage, 0.0f);
+        } else
+        {
+            logMessage(LOG_CRITICAL) << "Error: FIPTemporalDenoise only supports Y_8, RGB_8, Y_F32 and RGB_F32 input " << __FILE__ <<":"<<__LINE__<<".\n";
+            logMessage(LOG_CRITICAL).flush();
+            return false;
+        }
+        
+        restartVec_[i]=true;
+    }
+    
+    bool rValue=ImageProcessor::init();
+    //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
+    
+    return rValue;
+}
+
+bool FIPTemporalDenoise::trigger()
+{
+    if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
+    {//There are images to consume and the downstream producer has space to produce.
+        std::vector<Image**> imvRead=reserveReadSlot();
+        std::vector<Image**> imvWrite=reserveWriteSlot();
+        
+        //Start stats measurement event.
+        ProcessorStats_->tick();
+        
+        if (resetRequested_.exchange(false))
+        {
+            restartVec_.assign(ImagesPerSlot_, true);
+            residualShiftX_=0.0f;
+            residualShiftY_=0.0f;
+        }
+        
+        //Whole pixel global motion since the previous frame. The sub-pixel remainder is carried to the next frame, so
+        //that slow pans are compensated once they add up to half a pixel.
+        ptrdiff_t shiftX=0;
+        ptrdiff_t shiftY=0;
+        {
+            std::lock_guard<std::mutex> scopedLock(globalMotionSourceMutex_);
+            
+            float hx=0.0f;
+            float hy=0.0f;
+            
+            //Only the h-vector of this frame is used. It is missing if the source has not processed the frame yet.
+            if ((globalMotionSource_) && (globalMotionSource_->getHVect(frameNumber_, hx, hy)))
+            {
+                residualShiftX_+=hx;
+                residualShiftY_+=hy;
+                
+                shiftX=ptrdiff_t(lroundf(residualShiftX_));
+                shiftY=ptrdiff_t(lroundf(residualShiftY_));
+                
+                residualShiftX_-=float(shiftX);
+                residualShiftY_-=float(shiftY);
+            }
+        }
+        
+        const float noiseLevel=noiseLevel_;
+        const float motionThreshold=motionThreshold_;
+        const float stillWeight=stillWeight_;
+        
+        BlendRamp8 ramp8;
+        ramp8.low=int32_t(noiseLevel * 256.0f + 0.5f);
+        ramp8.range=std::max<int32_t>(int32_t((motionThreshold - 1.0f) * noiseLevel * 256.0f + 0.5f), 1);
+        ramp8.stillWeight=std::max<int32_t>(int32_t(stillWeight * 256.0f + 0.5f), 1);
+        ramp8.slopeQ16=((256 - ramp8.stillWeight) << 16) / ramp8.range;
+        
+        BlendRampF32 rampF32;
+        rampF32.low=noiseLevel * (1.0f/255.0f);
+        rampF32.range=std::max<float>((motionThreshold - 1.0f) * noiseLevel * (1.0f/255.0f), 1.0e-6f);
+        rampF32.stillWeight=stillWeight;
+        rampF32.slope=(1.0f - stillWeight) / rampF32.range;
+        
+        for (size_t imgNum=0; imgNum<ImagesPerSlot_; ++imgNum)
+        {
+            Image const * const imRead = *(imvRead[imgNum]);
+            Image * const imWrite = *(imvWrite[imgNum]);
+            
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
+            
+            const ImageFormat imFormat=getUpstreamFormat(imgNum);
+            const ptrdiff_t width=imFormat.getWidth();
+            const ptrdiff_t height=imFormat.getHeight();
+            const ptrdiff_t componentsPerPixel=imFormat.getComponentsPerPixel();
+            const bool restart=restartVec_[imgNum];
+            
+            if (imFormat.getDataType()==ImageFormat::FLITR_PIX_DT_FLOAT32)
+            {
+                blendFrame((float *)imWrite->data(), (float const *)imRead->data(),
+                           accumulatorF32Vec_[imgNum], movedAccumulatorF32Vec_[imgNum],
+                           width, height, componentsPerPixel, shiftX, shiftY, restart, rampF32);
+            } else
+            {
+                blendFrame(imWrite->data(), imRead->data(),
+                           accumulator8Vec_[imgNum], movedAccumulator8Vec_[imgNum],
+                           width, height, componentsPerPixel, shiftX, shiftY, restart, ramp8);
+            }
+            
+            restartVec_[imgNum]=false;
+        }
+        
+        //Stop stats measurement event.
+        ProcessorStats_->tock();
+        
+        releaseWriteSlot();
+        releaseReadSlot();
+        
+        return true;
+    }
+    
+    return false;
+}
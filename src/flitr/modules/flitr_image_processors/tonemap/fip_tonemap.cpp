@@ -27,7 +27,8 @@ FIPTonemap::FIPTonemap(ImageProducer& upStreamProducer, uint32_t images_per_slot
                        float power,
                        uint32_t buffer_size) :
     ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
-    power_(power)
+    power_(power),
+    toneCurve_(ToneCurveLUT::powerCurve(power))
 {
 
     //Setup image format being produced to downstream.
@@ -46,28 +47,39 @@ bool FIPTonemap::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
 
-    size_t maxHeight=0;
-
     for (uint32_t i=0; i<ImagesPerSlot_; i++)
     {
         const ImageFormat imFormat=getUpstreamFormat(i);//Downstream format is same as upstream format.
-        //const ImageFormat::PixelFormat pixelFormat=imFormat.getPixelFormat();
-
-        //const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
 
-        //const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        //const size_t bytesPerPixel=imFormat.getBytesPerPixel();
-
-        if (height>maxHeight)
+        switch (imFormat.getPixelFormat())
         {
-            maxHeight=height;
+            case ImageFormat::FLITR_PIX_FMT_Y_8:
+            case ImageFormat::FLITR_PIX_FMT_RGB_8:
+            case ImageFormat::FLITR_PIX_FMT_Y_16:
+            case ImageFormat::FLITR_PIX_FMT_Y_F32:
+            case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                break;
+            default:
+                logMessage(LOG_CRITICAL) << "FIPTonemap: Pixel format is not supported!" << __FILE__ << " " << __LINE__ << "\n";
+                rValue=false;
+                break;
         }
     }
 
     return rValue;
 }
 
+void FIPTonemap::setPower(const float power)
+{
+    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+
+    if (power!=power_)
+    {
+        power_=power;
+        toneCurve_.setCurve(ToneCurveLUT::powerCurve(power_));//The lookup tables are rebuilt lazily on the next trigger.
+    }
+}
+
 bool FIPTonemap::trigger()
 {
     if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
@@ -82,46 +94,31 @@ bool FIPTonemap::trigger()
         {
             const ImageFormat imFormat=getUpstreamFormat(imgNum);//Downstream format is same as upstream format.
 
-            const size_t width=imFormat.getWidth();
-            const size_t height=imFormat.getHeight();
-            const size_t bytesPerPixel=imFormat.getBytesPerPixel();
+            const size_t numComponents=imFormat.getWidth() * imFormat.getHeight() * imFormat.getComponentsPerPixel();
 
             Image const * const imRead = *(imvRead[imgNum]);
             Image * const imWrite = *(imvWrite[imgNum]);
 
-            if (imFormat.getPixelFormat()==flitr::ImageFormat::FLITR_PIX_FMT_Y_F32)
-            {//Image format float32.
-                float const * const dataRead=(float const * const)imRead->data();
-                float * const dataWrite=(float * const )imWrite->data();
-
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=y * width;
-
-                    for (size_t x=0; x<width; ++x)
-                    {
-                        dataWrite[lineOffset + x]=powf(dataRead[lineOffset + x], power_);
-                    }
-                }
-            } else
-            if (imFormat.getPixelFormat()==flitr::ImageFormat::FLITR_PIX_FMT_RGB_8)
-            {//Image format rgb8.
-                uint8_t const * const dataRead=(uint8_t const * const)imRead->data();
-                uint8_t * const dataWrite=(uint8_t * const )imWrite->data();
-
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=(y * width)*bytesPerPixel;
-                    size_t pixelOffset=0;
-
-                    for (size_t x=0; x<width; ++x)
-                    {
-                        dataWrite[lineOffset + pixelOffset + 0]=uint8_t(powf(float(dataRead[lineOffset + pixelOffset + 0])*(1.0f/255.0f), power_)*255.0f+0.5f);
-                        dataWrite[lineOffset + pixelOffset + 1]=uint8_t(powf(float(dataRead[lineOffset + pixelOffset + 1])*(1.0f/255.0f), power_)*255.0f+0.5f);
-                        dataWrite[lineOffset + pixelOffset + 2]=uint8_t(powf(float(dataRead[lineOffset + pixelOffset + 2])*(1.0f/255.0f), power_)*255.0f+0.5f);
-                        pixelOffset+=bytesPerPixel;
-                    }
-                }
+            switch (imFormat.getPixelFormat())
+            {
+                case ImageFormat::FLITR_PIX_FMT_Y_8:
+                case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                    toneCurve_.filter((uint8_t * const)imWrite->data(), (uint8_t const * const)imRead->data(), numComponents);
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_16:
+                    toneCurve_.filter((uint16_t * const)imWrite->data(), (uint16_t const * const)imRead->data(), numComponents);
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_F32:
+                case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                    ToneCurveLUT::power((float * const)imWrite->data(), (float const * const)imRead->data(), numComponents, power_);
+                    break;
+                default:
+                    break;
+            }
+
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
             }
         }
 
@@ -137,6 +134,3 @@ bool FIPTonemap::trigger()
 
     return false;
 }
-
-
-
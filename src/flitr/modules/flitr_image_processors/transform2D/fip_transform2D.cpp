@@ -27,7 +27,8 @@ FIPTransform2D::FIPTransform2D(ImageProducer& upStreamProducer, uint32_t images_
                                const std::vector<M2D> transformVect,
                                uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
-transformVect_(transformVect)
+transformVect_(transformVect),
+interpolation_(AffineTransform::Interpolation::NEAREST)
 {
     
     //Setup image format being produced to downstream.
@@ -47,9 +48,40 @@ bool FIPTransform2D::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
+    affineTransformVect_.resize(ImagesPerSlot_);
+    
+    for (uint32_t i=0; i<ImagesPerSlot_; i++)
+    {
+        const ImageFormat imFormatDS=getDownstreamFormat(i);
+        
+        const float halfWidthDS=imFormatDS.getWidth() * 0.5f;
+        const float halfHeightDS=imFormatDS.getHeight() * 0.5f;
+        
+        const M2D &transform=transformVect_[i];
+        
+        //The transform is applied about the image centre.
+        affineTransformVect_[i].setMatrix(transform.a_, transform.b_,
+                                          transform.c_, transform.d_,
+                                          halfWidthDS - transform.a_*halfWidthDS - transform.b_*halfHeightDS,
+                                          halfHeightDS - transform.c_*halfWidthDS - transform.d_*halfHeightDS);
+        affineTransformVect_[i].setInterpolation(interpolation_);
+    }
+    
     return rValue;
 }
 
+void FIPTransform2D::setInterpolation(const AffineTransform::Interpolation interpolation)
+{
+    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
+    
+    interpolation_=interpolation;
+    
+    for (AffineTransform &affineTransform : affineTransformVect_)
+    {
+        affineTransform.setInterpolation(interpolation_);
+    }
+}
+
 bool FIPTransform2D::trigger()
 {
     if ((getNumReadSlotsAvailable())&&(getNumWriteSlotsAvailable()))
@@ -65,41 +97,54 @@ bool FIPTransform2D::trigger()
             Image const * const imRead = *(imvRead[imgNum]);
             Image * const imWrite = *(imvWrite[imgNum]);
             
-            uint8_t const * const dataRead=(uint8_t const * const)imRead->data();
-            uint8_t * const dataWrite=(uint8_t * const )imWrite->data();
+            // Pass the metadata from the read image to the write image.
+            // By Default the base implementation will copy the pointer if no custom
+            // pass function was set.
+            if(PassMetadataFunction_ != nullptr)
+            {
+                imWrite->setMetadata(PassMetadataFunction_(imRead->metadata()));
+            }
             
             const ImageFormat imFormatUS=getUpstreamFormat(imgNum);
             const ImageFormat imFormatDS=getDownstreamFormat(imgNum);
             
-            const int widthUS=imFormatUS.getWidth();
-            //const int heightUS=imFormatUS.getHeight();
-            const int widthDS=imFormatDS.getWidth();
-            const int heightDS=imFormatDS.getHeight();
-            
-            const float halfWidthDS=widthDS * 0.5f;
-            const float halfHeightDS=heightDS * 0.5f;
+            const size_t widthUS=imFormatUS.getWidth();
+            const size_t heightUS=imFormatUS.getHeight();
+            const size_t widthDS=imFormatDS.getWidth();
+            const size_t heightDS=imFormatDS.getHeight();
             
-            const M2D transform=transformVect_[imgNum];
+            const size_t componentsPerPixel=imFormatUS.getComponentsPerPixel();
             
-            const int bytesPerPixel=imFormatUS.getBytesPerPixel();
+            const AffineTransform &affineTransform=affineTransformVect_[imgNum];
             
-            for (int y=0; y<heightDS; ++y)
+            switch (imFormatUS.getPixelFormat())
             {
-                int writeOffset=(y*widthDS)*bytesPerPixel;
-                
-                for (int x=0; x<widthDS; ++x)
-                {
-                    const float cx = x-halfWidthDS;
-                    const float cy = y-halfHeightDS;
-                    
-                    const float s=(cx*transform.a_) + (cy*transform.b_) + halfWidthDS;
-                    const float t=(cx*transform.c_) + (cy*transform.d_) + halfHeightDS;
-                    
-                    const int readOffset=(int(s+0.5f) + int(t+0.5f)*widthUS)*bytesPerPixel;
-                    
-                    memcpy(dataWrite+writeOffset, dataRead+readOffset, bytesPerPixel);
-                    writeOffset+=bytesPerPixel;
-                }
+                case ImageFormat::FLITR_PIX_FMT_Y_16:
+                    affineTransform.transform((uint16_t * const)imWrite->data(), widthDS, heightDS,
+                                              (uint16_t const * const)imRead->data(), widthUS, heightUS,
+                                              componentsPerPixel);
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_F32:
+                case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                    affineTransform.transform((float * const)imWrite->data(), widthDS, heightDS,
+                                              (float const * const)imRead->data(), widthUS, heightUS,
+                                              componentsPerPixel);
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_8:
+                case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                case ImageFormat::FLITR_PIX_FMT_BGR:
+                case ImageFormat::FLITR_PIX_FMT_BGRA:
+                case ImageFormat::FLITR_PIX_FMT_RGBA:
+                    affineTransform.transform((uint8_t * const)imWrite->data(), widthDS, heightDS,
+                                              (uint8_t const * const)imRead->data(), widthUS, heightUS,
+                                              componentsPerPixel);
+                    break;
+                default:
+                    //Unknown component type. Nearest neighbour sampling works for all pixel formats.
+                    affineTransform.transformNearest((uint8_t * const)imWrite->data(), widthDS, heightDS,
+                                                     (uint8_t const * const)imRead->data(), widthUS, heightUS,
+                                                     imFormatUS.getBytesPerPixel());
+                    break;
             }
         }
         
@@ -115,6 +160,3 @@ bool FIPTransform2D::trigger()
     
     return false;
 }
-
-
-
@@ -20,17 +20,267 @@
 
 #include <flitr/modules/flitr_image_processors/unsharp_mask/fip_unsharp_mask.h>
 
+#include <algorithm>
 
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    /*! The type that the two taps of a symmetric pair are added in before the multiply by their weight.
+     *  For the 8-bit formats the pair sums, the ring rows and the weights all fit in 16 bits, so that the
+     *  multiplies vectorise as 16x16->32 bit widening multiplies.*/
+    template<typename T> struct TapPairType { typedef T Type; };
+    template<> struct TapPairType<uint8_t> { typedef uint16_t Type; };
+    
+    /*! Symmetric kernel sum over tap lines: lineAcc = centre*k[0] + sum over o of (before(o) + after(o))*k[o].
+     *  The taps are taken two pairs per pass over the line to halve the accumulator loads and stores.*/
+    template<typename T, typename AccT, typename KernelT, typename TapLines>
+    inline void accumulateSymmetricTaps(AccT * __restrict lineAcc, const ptrdiff_t n,
+                                        KernelT const * __restrict halfKernel, const ptrdiff_t h,
+                                        const TapLines &tapLines)
+    {
+        typedef typename TapPairType<T>::Type PairT;
+        
+        T const * __restrict lineCentre=tapLines(0, 0);
+        
+        if (h==0)
+        {
+            for (ptrdiff_t i=0; i<n; ++i)
+            {
+                lineAcc[i]=AccT(lineCentre[i]) * AccT(halfKernel[0]);
+            }
+            return;
+        }
+        
+        {
+            T const * __restrict lineBefore=tapLines(1, -1);
+            T const * __restrict lineAfter=tapLines(1, 1);
+            const KernelT k0=halfKernel[0];
+            const KernelT k1=halfKernel[1];
+            
+            for (ptrdiff_t i=0; i<n; ++i)
+            {
+                lineAcc[i]=AccT(lineCentre[i]) * AccT(k0) + AccT(PairT(lineBefore[i] + lineAfter[i])) * AccT(k1);
+            }
+        }
+        
+        ptrdiff_t o=2;
+        for (; (o+1)<=h; o+=2)
+        {
+            T const * __restrict lineBeforeA=tapLines(o, -1);
+            T const * __restrict lineAfterA=tapLines(o, 1);
+            T const * __restrict lineBeforeB=tapLines(o+1, -1);
+            T const * __restrict lineAfterB=tapLines(o+1, 1);
+            const KernelT kA=halfKernel[o];
+            const KernelT kB=halfKernel[o+1];
+            
+            for (ptrdiff_t i=0; i<n; ++i)
+            {
+                lineAcc[i]+=AccT(PairT(lineBeforeA[i] + lineAfterA[i])) * AccT(kA) + AccT(PairT(lineBeforeB[i] + lineAfterB[i])) * AccT(kB);
+            }
+        }
+        
+        if (o<=h)
+        {
+            T const * __restrict lineBefore=tapLines(o, -1);
+            T const * __restrict lineAfter=tapLines(o, 1);
+            const KernelT k=halfKernel[o];
+            
+            for (ptrdiff_t i=0; i<n; ++i)
+            {
+                lineAcc[i]+=AccT(PairT(lineBefore[i] + lineAfter[i])) * AccT(k);
+            }
+        }
+    }
+    
+    //!Tap lines of a horizontal pass: the input line shifted by whole pixels.
+    template<typename T>
+    struct HorizontalTapLines
+    {
+        T const * const lineIn;
+        const ptrdiff_t tapStride;
+        
+        T const * operator()(const ptrdiff_t o, const ptrdiff_t side) const
+        {
+            return lineIn + side*o*tapStride;
+        }
+    };
+    
+    //!Tap lines of a vertical pass: the ring rows under the kernel, of which rows[h] is the centre row.
+    template<typename T>
+    struct VerticalTapLines
+    {
+        T const * const * const rows;
+        const ptrdiff_t h;
+        
+        T const * operator()(const ptrdiff_t o, const ptrdiff_t side) const
+        {
+            return rows[h + side*o];
+        }
+    };
+    
+    //!Horizontal Gaussian of the pixels [xStart,xEnd) of a line with the pixel coordinates clamped to the line.
+    template<typename T, typename AccT, typename KernelT>
+    inline void horizontalGaussianClamped(AccT * const lineAcc, T const * const lineIn,
+                                          const ptrdiff_t width, const ptrdiff_t c,
+                                          KernelT const * const halfKernel, const ptrdiff_t h,
+                                          const ptrdiff_t xStart, const ptrdiff_t xEnd)
+    {
+        for (ptrdiff_t x=xStart; x<xEnd; ++x)
+        {
+            for (ptrdiff_t i=0; i<c; ++i)
+            {
+                AccT sum=AccT(lineIn[x*c + i]) * AccT(halfKernel[0]);
+                
+                for (ptrdiff_t o=1; o<=h; ++o)
+                {
+                    const ptrdiff_t xLeft=std::max<ptrdiff_t>(x-o, 0);
+                    const ptrdiff_t xRight=std::min<ptrdiff_t>(x+o, width-1);
+                    sum+=(AccT(lineIn[xLeft*c + i]) + AccT(lineIn[xRight*c + i])) * AccT(halfKernel[o]);
+                }
+                
+                lineAcc[x*c + i]=sum;
+            }
+        }
+    }
+    
+    //!Horizontal Gaussian of one line. Only the pixels within half a kernel of the line ends need clamping.
+    template<typename T, typename AccT, typename KernelT>
+    inline void horizontalGaussian(AccT * const lineAcc, T const * const lineIn,
+                                   const ptrdiff_t width, const ptrdiff_t componentsPerPixel,
+                                   KernelT const * const halfKernel, const ptrdiff_t h)
+    {
+        const ptrdiff_t c=componentsPerPixel;
+        const ptrdiff_t interiorStart=std::min(h, width);
+        const ptrdiff_t interiorEnd=std::max(interiorStart, width-h);
+        
+        const HorizontalTapLines<T> tapLines={lineIn + interiorStart*c, c};
+        accumulateSymmetricTaps<T>(lineAcc + interiorStart*c, (interiorEnd-interiorStart)*c, halfKernel, h, tapLines);
+        
+        horizontalGaussianClamped(lineAcc, lineIn, width, c, halfKernel, h, 0, interiorStart);
+        horizontalGaussianClamped(lineAcc, lineIn, width, c, halfKernel, h, interiorEnd, width);
+    }
+    
+    //!Horizontal pass of one float input line into a ring row.
+    inline void horizontalRow(float * const ringRow, float * const /*lineAcc*/, float const * const lineIn,
+                              const ptrdiff_t width, const ptrdiff_t componentsPerPixel,
+                              float const * const halfKernel, const ptrdiff_t h)
+    {
+        horizontalGaussian(ringRow, lineIn, width, componentsPerPixel, halfKernel, h);
+    }
+    
+    //!Horizontal pass of one 8-bit input line into a ring row in Q7 fixed point.
+    inline void horizontalRow(uint16_t * __restrict ringRow, int32_t * __restrict lineAcc, uint8_t const * const lineIn,
+                              const ptrdiff_t width, const ptrdiff_t componentsPerPixel,
+                              uint16_t const * const halfKernel, const ptrdiff_t h)
+    {
+        horizontalGaussian(lineAcc, lineIn, width, componentsPerPixel, halfKernel, h);
+        
+        const ptrdiff_t n=width*componentsPerPixel;
+        for (ptrdiff_t i=0; i<n; ++i)
+        {//Q14 kernel sum of 8-bit values to Q7, so that the sum of two ring values still fits in 16 bits.
+            ringRow[i]=uint16_t((lineAcc[i] + 64) >> 7);
+        }
+    }
+    
+    //!Vertical pass fused with the sharpening: lineWrite = lineRead + gain*(lineRead - blur).
+    inline void sharpenRow(float * __restrict lineWrite, float const * __restrict lineRead,
+                           float const * const * const rows, float * __restrict lineAcc,
+                           const ptrdiff_t n, float const * const halfKernel, const ptrdiff_t h,
+                           const float gain)
+    {
+        const VerticalTapLines<float> tapLines={rows, h};
+        accumulateSymmetricTaps<float>(lineAcc, n, halfKernel, h, tapLines);
+        
+        for (ptrdiff_t i=0; i<n; ++i)
+        {
+            const float inputValue=lineRead[i];
+            lineWrite[i]=(inputValue - lineAcc[i])*gain + inputValue;
+        }
+    }
+    
+    //!Vertical pass fused with the sharpening in fixed point. The ring rows are Q7, the kernel Q14 and the gain Q8.
+    inline void sharpenRow(uint8_t * __restrict lineWrite, uint8_t const * __restrict lineRead,
+                           uint16_t const * const * const rows, int32_t * __restrict lineAcc,
+                           const ptrdiff_t n, uint16_t const * const halfKernel, const ptrdiff_t h,
+                           const int32_t gainQ8)
+    {
+        const VerticalTapLines<uint16_t> tapLines={rows, h};
+        accumulateSymmetricTaps<uint16_t>(lineAcc, n, halfKernel, h, tapLines);
+        
+        for (ptrdiff_t i=0; i<n; ++i)
+        {
+            const int32_t inputValue=lineRead[i];
+            const int32_t blurQ7=(lineAcc[i] + 8192) >> 14;
+            const int32_t value=((inputValue << 15) + ((inputValue << 7) - blurQ7)*gainQ8 + 16384) >> 15;
+            lineWrite[i]=uint8_t(std::min<int32_t>(std::max<int32_t>(value, 0), 255));
+        }
+    }
+    
+    /*! Unsharp mask streamed over row bands. Each band keeps the horizontally filtered rows under the vertical kernel
+     *  in a ring of kernelWidth rows and produces one output row per new input row.*/
+    template<typename T, typename RowT, typename AccT, typename KernelT>
+    void unsharpMask(T * const dataWriteDS, T const * const dataReadUS,
+                     const ptrdiff_t width, const ptrdiff_t height, const ptrdiff_t componentsPerPixel,
+                     std::vector<KernelT> const &halfKernel, const AccT gain,
+                     std::vector<std::vector<RowT> > &bandRows, std::vector<std::vector<AccT> > &bandAccum)
+    {
+        const ptrdiff_t h=ptrdiff_t(halfKernel.size()) - 1;
+        const ptrdiff_t kernelWidth=2*h + 1;
+        const ptrdiff_t n=width*componentsPerPixel;
+        const size_t numBands=getNumRowBands(height);
+        
+        if (bandRows.size()<numBands) bandRows.resize(numBands);
+        if (bandAccum.size()<numBands) bandAccum.resize(numBands);
+        for (size_t bandNum=0; bandNum<numBands; ++bandNum)
+        {
+            if (bandRows[bandNum].size()<size_t(kernelWidth*n)) bandRows[bandNum].resize(kernelWidth*n);
+            if (bandAccum[bandNum].size()<size_t(n)) bandAccum[bandNum].resize(n);
+        }
+        
+        const ptrdiff_t bandHeight=ptrdiff_t((height + numBands - 1) / numBands);
+        
+        int32_t bandNum=0;
+#pragma omp parallel for
+        for (bandNum=0; bandNum<int32_t(numBands); ++bandNum)
+        {
+            const ptrdiff_t yStart=bandNum * bandHeight;
+            const ptrdiff_t yEnd=std::min(yStart + bandHeight, height);
+            
+            RowT * const ring=bandRows[bandNum].data();
+            AccT * const lineAcc=bandAccum[bandNum].data();
+            std::vector<RowT const *> rows(kernelWidth);
+            
+            //Ring row r holds the horizontal pass of input row clamp(r), so that the vertical kernel is clamped at the top and bottom.
+            for (ptrdiff_t r=yStart-h; r<yEnd+h; ++r)
+            {
+                const ptrdiff_t yRead=std::min(std::max<ptrdiff_t>(r, 0), height-1);
+                horizontalRow(ring + ((r - yStart + kernelWidth) % kernelWidth)*n, lineAcc,
+                              dataReadUS + yRead*n, width, componentsPerPixel, halfKernel.data(), h);
+                
+                const ptrdiff_t y=r-h;
+                if (y<yStart) continue;
+                
+                for (ptrdiff_t j=0; j<kernelWidth; ++j)
+                {
+                    rows[j]=ring + ((y - h + j - yStart + kernelWidth) % kernelWidth)*n;
+                }
+                
+                sharpenRow(dataWriteDS + y*n, dataReadUS + y*n, rows.data(), lineAcc, n, halfKernel.data(), h, gain);
+            }
+        }
+    }
+}
+
 FIPUnsharpMask::FIPUnsharpMask(ImageProducer& upStreamProducer, uint32_t images_per_slot,
                                const float gain,
                                const float filterRadius,
                                uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 gain_(gain),
-gaussianFilter_(filterRadius, int(ceilf(filterRadius*2.0f+0.5)+0.5)*2 - 1)//Filter size includes 2xradius to each side.
+filterRadius_(filterRadius),
+kernelRadius_(-1.0f)
 {
     
     ProcessorStats_->setID("ImageProcessor::FIPUnsharpMask");
@@ -54,10 +304,6 @@ FIPUnsharpMask::~FIPUnsharpMask()
     // nothing. stopTriggerThread() will get called in the base destructor, but
     // at that time it might be too late.
     stopTriggerThread();
-    // Thread should be done, cleaning up can start. This might still be a problem
-    // if the application calls trigger() and not the triggerThread.
-    delete [] xFiltData_;
-    delete [] filtData_;
 }
 
 bool FIPUnsharpMask::init()
@@ -65,30 +311,33 @@ bool FIPUnsharpMask::init()
     bool rValue=ImageProcessor::init();
     //Note: SharedImageBuffer of downstream producer is initialised with storage in ImageProcessor::init.
     
-    size_t maxXFiltDataSize=0;
+    //The per band scratch is sized on the first trigger, because it depends on the filter radius.
     
-    for (uint32_t i=0; i<ImagesPerSlot_; i++)
-    {
-        const ImageFormat imFormat=getUpstreamFormat(i);
-        
-        const size_t width=imFormat.getWidth();
-        const size_t height=imFormat.getHeight();
-        
-        const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
-        
-        const size_t xFiltDataSize = width*height*componentsPerPixel;
-        
-        if (xFiltDataSize>maxXFiltDataSize)
-        {
-            maxXFiltDataSize=xFiltDataSize;
-        }
-    }
+    return rValue;
+}
+
+void FIPUnsharpMask::updateKernel(const float filterRadius)
+{
+    if (filterRadius==kernelRadius_) return;
+    kernelRadius_=filterRadius;
     
-    //Allocate a buffer big enough for any of the image slots.
-    xFiltData_=new float[maxXFiltDataSize*3];
-    filtData_=new float[maxXFiltDataSize*3];
+    const size_t kernelWidth=size_t(int(ceilf(filterRadius*2.0f+0.5)+0.5)*2 - 1) | 1;//Filter size includes 2xradius to each side.
+    const size_t h=kernelWidth>>1;
     
-    return rValue;
+    std::vector<float> kernel1D(kernelWidth);
+    GaussianFilter::computeKernel1D(kernel1D.data(), filterRadius, kernelWidth);
+    
+    kernelF32_.assign(kernel1D.begin()+h, kernel1D.end());
+    
+    //Round the taps to Q14 and put the rounding error into the centre tap, so that the fixed point kernel sums to exactly one.
+    kernelQ14_.resize(h+1);
+    int32_t kernelSum=0;
+    for (size_t o=0; o<=h; ++o)
+    {
+        kernelQ14_[o]=uint16_t(kernelF32_[o]*16384.0f + 0.5f);
+        kernelSum+=(o==0) ? kernelQ14_[o] : 2*kernelQ14_[o];
+    }
+    kernelQ14_[0]=uint16_t(kernelQ14_[0] + (16384 - kernelSum));
 }
 
 bool FIPUnsharpMask::trigger()
@@ -102,6 +351,13 @@ bool FIPUnsharpMask::trigger()
         //Start stats measurement event.
         ProcessorStats_->tick();
         
+        //Read the parameters once, because they may be changed from another thread.
+        const float gain=gain_;
+        updateKernel(filterRadius_);
+        
+        //The 8-bit path is Q8 fixed point. The gain is limited so that the sharpening term does not overflow 32 bits.
+        const int32_t gainQ8=int32_t(std::min(std::max(gain, -64.0f), 64.0f)*256.0f + ((gain<0.0f) ? -0.5f : 0.5f));
+        
         for (size_t imgNum=0; imgNum<ImagesPerSlot_; imgNum++)
         {
             Image const * const imReadUS = *(imvRead[imgNum]);
@@ -119,55 +375,25 @@ bool FIPUnsharpMask::trigger()
             
             const size_t width=imFormat.getWidth();
             const size_t height=imFormat.getHeight();
+            const size_t componentsPerPixel=imFormat.getComponentsPerPixel();
             
-            if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_Y_F32)
+            switch (imFormat.getPixelFormat())
             {
-                float const * const dataReadUS=(float const * const)imReadUS->data();
-                float * const dataWriteDS=(float * const)imWriteDS->data();
-                
-                gaussianFilter_.filter(filtData_, dataReadUS, width, height, xFiltData_);
-                
-                for (size_t y=0; y<height; ++y)
-                {
-                    const size_t lineOffset=y*width;
-                    
-                    for (size_t x=0; x<width; ++x)
-                    {
-                        const float filtValue=filtData_[lineOffset+x];
-                        const float inputValue=dataReadUS[lineOffset+x];
-                        
-                        dataWriteDS[lineOffset+x]=(inputValue-filtValue)*gain_ + inputValue;
-                    }
-                }
-            } else
-                if (imFormat.getPixelFormat()==ImageFormat::FLITR_PIX_FMT_RGB_F32)
-                {
-                    float const * const dataReadUS=(float const * const)imReadUS->data();
-                    float * const dataWriteDS=(float * const)imWriteDS->data();
-                    
-                    gaussianFilter_.filterRGB(filtData_, dataReadUS, width, height, xFiltData_);
-                    
-                    for (size_t y=0; y<height; ++y)
-                    {
-                        const size_t lineOffset=y*width*3;
-                        
-                        for (size_t x=0; x<width; ++x)
-                        {
-                            const float filtValueR=filtData_[lineOffset+x*3 + 0]; //x*3 only calculated once when compiler optimisations enabled.
-                            const float inputValueR=dataReadUS[lineOffset+x*3 + 0];
-                            
-                            const float filtValueG=filtData_[lineOffset+x*3 + 1];
-                            const float inputValueG=dataReadUS[lineOffset+x*3 + 1];
-                            
-                            const float filtValueB=filtData_[lineOffset+x*3 + 2];
-                            const float inputValueB=dataReadUS[lineOffset+x*3 + 2];
-                            
-                            dataWriteDS[lineOffset + x*3 + 0] = (inputValueR-filtValueR)*gain_ + inputValueR;
-                            dataWriteDS[lineOffset + x*3 + 1] = (inputValueG-filtValueG)*gain_ + inputValueG;
-                            dataWriteDS[lineOffset + x*3 + 2] = (inputValueB-filtValueB)*gain_ + inputValueB;
-                        }
-                    }
-                }
+                case ImageFormat::FLITR_PIX_FMT_Y_F32:
+                case ImageFormat::FLITR_PIX_FMT_RGB_F32:
+                    unsharpMask((float *)imWriteDS->data(), (float const *)imReadUS->data(),
+                                width, height, componentsPerPixel,
+                                kernelF32_, gain, bandRowsF32_, bandAccumF32_);
+                    break;
+                case ImageFormat::FLITR_PIX_FMT_Y_8:
+                case ImageFormat::FLITR_PIX_FMT_RGB_8:
+                    unsharpMask((uint8_t *)imWriteDS->data(), (uint8_t const *)imReadUS->data(),
+                                width, height, componentsPerPixel,
+                                kernelQ14_, gainQ8, bandRows16_, bandAccum32_);
+                    break;
+                default:
+                    break;
+            }
         }
         
         //Stop stats measurement event.
@@ -184,8 +410,6 @@ bool FIPUnsharpMask::trigger()
 
 void FIPUnsharpMask::setGain(const float gain)
 {
-    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
-    
     gain_ = gain;
 }
 
@@ -196,13 +420,10 @@ float FIPUnsharpMask::getGain() const
 
 void FIPUnsharpMask::setFilterRadius(const float filterRadius)
 {
-    std::lock_guard<std::mutex> scopedLock(triggerMutex_);
-    
-    gaussianFilter_.setFilterRadius(filterRadius);
+    filterRadius_ = filterRadius;
 }
 
 float FIPUnsharpMask::getFilterRadius() const
 {
-    return gaussianFilter_.getFilterRadius();
+    return filterRadius_;
 }
-
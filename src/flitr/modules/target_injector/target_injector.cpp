@@ -23,12 +23,180 @@
 using namespace flitr;
 using std::shared_ptr;
 
+namespace
+{
+    //!Number of subpixel samples along each axis in SyntheticTarget::getSupportDensity.
+    const int32_t SubpixelSamples=10;
+    const float SubpixelSize=0.1f;
+    
+    //!Samples smaller than this are negligible. Away from its peak a row of samples only decreases.
+    const float NegligibleSample=1.0e-10f;
+    
+    //!Blends the target brightness into the pixels of [x0,x1) x [y0,y1) according to their transmission.
+    void blendTile(const ImageFormat::PixelFormat pixelFormat, const float targetBrightness,
+                   uint8_t const * const dataRead, uint8_t * const dataWrite,
+                   float const * const transmission,
+                   const uint32_t width, const uint32_t bytesPerPixel,
+                   const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1)
+    {
+        for (int32_t y=y0; y<y1; ++y)
+        {
+            float const * const transmissionLine=transmission + y * width;
+            
+            for (int32_t x=x0; x<x1; ++x)
+            {
+                const float t=transmissionLine[x];
+                const float d=1.0f - t;
+                const size_t offset=(y * width + x) * bytesPerPixel;
+                
+                switch (pixelFormat)
+                {
+                    case ImageFormat::FLITR_PIX_FMT_Y_8 :
+                        dataWrite[offset]=(uint8_t)(dataRead[offset]*t+targetBrightness*d+0.5f);
+                        break;
+                    case ImageFormat::FLITR_PIX_FMT_RGB_8 :
+                    case ImageFormat::FLITR_PIX_FMT_BGR :
+                    case ImageFormat::FLITR_PIX_FMT_BGRA :
+                    case ImageFormat::FLITR_PIX_FMT_RGBA :
+                        //The alpha channel is left as is.
+                        dataWrite[offset]=(uint8_t)(dataRead[offset]*t+targetBrightness*d+0.5f);
+                        dataWrite[offset+1]=(uint8_t)(dataRead[offset+1]*t+targetBrightness*d+0.5f);
+                        dataWrite[offset+2]=(uint8_t)(dataRead[offset+2]*t+targetBrightness*d+0.5f);
+                        break;
+                    case ImageFormat::FLITR_PIX_FMT_Y_16 :
+                        *((uint16_t *)(dataWrite+offset))=(uint16_t)((*((uint16_t const *)(dataRead+offset)))*t+targetBrightness*256.0f*d+0.5f);
+                        break;
+                    case ImageFormat::FLITR_PIX_FMT_Y_F32 :
+                        *((float *)(dataWrite+offset))=(*((float const *)(dataRead+offset)))*t+targetBrightness*0.00390625f*d; // /256.0
+                        break;
+                    case ImageFormat::FLITR_PIX_FMT_RGB_F32 :
+                        for (size_t c=0; c<3; ++c)
+                        {
+                            ((float *)(dataWrite+offset))[c]=((float const *)(dataRead+offset))[c]*t+targetBrightness*0.00390625f*d; // /256.0
+                        }
+                        break;
+                    
+                    case ImageFormat::FLITR_PIX_FMT_UNDF:
+                        //Should not happen.
+                        break;
+                    case ImageFormat::FLITR_PIX_FMT_ANY :
+                        //Should not happen.
+                        break;
+                }
+            }
+        }
+    }
+}
+
+bool TargetInjector::SyntheticTarget::getBoundingBox(const uint32_t width, const uint32_t height,
+                                                     int32_t &x0, int32_t &y0, int32_t &x1, int32_t &y1) const
+{
+    if (!((sa_>0.0f)&&(sb_>0.0f)))
+    {
+        return false;
+    }
+    
+    //Pixels whose centres satisfy |x+0.5-px|<4*sa, clamped in float before converting to int.
+    const float extent=sa_*4.0f;
+    x0=(int32_t)std::min<float>(std::max<float>(floorf(px_-extent-0.5f)+1.0f, 0.0f), (float)width);
+    y0=(int32_t)std::min<float>(std::max<float>(floorf(py_-extent-0.5f)+1.0f, 0.0f), (float)height);
+    x1=(int32_t)std::min<float>(std::max<float>(ceilf(px_+extent-0.5f), 0.0f), (float)width);
+    y1=(int32_t)std::min<float>(std::max<float>(ceilf(py_+extent-0.5f), 0.0f), (float)height);
+    
+    return (x0<x1)&&(y0<y1);
+}
+
+void TargetInjector::SyntheticTarget::multiplyTransmission(float * const transmission, const size_t stride,
+                                                           const int32_t x0, const int32_t y0, const int32_t x1, const int32_t y1) const
+{
+    //In target coordinates the exponent of the support is a*a/(sa*sa) + b*b/(sb*sb), with a=rx*dx+ry*dy and b=rx*dy-ry*dx.
+    // As a function of rx it is qa*rx*rx + 2*qb*ry*rx + qc*ry*ry.
+    const float invSa2=1.0f/(sa_*sa_);
+    const float invSb2=1.0f/(sb_*sb_);
+    const float qa=dx_*dx_*invSa2 + dy_*dy_*invSb2;
+    const float qb=dx_*dy_*(invSa2 - invSb2);
+    
+    if (!(qa>0.0f))
+    {//Degenerate direction.
+        return;
+    }
+    
+    //Along a row of samples f[k+1]=f[k]*r[k] and r[k+1]=r[k]*m.
+    const float m=expf(-qa*SubpixelSize*SubpixelSize);
+    
+    const int32_t chunkWidth=32;
+    float accumulator[chunkWidth];
+    
+    for (int32_t cx0=x0; cx0<x1; cx0+=chunkWidth)
+    {
+        const int32_t cx1=std::min<int32_t>(cx0+chunkWidth, x1);
+        const int32_t numSamples=(cx1-cx0)*SubpixelSamples;
+        
+        //rx of sample k of a row is rxStart + k*SubpixelSize.
+        const float rxStart=(cx0+0.5f-px_) - (0.5f-SubpixelSize*0.5f);
+        
+        for (int32_t y=y0; y<y1; ++y)
+        {
+            std::fill(accumulator, accumulator+(cx1-cx0), 0.0f);
+            
+            for (int32_t j=0; j<SubpixelSamples; ++j)
+            {
+                const float ry=(y+0.5f-py_) - (0.5f-SubpixelSize*0.5f) + j*SubpixelSize;
+                
+                //Walk the row outwards from its largest sample so that no sample underflows before it is negligible.
+                const float kPeakF=(-qb*ry/qa - rxStart)/SubpixelSize + 0.5f;
+                const int32_t kPeak=(int32_t)std::min<float>(std::max<float>(floorf(kPeakF), 0.0f), (float)(numSamples-1));
+                
+                const float rx=rxStart + kPeak*SubpixelSize;
+                const float a=rx*dx_ + ry*dy_;
+                const float b=rx*dy_ - ry*dx_;
+                const float fPeak=expf(-0.5f*(a*a*invSa2 + b*b*invSb2));
+                
+                if (fPeak<NegligibleSample)
+                {
+                    continue;
+                }
+                
+                accumulator[kPeak/SubpixelSamples]+=fPeak;
+                
+                const float slope=qa*rx + qb*ry;
+                
+                float f=fPeak;
+                float r=expf(-0.5f*SubpixelSize*(2.0f*slope + qa*SubpixelSize));
+                for (int32_t k=kPeak+1; (k<numSamples)&&(f>=NegligibleSample); ++k)
+                {
+                    f*=r;
+                    r*=m;
+                    accumulator[k/SubpixelSamples]+=f;
+                }
+                
+                f=fPeak;
+                r=expf(-0.5f*SubpixelSize*(qa*SubpixelSize - 2.0f*slope));
+                for (int32_t k=kPeak-1; (k>=0)&&(f>=NegligibleSample); --k)
+                {
+                    f*=r;
+                    r*=m;
+                    accumulator[k/SubpixelSamples]+=f;
+                }
+            }
+            
+            float * const transmissionLine=transmission + y*stride;
+            for (int32_t x=cx0; x<cx1; ++x)
+            {
+                transmissionLine[x]*=1.0f - accumulator[x-cx0]*(1.0f/(SubpixelSamples*SubpixelSamples));
+            }
+        }
+    }
+}
+
 TargetInjector::TargetInjector(ImageProducer& upStreamProducer,
                                uint32_t images_per_slot, uint32_t buffer_size) :
 ImageProcessor(upStreamProducer, images_per_slot, buffer_size),
 targetBrightness_(255.0f),
 startTimeSec_(0.0)
 {
+    ProcessorStats_->setID("ImageProcessor::TargetInjector");
+    
     //Setup image format being produced to downstream.
     for (uint32_t i=0; i<images_per_slot; i++)
     {
@@ -59,6 +227,7 @@ bool TargetInjector::trigger()
         std::vector<Image**> imvWrite=reserveWriteSlot();
         
         //Start stats measurement event.
+        ProcessorStats_->tick();
         
 		// Update timer
 		float dT = double(currentTimeNanoSec()) / 1000000000.0 - startTimeSec_;
@@ -70,6 +239,8 @@ bool TargetInjector::trigger()
             iter->update(dT);
         }
         
+        const float targetBrightness=targetBrightness_;
+        
         unsigned int i=0;
         for (i=0; i<ImagesPerSlot_; i++)
         {
@@ -90,101 +261,80 @@ bool TargetInjector::trigger()
             // The read and write images have the same format.
             memcpy(dataWrite, dataRead, imFormat.getBytesPerImage());
             
-            //Do image processing here...
-            int32_t y=0;
+            //Bin the targets into the tiles that their bounding boxes overlap.
+            const size_t numTilesX=(width+TileSize-1)/TileSize;
+            const size_t numTilesY=(height+TileSize-1)/TileSize;
             
+            for (size_t tileIndex : activeTiles_)
             {
-#pragma omp parallel for
-                for (y=0; y<(int32_t)height; y++)
+                if (tileIndex<tileTargets_.size())
                 {
-                    uint32_t offset=0;
-                    
-                    switch (pixelFormat)
-                    {
-                        case ImageFormat::FLITR_PIX_FMT_Y_8 :
-                            offset=y*width*1;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_RGB_8 :
-                            offset=y*width*3;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_Y_16 :
-                            offset=y*width*2;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_BGR :
-                            offset=y*width*3;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_BGRA :
-                            offset=y*width*4;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_Y_F32 :
-                            offset=y*width*4;
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_RGB_F32 :
-                            //Not handled yet.
-                            break;
-                            
-                        case ImageFormat::FLITR_PIX_FMT_UNDF:
-                            //Should not happen.
-                            break;
-                        case ImageFormat::FLITR_PIX_FMT_ANY :
-                            //Should not happen.
-                            break;
-                    }
-                    
-                    for (uint32_t x=0; x<width; x++)
+                    tileTargets_[tileIndex].clear();
+                }
+            }
+            activeTiles_.clear();
+            tileTargets_.resize(numTilesX*numTilesY);
+            
+            for (size_t targetIndex=0; targetIndex<targetVector_.size(); ++targetIndex)
+            {
+                int32_t x0, y0, x1, y1;
+                if (targetVector_[targetIndex].getBoundingBox(width, height, x0, y0, x1, y1))
+                {
+                    for (size_t tileY=y0/TileSize; tileY<=size_t((y1-1)/TileSize); ++tileY)
                     {
-                        float targetSupportDensity=0.0;
-                        
-                        std::vector<SyntheticTarget>::iterator iter=targetVector_.begin();
-                        for (; iter!=targetVector_.end(); iter++)
-                        {
-                            targetSupportDensity=1.0f - (1.0f-targetSupportDensity)*(1.0f-iter->getSupportDensity(x+0.5f, y+0.5f));
-                        }
-                        
-                        switch (pixelFormat)
+                        for (size_t tileX=x0/TileSize; tileX<=size_t((x1-1)/TileSize); ++tileX)
                         {
-                            case ImageFormat::FLITR_PIX_FMT_Y_8 :
-                                dataWrite[offset]=(uint8_t)(dataRead[offset]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_RGB_8 :
-                                dataWrite[offset]=(uint8_t)(dataRead[offset]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+1]=(uint8_t)(dataRead[offset+1]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+2]=(uint8_t)(dataRead[offset+2]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_Y_16 :
-                                dataWrite[offset]=0;
-                                dataWrite[offset+1]=(uint8_t)(dataRead[offset+1]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_BGR :
-                                dataWrite[offset]=(uint8_t)(dataRead[offset]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+1]=(uint8_t)(dataRead[offset+1]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+2]=(uint8_t)(dataRead[offset+2]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_BGRA :
-                                dataWrite[offset]=(uint8_t)(dataRead[offset]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+1]=(uint8_t)(dataRead[offset+1]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                dataWrite[offset+2]=(uint8_t)(dataRead[offset+2]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f);
-                                break;                                
-                            case ImageFormat::FLITR_PIX_FMT_Y_F32 :
-                                *((float *)(dataWrite+offset))=(dataRead[offset]*(1.0f-targetSupportDensity)+targetBrightness_*targetSupportDensity+0.5f)/256.0f;
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_RGB_F32 :
-                                //Not handled yet.
-                                break;
-                                
-                            case ImageFormat::FLITR_PIX_FMT_UNDF:
-                                //Should not happen.
-                                break;
-                            case ImageFormat::FLITR_PIX_FMT_ANY :
-                                //Should not happen.
-                                break;
+                            std::vector<size_t> &targets=tileTargets_[tileY*numTilesX + tileX];
+                            
+                            if (targets.empty())
+                            {
+                                activeTiles_.push_back(tileY*numTilesX + tileX);
+                            }
+                            targets.push_back(targetIndex);
                         }
-                        
-                        offset+=bytesPerPixel;
                     }
                 }
             }
             
+            if (transmission_.size()<size_t(width)*height)
+            {
+                transmission_.resize(size_t(width)*height);
+            }
+            float * const transmission=transmission_.data();
+            
+            //Each tile is owned by one thread, so targets that share a tile do not conflict.
+            int32_t activeTileNum=0;
+#pragma omp parallel for schedule(dynamic)
+            for (activeTileNum=0; activeTileNum<(int32_t)activeTiles_.size(); ++activeTileNum)
+            {
+                const size_t tileIndex=activeTiles_[activeTileNum];
+                const int32_t tileX0=int32_t(tileIndex%numTilesX)*TileSize;
+                const int32_t tileY0=int32_t(tileIndex/numTilesX)*TileSize;
+                const int32_t tileX1=std::min<int32_t>(tileX0+TileSize, width);
+                const int32_t tileY1=std::min<int32_t>(tileY0+TileSize, height);
+                
+                for (int32_t y=tileY0; y<tileY1; ++y)
+                {
+                    std::fill(transmission + y*width + tileX0, transmission + y*width + tileX1, 1.0f);
+                }
+                
+                for (size_t targetIndex : tileTargets_[tileIndex])
+                {
+                    const SyntheticTarget &target=targetVector_[targetIndex];
+                    
+                    int32_t x0, y0, x1, y1;
+                    target.getBoundingBox(width, height, x0, y0, x1, y1);
+                    
+                    target.multiplyTransmission(transmission, width,
+                                                std::max<int32_t>(x0, tileX0), std::max<int32_t>(y0, tileY0),
+                                                std::min<int32_t>(x1, tileX1), std::min<int32_t>(y1, tileY1));
+                }
+                
+                blendTile(pixelFormat, targetBrightness,
+                          dataRead, dataWrite, transmission,
+                          width, bytesPerPixel,
+                          tileX0, tileY0, tileX1, tileY1);
+            }
         }
         
         //Stop stats measurement event.
@@ -198,4 +348,3 @@ bool TargetInjector::trigger()
     
     return false;
 }
-
@@ -229,6 +229,20 @@ uint32_t SharedImageBuffer::getLeastNumReadSlotsAvailable()
     return least_num;
 }
 
+bool SharedImageBuffer::allConsumersAcceptStridedImages()
+{
+    std::lock_guard<std::mutex> scopedLock(BufferMutex_);
+    typedef std::map< const ImageConsumer*, uint32_t >::iterator map_it;
+    for (map_it i = ReadTails_.begin(); i != ReadTails_.end(); ++i)
+    {
+        if (!i->first->acceptsStridedImages())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 uint32_t SharedImageBuffer::getNumReadSlotsAvailable(const ImageConsumer& consumer)
 {
     std::lock_guard<std::mutex> scopedLock(BufferMutex_);
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <flitr/image_processor_utils.h>
+
+using namespace flitr;
+
+void checkCondition(bool condition, std::string message)
+{
+    if (!condition) {
+        std::cerr << message;
+        exit(-1);
+    }
+}
+
+#define WIDTH 64
+#define HEIGHT 48
+#define BORDER 20
+#define WINDOW_SIZE 9
+
+// An image with a black border on the left, like a stabilised image, and texture elsewhere.
+template<typename T>
+std::vector<T> makeBorderImage(const size_t componentsPerPixel, const float fullScale)
+{
+    std::vector<T> image(WIDTH * HEIGHT * componentsPerPixel, T(0));
+    
+    for (size_t y=0; y<HEIGHT; y++) {
+        for (size_t x=BORDER; x<WIDTH; x++) {
+            for (size_t k=0; k<componentsPerPixel; k++) {
+                image[(y*WIDTH + x)*componentsPerPixel + k]=T(fullScale * (0.2f + 0.1f * float((x*7 + y*3 + k) % 5)));
+            }
+        }
+    }
+    
+    return image;
+}
+
+template<typename T>
+void testZeroWindows(PhotometricEqualisation &equalisation, const size_t componentsPerPixel,
+                     const bool scaleByFirstComponent, const float fullScale, const std::string name)
+{
+    const std::vector<T> dataRead=makeBorderImage<T>(componentsPerPixel, fullScale);
+    std::vector<T> dataWrite(dataRead.size(), T(1));
+    
+    equalisation.equaliseLocal(dataWrite.data(), dataRead.data(), WIDTH, HEIGHT, componentsPerPixel,
+                               WINDOW_SIZE, 0.5f, scaleByFirstComponent);
+    
+    for (size_t y=0; y<HEIGHT; y++) {
+        for (size_t x=0; x<WIDTH; x++) {
+            for (size_t k=0; k<componentsPerPixel; k++) {
+                const float value=float(dataWrite[(y*WIDTH + x)*componentsPerPixel + k]);
+                
+                checkCondition(std::isfinite(value), name + ": Expected finite output\n");
+                
+                if ((x+WINDOW_SIZE/2)<BORDER) {
+                    // The whole window is inside the black border.
+                    checkCondition(value==0.0f, name + ": Expected zero output in an all-zero window\n");
+                } else if (x>=BORDER) {
+                    checkCondition(value>0.0f, name + ": Expected non-zero output outside the border\n");
+                }
+            }
+        }
+    }
+    
+    // A completely black image stays black.
+    const std::vector<T> blackRead(dataRead.size(), T(0));
+    equalisation.equaliseLocal(dataWrite.data(), blackRead.data(), WIDTH, HEIGHT, componentsPerPixel,
+                               WINDOW_SIZE, 0.5f, scaleByFirstComponent);
+    
+    for (size_t i=0; i<dataWrite.size(); i++) {
+        checkCondition(float(dataWrite[i])==0.0f, name + ": Expected a black image to stay black\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    PhotometricEqualisation equalisation;
+    
+    testZeroWindows<uint8_t>(equalisation, 1, false, 255.0f, "uint8 Y");
+    testZeroWindows<uint8_t>(equalisation, 3, true, 255.0f, "uint8 RGB");
+    testZeroWindows<uint16_t>(equalisation, 1, false, 65535.0f, "uint16 Y");
+    testZeroWindows<float>(equalisation, 1, false, 1.0f, "float Y");
+    testZeroWindows<float>(equalisation, 3, false, 1.0f, "float RGB");
+    
+    std::cout << "All tests passed\n";
+    
+    return 0;
+}